@@ -2,6 +2,9 @@
 #include "net_handler.h"
 #include "../common/utils.h"
 #include "../common/protocol.h"
+#include "../common/delta.h"
+#include "../common/crc32c.h"
+#include "../common/tar.h"
 #include "../../lib/cJSON/cJSON.h"
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +12,10 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <zlib.h>
+
+#define TREE_INFLATE_CHUNK (256 * 1024)
+#define TREE_UPLOAD_CHUNK (1024 * 1024)
 
 ClientConnection* client_connect(const char* ip, int port) {
     ClientConnection* conn = malloc(sizeof(ClientConnection));
@@ -132,8 +139,12 @@ int client_list_dir(ClientConnection* conn, int dir_id) {
             int size = cJSON_GetObjectItem(file, "size")->valueint;
             int perms = cJSON_GetObjectItem(file, "permissions")->valueint;
 
+            // Directories show the size of everything below them
+            cJSON* total = cJSON_GetObjectItem(file, "total_size");
+            if (is_dir) size = total ? total->valueint : 0;
+
             printf("%-6d %-4s %-30s %-10d %03o\n",
-                   id, is_dir ? "DIR" : "FILE", name, is_dir ? 0 : size, perms);
+                   id, is_dir ? "DIR" : "FILE", name, size, perms);
         }
         printf("\n");
         result = 0;
@@ -332,12 +343,154 @@ int client_upload(ClientConnection* conn, const char* local_path) {
     return 0;
 }
 
+// Helper: read a whole local file into a malloc'd buffer
+static uint8_t* read_local_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size <= 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    uint8_t* data = malloc((size_t)st.st_size);
+    if (data && fread(data, 1, (size_t)st.st_size, fp) != (size_t)st.st_size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+
+    *size = (size_t)st.st_size;
+    return data;
+}
+
+// Helper: receive a JSON response, printing the server's message on error
+static cJSON* recv_json_response(ClientConnection* conn, const char* what) {
+    Packet* response = net_recv_packet(conn->socket_fd);
+    if (!response) {
+        printf("Error: No response from server\n");
+        return NULL;
+    }
+    if (response->command != CMD_SUCCESS) {
+        printf("Error: %s rejected: %.*s\n", what, (int)response->data_length,
+               response->payload ? response->payload : "");
+        packet_free(response);
+        return NULL;
+    }
+
+    cJSON* json = cJSON_Parse(response->payload);
+    packet_free(response);
+    return json;
+}
+
+int client_upload_delta(ClientConnection* conn, int file_id, const char* local_path) {
+    if (!conn || !conn->authenticated || !local_path) return -1;
+
+    size_t size = 0;
+    uint8_t* data = read_local_file(local_path, &size);
+    if (!data) {
+        printf("Error: Cannot read file: %s\n", local_path);
+        return -1;
+    }
+
+    // STEP 1: Fetch block signatures of the server's copy
+    char request[64];
+    snprintf(request, sizeof(request), "{\"file_id\":%d}", file_id);
+    Packet* pkt = packet_create(CMD_DELTA_SIG_REQ, request, strlen(request));
+    int result = packet_send(conn->socket_fd, pkt);
+    packet_free(pkt);
+    if (result < 0) {
+        free(data);
+        return -1;
+    }
+
+    cJSON* params = recv_json_response(conn, "Signature request");
+    if (!params) {
+        free(data);
+        return -1;
+    }
+    size_t block_size = (size_t)cJSON_GetNumberValue(cJSON_GetObjectItem(params, "block_size"));
+    size_t old_size = (size_t)cJSON_GetNumberValue(cJSON_GetObjectItem(params, "size"));
+    size_t chunk = (size_t)cJSON_GetNumberValue(cJSON_GetObjectItem(params, "checksum_chunk"));
+    cJSON_Delete(params);
+
+    Packet* sig_pkt = net_recv_packet(conn->socket_fd);
+    DeltaSig* sigs = NULL;
+    int sig_count = 0;
+    if (!sig_pkt || block_size == 0 || chunk == 0 ||
+        delta_sigs_decode((const uint8_t*)sig_pkt->payload, sig_pkt->data_length, &sigs, &sig_count) < 0) {
+        printf("Error: Invalid signature data\n");
+        if (sig_pkt) packet_free(sig_pkt);
+        free(data);
+        return -1;
+    }
+    packet_free(sig_pkt);
+
+    // STEP 2: Diff the local file against them
+    uint8_t* delta = NULL;
+    size_t delta_len = 0;
+    uint32_t* crcs = NULL;
+    int crc_count = 0;
+    result = delta_encode(data, size, block_size, sigs, sig_count, old_size, &delta, &delta_len);
+    free(sigs);
+    if (result == 0) {
+        result = crc32c_chunks(data, size, chunk, &crcs, &crc_count);
+    }
+    free(data);
+
+    if (result < 0 || delta_len > MAX_PAYLOAD_SIZE) {
+        printf("Error: %s\n", result < 0 ? "Failed to compute delta" : "Delta too large, use upload");
+        free(delta);
+        free(crcs);
+        return -1;
+    }
+
+    // STEP 3: Announce the new content, then send the delta
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "file_id", file_id);
+    cJSON_AddNumberToObject(json, "size", (double)size);
+    cJSON_AddNumberToObject(json, "block_size", (double)block_size);
+    cJSON* crc_array = cJSON_AddArrayToObject(json, "crcs");
+    for (int i = 0; i < crc_count; i++) {
+        cJSON_AddItemToArray(crc_array, cJSON_CreateNumber(crcs[i]));
+    }
+    free(crcs);
+
+    char* payload = cJSON_PrintUnformatted(json);
+    pkt = packet_create(CMD_DELTA_REQ, payload, strlen(payload));
+    result = packet_send(conn->socket_fd, pkt);
+    free(payload);
+    packet_free(pkt);
+    cJSON_Delete(json);
+
+    cJSON* ready = (result < 0) ? NULL : recv_json_response(conn, "Delta upload");
+    if (!ready) {
+        free(delta);
+        return -1;
+    }
+    cJSON_Delete(ready);
+
+    printf("Sending delta for '%s' (%zu of %zu bytes)...\n", local_path, delta_len, size);
+    result = packet_send_data(conn->socket_fd, CMD_DELTA_DATA, delta, (uint32_t)delta_len);
+    free(delta);
+    if (result < 0) return -1;
+
+    cJSON* done = recv_json_response(conn, "Delta upload");
+    if (!done) return -1;
+    cJSON_Delete(done);
+
+    printf("Update successful!\n");
+    return 0;
+}
+
 int client_download(ClientConnection* conn, int file_id, const char* local_path) {
     if (!conn || !conn->authenticated || !local_path) return -1;
 
     cJSON* json = cJSON_CreateObject();
     cJSON_AddNumberToObject(json, "user_id", conn->user_id);
     cJSON_AddNumberToObject(json, "file_id", file_id);
+    cJSON_AddStringToObject(json, "accept_encoding", "deflate");
 
     char* payload = cJSON_PrintUnformatted(json);
     Packet* pkt = packet_create(CMD_DOWNLOAD_REQ, payload, strlen(payload));
@@ -382,14 +535,24 @@ int client_download(ClientConnection* conn, int file_id, const char* local_path)
     }
 
     size_t file_size = size_obj->valueint;
-    const char* name = name_obj ? cJSON_GetStringValue(name_obj) : "file";
+    char name[256];
+    snprintf(name, sizeof(name), "%s", name_obj ? cJSON_GetStringValue(name_obj) : "file");
+
+    // Compressed blobs come over the wire as stored and are inflated here
+    cJSON* encoding_obj = cJSON_GetObjectItem(resp_json, "encoding");
+    cJSON* stored_obj = cJSON_GetObjectItem(resp_json, "stored_size");
+    int deflated = cJSON_IsString(encoding_obj) && cJSON_IsNumber(stored_obj) &&
+                   strcmp(encoding_obj->valuestring, "deflate") == 0;
+    size_t stored_size = deflated ? (size_t)stored_obj->valuedouble : 0;
 
     cJSON_Delete(resp_json);
     packet_free(response);
 
     printf("Downloading '%s' (%zu bytes)...\n", name, file_size);
 
-    if (net_recv_file(conn->socket_fd, local_path, file_size) < 0) {
+    int rc = deflated ? net_recv_file_inflate(conn->socket_fd, local_path, stored_size, file_size)
+                      : net_recv_file(conn->socket_fd, local_path, file_size);
+    if (rc < 0) {
         printf("Error: Download failed\n");
         return -1;
     }
@@ -766,87 +929,316 @@ int client_move(ClientConnection* conn, int file_id, int new_parent_id) {
     return result;
 }
 
-int client_upload_folder(ClientConnection* conn, const char* local_path) {
-    if (!conn || !conn->authenticated || !local_path) return -1;
+int client_quota(ClientConnection* conn) {
+    if (!conn || !conn->authenticated) return -1;
 
-    DIR* dir = opendir(local_path);
-    if (!dir) {
-        printf("Error: Cannot open directory: %s\n", local_path);
+    Packet* pkt = packet_create(CMD_GET_QUOTA, "{}", 2);
+    int result = packet_send(conn->socket_fd, pkt);
+    packet_free(pkt);
+    if (result < 0) return -1;
+
+    cJSON* json = recv_json_response(conn, "Quota request");
+    if (!json) return -1;
+
+    double bytes_used = cJSON_GetNumberValue(cJSON_GetObjectItem(json, "bytes_used"));
+    double files_used = cJSON_GetNumberValue(cJSON_GetObjectItem(json, "files_used"));
+    double max_bytes = cJSON_GetNumberValue(cJSON_GetObjectItem(json, "max_bytes"));
+    double max_files = cJSON_GetNumberValue(cJSON_GetObjectItem(json, "max_files"));
+
+    printf("Storage used: %.0f bytes", bytes_used);
+    if (max_bytes > 0) printf(" of %.0f", max_bytes);
+    printf("\nFiles:        %.0f", files_used);
+    if (max_files > 0) printf(" of %.0f", max_files);
+    printf("\n");
+
+    cJSON_Delete(json);
+    return 0;
+}
+
+// Tar stream state for a folder upload
+typedef struct {
+    int socket_fd;
+    uint8_t* buf;
+    size_t len;
+    int files;
+    int dirs;
+    int errors;
+    int failed;             // Sending failed; the connection is unusable
+} TreeUpload;
+
+static int tree_flush(TreeUpload* u) {
+    if (u->failed) return -1;
+    if (u->len == 0) return 0;
+    if (packet_send_data(u->socket_fd, CMD_UPLOAD_DATA, u->buf, (uint32_t)u->len) < 0) {
+        printf("Error: Connection lost during upload\n");
+        u->failed = 1;
         return -1;
     }
+    u->len = 0;
+    return 0;
+}
 
-    // Extract folder name from path
-    const char* folder_name = strrchr(local_path, '/');
-    folder_name = folder_name ? folder_name + 1 : local_path;
+static int tree_emit(TreeUpload* u, const void* data, size_t len) {
+    const uint8_t* p = data;
+    while (len > 0) {
+        size_t take = TREE_UPLOAD_CHUNK - u->len;
+        if (take > len) take = len;
+        memcpy(u->buf + u->len, p, take);
+        u->len += take;
+        p += take;
+        len -= take;
+        if (u->len == TREE_UPLOAD_CHUNK && tree_flush(u) < 0) return -1;
+    }
+    return 0;
+}
 
-    // Create remote directory
-    printf("Creating remote directory: %s\n", folder_name);
-    if (client_mkdir(conn, folder_name) < 0) {
-        closedir(dir);
+// Helper: append one regular file, read straight into the send buffer
+static int tree_add_file(TreeUpload* u, const char* local, const char* rel, const struct stat* st) {
+    if (st->st_size > MAX_PAYLOAD_SIZE) {
+        printf("Warning: Skipping %s (larger than %d bytes)\n", rel, MAX_PAYLOAD_SIZE);
+        u->errors++;
+        return 0;
+    }
+    FILE* f = fopen(local, "rb");
+    if (!f) {
+        printf("Warning: Cannot read %s, skipping\n", local);
+        u->errors++;
+        return 0;
+    }
+
+    uint8_t header[TAR_HEADER_MAX];
+    size_t hlen = tar_header(header, rel, TAR_TYPE_FILE, (uint64_t)st->st_size,
+                             (int)(st->st_mode & 0777), (long)st->st_mtime);
+    if (hlen == 0) {
+        printf("Warning: Path too long, skipping %s\n", rel);
+        fclose(f);
+        u->errors++;
+        return 0;
+    }
+    if (tree_emit(u, header, hlen) < 0) {
+        fclose(f);
         return -1;
     }
 
-    // Get the ID of the newly created directory
-    // We need to list the current directory to find its ID
-    int saved_dir = conn->current_directory;
+    // The header promised st_size bytes: pad with zeros if the file shrank
+    uint64_t remaining = (uint64_t)st->st_size;
+    int short_read = 0;
+    while (remaining > 0) {
+        size_t want = TREE_UPLOAD_CHUNK - u->len;
+        if (want > remaining) want = (size_t)remaining;
+        size_t got = fread(u->buf + u->len, 1, want, f);
+        if (got < want) {
+            memset(u->buf + u->len + got, 0, want - got);
+            if (!short_read) {
+                printf("Warning: %s changed while reading\n", local);
+                u->errors++;
+                short_read = 1;
+            }
+        }
+        u->len += want;
+        remaining -= want;
+        if (u->len == TREE_UPLOAD_CHUNK && tree_flush(u) < 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
 
-    // TODO: This is a workaround - ideally mkdir should return the new dir ID
-    // For now, we'll assume the last created directory is the one we want
+    static const uint8_t zeros[TAR_BLOCK];
+    if (tree_emit(u, zeros, tar_padding((uint64_t)st->st_size)) < 0) return -1;
+    u->files++;
+    return 0;
+}
 
-    int files_uploaded = 0;
-    int dirs_created = 1;
-    int errors = 0;
+// Helper: append a directory and everything below it
+static int tree_add_dir(TreeUpload* u, const char* local, const char* rel, const struct stat* st) {
+    uint8_t header[TAR_HEADER_MAX];
+    size_t hlen = tar_header(header, rel, TAR_TYPE_DIR, 0, (int)(st->st_mode & 0777), (long)st->st_mtime);
+    if (hlen == 0) {
+        printf("Warning: Path too long, skipping %s\n", rel);
+        u->errors++;
+        return 0;
+    }
+
+    DIR* dir = opendir(local);
+    if (!dir) {
+        printf("Warning: Cannot open directory %s, skipping\n", local);
+        u->errors++;
+        return 0;
+    }
+    if (tree_emit(u, header, hlen) < 0) {
+        closedir(dir);
+        return -1;
+    }
+    u->dirs++;
 
     struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
+    int rc = 0;
+    while (rc == 0 && (entry = readdir(dir)) != NULL) {
         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
             continue;
         }
 
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", local_path, entry->d_name);
+        char child_local[2048];
+        char child_rel[TAR_PATH_MAX + 256];
+        snprintf(child_local, sizeof(child_local), "%s/%s", local, entry->d_name);
+        snprintf(child_rel, sizeof(child_rel), "%s/%s", rel, entry->d_name);
 
-        struct stat st;
-        if (stat(full_path, &st) != 0) {
+        struct stat child;
+        if (stat(child_local, &child) != 0) {
             printf("Warning: Cannot stat %s, skipping\n", entry->d_name);
-            errors++;
+            u->errors++;
             continue;
         }
 
-        if (S_ISDIR(st.st_mode)) {
-            // Recursive upload of subdirectory
-            printf("Uploading folder: %s\n", entry->d_name);
-            if (client_upload_folder(conn, full_path) < 0) {
-                printf("Warning: Failed to upload folder %s\n", entry->d_name);
-                errors++;
-            } else {
-                dirs_created++;
-            }
-        } else if (S_ISREG(st.st_mode)) {
-            // Upload file
-            printf("Uploading file: %s (%lld bytes)\n", entry->d_name, (long long)st.st_size);
-            if (client_upload(conn, full_path) < 0) {
-                printf("Warning: Failed to upload file %s\n", entry->d_name);
-                errors++;
-            } else {
-                files_uploaded++;
-            }
+        if (S_ISDIR(child.st_mode)) {
+            rc = tree_add_dir(u, child_local, child_rel, &child);
+        } else if (S_ISREG(child.st_mode)) {
+            rc = tree_add_file(u, child_local, child_rel, &child);
         }
     }
 
     closedir(dir);
+    return rc;
+}
+
+int client_upload_folder(ClientConnection* conn, const char* local_path) {
+    if (!conn || !conn->authenticated || !local_path) return -1;
+
+    char root[1024];
+    snprintf(root, sizeof(root), "%s", local_path);
+    size_t root_len = strlen(root);
+    while (root_len > 1 && root[root_len - 1] == '/') {
+        root[--root_len] = '\0';
+    }
+
+    struct stat st;
+    if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        printf("Error: Cannot open directory: %s\n", local_path);
+        return -1;
+    }
+
+    // Extract folder name from path
+    const char* folder_name = strrchr(root, '/');
+    folder_name = folder_name ? folder_name + 1 : root;
+
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "parent_id", conn->current_directory);
+    char* payload = cJSON_PrintUnformatted(json);
+    Packet* pkt = packet_create(CMD_UPLOAD_TREE, payload, strlen(payload));
+    int result = packet_send(conn->socket_fd, pkt);
+    free(payload);
+    packet_free(pkt);
+    cJSON_Delete(json);
+    if (result < 0) return -1;
+
+    cJSON* ready = recv_json_response(conn, "Folder upload");
+    if (!ready) return -1;
+    cJSON_Delete(ready);
+
+    printf("Uploading folder: %s\n", folder_name);
+
+    // The whole tree goes out as one tar stream
+    TreeUpload u;
+    memset(&u, 0, sizeof(u));
+    u.socket_fd = conn->socket_fd;
+    u.buf = malloc(TREE_UPLOAD_CHUNK);
+    if (!u.buf) return -1;
+
+    static const uint8_t end_marker[2 * TAR_BLOCK];
+    if (tree_add_dir(&u, root, folder_name, &st) == 0) {
+        tree_emit(&u, end_marker, sizeof(end_marker));
+        tree_flush(&u);
+    }
+    free(u.buf);
+
+    // An empty packet ends the stream
+    if (u.failed || packet_send_data(conn->socket_fd, CMD_UPLOAD_DATA, NULL, 0) < 0) {
+        return -1;
+    }
+
+    cJSON* resp = recv_json_response(conn, "Folder upload");
+    if (!resp) return -1;
+
+    cJSON* ids = cJSON_GetObjectItem(resp, "ids");
+    cJSON* root_id = ids ? cJSON_GetObjectItem(ids, folder_name) : NULL;
+    cJSON* skipped = cJSON_GetObjectItem(resp, "skipped");
 
     printf("\nFolder upload complete!\n");
-    printf("Directories created: %d\n", dirs_created);
-    printf("Files uploaded: %d\n", files_uploaded);
-    if (errors > 0) {
-        printf("Errors: %d\n", errors);
+    if (cJSON_IsNumber(root_id)) {
+        printf("Remote folder ID: %d\n", root_id->valueint);
+    }
+    printf("Directories created: %d\n", cJSON_GetObjectItem(resp, "directories")->valueint);
+    printf("Files uploaded: %d\n", cJSON_GetObjectItem(resp, "files")->valueint);
+    if (cJSON_IsNumber(skipped) && skipped->valueint > 0) {
+        printf("Skipped by server: %d\n", skipped->valueint);
+    }
+    if (u.errors > 0) {
+        printf("Errors: %d\n", u.errors);
+    }
+    cJSON_Delete(resp);
+
+    return u.errors > 0 ? -1 : 0;
+}
+
+// Extraction state for a folder download
+typedef struct {
+    const char* root;
+    FILE* out;
+    int files;
+    int dirs;
+    int errors;
+} TreeExtract;
+
+static int extract_entry(void* ctx, const TarEntry* entry) {
+    TreeExtract* x = ctx;
+
+    if (x->out) {
+        fclose(x->out);
+        x->out = NULL;
+    }
+
+    // Never write outside the target directory
+    if (!tar_path_safe(entry->path)) {
+        printf("Warning: Skipping unsafe path '%s'\n", entry->path);
+        x->errors++;
+        return 0;
+    }
+
+    char path[2048];
+    snprintf(path, sizeof(path), "%s/%s", x->root, entry->path);
+
+    if (entry->type == TAR_TYPE_DIR) {
+        if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+            printf("Warning: Cannot create directory %s\n", path);
+            x->errors++;
+        } else {
+            x->dirs++;
+        }
+        return 0;
     }
 
-    return errors > 0 ? -1 : 0;
+    // Entries arrive parent-first, so the directory already exists
+    x->out = fopen(path, "wb");
+    if (!x->out) {
+        printf("Warning: Cannot create file %s\n", path);
+        x->errors++;
+        return 0;
+    }
+    x->files++;
+    return 0;
+}
+
+static int extract_data(void* ctx, const uint8_t* data, size_t len) {
+    TreeExtract* x = ctx;
+    if (x->out && fwrite(data, 1, len, x->out) != len) {
+        printf("Error: Write failed\n");
+        return -1;
+    }
+    return 0;
 }
 
-int client_download_folder(ClientConnection* conn, int folder_id, const char* local_path) {
+int client_download_folder(ClientConnection* conn, int folder_id, const char* local_path, int compress) {
     if (!conn || !conn->authenticated || !local_path) return -1;
 
     // Create local directory
@@ -855,74 +1247,126 @@ int client_download_folder(ClientConnection* conn, int folder_id, const char* lo
         return -1;
     }
 
-    printf("Downloading to: %s\n", local_path);
+    // The whole tree comes back as one tar stream
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "directory_id", folder_id);
+    cJSON_AddBoolToObject(json, "compress", compress);
+    char* payload = cJSON_PrintUnformatted(json);
+    Packet* pkt = packet_create(CMD_DOWNLOAD_TREE, payload, strlen(payload));
+    int result = packet_send(conn->socket_fd, pkt);
+    free(payload);
+    packet_free(pkt);
+    cJSON_Delete(json);
+    if (result < 0) return -1;
 
-    // Save current directory and navigate to the folder
-    int saved_dir = conn->current_directory;
-    if (client_cd(conn, folder_id) < 0) {
-        printf("Error: Cannot enter directory %d\n", folder_id);
+    Packet* response = net_recv_packet(conn->socket_fd);
+    if (!response) {
+        printf("Error: No response from server\n");
         return -1;
     }
-
-    // Get file listing for this directory (use current_directory after cd)
-    cJSON* resp_json = (cJSON*)client_list_dir_gui(conn, conn->current_directory);
-    if (!resp_json) {
-        client_cd(conn, saved_dir);  // Restore directory
-        printf("Error: Cannot list directory\n");
+    if (response->command != CMD_DOWNLOAD_RES) {
+        printf("Error: Folder download rejected: %.*s\n", (int)response->data_length,
+               response->payload ? response->payload : "");
+        packet_free(response);
         return -1;
     }
+    cJSON* meta = cJSON_Parse(response->payload);
+    packet_free(response);
+    if (!meta) return -1;
+    cJSON* format = cJSON_GetObjectItem(meta, "format");
+    int gzip = cJSON_IsString(format) && strcmp(format->valuestring, "tar+gzip") == 0;
+    cJSON_Delete(meta);
 
-    int files_downloaded = 0;
-    int dirs_downloaded = 0;
-    int errors = 0;
+    printf("Downloading to: %s\n", local_path);
 
-    cJSON* files = cJSON_GetObjectItem(resp_json, "files");
-    if (files) {
-        cJSON* file;
-        cJSON_ArrayForEach(file, files) {
-            int id = cJSON_GetObjectItem(file, "id")->valueint;
-            int is_dir = cJSON_GetObjectItem(file, "is_directory")->valueint;
-            const char* name = cJSON_GetStringValue(cJSON_GetObjectItem(file, "name"));
+    TreeExtract x;
+    memset(&x, 0, sizeof(x));
+    x.root = local_path;
+    TarReader reader;
+    tar_reader_init(&reader, extract_entry, extract_data, &x);
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    uint8_t* inflated = NULL;
+    if (gzip) {
+        inflated = malloc(TREE_INFLATE_CHUNK);
+        if (!inflated || inflateInit2(&zs, 15 + 16) != Z_OK) {
+            free(inflated);
+            return -1;
+        }
+    }
 
-            char local_file_path[1024];
-            snprintf(local_file_path, sizeof(local_file_path), "%s/%s", local_path, name);
-
-            if (is_dir) {
-                // Recursively download subdirectory
-                printf("Downloading folder: %s\n", name);
-                if (client_download_folder(conn, id, local_file_path) < 0) {
-                    printf("Warning: Failed to download folder %s\n", name);
-                    errors++;
-                } else {
-                    dirs_downloaded++;
-                }
-            } else {
-                // Download file
-                int size = cJSON_GetObjectItem(file, "size")->valueint;
-                printf("Downloading file: %s (%d bytes)\n", name, size);
-                if (client_download(conn, id, local_file_path) < 0) {
-                    printf("Warning: Failed to download file %s\n", name);
-                    errors++;
-                } else {
-                    files_downloaded++;
+    // Data packets until the summary; keep draining after a local failure
+    // so the connection stays in sync
+    int failed = 0, done = 0;
+    cJSON* summary = NULL;
+    for (;;) {
+        Packet* data = net_recv_packet(conn->socket_fd);
+        if (!data) {
+            printf("Error: Connection lost during download\n");
+            failed = 1;
+            break;
+        }
+        if (data->command == CMD_DOWNLOAD_RES) {
+            summary = cJSON_Parse(data->payload);
+            packet_free(data);
+            break;
+        }
+        if (data->command != CMD_SUCCESS) {
+            printf("Error: Download aborted by server\n");
+            packet_free(data);
+            failed = 1;
+            break;
+        }
+
+        const uint8_t* in = (const uint8_t*)data->payload;
+        size_t in_len = data->data_length;
+        if (!failed && !done && gzip) {
+            zs.next_in = (Bytef*)in;
+            zs.avail_in = (uInt)in_len;
+            while (zs.avail_in > 0 && !failed && !done) {
+                zs.next_out = inflated;
+                zs.avail_out = TREE_INFLATE_CHUNK;
+                int zrc = inflate(&zs, Z_NO_FLUSH);
+                if (zrc != Z_OK && zrc != Z_STREAM_END && zrc != Z_BUF_ERROR) {
+                    failed = 1;
+                    break;
                 }
+                int rc = tar_reader_feed(&reader, inflated, TREE_INFLATE_CHUNK - zs.avail_out);
+                if (rc < 0) failed = 1;
+                if (rc == 1) done = 1;
+                if (zrc == Z_STREAM_END) break;
             }
+        } else if (!failed && !done) {
+            int rc = tar_reader_feed(&reader, in, in_len);
+            if (rc < 0) failed = 1;
+            if (rc == 1) done = 1;
         }
+        packet_free(data);
     }
 
-    cJSON_Delete(resp_json);
+    if (x.out) fclose(x.out);
+    if (gzip) inflateEnd(&zs);
+    free(inflated);
 
-    // Restore original directory
-    client_cd(conn, saved_dir);
+    if (!failed && !done) {
+        printf("Error: Archive ended unexpectedly\n");
+        failed = 1;
+    }
 
-    printf("\nFolder download complete!\n");
-    printf("Directories downloaded: %d\n", dirs_downloaded);
-    printf("Files downloaded: %d\n", files_downloaded);
-    if (errors > 0) {
-        printf("Errors: %d\n", errors);
+    printf("\nFolder download %s!\n", failed ? "failed" : "complete");
+    printf("Directories downloaded: %d\n", x.dirs);
+    printf("Files downloaded: %d\n", x.files);
+    cJSON* skipped = summary ? cJSON_GetObjectItem(summary, "skipped") : NULL;
+    if (cJSON_IsNumber(skipped) && skipped->valueint > 0) {
+        printf("Skipped on server: %d\n", skipped->valueint);
+    }
+    if (x.errors > 0) {
+        printf("Errors: %d\n", x.errors);
     }
+    cJSON_Delete(summary);
 
-    return errors > 0 ? -1 : 0;
+    return (failed || x.errors > 0) ? -1 : 0;
 }
 
 // Admin operations
@@ -29,12 +29,13 @@ void* client_list_dir_gui(ClientConnection* conn, int dir_id);  // Returns cJSON
 int client_mkdir(ClientConnection* conn, const char* name);
 int client_cd(ClientConnection* conn, int dir_id);
 int client_upload(ClientConnection* conn, const char* local_path);
+int client_upload_delta(ClientConnection* conn, int file_id, const char* local_path);
 int client_download(ClientConnection* conn, int file_id, const char* local_path);
 int client_chmod(ClientConnection* conn, int file_id, int permissions);
 
 // Recursive operations
 int client_upload_folder(ClientConnection* conn, const char* local_path);
-int client_download_folder(ClientConnection* conn, int folder_id, const char* local_path);
+int client_download_folder(ClientConnection* conn, int folder_id, const char* local_path, int compress);
 
 // Additional operations
 int client_delete(ClientConnection* conn, int file_id);
@@ -47,6 +48,7 @@ void* client_search(ClientConnection* conn, const char* pattern, int recursive,
 int client_rename(ClientConnection* conn, int file_id, const char* new_name);
 int client_copy(ClientConnection* conn, int source_id, int dest_parent_id, const char* new_name);
 int client_move(ClientConnection* conn, int file_id, int new_parent_id);
+int client_quota(ClientConnection* conn);
 
 // Admin operations
 void* client_admin_list_users(ClientConnection* conn);  // Returns cJSON* with user list
@@ -173,7 +173,7 @@ void on_download_clicked(GtkWidget *widget, AppState *state) {
             char full_path[1024];
             snprintf(full_path, sizeof(full_path), "%s/%s", save_path, name);
 
-            if (client_download_folder(state->conn, file_id, full_path) == 0) {
+            if (client_download_folder(state->conn, file_id, full_path, 0) == 0) {
                 show_info_dialog(state->window, "Folder downloaded successfully!");
             } else {
                 show_error_dialog(state->window, "Folder download failed");
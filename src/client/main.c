@@ -13,8 +13,9 @@ void print_help(void) {
     printf("  mkdir <name>          - Create new directory\n");
     printf("  upload <file>         - Upload local file\n");
     printf("  uploadfolder <folder> - Upload folder recursively\n");
+    printf("  sync <id> <file>      - Update file from local copy, sending only changes\n");
     printf("  download <id> <file>  - Download file to local path\n");
-    printf("  downloadfolder <id> <path> - Download folder recursively\n");
+    printf("  downloadfolder <id> <path> [-z] - Download folder as one stream (-z: gzip)\n");
     printf("  chmod <id> <perm>     - Change permissions (e.g., 755)\n");
     printf("  delete <id>           - Delete file or directory\n");
     printf("  info <id>             - Show detailed file information\n");
@@ -22,6 +23,7 @@ void print_help(void) {
     printf("  rename <id> <name>    - Rename file or directory\n");
     printf("  copy <src_id> <dest_parent_id> [name] - Copy file to directory\n");
     printf("  move <id> <dest_parent_id> - Move file to directory\n");
+    printf("  quota                 - Show storage usage and quota\n");
     printf("  pwd                   - Print current directory\n");
     printf("  help                  - Show this help\n");
     printf("  quit                  - Exit\n");
@@ -120,6 +122,14 @@ int main(int argc, char** argv) {
             } else {
                 printf("Usage: upload <local_file_path>\n");
             }
+        } else if (strcmp(cmd, "sync") == 0) {
+            char* id_str = strtok(NULL, " \t\n");
+            char* path = strtok(NULL, " \t\n");
+            if (id_str && path) {
+                client_upload_delta(conn, atoi(id_str), path);
+            } else {
+                printf("Usage: sync <file_id> <local_path>\n");
+            }
         } else if (strcmp(cmd, "uploadfolder") == 0) {
             char* path = strtok(NULL, " \t\n");
             if (path) {
@@ -138,10 +148,11 @@ int main(int argc, char** argv) {
         } else if (strcmp(cmd, "downloadfolder") == 0) {
             char* id_str = strtok(NULL, " \t\n");
             char* path = strtok(NULL, " \t\n");
+            char* flag = strtok(NULL, " \t\n");
             if (id_str && path) {
-                client_download_folder(conn, atoi(id_str), path);
+                client_download_folder(conn, atoi(id_str), path, flag && strcmp(flag, "-z") == 0);
             } else {
-                printf("Usage: downloadfolder <folder_id> <local_path>\n");
+                printf("Usage: downloadfolder <folder_id> <local_path> [-z]\n");
             }
         } else if (strcmp(cmd, "chmod") == 0) {
             char* id_str = strtok(NULL, " \t\n");
@@ -254,6 +265,8 @@ int main(int argc, char** argv) {
             } else {
                 printf("Usage: move <file_id> <dest_parent_id>\n");
             }
+        } else if (strcmp(cmd, "quota") == 0) {
+            client_quota(conn);
         } else if (strcmp(cmd, "pwd") == 0) {
             printf("Current directory: %s (ID: %d)\n", conn->current_path, conn->current_directory);
         } else {
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <zlib.h>
 
 int net_connect(const char* host, uint16_t port) {
     struct addrinfo hints, *result, *rp;
@@ -149,3 +150,64 @@ int net_recv_file(int sockfd, const char* file_path, size_t file_size) {
     fclose(fp);
     return result;
 }
+
+int net_recv_file_inflate(int sockfd, const char* file_path, size_t stored_size, size_t file_size) {
+    FILE* fp = fopen(file_path, "wb");
+    if (!fp) return -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        fclose(fp);
+        return -1;
+    }
+
+    unsigned char out[65536];
+    size_t total_received = 0;
+    size_t total_written = 0;
+    int rc = Z_OK;
+    int result = 0;
+
+    while (total_received < stored_size && rc != Z_STREAM_END) {
+        Packet pkt = {0};
+        if (packet_recv(sockfd, &pkt) < 0) {
+            result = -1;
+            break;
+        }
+
+        if (pkt.command == CMD_ERROR) {
+            if (pkt.payload) free(pkt.payload);
+            result = -1;
+            break;
+        }
+
+        if (pkt.command != CMD_DOWNLOAD_RES && pkt.data_length > 0) {
+            total_received += pkt.data_length;
+            zs.next_in = (Bytef*)pkt.payload;
+            zs.avail_in = pkt.data_length;
+            while (zs.avail_in > 0 && rc != Z_STREAM_END) {
+                zs.next_out = out;
+                zs.avail_out = sizeof(out);
+                rc = inflate(&zs, Z_NO_FLUSH);
+                if (rc != Z_OK && rc != Z_STREAM_END) {
+                    result = -1;
+                    break;
+                }
+                size_t produced = sizeof(out) - zs.avail_out;
+                fwrite(out, 1, produced, fp);
+                total_written += produced;
+            }
+        }
+
+        if (pkt.payload) free(pkt.payload);
+        if (result < 0) break;
+    }
+
+    if (result == 0 && (rc != Z_STREAM_END || total_written != file_size)) {
+        result = -1;
+    }
+
+    inflateEnd(&zs);
+    fclose(fp);
+    return result;
+}
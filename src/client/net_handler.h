@@ -15,5 +15,8 @@ Packet* net_recv_packet(int sockfd);
 // File transfer helpers
 int net_send_file(int sockfd, const char* file_path);
 int net_recv_file(int sockfd, const char* file_path, size_t file_size);
+// Receive a deflate-compressed download (stored_size bytes on the wire),
+// writing the inflated file_size bytes to file_path
+int net_recv_file_inflate(int sockfd, const char* file_path, size_t stored_size, size_t file_size);
 
 #endif // NET_HANDLER_H
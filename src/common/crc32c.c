@@ -0,0 +1,115 @@
+#include "crc32c.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u  // Reflected Castagnoli polynomial
+
+static uint32_t crc_table[8][256];
+static uint32_t (*crc_impl)(uint32_t, const uint8_t*, size_t) = NULL;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+// Slice-by-8: eight bytes per step through eight derived tables
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t* p, size_t len) {
+    while (len && ((uintptr_t)p & 7)) {
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        word ^= crc;  // Little-endian: low bytes mix with the running CRC
+        crc = crc_table[7][word & 0xFF] ^
+              crc_table[6][(word >> 8) & 0xFF] ^
+              crc_table[5][(word >> 16) & 0xFF] ^
+              crc_table[4][(word >> 24) & 0xFF] ^
+              crc_table[3][(word >> 32) & 0xFF] ^
+              crc_table[2][(word >> 40) & 0xFF] ^
+              crc_table[1][(word >> 48) & 0xFF] ^
+              crc_table[0][word >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t* p, size_t len) {
+    uint64_t c = crc;
+    while (len && ((uintptr_t)p & 7)) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    }
+    return (uint32_t)c;
+}
+#endif
+
+static void crc32c_setup(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = crc_table[t - 1][i];
+            crc_table[t][i] = crc_table[0][prev & 0xFF] ^ (prev >> 8);
+        }
+    }
+
+    crc_impl = crc32c_sw;
+#ifdef CRC32C_HAVE_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc_impl = crc32c_hw;
+    }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+    pthread_once(&crc_once, crc32c_setup);
+    return ~crc_impl(~crc, (const uint8_t*)data, len);
+}
+
+int crc32c_chunks(const uint8_t* data, size_t size, size_t chunk_size,
+                  uint32_t** crcs, int* count) {
+    if (!crcs || !count || chunk_size == 0 || (size > 0 && !data)) {
+        return -1;
+    }
+
+    size_t n = (size + chunk_size - 1) / chunk_size;
+    *crcs = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+    if (!*crcs) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        size_t off = i * chunk_size;
+        size_t len = (size - off < chunk_size) ? size - off : chunk_size;
+        (*crcs)[i] = crc32c(0, data + off, len);
+    }
+
+    *count = (int)n;
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the CPU
+// has it, otherwise a slice-by-8 table implementation.
+
+// Extend `crc` (0 to start) over `len` bytes
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+// CRC of each `chunk_size` piece of a buffer (the last may be shorter).
+// Allocates *crcs; an empty buffer yields zero chunks. Returns 0 or -1.
+int crc32c_chunks(const uint8_t* data, size_t size, size_t chunk_size,
+                  uint32_t** crcs, int* count);
+
+#endif
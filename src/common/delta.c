@@ -0,0 +1,274 @@
+#include "delta.h"
+#include "crc32c.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Growable output buffer
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} DeltaBuf;
+
+static int buf_reserve(DeltaBuf* b, size_t extra) {
+    if (b->len + extra <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra) cap *= 2;
+    uint8_t* grown = realloc(b->data, cap);
+    if (!grown) return -1;
+    b->data = grown;
+    b->cap = cap;
+    return 0;
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// rsync weak checksum: a = sum(x), b = sum((len - i) * x), 16 bits each
+static void weak_init(const uint8_t* p, size_t len, uint32_t* a, uint32_t* b) {
+    uint32_t s1 = 0, s2 = 0;
+    for (size_t i = 0; i < len; i++) {
+        s1 += p[i];
+        s2 += (uint32_t)(len - i) * p[i];
+    }
+    *a = s1 & 0xFFFF;
+    *b = s2 & 0xFFFF;
+}
+
+static uint32_t weak_value(uint32_t a, uint32_t b) {
+    return a | (b << 16);
+}
+
+size_t delta_block_size(size_t file_size) {
+    // Smallest multiple of 1KB whose square covers the file
+    size_t block = DELTA_MIN_BLOCK;
+    while (block < DELTA_MAX_BLOCK && block * block < file_size) {
+        block += 1024;
+    }
+    return block;
+}
+
+int delta_signatures(const uint8_t* data, size_t size, size_t block_size,
+                     DeltaSig** sigs, int* count) {
+    if (!sigs || !count || block_size == 0 || (size > 0 && !data)) return -1;
+
+    size_t n = (size + block_size - 1) / block_size;
+    *sigs = malloc((n > 0 ? n : 1) * sizeof(DeltaSig));
+    if (!*sigs) return -1;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t off = i * block_size;
+        size_t len = (size - off < block_size) ? size - off : block_size;
+        uint32_t a, b;
+        weak_init(data + off, len, &a, &b);
+        (*sigs)[i].weak = weak_value(a, b);
+        (*sigs)[i].strong = crc32c(0, data + off, len);
+    }
+
+    *count = (int)n;
+    return 0;
+}
+
+int delta_sigs_encode(const DeltaSig* sigs, int count, uint8_t** out, size_t* out_len) {
+    if (!out || !out_len || count < 0) return -1;
+
+    *out = malloc(count > 0 ? (size_t)count * DELTA_SIG_WIRE_SIZE : 1);
+    if (!*out) return -1;
+
+    for (int i = 0; i < count; i++) {
+        put_u32(*out + i * DELTA_SIG_WIRE_SIZE, sigs[i].weak);
+        put_u32(*out + i * DELTA_SIG_WIRE_SIZE + 4, sigs[i].strong);
+    }
+    *out_len = (size_t)count * DELTA_SIG_WIRE_SIZE;
+    return 0;
+}
+
+int delta_sigs_decode(const uint8_t* buf, size_t len, DeltaSig** sigs, int* count) {
+    if (!sigs || !count || len % DELTA_SIG_WIRE_SIZE != 0 || (len > 0 && !buf)) return -1;
+
+    size_t n = len / DELTA_SIG_WIRE_SIZE;
+    *sigs = malloc((n > 0 ? n : 1) * sizeof(DeltaSig));
+    if (!*sigs) return -1;
+
+    for (size_t i = 0; i < n; i++) {
+        (*sigs)[i].weak = get_u32(buf + i * DELTA_SIG_WIRE_SIZE);
+        (*sigs)[i].strong = get_u32(buf + i * DELTA_SIG_WIRE_SIZE + 4);
+    }
+    *count = (int)n;
+    return 0;
+}
+
+// Helper: append a literal run, split so each op length fits in a u32
+static int emit_data(DeltaBuf* out, const uint8_t* p, size_t len) {
+    while (len > 0) {
+        size_t run = len > 0x7FFFFFFF ? 0x7FFFFFFF : len;
+        if (buf_reserve(out, 5 + run) < 0) return -1;
+        out->data[out->len] = DELTA_OP_DATA;
+        put_u32(out->data + out->len + 1, (uint32_t)run);
+        memcpy(out->data + out->len + 5, p, run);
+        out->len += 5 + run;
+        p += run;
+        len -= run;
+    }
+    return 0;
+}
+
+// Helper: append a block copy, merging with the previous op when contiguous
+static int emit_copy(DeltaBuf* out, size_t* last_copy, uint32_t block) {
+    if (*last_copy != (size_t)-1) {
+        uint8_t* op = out->data + *last_copy;
+        uint32_t first = get_u32(op + 1);
+        uint32_t n = get_u32(op + 5);
+        if (first + n == block) {
+            put_u32(op + 5, n + 1);
+            return 0;
+        }
+    }
+
+    if (buf_reserve(out, 9) < 0) return -1;
+    *last_copy = out->len;
+    out->data[out->len] = DELTA_OP_COPY;
+    put_u32(out->data + out->len + 1, block);
+    put_u32(out->data + out->len + 5, 1);
+    out->len += 9;
+    return 0;
+}
+
+int delta_encode(const uint8_t* data, size_t size, size_t block_size,
+                 const DeltaSig* sigs, int count, size_t old_size,
+                 uint8_t** out, size_t* out_len) {
+    if (!out || !out_len || block_size == 0 || (size > 0 && !data) || count < 0) return -1;
+
+    DeltaBuf buf = {0};
+
+    // Open-addressed table from weak checksum to block index. Only full
+    // blocks go in: a short final block can't match a block-sized window.
+    size_t slots = 16;
+    while (slots < (size_t)count * 2) slots *= 2;
+    int* table = malloc(slots * sizeof(int));
+    if (!table) return -1;
+    memset(table, 0xFF, slots * sizeof(int));
+    int full_blocks = (int)(old_size / block_size);
+    if (full_blocks > count) full_blocks = count;
+    for (int i = 0; i < full_blocks; i++) {
+        size_t h = (sigs[i].weak * 2654435761u) & (slots - 1);
+        while (table[h] >= 0) h = (h + 1) & (slots - 1);
+        table[h] = i;
+    }
+
+    size_t last_copy = (size_t)-1;
+    size_t literal_start = 0;
+    size_t pos = 0;
+    uint32_t a = 0, b = 0;
+    int rolling = 0;
+    int rc = 0;
+
+    while (size >= block_size && pos + block_size <= size) {
+        if (!rolling) {
+            weak_init(data + pos, block_size, &a, &b);
+            rolling = 1;
+        }
+
+        uint32_t weak = weak_value(a, b);
+        int match = -1;
+        int strong_done = 0;
+        uint32_t strong = 0;
+        for (size_t h = (weak * 2654435761u) & (slots - 1); table[h] >= 0; h = (h + 1) & (slots - 1)) {
+            const DeltaSig* s = &sigs[table[h]];
+            if (s->weak != weak) continue;
+            if (!strong_done) {
+                strong = crc32c(0, data + pos, block_size);
+                strong_done = 1;
+            }
+            if (s->strong == strong) {
+                match = table[h];
+                break;
+            }
+        }
+
+        if (match >= 0) {
+            if (pos > literal_start) {
+                if (emit_data(&buf, data + literal_start, pos - literal_start) < 0) { rc = -1; break; }
+                last_copy = (size_t)-1;
+            }
+            if (emit_copy(&buf, &last_copy, (uint32_t)match) < 0) { rc = -1; break; }
+            pos += block_size;
+            literal_start = pos;
+            rolling = 0;
+            continue;
+        }
+
+        // Slide the window one byte
+        if (pos + block_size < size) {
+            uint8_t out_byte = data[pos];
+            uint8_t in_byte = data[pos + block_size];
+            a = (a - out_byte + in_byte) & 0xFFFF;
+            b = (b - (uint32_t)block_size * out_byte + a) & 0xFFFF;
+        }
+        pos++;
+    }
+
+    if (rc == 0 && size > literal_start) {
+        rc = emit_data(&buf, data + literal_start, size - literal_start);
+    }
+    free(table);
+
+    if (rc < 0) {
+        free(buf.data);
+        return -1;
+    }
+
+    *out = buf.data ? buf.data : malloc(1);
+    *out_len = buf.len;
+    return *out ? 0 : -1;
+}
+
+int delta_apply(const uint8_t* old, size_t old_size, size_t block_size,
+                const uint8_t* delta, size_t delta_len,
+                uint8_t* out, size_t out_size) {
+    if (block_size == 0 || (delta_len > 0 && !delta) || (out_size > 0 && !out)) return -1;
+
+    size_t old_blocks = (old_size + block_size - 1) / block_size;
+    size_t written = 0;
+    size_t i = 0;
+
+    while (i < delta_len) {
+        uint8_t op = delta[i];
+        if (op == DELTA_OP_COPY) {
+            if (delta_len - i < 9) return -1;
+            size_t first = get_u32(delta + i + 1);
+            size_t n = get_u32(delta + i + 5);
+            if (first >= old_blocks || n > old_blocks - first) return -1;
+
+            size_t off = first * block_size;
+            size_t end = (first + n) * block_size;
+            if (end > old_size) end = old_size;
+            size_t len = end - off;
+            if (len > out_size - written) return -1;
+
+            memcpy(out + written, old + off, len);
+            written += len;
+            i += 9;
+        } else if (op == DELTA_OP_DATA) {
+            if (delta_len - i < 5) return -1;
+            size_t len = get_u32(delta + i + 1);
+            if (len > delta_len - i - 5 || len > out_size - written) return -1;
+
+            memcpy(out + written, delta + i + 5, len);
+            written += len;
+            i += 5 + len;
+        } else {
+            return -1;
+        }
+    }
+
+    return written == out_size ? 0 : -1;
+}
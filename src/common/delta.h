@@ -0,0 +1,52 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// rsync-style delta transfer. The holder of the old version publishes a
+// signature (weak rolling checksum + CRC-32C) per block; the holder of the
+// new version scans its data with the rolling checksum and emits a delta of
+// block-copy instructions and literal bytes, which rebuilds the new version
+// from the old one.
+//
+// Wire formats (all integers big-endian):
+//   signatures: per block { u32 weak, u32 strong }
+//   delta ops:  DELTA_OP_COPY { u32 first_block, u32 block_count }
+//               DELTA_OP_DATA { u32 length, length bytes }
+
+#define DELTA_MIN_BLOCK 2048
+#define DELTA_MAX_BLOCK (128 * 1024)
+#define DELTA_SIG_WIRE_SIZE 8
+
+#define DELTA_OP_COPY 0x01
+#define DELTA_OP_DATA 0x02
+
+typedef struct {
+    uint32_t weak;      // Rolling checksum of the block
+    uint32_t strong;    // CRC-32C of the block
+} DeltaSig;
+
+// Block size for a file of the given size (about sqrt(size), clamped)
+size_t delta_block_size(size_t file_size);
+
+// Signatures for every block of `data` (the last block may be short)
+int delta_signatures(const uint8_t* data, size_t size, size_t block_size,
+                     DeltaSig** sigs, int* count);
+
+// Serialize / parse signatures. Buffers are malloc'd.
+int delta_sigs_encode(const DeltaSig* sigs, int count, uint8_t** out, size_t* out_len);
+int delta_sigs_decode(const uint8_t* buf, size_t len, DeltaSig** sigs, int* count);
+
+// Build the delta turning the signed old data (`old_size` bytes) into `data`
+int delta_encode(const uint8_t* data, size_t size, size_t block_size,
+                 const DeltaSig* sigs, int count, size_t old_size,
+                 uint8_t** out, size_t* out_len);
+
+// Rebuild the new data from `old` and a delta into `out` (exactly
+// `out_size` bytes). Returns 0 on success, -1 on a malformed delta.
+int delta_apply(const uint8_t* old, size_t old_size, size_t block_size,
+                const uint8_t* delta, size_t delta_len,
+                uint8_t* out, size_t out_size);
+
+#endif
@@ -0,0 +1,94 @@
+#include "json_buf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void json_buf_init(JsonBuf* buf) {
+    memset(buf, 0, sizeof(*buf));
+}
+
+void json_buf_free(JsonBuf* buf) {
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+void json_buf_reset(JsonBuf* buf) {
+    buf->len = 0;
+    if (buf->data) buf->data[0] = '\0';
+}
+
+// Helper: make room for `extra` more bytes plus the terminator
+static int reserve(JsonBuf* buf, size_t extra) {
+    if (buf->failed) return -1;
+    if (buf->len + extra + 1 <= buf->cap) return 0;
+
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap < buf->len + extra + 1) {
+        cap *= 2;
+    }
+    char* data = realloc(buf->data, cap);
+    if (!data) {
+        buf->failed = 1;
+        return -1;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+static void append_bytes(JsonBuf* buf, const char* bytes, size_t n) {
+    if (reserve(buf, n) < 0) return;
+    memcpy(buf->data + buf->len, bytes, n);
+    buf->len += n;
+    buf->data[buf->len] = '\0';
+}
+
+void json_buf_append(JsonBuf* buf, const char* text) {
+    append_bytes(buf, text, strlen(text));
+}
+
+void json_buf_string(JsonBuf* buf, const char* str) {
+    if (!str) {
+        json_buf_append(buf, "null");
+        return;
+    }
+
+    append_bytes(buf, "\"", 1);
+    const char* run = str;
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+        const char* esc = NULL;
+        char hex[8];
+        switch (*p) {
+            case '"':  esc = "\\\""; break;
+            case '\\': esc = "\\\\"; break;
+            case '\b': esc = "\\b"; break;
+            case '\f': esc = "\\f"; break;
+            case '\n': esc = "\\n"; break;
+            case '\r': esc = "\\r"; break;
+            case '\t': esc = "\\t"; break;
+            default:
+                if (*p < 0x20) {
+                    snprintf(hex, sizeof(hex), "\\u%04x", *p);
+                    esc = hex;
+                }
+        }
+        if (esc) {
+            // Copy the unescaped run before this character in one go
+            append_bytes(buf, run, (size_t)((const char*)p - run));
+            json_buf_append(buf, esc);
+            run = (const char*)p + 1;
+        }
+    }
+    append_bytes(buf, run, strlen(run));
+    append_bytes(buf, "\"", 1);
+}
+
+void json_buf_number(JsonBuf* buf, long long value) {
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%lld", value);
+    append_bytes(buf, num, (size_t)n);
+}
+
+void json_buf_bool(JsonBuf* buf, int value) {
+    json_buf_append(buf, value ? "true" : "false");
+}
@@ -0,0 +1,32 @@
+#ifndef JSON_BUF_H
+#define JSON_BUF_H
+
+#include <stddef.h>
+
+// Append-only JSON text buffer for responses built row by row, without a
+// cJSON tree in between. Strings are escaped the way cJSON prints them.
+// An allocation failure sets `failed` and turns later appends into no-ops.
+
+typedef struct {
+    char* data;             // NUL-terminated
+    size_t len;
+    size_t cap;
+    int failed;
+} JsonBuf;
+
+void json_buf_init(JsonBuf* buf);
+void json_buf_free(JsonBuf* buf);
+
+// Empty the buffer for the next message, keeping its allocation
+void json_buf_reset(JsonBuf* buf);
+
+// Raw JSON text (punctuation, keys known not to need escaping)
+void json_buf_append(JsonBuf* buf, const char* text);
+
+// Quoted, escaped string; NULL is written as null
+void json_buf_string(JsonBuf* buf, const char* str);
+
+void json_buf_number(JsonBuf* buf, long long value);
+void json_buf_bool(JsonBuf* buf, int value);
+
+#endif
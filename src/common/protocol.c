@@ -3,6 +3,8 @@
 #include <string.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
 
 Packet* packet_create(uint8_t command, const char* payload, uint32_t length) {
     Packet* pkt = malloc(sizeof(Packet));
@@ -163,3 +165,42 @@ int packet_send(int socket_fd, Packet* pkt) {
 
     return (sent == encoded_size) ? 0 : -3;
 }
+
+// Helper: Send header + payload with writev, resuming after partial writes
+int packet_send_data(int socket_fd, uint8_t command, const void* data, uint32_t length) {
+    if (length > 0 && !data) return -1;
+
+    uint8_t header[HEADER_SIZE];
+    header[0] = MAGIC_BYTE_1;
+    header[1] = MAGIC_BYTE_2;
+    header[2] = command;
+    uint32_t net_length = htonl(length);
+    memcpy(header + 3, &net_length, sizeof(uint32_t));
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = HEADER_SIZE;
+    iov[1].iov_base = (void*)data;
+    iov[1].iov_len = length;
+    int iovcnt = (length > 0) ? 2 : 1;
+    struct iovec* cur = iov;
+
+    while (iovcnt > 0) {
+        ssize_t n = writev(socket_fd, cur, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -3;
+        }
+        while (iovcnt > 0 && (size_t)n >= cur->iov_len) {
+            n -= cur->iov_len;
+            cur++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            cur->iov_base = (uint8_t*)cur->iov_base + n;
+            cur->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
@@ -19,8 +19,13 @@
 #define CMD_MAKE_DIR     0x12
 #define CMD_UPLOAD_REQ   0x20
 #define CMD_UPLOAD_DATA  0x21
+#define CMD_DELTA_SIG_REQ 0x22
+#define CMD_DELTA_REQ    0x23
+#define CMD_DELTA_DATA   0x24
+#define CMD_UPLOAD_TREE  0x25
 #define CMD_DOWNLOAD_REQ 0x30
 #define CMD_DOWNLOAD_RES 0x31
+#define CMD_DOWNLOAD_TREE 0x32
 #define CMD_DELETE       0x40
 #define CMD_CHMOD        0x41
 #define CMD_FILE_INFO    0x42
@@ -29,10 +34,13 @@
 #define CMD_RENAME       0x45
 #define CMD_COPY         0x46
 #define CMD_MOVE         0x47
+#define CMD_GET_QUOTA    0x48
 #define CMD_ADMIN_LIST_USERS   0x50
 #define CMD_ADMIN_CREATE_USER  0x51
 #define CMD_ADMIN_DELETE_USER  0x52
 #define CMD_ADMIN_UPDATE_USER  0x53
+#define CMD_ADMIN_STORAGE_GC   0x54
+#define CMD_ADMIN_SET_QUOTA    0x55
 #define CMD_ERROR        0xFF
 #define CMD_SUCCESS      0xFE
 
@@ -61,4 +69,8 @@ Packet* packet_create(uint8_t command, const char* payload, uint32_t length);
 int packet_recv(int socket_fd, Packet* pkt);
 int packet_send(int socket_fd, Packet* pkt);
 
+// Send a packet whose payload lives in caller-owned memory (e.g. a mapped
+// blob). The payload is written straight from `data` without being copied.
+int packet_send_data(int socket_fd, uint8_t command, const void* data, uint32_t length);
+
 #endif // PROTOCOL_H
@@ -0,0 +1,291 @@
+#include "tar.h"
+#include <stdio.h>
+#include <string.h>
+
+enum {
+    TAR_STATE_HEADER,
+    TAR_STATE_LONGNAME,
+    TAR_STATE_DATA,
+    TAR_STATE_PADDING,
+    TAR_STATE_END
+};
+
+// Helper: numeric field as zero-padded octal, or GNU base-256 if too large
+static void put_number(char* field, size_t width, uint64_t value) {
+    if (width >= 2 && value < (1ULL << (3 * (width - 1)))) {
+        snprintf(field, width, "%0*llo", (int)(width - 1), (unsigned long long)value);
+        return;
+    }
+    memset(field, 0, width);
+    for (size_t i = width - 1; i > 0; i--) {
+        field[i] = (char)(value & 0xFF);
+        value >>= 8;
+    }
+    field[0] = (char)0x80;
+}
+
+static uint64_t get_number(const uint8_t* field, size_t width) {
+    uint64_t value = 0;
+    if (field[0] & 0x80) {
+        for (size_t i = 1; i < width; i++) {
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+    for (size_t i = 0; i < width && field[i]; i++) {
+        if (field[i] == ' ') continue;
+        if (field[i] < '0' || field[i] > '7') break;
+        value = (value << 3) | (uint64_t)(field[i] - '0');
+    }
+    return value;
+}
+
+static unsigned int header_checksum(const uint8_t* block) {
+    unsigned int sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : block[i];
+    }
+    return sum;
+}
+
+// Helper: one ustar header block
+static void build_block(uint8_t* block, const char* name, char type, uint64_t size, int mode, long mtime) {
+    memset(block, 0, TAR_BLOCK);
+    strncpy((char*)block, name, 100);
+    put_number((char*)block + 100, 8, (uint64_t)(mode & 07777));
+    put_number((char*)block + 108, 8, 0);
+    put_number((char*)block + 116, 8, 0);
+    put_number((char*)block + 124, 12, size);
+    put_number((char*)block + 136, 12, mtime > 0 ? (uint64_t)mtime : 0);
+    block[156] = (uint8_t)type;
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+    snprintf((char*)block + 148, 8, "%06o", header_checksum(block));
+    block[155] = ' ';
+}
+
+size_t tar_padding(uint64_t size) {
+    return (size_t)((TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+}
+
+size_t tar_header(uint8_t* out, const char* path, char type, uint64_t size, int mode, long mtime) {
+    char name[TAR_PATH_MAX + 1];
+    int len = snprintf(name, sizeof(name), "%s%s", path, type == TAR_TYPE_DIR ? "/" : "");
+    if (len <= 0 || len >= TAR_PATH_MAX) {
+        return 0;
+    }
+
+    size_t written = 0;
+    if (len > 100) {
+        // GNU long name: the full path travels as the data of an 'L' entry
+        build_block(out, "././@LongLink", TAR_TYPE_LONGNAME, (uint64_t)len + 1, 0644, 0);
+        memset(out + TAR_BLOCK, 0, (size_t)len + 1 + tar_padding((uint64_t)len + 1));
+        memcpy(out + TAR_BLOCK, name, (size_t)len);
+        written = TAR_BLOCK + (size_t)len + 1 + tar_padding((uint64_t)len + 1);
+    }
+
+    build_block(out + written, name, type, type == TAR_TYPE_DIR ? 0 : size, mode, mtime);
+    return written + TAR_BLOCK;
+}
+
+void tar_reader_init(TarReader* reader, int (*on_entry)(void*, const TarEntry*),
+                     int (*on_data)(void*, const uint8_t*, size_t), void* ctx) {
+    memset(reader, 0, sizeof(*reader));
+    reader->on_entry = on_entry;
+    reader->on_data = on_data;
+    reader->ctx = ctx;
+    reader->state = TAR_STATE_HEADER;
+}
+
+// Helper: act on a complete header block
+static int handle_header(TarReader* r) {
+    int empty = 1;
+    for (int i = 0; i < TAR_BLOCK && empty; i++) {
+        if (r->block[i]) empty = 0;
+    }
+    if (empty) {
+        r->state = TAR_STATE_END;
+        return 1;
+    }
+
+    if (get_number(r->block + 148, 8) != header_checksum(r->block)) {
+        return -1;
+    }
+
+    uint64_t size = get_number(r->block + 124, 12);
+    char type = (char)r->block[156];
+
+    if (type == TAR_TYPE_LONGNAME || (type == TAR_TYPE_PAX && size > 0 && size <= TAR_EXT_MAX)) {
+        if (size == 0 || size > TAR_EXT_MAX) return -1;
+        r->ext_len = 0;
+        r->ext_type = type;
+        r->remaining = size;
+        r->padding = tar_padding(size);
+        r->state = TAR_STATE_LONGNAME;
+        return 0;
+    }
+
+    TarEntry* e = &r->entry;
+    memset(e, 0, sizeof(*e));
+    if (r->have_long_name) {
+        snprintf(e->path, sizeof(e->path), "%s", r->long_name);
+        r->have_long_name = 0;
+    } else {
+        char name[101], prefix[156];
+        memcpy(name, r->block, 100);
+        name[100] = '\0';
+        memcpy(prefix, r->block + 345, 155);
+        prefix[155] = '\0';
+        int is_ustar = memcmp(r->block + 257, "ustar", 5) == 0;
+        if (is_ustar && prefix[0]) {
+            snprintf(e->path, sizeof(e->path), "%s/%s", prefix, name);
+        } else {
+            snprintf(e->path, sizeof(e->path), "%s", name);
+        }
+    }
+
+    size_t len = strlen(e->path);
+    while (len > 0 && e->path[len - 1] == '/') {
+        e->path[--len] = '\0';
+    }
+
+    e->size = size;
+    e->mode = (int)get_number(r->block + 100, 8);
+    e->mtime = (long)get_number(r->block + 136, 12);
+
+    if (type == TAR_TYPE_FILE || type == '\0') {
+        e->type = TAR_TYPE_FILE;
+        r->skip = 0;
+    } else if (type == TAR_TYPE_DIR) {
+        e->type = TAR_TYPE_DIR;
+        r->skip = 0;
+    } else {
+        r->skip = 1;        // Links, devices, pax headers...
+    }
+
+    if (!r->skip && r->on_entry && r->on_entry(r->ctx, e) < 0) {
+        return -1;
+    }
+
+    // Directory sizes carry no data in ustar
+    r->remaining = (e->type == TAR_TYPE_DIR && !r->skip) ? 0 : size;
+    r->padding = tar_padding(r->remaining);
+    r->state = r->remaining > 0 ? TAR_STATE_DATA :
+               (r->padding > 0 ? TAR_STATE_PADDING : TAR_STATE_HEADER);
+    return 0;
+}
+
+// Helper: take the next entry's path from a complete long-name or pax header
+static int extended_header(TarReader* r) {
+    if (r->ext_type == TAR_TYPE_LONGNAME) {
+        if (r->ext_len > TAR_PATH_MAX) return -1;
+        memcpy(r->long_name, r->ext, r->ext_len);
+        r->long_name[r->ext_len - 1] = '\0';
+        r->have_long_name = 1;
+        return 0;
+    }
+
+    // pax: "<length> <key>=<value>\n" records
+    size_t pos = 0;
+    while (pos < r->ext_len) {
+        size_t rec_len = 0;
+        size_t i = pos;
+        while (i < r->ext_len && r->ext[i] >= '0' && r->ext[i] <= '9') {
+            rec_len = rec_len * 10 + (size_t)(r->ext[i++] - '0');
+        }
+        if (rec_len == 0 || pos + rec_len > r->ext_len || i >= r->ext_len || r->ext[i] != ' ') {
+            return -1;
+        }
+
+        const char* key = r->ext + i + 1;
+        const char* end = r->ext + pos + rec_len - 1;     // The trailing newline
+        if (end - key > 5 && memcmp(key, "path=", 5) == 0) {
+            size_t value_len = (size_t)(end - key - 5);
+            if (value_len >= TAR_PATH_MAX) return -1;
+            memcpy(r->long_name, key + 5, value_len);
+            r->long_name[value_len] = '\0';
+            r->have_long_name = 1;
+        }
+        pos += rec_len;
+    }
+    return 0;
+}
+
+int tar_reader_feed(TarReader* r, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        switch (r->state) {
+            case TAR_STATE_HEADER: {
+                size_t take = TAR_BLOCK - r->block_len;
+                if (take > len) take = len;
+                memcpy(r->block + r->block_len, data, take);
+                r->block_len += take;
+                data += take;
+                len -= take;
+                if (r->block_len == TAR_BLOCK) {
+                    r->block_len = 0;
+                    int rc = handle_header(r);
+                    if (rc != 0) return rc;
+                }
+                break;
+            }
+            case TAR_STATE_LONGNAME: {
+                size_t take = r->remaining < len ? (size_t)r->remaining : len;
+                memcpy(r->ext + r->ext_len, data, take);
+                r->ext_len += take;
+                r->remaining -= take;
+                data += take;
+                len -= take;
+                if (r->remaining == 0) {
+                    if (extended_header(r) < 0) return -1;
+                    r->state = r->padding > 0 ? TAR_STATE_PADDING : TAR_STATE_HEADER;
+                }
+                break;
+            }
+            case TAR_STATE_DATA: {
+                size_t take = r->remaining < len ? (size_t)r->remaining : len;
+                if (!r->skip && r->on_data && r->on_data(r->ctx, data, take) < 0) {
+                    return -1;
+                }
+                r->remaining -= take;
+                data += take;
+                len -= take;
+                if (r->remaining == 0) {
+                    r->state = r->padding > 0 ? TAR_STATE_PADDING : TAR_STATE_HEADER;
+                }
+                break;
+            }
+            case TAR_STATE_PADDING: {
+                size_t take = r->padding < len ? r->padding : len;
+                r->padding -= take;
+                data += take;
+                len -= take;
+                if (r->padding == 0) {
+                    r->state = TAR_STATE_HEADER;
+                }
+                break;
+            }
+            default:
+                return 1;   // Anything after the end marker is ignored
+        }
+    }
+    return r->state == TAR_STATE_END ? 1 : 0;
+}
+
+int tar_path_safe(const char* path) {
+    if (!path || !*path || path[0] == '/') {
+        return 0;
+    }
+
+    const char* p = path;
+    while (*p) {
+        const char* end = strchr(p, '/');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        if (n == 0 || (n == 1 && p[0] == '.') || (n == 2 && p[0] == '.' && p[1] == '.')) {
+            return 0;
+        }
+        p += n;
+        if (*p == '/') p++;
+        if (end && !*p) return 0;   // Trailing slash
+    }
+    return 1;
+}
@@ -0,0 +1,70 @@
+#ifndef TAR_H
+#define TAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal ustar reader/writer for folder transfers. Paths longer than the
+// 100-byte header field use a GNU long-name ('L') entry; the reader also
+// takes them from pax ('x') headers. Only regular files and directories
+// are produced; other entry types are skipped.
+
+#define TAR_BLOCK 512
+#define TAR_PATH_MAX 1024
+#define TAR_HEADER_MAX (3 * TAR_BLOCK + TAR_PATH_MAX)   // Long-name entry + header
+
+#define TAR_TYPE_FILE '0'
+#define TAR_TYPE_DIR '5'
+#define TAR_TYPE_LONGNAME 'L'
+#define TAR_TYPE_PAX 'x'
+#define TAR_EXT_MAX (4 * TAR_PATH_MAX)                  // Largest long-name / pax header read
+
+typedef struct {
+    char path[TAR_PATH_MAX];
+    char type;              // TAR_TYPE_FILE or TAR_TYPE_DIR
+    uint64_t size;
+    int mode;
+    long mtime;
+} TarEntry;
+
+// Write the header block(s) for an entry into `out` (at least
+// TAR_HEADER_MAX bytes). Returns the bytes written, or 0 if the path is too long.
+size_t tar_header(uint8_t* out, const char* path, char type, uint64_t size, int mode, long mtime);
+
+// Zero bytes needed after `size` bytes of data to reach a block boundary
+size_t tar_padding(uint64_t size);
+
+// Streaming parser. Feed it the archive in chunks of any size; it calls
+// on_entry for each entry, then on_data for that entry's contents.
+// Callbacks return 0 to continue or -1 to abort.
+typedef struct {
+    int (*on_entry)(void* ctx, const TarEntry* entry);
+    int (*on_data)(void* ctx, const uint8_t* data, size_t len);
+    void* ctx;
+
+    int state;
+    uint8_t block[TAR_BLOCK];
+    size_t block_len;
+    TarEntry entry;
+    char ext[TAR_EXT_MAX];  // Long-name or pax header data
+    size_t ext_len;
+    char ext_type;
+    char long_name[TAR_PATH_MAX];
+    int have_long_name;
+    uint64_t remaining;     // Data bytes left in the current entry
+    size_t padding;         // Padding bytes left after it
+    int skip;               // Current entry's data is not reported
+} TarReader;
+
+void tar_reader_init(TarReader* reader, int (*on_entry)(void*, const TarEntry*),
+                     int (*on_data)(void*, const uint8_t*, size_t), void* ctx);
+
+// Returns 0 if more input is expected, 1 once the end-of-archive marker
+// was read, -1 on a malformed archive or a callback abort
+int tar_reader_feed(TarReader* reader, const uint8_t* data, size_t len);
+
+// Whether a path is safe to create below an extraction root (relative,
+// no "." or ".." components, no empty components)
+int tar_path_safe(const char* path);
+
+#endif
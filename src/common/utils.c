@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <time.h>
 #include <unistd.h>
+#include <stdint.h>
 
 static FILE* log_file_handle = NULL;
 static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -57,10 +58,13 @@ void log_error(const char* format, ...) {
     va_start(args, format);
 
     if (log_file_handle) {
+        va_list file_args;
+        va_copy(file_args, args);
         fprintf(log_file_handle, "[%s] [ERROR] ", ts);
-        vfprintf(log_file_handle, format, args);
+        vfprintf(log_file_handle, format, file_args);
         fprintf(log_file_handle, "\n");
         fflush(log_file_handle);
+        va_end(file_args);
     }
 
     // Also print to stderr
@@ -100,12 +104,30 @@ char* generate_uuid(void) {
     char* uuid_str = malloc(37);
     if (!uuid_str) return NULL;
 
-    // Simple UUID generation using random
-    srand(time(NULL) ^ getpid());
-    snprintf(uuid_str, 37, "%08x-%04x-%04x-%04x-%012llx",
-             rand(), rand() & 0xffff, (rand() & 0x0fff) | 0x4000,
-             (rand() & 0x3fff) | 0x8000,
-             ((long long)rand() << 32) | rand());
+    // Random (version 4) UUID from the kernel CSPRNG. Re-seeding rand() on
+    // every call handed out identical UUIDs within the same second.
+    uint8_t b[16];
+    FILE* fp = fopen("/dev/urandom", "rb");
+    size_t got = fp ? fread(b, 1, sizeof(b), fp) : 0;
+    if (fp) fclose(fp);
+    if (got != sizeof(b)) {
+        static pthread_mutex_t seed_mutex = PTHREAD_MUTEX_INITIALIZER;
+        static int seeded = 0;
+        pthread_mutex_lock(&seed_mutex);
+        if (!seeded) {
+            srand(time(NULL) ^ getpid());
+            seeded = 1;
+        }
+        for (size_t i = 0; i < sizeof(b); i++) b[i] = (uint8_t)rand();
+        pthread_mutex_unlock(&seed_mutex);
+    }
+
+    b[6] = (b[6] & 0x0f) | 0x40;
+    b[8] = (b[8] & 0x3f) | 0x80;
+    snprintf(uuid_str, 37,
+             "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+             b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7],
+             b[8], b[9], b[10], b[11], b[12], b[13], b[14], b[15]);
     return uuid_str;
 }
 
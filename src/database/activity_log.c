@@ -0,0 +1,267 @@
+#include "activity_log.h"
+#include "../common/utils.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    atomic_size_t seq;      // Ring position this slot is ready for
+    ActivityRecord record;
+} ActivitySlot;
+
+struct ActivityWriter {
+    Database* db;
+    int flush_ms;
+    int batch;
+    ActivityOverflow overflow;
+
+    ActivitySlot* slots;
+    atomic_size_t head;     // Next position to fill (producers)
+    atomic_size_t tail;     // Next position to drain (written by the writer thread only)
+
+    pthread_t thread;
+    atomic_int stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;    // Writer: a batch is ready or a flush was asked for
+    pthread_cond_t done;    // Producers/flushers: records were written
+    size_t written;         // Ring positions consumed so far (under mutex)
+    int flush_requested;
+
+    atomic_long dropped;
+};
+
+void activity_timestamp(char* out, size_t size) {
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(out, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+// Helper: claim a slot and publish a record. Returns -1 if the ring is full.
+static int ring_push(ActivityWriter* w, const ActivityRecord* record) {
+    size_t pos = atomic_load_explicit(&w->head, memory_order_relaxed);
+    for (;;) {
+        ActivitySlot* slot = &w->slots[pos & (ACTIVITY_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&w->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                slot->record = *record;
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&w->head, memory_order_relaxed);
+        }
+    }
+}
+
+// Helper: take the oldest published record (writer thread only)
+static int ring_pop(ActivityWriter* w, ActivityRecord* record) {
+    size_t tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+    ActivitySlot* slot = &w->slots[tail & (ACTIVITY_QUEUE_SIZE - 1)];
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1) {
+        return -1;
+    }
+    *record = slot->record;
+    atomic_store_explicit(&slot->seq, tail + ACTIVITY_QUEUE_SIZE, memory_order_release);
+    atomic_store_explicit(&w->tail, tail + 1, memory_order_relaxed);
+    return 0;
+}
+
+static size_t ring_pending(ActivityWriter* w) {
+    return atomic_load_explicit(&w->head, memory_order_relaxed) -
+           atomic_load_explicit(&w->tail, memory_order_relaxed);
+}
+
+// Helper: write everything queued so far, `batch` rows per transaction
+static void drain(ActivityWriter* w, ActivityRecord* records) {
+    for (;;) {
+        int count = 0;
+        while (count < w->batch && ring_pop(w, &records[count]) == 0) {
+            count++;
+        }
+        if (count == 0) break;
+
+        if (db_insert_activity(w->db, records, count) < 0) {
+            log_error("Activity log: failed to write %d records", count);
+        }
+        for (int i = 0; i < count; i++) {
+            free(records[i].description);
+        }
+
+        pthread_mutex_lock(&w->mutex);
+        w->written += (size_t)count;
+        pthread_cond_broadcast(&w->done);
+        pthread_mutex_unlock(&w->mutex);
+    }
+}
+
+static void* writer_thread(void* arg) {
+    ActivityWriter* w = arg;
+    ActivityRecord* records = malloc((size_t)w->batch * sizeof(ActivityRecord));
+    if (!records) {
+        log_error("Activity log: out of memory, writer stopped");
+        return NULL;
+    }
+
+    while (!atomic_load(&w->stopping)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)w->flush_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        // Sleep until the interval ends, a batch fills up or someone flushes
+        pthread_mutex_lock(&w->mutex);
+        while (!atomic_load(&w->stopping) && !w->flush_requested &&
+               ring_pending(w) < (size_t)w->batch) {
+            if (pthread_cond_timedwait(&w->wake, &w->mutex, &deadline) != 0) break;
+        }
+        w->flush_requested = 0;
+        pthread_mutex_unlock(&w->mutex);
+
+        drain(w, records);
+    }
+
+    drain(w, records);
+    free(records);
+    return NULL;
+}
+
+int activity_enqueue(ActivityWriter* w, int user_id, const char* action_type, const char* description) {
+    if (atomic_load(&w->stopping)) {
+        return 1;
+    }
+
+    ActivityRecord record;
+    record.user_id = user_id;
+    snprintf(record.action_type, sizeof(record.action_type), "%s", action_type);
+    activity_timestamp(record.timestamp, sizeof(record.timestamp));
+    record.description = strdup(description ? description : "");
+    if (!record.description) {
+        return 1;
+    }
+
+    while (ring_push(w, &record) < 0) {
+        if (w->overflow != ACTIVITY_OVERFLOW_BLOCK || atomic_load(&w->stopping)) {
+            free(record.description);
+            if (w->overflow == ACTIVITY_OVERFLOW_DROP) {
+                atomic_fetch_add(&w->dropped, 1);
+                return -1;
+            }
+            return 1;
+        }
+
+        // Block: hurry the writer along and wait for it to make room
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += ACTIVITY_BLOCK_WAIT_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        pthread_mutex_lock(&w->mutex);
+        w->flush_requested = 1;
+        pthread_cond_signal(&w->wake);
+        pthread_cond_timedwait(&w->done, &w->mutex, &deadline);
+        pthread_mutex_unlock(&w->mutex);
+    }
+
+    // Wake the writer early once a full batch is waiting
+    if (ring_pending(w) == (size_t)w->batch) {
+        pthread_mutex_lock(&w->mutex);
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->mutex);
+    }
+    return 0;
+}
+
+int db_start_activity_writer(Database* db, int flush_ms, int batch, ActivityOverflow overflow) {
+    if (db->activity) {
+        return 0;
+    }
+
+    ActivityWriter* w = calloc(1, sizeof(ActivityWriter));
+    if (!w) return -1;
+    w->slots = calloc(ACTIVITY_QUEUE_SIZE, sizeof(ActivitySlot));
+    if (!w->slots) {
+        free(w);
+        return -1;
+    }
+    for (size_t i = 0; i < ACTIVITY_QUEUE_SIZE; i++) {
+        atomic_init(&w->slots[i].seq, i);
+    }
+
+    w->db = db;
+    w->flush_ms = flush_ms > 0 ? flush_ms : ACTIVITY_DEFAULT_FLUSH_MS;
+    w->batch = batch > 0 ? (batch < ACTIVITY_QUEUE_SIZE ? batch : ACTIVITY_QUEUE_SIZE) : ACTIVITY_DEFAULT_BATCH;
+    w->overflow = overflow;
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    pthread_cond_init(&w->done, NULL);
+
+    if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+        pthread_mutex_destroy(&w->mutex);
+        pthread_cond_destroy(&w->wake);
+        pthread_cond_destroy(&w->done);
+        free(w->slots);
+        free(w);
+        return -1;
+    }
+
+    db->activity = w;
+    log_info("Activity log writer started (flush %d ms, batch %d)", w->flush_ms, w->batch);
+    return 0;
+}
+
+void db_flush_activity(Database* db) {
+    ActivityWriter* w = db->activity;
+    if (!w || atomic_load(&w->stopping)) {
+        return;
+    }
+
+    size_t target = atomic_load(&w->head);
+    pthread_mutex_lock(&w->mutex);
+    w->flush_requested = 1;
+    pthread_cond_signal(&w->wake);
+    while (w->written < target && !atomic_load(&w->stopping)) {
+        pthread_cond_wait(&w->done, &w->mutex);
+    }
+    pthread_mutex_unlock(&w->mutex);
+}
+
+void activity_writer_free(ActivityWriter* w) {
+    if (!w) return;
+
+    atomic_store(&w->stopping, 1);
+    pthread_mutex_lock(&w->mutex);
+    pthread_cond_broadcast(&w->wake);
+    pthread_cond_broadcast(&w->done);
+    pthread_mutex_unlock(&w->mutex);
+    pthread_join(w->thread, NULL);
+
+    // Records that raced with the shutdown
+    ActivityRecord* records = malloc((size_t)w->batch * sizeof(ActivityRecord));
+    if (records) {
+        drain(w, records);
+        free(records);
+    }
+
+    long dropped = atomic_load(&w->dropped);
+    if (dropped > 0) {
+        log_error("Activity log: %ld records dropped on overflow", dropped);
+    }
+
+    pthread_mutex_destroy(&w->mutex);
+    pthread_cond_destroy(&w->wake);
+    pthread_cond_destroy(&w->done);
+    free(w->slots);
+    free(w);
+    log_info("Activity log writer stopped");
+}
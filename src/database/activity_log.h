@@ -0,0 +1,26 @@
+#ifndef ACTIVITY_LOG_H
+#define ACTIVITY_LOG_H
+
+#include "db_manager.h"
+
+// Asynchronous activity-log writer, internal to the database module.
+// Handlers push records into a bounded lock-free ring (many producers,
+// one consumer); a background thread drains it into activity_logs in
+// one transaction per batch. The public controls are in db_manager.h.
+
+#define ACTIVITY_QUEUE_SIZE 8192        // Ring slots (power of two)
+#define ACTIVITY_BLOCK_WAIT_MS 10       // Re-check interval for a full ring
+
+typedef struct ActivityWriter ActivityWriter;
+
+// Queue a record. Returns 0 if queued, 1 if the caller should insert it
+// itself (spill, or the writer is stopping), -1 if it was dropped.
+int activity_enqueue(ActivityWriter* w, int user_id, const char* action_type, const char* description);
+
+// Current UTC time in the format of ActivityRecord.timestamp
+void activity_timestamp(char* out, size_t size);
+
+// Stop the writer thread, write whatever is still queued and free it
+void activity_writer_free(ActivityWriter* w);
+
+#endif
@@ -23,22 +23,300 @@ CREATE TABLE IF NOT EXISTS files (
     FOREIGN KEY (parent_id) REFERENCES files(id)
 );
 
--- Activity logs
-CREATE TABLE IF NOT EXISTS activity_logs (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
-    user_id INTEGER NOT NULL,
-    action_type TEXT NOT NULL,
-    description TEXT,
-    timestamp TEXT DEFAULT CURRENT_TIMESTAMP,
-    FOREIGN KEY (user_id) REFERENCES users(id)
+-- Activity log action names; the log rows themselves live in monthly
+-- activity_logs_YYYYMM tables created by the server, read together through
+-- the activity_logs view
+CREATE TABLE IF NOT EXISTS activity_actions (
+    code INTEGER PRIMARY KEY,
+    name TEXT UNIQUE NOT NULL
+);
+
+-- Files whose blob the storage GC could not find
+CREATE TABLE IF NOT EXISTS missing_blobs (
+    file_id INTEGER PRIMARY KEY,
+    detected_at TEXT DEFAULT CURRENT_TIMESTAMP,
+    FOREIGN KEY (file_id) REFERENCES files(id)
+);
+
+CREATE TRIGGER IF NOT EXISTS trg_files_missing_cleanup AFTER DELETE ON files
+BEGIN
+    DELETE FROM missing_blobs WHERE file_id = OLD.id;
+END;
+
+-- Per-chunk CRC-32C of each blob (little-endian uint32 array)
+CREATE TABLE IF NOT EXISTS blob_checksums (
+    physical_path TEXT PRIMARY KEY,
+    chunk_size INTEGER NOT NULL,
+    crcs BLOB NOT NULL,
+    verified_at INTEGER DEFAULT 0,
+    corrupt INTEGER DEFAULT 0
 );
 
+CREATE TRIGGER IF NOT EXISTS trg_files_checksum_cleanup AFTER DELETE ON files
+WHEN OLD.physical_path IS NOT NULL
+BEGIN
+    DELETE FROM blob_checksums WHERE physical_path = OLD.physical_path;
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_checksum_replace AFTER UPDATE OF physical_path ON files
+WHEN OLD.physical_path IS NOT NULL AND OLD.physical_path IS NOT NEW.physical_path
+BEGIN
+    DELETE FROM blob_checksums WHERE physical_path = OLD.physical_path;
+END;
+
+-- Blobs stored in an encoded (compressed) form; absent means raw
+CREATE TABLE IF NOT EXISTS blob_encoding (
+    physical_path TEXT PRIMARY KEY,
+    encoding TEXT NOT NULL,
+    stored_size INTEGER NOT NULL
+);
+
+CREATE TRIGGER IF NOT EXISTS trg_files_encoding_cleanup AFTER DELETE ON files
+WHEN OLD.physical_path IS NOT NULL
+BEGIN
+    DELETE FROM blob_encoding WHERE physical_path = OLD.physical_path;
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_encoding_replace AFTER UPDATE OF physical_path ON files
+WHEN OLD.physical_path IS NOT NULL AND OLD.physical_path IS NOT NEW.physical_path
+BEGIN
+    DELETE FROM blob_encoding WHERE physical_path = OLD.physical_path;
+END;
+
+-- Per-user quota limits (0 = unlimited) and usage. The usage counters are
+-- maintained by the triggers below inside every statement that changes
+-- files, so reading them never has to sum over the files table.
+CREATE TABLE IF NOT EXISTS user_quotas (
+    user_id INTEGER PRIMARY KEY,
+    max_bytes INTEGER NOT NULL DEFAULT 0,
+    max_files INTEGER NOT NULL DEFAULT 0,
+    bytes_used INTEGER NOT NULL DEFAULT 0,
+    files_used INTEGER NOT NULL DEFAULT 0
+);
+
+-- Backfill usage once for databases created before quotas existed
+INSERT INTO user_quotas (user_id, bytes_used, files_used)
+SELECT owner_id, SUM(CASE WHEN is_directory = 0 THEN size ELSE 0 END),
+       SUM(CASE WHEN is_directory = 0 THEN 1 ELSE 0 END)
+FROM files
+WHERE NOT EXISTS (SELECT 1 FROM user_quotas)
+GROUP BY owner_id;
+
+-- Reject rows that would push their owner over quota (backstop for races
+-- between the upload pre-check and the insert)
+CREATE TRIGGER IF NOT EXISTS trg_files_quota_insert BEFORE INSERT ON files
+WHEN NEW.is_directory = 0 AND EXISTS (
+    SELECT 1 FROM user_quotas q WHERE q.user_id = NEW.owner_id AND
+        ((q.max_bytes > 0 AND q.bytes_used + NEW.size > q.max_bytes) OR
+         (q.max_files > 0 AND q.files_used + 1 > q.max_files)))
+BEGIN
+    SELECT RAISE(ABORT, 'quota exceeded');
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_quota_grow BEFORE UPDATE OF size ON files
+WHEN NEW.size > OLD.size AND EXISTS (
+    SELECT 1 FROM user_quotas q WHERE q.user_id = NEW.owner_id AND
+        q.max_bytes > 0 AND q.bytes_used + NEW.size - OLD.size > q.max_bytes)
+BEGIN
+    SELECT RAISE(ABORT, 'quota exceeded');
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_usage_insert AFTER INSERT ON files
+BEGIN
+    INSERT OR IGNORE INTO user_quotas (user_id) VALUES (NEW.owner_id);
+    UPDATE user_quotas
+    SET bytes_used = bytes_used + (CASE WHEN NEW.is_directory = 0 THEN NEW.size ELSE 0 END),
+        files_used = files_used + (NEW.is_directory = 0)
+    WHERE user_id = NEW.owner_id;
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_usage_delete AFTER DELETE ON files
+BEGIN
+    UPDATE user_quotas
+    SET bytes_used = bytes_used - (CASE WHEN OLD.is_directory = 0 THEN OLD.size ELSE 0 END),
+        files_used = files_used - (OLD.is_directory = 0)
+    WHERE user_id = OLD.owner_id;
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_usage_update AFTER UPDATE OF size, owner_id ON files
+WHEN OLD.is_directory = 0
+BEGIN
+    UPDATE user_quotas
+    SET bytes_used = bytes_used - OLD.size, files_used = files_used - 1
+    WHERE user_id = OLD.owner_id;
+    INSERT OR IGNORE INTO user_quotas (user_id) VALUES (NEW.owner_id);
+    UPDATE user_quotas
+    SET bytes_used = bytes_used + NEW.size, files_used = files_used + 1
+    WHERE user_id = NEW.owner_id;
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_users_quota_cleanup AFTER DELETE ON users
+BEGIN
+    DELETE FROM user_quotas WHERE user_id = OLD.id;
+END;
+
+-- Materialized location of every entry. `ancestry` lists the IDs from the
+-- root down ("/5/9/" for 9 inside 5 inside the root, whose own is "/"), so
+-- a subtree is one range scan: ancestry > A AND ancestry < A || ':'
+-- (':' sorts right after the digits). `path` is the display path.
+CREATE TABLE IF NOT EXISTS file_paths (
+    file_id INTEGER PRIMARY KEY,
+    ancestry TEXT NOT NULL,
+    path TEXT NOT NULL
+);
+
+-- Backfill once for databases created before paths were materialized
+INSERT INTO file_paths (file_id, ancestry, path)
+WITH RECURSIVE walk(id, ancestry, path) AS (
+    SELECT 0, '/', '/'
+    UNION ALL
+    SELECT f.id, w.ancestry || f.id || '/', rtrim(w.path, '/') || '/' || f.name
+    FROM files f JOIN walk w ON f.parent_id = w.id
+    WHERE f.id != 0
+)
+SELECT id, ancestry, path FROM walk
+WHERE NOT EXISTS (SELECT 1 FROM file_paths);
+
+CREATE TRIGGER IF NOT EXISTS trg_files_path_insert AFTER INSERT ON files
+WHEN NEW.id != 0
+BEGIN
+    INSERT OR REPLACE INTO file_paths (file_id, ancestry, path)
+    VALUES (NEW.id,
+            COALESCE((SELECT ancestry FROM file_paths WHERE file_id = NEW.parent_id), '/') || NEW.id || '/',
+            rtrim(COALESCE((SELECT path FROM file_paths WHERE file_id = NEW.parent_id), '/'), '/') || '/' || NEW.name);
+END;
+
+-- Move or rename: rewrite the prefix of every descendant, then the entry
+CREATE TRIGGER IF NOT EXISTS trg_files_path_update AFTER UPDATE OF parent_id, name ON files
+WHEN NEW.parent_id IS NOT OLD.parent_id OR NEW.name IS NOT OLD.name
+BEGIN
+    UPDATE file_paths
+    SET ancestry = COALESCE((SELECT ancestry FROM file_paths WHERE file_id = NEW.parent_id), '/') || NEW.id || '/'
+                   || substr(ancestry, length((SELECT ancestry FROM file_paths WHERE file_id = OLD.id)) + 1),
+        path = rtrim(COALESCE((SELECT path FROM file_paths WHERE file_id = NEW.parent_id), '/'), '/') || '/' || NEW.name
+               || substr(path, length((SELECT path FROM file_paths WHERE file_id = OLD.id)) + 1)
+    WHERE ancestry > (SELECT ancestry FROM file_paths WHERE file_id = OLD.id)
+      AND ancestry < (SELECT ancestry FROM file_paths WHERE file_id = OLD.id) || ':';
+
+    INSERT OR REPLACE INTO file_paths (file_id, ancestry, path)
+    VALUES (NEW.id,
+            COALESCE((SELECT ancestry FROM file_paths WHERE file_id = NEW.parent_id), '/') || NEW.id || '/',
+            rtrim(COALESCE((SELECT path FROM file_paths WHERE file_id = NEW.parent_id), '/'), '/') || '/' || NEW.name);
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_path_delete AFTER DELETE ON files
+BEGIN
+    DELETE FROM file_paths WHERE file_id = OLD.id;
+END;
+
+-- Bytes and files below every directory (the root's cover everything),
+-- kept by the triggers below in the same statement as the change, which
+-- adds or removes its weight along the parent's ancestry. Deleting a
+-- directory takes its whole total off its ancestors at once, so rows
+-- deleted after an ancestor of theirs (some ancestor has no row left)
+-- change nothing.
+CREATE TABLE IF NOT EXISTS dir_totals (
+    dir_id INTEGER PRIMARY KEY,
+    bytes INTEGER NOT NULL DEFAULT 0,
+    files INTEGER NOT NULL DEFAULT 0
+);
+
+-- Backfill once for databases created before the totals existed
+INSERT INTO dir_totals (dir_id, bytes, files)
+SELECT d.file_id, COALESCE(SUM(f.size), 0), COUNT(f.id)
+FROM file_paths d
+JOIN files dir ON dir.id = d.file_id AND dir.is_directory = 1
+LEFT JOIN file_paths p ON p.ancestry > d.ancestry AND p.ancestry < d.ancestry || ':'
+LEFT JOIN files f ON f.id = p.file_id AND f.is_directory = 0
+WHERE NOT EXISTS (SELECT 1 FROM dir_totals)
+GROUP BY d.file_id;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_totals_insert AFTER INSERT ON files
+BEGIN
+    INSERT OR IGNORE INTO dir_totals (dir_id) SELECT NEW.id WHERE NEW.is_directory = 1;
+    UPDATE dir_totals SET bytes = bytes + NEW.size, files = files + 1
+    WHERE NEW.is_directory = 0
+      AND dir_id IN (SELECT value FROM json_each('[0' || replace(rtrim((SELECT ancestry FROM file_paths WHERE file_id = NEW.parent_id), '/'), '/', ',') || ']'));
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_totals_delete AFTER DELETE ON files
+BEGIN
+    UPDATE dir_totals
+    SET bytes = bytes - (CASE WHEN OLD.is_directory = 0 THEN OLD.size
+                              ELSE (SELECT t.bytes FROM dir_totals t WHERE t.dir_id = OLD.id) END),
+        files = files - (CASE WHEN OLD.is_directory = 0 THEN 1
+                              ELSE (SELECT t.files FROM dir_totals t WHERE t.dir_id = OLD.id) END)
+    WHERE dir_id IN (SELECT value FROM json_each('[0' || replace(rtrim((SELECT ancestry FROM file_paths WHERE file_id = OLD.parent_id), '/'), '/', ',') || ']'))
+      AND NOT EXISTS (SELECT 1 FROM json_each('[0' || replace(rtrim((SELECT ancestry FROM file_paths WHERE file_id = OLD.parent_id), '/'), '/', ',') || ']') a
+                      WHERE a.value NOT IN (SELECT dir_id FROM dir_totals))
+      AND (OLD.is_directory = 0 OR EXISTS (SELECT 1 FROM dir_totals t WHERE t.dir_id = OLD.id));
+    DELETE FROM dir_totals WHERE dir_id = OLD.id;
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_totals_size AFTER UPDATE OF size ON files
+WHEN NEW.is_directory = 0 AND NEW.size IS NOT OLD.size
+BEGIN
+    UPDATE dir_totals SET bytes = bytes + NEW.size - OLD.size
+    WHERE dir_id IN (SELECT value FROM json_each('[0' || replace(rtrim((SELECT ancestry FROM file_paths WHERE file_id = NEW.parent_id), '/'), '/', ',') || ']'));
+END;
+
+-- Moves carry the entry's weight from the old ancestry to the new one
+CREATE TRIGGER IF NOT EXISTS trg_files_totals_move AFTER UPDATE OF parent_id ON files
+WHEN NEW.parent_id IS NOT OLD.parent_id
+BEGIN
+    UPDATE dir_totals
+    SET bytes = bytes - (CASE WHEN OLD.is_directory = 0 THEN OLD.size
+                              ELSE (SELECT t.bytes FROM dir_totals t WHERE t.dir_id = OLD.id) END),
+        files = files - (CASE WHEN OLD.is_directory = 0 THEN 1
+                              ELSE (SELECT t.files FROM dir_totals t WHERE t.dir_id = OLD.id) END)
+    WHERE dir_id IN (SELECT value FROM json_each('[0' || replace(rtrim((SELECT ancestry FROM file_paths WHERE file_id = OLD.parent_id), '/'), '/', ',') || ']'));
+    UPDATE dir_totals
+    SET bytes = bytes + (CASE WHEN OLD.is_directory = 0 THEN OLD.size
+                              ELSE (SELECT t.bytes FROM dir_totals t WHERE t.dir_id = OLD.id) END),
+        files = files + (CASE WHEN OLD.is_directory = 0 THEN 1
+                              ELSE (SELECT t.files FROM dir_totals t WHERE t.dir_id = OLD.id) END)
+    WHERE dir_id IN (SELECT value FROM json_each('[0' || replace(rtrim((SELECT ancestry FROM file_paths WHERE file_id = NEW.parent_id), '/'), '/', ',') || ']'));
+END;
+
+-- Trigram index over file names, so substring searches (LIKE '%foo%')
+-- are answered from the index instead of scanning files. External
+-- content: the names themselves stay in files.
+CREATE VIRTUAL TABLE IF NOT EXISTS files_name_fts USING fts5(
+    name,
+    content='files',
+    content_rowid='id',
+    tokenize='trigram'
+);
+
+-- Index existing names once for databases created before the index
+INSERT INTO files_name_fts (files_name_fts)
+SELECT 'rebuild' WHERE NOT EXISTS (SELECT 1 FROM files_name_fts_docsize);
+
+CREATE TRIGGER IF NOT EXISTS trg_files_fts_insert AFTER INSERT ON files
+BEGIN
+    INSERT INTO files_name_fts (rowid, name) VALUES (NEW.id, NEW.name);
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_fts_rename AFTER UPDATE OF name ON files
+WHEN NEW.name IS NOT OLD.name
+BEGIN
+    INSERT INTO files_name_fts (files_name_fts, rowid, name) VALUES ('delete', OLD.id, OLD.name);
+    INSERT INTO files_name_fts (rowid, name) VALUES (NEW.id, NEW.name);
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_files_fts_delete AFTER DELETE ON files
+BEGIN
+    INSERT INTO files_name_fts (files_name_fts, rowid, name) VALUES ('delete', OLD.id, OLD.name);
+END;
+
 -- Indexes
 CREATE INDEX IF NOT EXISTS idx_files_parent ON files(parent_id);
+CREATE INDEX IF NOT EXISTS idx_files_listing ON files(parent_id, is_directory DESC, name);
 CREATE INDEX IF NOT EXISTS idx_files_owner ON files(owner_id);
 CREATE INDEX IF NOT EXISTS idx_files_name ON files(name COLLATE NOCASE);
-CREATE INDEX IF NOT EXISTS idx_logs_user ON activity_logs(user_id);
 CREATE INDEX IF NOT EXISTS idx_users_admin ON users(is_admin);
+CREATE INDEX IF NOT EXISTS idx_checksums_verified ON blob_checksums(verified_at);
+CREATE INDEX IF NOT EXISTS idx_file_paths_ancestry ON file_paths(ancestry);
 
 -- Create root directory (id=0 represents root)
 INSERT OR IGNORE INTO files (id, parent_id, name, owner_id, is_directory, permissions)
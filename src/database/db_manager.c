@@ -1,17 +1,212 @@
 #include "db_manager.h"
+#include "activity_log.h"
+#include "file_cache.h"
+#include "group_commit.h"
+#include "vfs_snapshot.h"
 #include "../common/utils.h"
+#include "../common/json_buf.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int reader_count = -1;     // -1: one per core
+static int file_cache_entries = DB_FILE_CACHE_DEFAULT_ENTRIES;
+static int group_commit_window_us = DB_GROUP_COMMIT_DEFAULT_US;
+static int group_commit_max = DB_GROUP_COMMIT_DEFAULT_MAX;
+static int activity_retention_months = 0;      // 0: keep every partition
+static int vfs_snapshot_quiet_ms = 0;          // 0: no in-memory snapshot
+
+void db_set_reader_count(int count) {
+    if (count > DB_MAX_READERS) count = DB_MAX_READERS;
+    reader_count = count < 0 ? -1 : count;
+}
+
+void db_set_file_cache_entries(int entries) {
+    file_cache_entries = entries;
+}
+
+void db_set_group_commit(int window_us, int max_writes) {
+    group_commit_window_us = window_us;
+    group_commit_max = max_writes;
+}
+
+void db_set_activity_retention(int months) {
+    activity_retention_months = months > 0 ? months : 0;
+}
+
+void db_set_vfs_snapshot(int quiet_ms) {
+    vfs_snapshot_quiet_ms = quiet_ms;
+}
+
+// Helper: open the read-only connections (the writer already set WAL mode)
+static void open_readers(Database* db, const char* db_path) {
+    int count = reader_count;
+    if (count < 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cores < 2 ? 2 : (cores > DB_MAX_READERS ? DB_MAX_READERS : (int)cores);
+    }
+
+    for (int i = 0; i < count; i++) {
+        sqlite3* reader = NULL;
+        int rc = sqlite3_open_v2(db_path, &reader, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+        if (rc != SQLITE_OK) {
+            log_error("Cannot open read connection: %s", reader ? sqlite3_errmsg(reader) : "out of memory");
+            sqlite3_close(reader);
+            break;
+        }
+        sqlite3_busy_timeout(reader, DB_BUSY_TIMEOUT_MS);
+        db->readers[db->reader_count++] = reader;
+        db->idle[db->idle_count++] = reader;
+    }
+}
+
+// Borrow a read-only connection, waiting if all are busy. Without a pool
+// this is the writer under its mutex.
+static sqlite3* reader_acquire(Database* db) {
+    if (db->reader_count == 0) {
+        pthread_mutex_lock(&db->mutex);
+        return db->conn;
+    }
+
+    pthread_mutex_lock(&db->pool_mutex);
+    while (db->idle_count == 0) {
+        pthread_cond_wait(&db->pool_cond, &db->pool_mutex);
+    }
+    sqlite3* conn = db->idle[--db->idle_count];
+    pthread_mutex_unlock(&db->pool_mutex);
+    return conn;
+}
+
+static void reader_release(Database* db, sqlite3* conn) {
+    if (conn == db->conn) {
+        pthread_mutex_unlock(&db->mutex);
+        return;
+    }
+
+    pthread_mutex_lock(&db->pool_mutex);
+    db->idle[db->idle_count++] = conn;
+    pthread_cond_signal(&db->pool_cond);
+    pthread_mutex_unlock(&db->pool_mutex);
+}
+
+static uint32_t sql_hash(const char* sql) {
+    uint32_t h = 2166136261u;
+    while (*sql) {
+        h = (h ^ (uint8_t)*sql++) * 16777619u;
+    }
+    return h;
+}
+
+static StatementCache* cache_for(Database* db, sqlite3* conn) {
+    if (conn == db->conn) {
+        return &db->writer_cache;
+    }
+    for (int i = 0; i < db->reader_count; i++) {
+        if (db->readers[i] == conn) return &db->reader_caches[i];
+    }
+    return NULL;
+}
+
+// Helper: place a statement in the open-addressing table (no resize)
+static void cache_insert(StatementCache* cache, uint32_t hash, sqlite3_stmt* stmt) {
+    int mask = cache->capacity - 1;
+    int i = (int)(hash & (uint32_t)mask);
+    while (cache->slots[i].stmt) {
+        i = (i + 1) & mask;
+    }
+    cache->slots[i].hash = hash;
+    cache->slots[i].stmt = stmt;
+    cache->count++;
+}
+
+static int cache_grow(StatementCache* cache) {
+    int capacity = cache->capacity ? cache->capacity * 2 : DB_STMT_CACHE_INITIAL;
+    CachedStatement* slots = calloc((size_t)capacity, sizeof(CachedStatement));
+    if (!slots) return -1;
+
+    CachedStatement* old = cache->slots;
+    int old_capacity = cache->capacity;
+    cache->slots = slots;
+    cache->capacity = capacity;
+    cache->count = 0;
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i].stmt) cache_insert(cache, old[i].hash, old[i].stmt);
+    }
+    free(old);
+    return 0;
+}
+
+static void cache_clear(StatementCache* cache) {
+    for (int i = 0; i < cache->capacity; i++) {
+        sqlite3_finalize(cache->slots[i].stmt);
+    }
+    free(cache->slots);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// Get a prepared statement for `sql` on `conn`, reusing the one cached
+// for that connection when there is one. The caller must hold the
+// connection (writer mutex or a borrowed reader) and hand the statement
+// back with stmt_release() instead of finalizing it.
+static int stmt_prepare(Database* db, sqlite3* conn, const char* sql, sqlite3_stmt** stmt) {
+    *stmt = NULL;
+    StatementCache* cache = cache_for(db, conn);
+    uint32_t hash = sql_hash(sql);
+
+    if (cache && cache->capacity > 0) {
+        int mask = cache->capacity - 1;
+        for (int i = (int)(hash & (uint32_t)mask); cache->slots[i].stmt; i = (i + 1) & mask) {
+            if (cache->slots[i].hash == hash && strcmp(sqlite3_sql(cache->slots[i].stmt), sql) == 0) {
+                *stmt = cache->slots[i].stmt;
+                return SQLITE_OK;
+            }
+        }
+    }
+
+    int rc = sqlite3_prepare_v3(conn, sql, -1, SQLITE_PREPARE_PERSISTENT, stmt, NULL);
+    if (rc != SQLITE_OK || !cache) {
+        return rc;
+    }
+
+    // Keep the table at most half full
+    if ((cache->count + 1) * 2 > cache->capacity && cache_grow(cache) < 0) {
+        return rc;      // Statement works, it just isn't cached
+    }
+    cache_insert(cache, hash, *stmt);
+    return rc;
+}
+
+// Reset a statement for its next use; this also ends its read transaction
+static void stmt_release(sqlite3_stmt* stmt) {
+    if (stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+}
+
+// Helper: run a statement with no result (transaction control)
+static int exec_locked(Database* db, const char* sql) {
+    char* err = NULL;
+    if (sqlite3_exec(db->conn, sql, NULL, NULL, &err) != SQLITE_OK) {
+        log_error("%s failed: %s", sql, err ? err : sqlite3_errmsg(db->conn));
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
 
 Database* db_init(const char* db_path) {
-    Database* db = malloc(sizeof(Database));
+    Database* db = calloc(1, sizeof(Database));
     if (!db) {
         log_error("Failed to allocate database structure");
         return NULL;
     }
 
     pthread_mutex_init(&db->mutex, NULL);
+    pthread_mutex_init(&db->pool_mutex, NULL);
+    pthread_cond_init(&db->pool_cond, NULL);
 
     int rc = sqlite3_open(db_path, &db->conn);
     if (rc != SQLITE_OK) {
@@ -22,24 +217,329 @@ Database* db_init(const char* db_path) {
 
     // Enable WAL mode for better concurrency
     sqlite3_exec(db->conn, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
+    sqlite3_busy_timeout(db->conn, DB_BUSY_TIMEOUT_MS);
+
+    open_readers(db, db_path);
+    db->file_cache = file_cache_create(file_cache_entries);
 
-    log_info("Database opened: %s", db_path);
+    // Without read connections, reads would see a group's uncommitted writes
+    if (db->reader_count > 0) {
+        db->group_commit = group_commit_create(group_commit_window_us, group_commit_max);
+    }
+    db->vfs = vfs_tree_create(db->conn, db_path, vfs_snapshot_quiet_ms);
+
+    log_info("Database opened: %s (%d read connections)", db_path, db->reader_count);
     return db;
 }
 
 void db_close(Database* db) {
     if (db) {
-        pthread_mutex_lock(&db->mutex);
+        activity_writer_free(db->activity);
+        db->activity = NULL;
+
+        write_lock(db);
+        vfs_tree_free(db->vfs);
+        for (int i = 0; i < db->reader_count; i++) {
+            cache_clear(&db->reader_caches[i]);
+            sqlite3_close(db->readers[i]);
+        }
+        cache_clear(&db->writer_cache);
         if (db->conn) {
             sqlite3_close(db->conn);
         }
-        pthread_mutex_unlock(&db->mutex);
+        write_unlock(db);
         pthread_mutex_destroy(&db->mutex);
+        pthread_mutex_destroy(&db->pool_mutex);
+        pthread_cond_destroy(&db->pool_cond);
+        file_cache_free(db->file_cache);
+        group_commit_free(db->group_commit);
         free(db);
         log_info("Database closed");
     }
 }
 
+// Activity partitions: one activity_logs_YYYYMM table per UTC month, with
+// action names stored once in activity_actions. The activity_logs view
+// joins them all back into the old shape for ad-hoc queries.
+
+// Helper: "YYYYMM" of a "YYYY-MM-DD ..." timestamp (the current month if malformed)
+static void timestamp_month(const char* timestamp, char* month) {
+    int valid = timestamp && strlen(timestamp) >= 7 && timestamp[4] == '-';
+    for (int i = 0; valid && i < 7; i++) {
+        if (i != 4 && (timestamp[i] < '0' || timestamp[i] > '9')) valid = 0;
+    }
+    if (valid) {
+        memcpy(month, timestamp, 4);
+        memcpy(month + 4, timestamp + 5, 2);
+        month[6] = '\0';
+        return;
+    }
+
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(month, 7, "%Y%m", &tm);
+}
+
+// Helper: months that have a partition, oldest first (caller frees)
+static int list_activity_months(Database* db, sqlite3* conn, char (**months)[8], int* count) {
+    *months = NULL;
+    *count = 0;
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT substr(name, 15) FROM sqlite_master WHERE type = 'table' "
+                      "AND name GLOB 'activity_logs_[0-9][0-9][0-9][0-9][0-9][0-9]' ORDER BY name";
+    if (stmt_prepare(db, conn, sql, &stmt) != SQLITE_OK) {
+        return -1;
+    }
+
+    int capacity = 0;
+    int result = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            char (*grown)[8] = realloc(*months, (size_t)capacity * sizeof(**months));
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            *months = grown;
+        }
+        snprintf((*months)[(*count)++], 8, "%s", (const char*)sqlite3_column_text(stmt, 0));
+    }
+    stmt_release(stmt);
+
+    if (result < 0) {
+        free(*months);
+        *months = NULL;
+        *count = 0;
+    }
+    return result;
+}
+
+// Helper: point the activity_logs view at the current partitions (writer)
+static int rebuild_activity_view(Database* db) {
+    char (*months)[8];
+    int count;
+    if (list_activity_months(db, db->conn, &months, &count) < 0) {
+        return -1;
+    }
+
+    sqlite3_str* sql = sqlite3_str_new(db->conn);
+    sqlite3_str_appendall(sql, "DROP VIEW IF EXISTS activity_logs; CREATE VIEW activity_logs AS ");
+    for (int i = 0; i < count; i++) {
+        sqlite3_str_appendf(sql, "%sSELECT l.id, l.user_id, a.name AS action_type, l.description, l.timestamp "
+                                 "FROM activity_logs_%s l JOIN activity_actions a ON a.code = l.action",
+                            i > 0 ? " UNION ALL " : "", months[i]);
+    }
+    if (count == 0) {
+        sqlite3_str_appendall(sql, "SELECT NULL AS id, NULL AS user_id, NULL AS action_type, "
+                                   "NULL AS description, NULL AS timestamp WHERE 0");
+    }
+    free(months);
+
+    char* text = sqlite3_str_finish(sql);
+    int result = text ? exec_locked(db, text) : -1;
+    sqlite3_free(text);
+    return result;
+}
+
+// Helper: drop the partitions of months before `first_kept`; returns how many went (writer)
+static int drop_activity_partitions(Database* db, const char* first_kept) {
+    char (*months)[8];
+    int count;
+    if (list_activity_months(db, db->conn, &months, &count) < 0) {
+        return -1;
+    }
+
+    int dropped = 0;
+    for (int i = 0; i < count && strcmp(months[i], first_kept) < 0; i++) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "DROP TABLE activity_logs_%s", months[i]);
+        if (exec_locked(db, sql) < 0) {
+            dropped = -1;
+            break;
+        }
+        dropped++;
+    }
+    free(months);
+
+    if (strcmp(db->activity_parts.month, first_kept) < 0) {
+        db->activity_parts.month[0] = '\0';
+    }
+    return dropped;
+}
+
+// Helper: first month the retention setting keeps, as YYYYMM
+static void retention_cutoff(char* month, size_t size) {
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    int index = tm.tm_year * 12 + tm.tm_mon - (activity_retention_months - 1);
+    tm.tm_year = index / 12;
+    tm.tm_mon = index % 12;
+    strftime(month, size, "%Y%m", &tm);
+}
+
+// Helper: create the month's partition unless it exists. Opening a new
+// month also applies retention. Caller holds a transaction on the writer.
+static int ensure_activity_partition(Database* db, const char* month) {
+    if (strcmp(month, db->activity_parts.month) == 0) {
+        return 0;
+    }
+
+    char table[32];
+    snprintf(table, sizeof(table), "activity_logs_%s", month);
+
+    sqlite3_stmt* stmt;
+    if (stmt_prepare(db, db->conn, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?",
+                     &stmt) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    int exists = sqlite3_step(stmt) == SQLITE_ROW;
+    stmt_release(stmt);
+
+    if (!exists) {
+        char sql[1024];
+        snprintf(sql, sizeof(sql),
+                 "CREATE TABLE %s ("
+                 "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                 "  user_id INTEGER NOT NULL,"
+                 "  action INTEGER NOT NULL,"
+                 "  description TEXT,"
+                 "  timestamp TEXT NOT NULL,"
+                 "  FOREIGN KEY (user_id) REFERENCES users(id));"
+                 "CREATE INDEX idx_logs_%s_time ON %s(timestamp);"
+                 "CREATE INDEX idx_logs_%s_user ON %s(user_id, timestamp);"
+                 "CREATE INDEX idx_logs_%s_action ON %s(action, timestamp)",
+                 table, month, table, month, table, month, table);
+        if (exec_locked(db, sql) < 0) {
+            return -1;
+        }
+
+        int newest = strcmp(month, db->activity_parts.month) > 0;
+        if (newest && activity_retention_months > 0) {
+            char first_kept[8];
+            retention_cutoff(first_kept, sizeof(first_kept));
+            if (drop_activity_partitions(db, first_kept) < 0) {
+                return -1;
+            }
+        }
+        if (rebuild_activity_view(db) < 0) {
+            return -1;
+        }
+        log_info("Created activity partition %s", table);
+    }
+
+    if (strcmp(month, db->activity_parts.month) > 0) {
+        snprintf(db->activity_parts.month, sizeof(db->activity_parts.month), "%s", month);
+    }
+    return 0;
+}
+
+// Helper: move the rows of the old single activity_logs table into
+// partitions (writer, inside a transaction)
+static int migrate_activity_logs(Database* db) {
+    sqlite3_stmt* stmt;
+    if (stmt_prepare(db, db->conn, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'activity_logs'",
+                     &stmt) != SQLITE_OK) {
+        return -1;
+    }
+    int legacy = sqlite3_step(stmt) == SQLITE_ROW;
+    stmt_release(stmt);
+    if (!legacy) {
+        return 0;
+    }
+
+    // Out of the way of the view; its ID sequence comes along
+    if (exec_locked(db, "ALTER TABLE activity_logs RENAME TO activity_logs_old") < 0 ||
+        exec_locked(db, "INSERT OR IGNORE INTO activity_actions (name) "
+                        "SELECT DISTINCT action_type FROM activity_logs_old") < 0) {
+        return -1;
+    }
+
+    // Rows without a readable timestamp count as this month's
+    char (*months)[8] = NULL;
+    int count = 0;
+    int capacity = 0;
+    const char* month_sql = "SELECT DISTINCT COALESCE(strftime('%Y%m', timestamp), strftime('%Y%m', 'now')) "
+                            "FROM activity_logs_old";
+    if (stmt_prepare(db, db->conn, month_sql, &stmt) != SQLITE_OK) {
+        return -1;
+    }
+    int result = 0;
+    while (result == 0 && sqlite3_step(stmt) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            char (*grown)[8] = realloc(months, (size_t)capacity * sizeof(*months));
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            months = grown;
+        }
+        snprintf(months[count++], 8, "%s", (const char*)sqlite3_column_text(stmt, 0));
+    }
+    stmt_release(stmt);
+
+    for (int i = 0; i < count && result == 0; i++) {
+        char sql[512];
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO activity_logs_%s (id, user_id, action, description, timestamp) "
+                 "SELECT l.id, l.user_id, a.code, l.description, COALESCE(l.timestamp, CURRENT_TIMESTAMP) "
+                 "FROM activity_logs_old l JOIN activity_actions a ON a.name = l.action_type "
+                 "WHERE COALESCE(strftime('%%Y%%m', l.timestamp), strftime('%%Y%%m', 'now')) = '%s'",
+                 months[i], months[i]);
+        if (ensure_activity_partition(db, months[i]) < 0 || exec_locked(db, sql) < 0) {
+            result = -1;
+        }
+    }
+    free(months);
+
+    if (result == 0) {
+        result = exec_locked(db, "DROP TABLE activity_logs_old");
+    }
+    if (result == 0) {
+        log_info("Moved activity_logs into %d monthly partitions", count);
+    }
+    return result;
+}
+
+// Helper: migrate, open this month's partition and apply retention
+static int init_activity_partitions(Database* db) {
+    char month[8];
+    timestamp_month(NULL, month);
+
+    write_lock(db);
+
+    int result = exec_locked(db, "BEGIN");
+    if (result == 0) {
+        result = migrate_activity_logs(db);
+        if (result == 0) {
+            result = ensure_activity_partition(db, month);
+        }
+        if (result == 0 && activity_retention_months > 0) {
+            char first_kept[8];
+            retention_cutoff(first_kept, sizeof(first_kept));
+            result = drop_activity_partitions(db, first_kept) < 0 ? -1 : 0;
+        }
+        if (result == 0) {
+            result = rebuild_activity_view(db);
+        }
+        if (result == 0) {
+            result = exec_locked(db, "COMMIT");
+        }
+        if (result < 0) {
+            exec_locked(db, "ROLLBACK");
+            memset(&db->activity_parts, 0, sizeof(db->activity_parts));
+        }
+    }
+
+    write_unlock(db);
+    return result;
+}
+
 int db_init_schema(Database* db, const char* schema_path) {
     FILE* f = fopen(schema_path, "r");
     if (!f) {
@@ -57,12 +557,12 @@ int db_init_schema(Database* db, const char* schema_path) {
     sql[size] = '\0';
     fclose(f);
 
-    pthread_mutex_lock(&db->mutex);
+    write_lock(db);
 
     char* err_msg = NULL;
     int rc = sqlite3_exec(db->conn, sql, NULL, NULL, &err_msg);
 
-    pthread_mutex_unlock(&db->mutex);
+    write_unlock(db);
 
     if (rc != SQLITE_OK) {
         log_error("Schema execution failed: %s", err_msg);
@@ -72,19 +572,28 @@ int db_init_schema(Database* db, const char* schema_path) {
     }
 
     free(sql);
+
+    if (init_activity_partitions(db) < 0) {
+        log_error("Activity log partitions could not be set up");
+        return -1;
+    }
+
+    // Tables may have been created or backfilled: read them again
+    vfs_tree_changed(db->vfs);
+
     log_info("Database schema initialized");
     return 0;
 }
 
 int db_create_user(Database* db, const char* username, const char* password_hash) {
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "INSERT INTO users (username, password_hash) VALUES (?, ?)";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -94,8 +603,8 @@ int db_create_user(Database* db, const char* username, const char* password_hash
     rc = sqlite3_step(stmt);
     int user_id = (rc == SQLITE_DONE) ? (int)sqlite3_last_insert_rowid(db->conn) : -1;
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    user_id = write_end(db, group, user_id);
 
     if (user_id > 0) {
         log_info("Created user: %s (id=%d)", username, user_id);
@@ -105,14 +614,14 @@ int db_create_user(Database* db, const char* username, const char* password_hash
 }
 
 int db_verify_user(Database* db, const char* username, const char* password_hash, int* user_id) {
-    pthread_mutex_lock(&db->mutex);
+    sqlite3* conn = reader_acquire(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "SELECT id FROM users WHERE username = ? AND password_hash = ? AND is_active = 1";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        reader_release(db, conn);
         return -1;
     }
 
@@ -127,21 +636,21 @@ int db_verify_user(Database* db, const char* username, const char* password_hash
         result = 0;  // Success
     }
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    reader_release(db, conn);
 
     return result;
 }
 
 int db_get_user_by_id(Database* db, int user_id, char* username, int username_size) {
-    pthread_mutex_lock(&db->mutex);
+    sqlite3* conn = reader_acquire(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "SELECT username FROM users WHERE id = ?";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        reader_release(db, conn);
         return -1;
     }
 
@@ -157,21 +666,21 @@ int db_get_user_by_id(Database* db, int user_id, char* username, int username_si
         result = 0;
     }
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    reader_release(db, conn);
 
     return result;
 }
 
 int db_user_exists(Database* db, const char* username) {
-    pthread_mutex_lock(&db->mutex);
+    sqlite3* conn = reader_acquire(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "SELECT 1 FROM users WHERE username = ?";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        reader_release(db, conn);
         return -1;
     }
 
@@ -180,150 +689,171 @@ int db_user_exists(Database* db, const char* username) {
     rc = sqlite3_step(stmt);
     int exists = (rc == SQLITE_ROW) ? 1 : 0;
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    reader_release(db, conn);
 
     return exists;
 }
 
 int db_log_activity(Database* db, int user_id, const char* action_type, const char* description) {
-    pthread_mutex_lock(&db->mutex);
-
-    sqlite3_stmt* stmt;
-    const char* sql = "INSERT INTO activity_logs (user_id, action_type, description) VALUES (?, ?, ?)";
-
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
-        return -1;
+    if (db->activity) {
+        int queued = activity_enqueue(db->activity, user_id, action_type, description);
+        if (queued <= 0) {
+            return queued;
+        }
+        // Spilled: write it here
     }
 
-    sqlite3_bind_int(stmt, 1, user_id);
-    sqlite3_bind_text(stmt, 2, action_type, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, description ? description : "", -1, SQLITE_STATIC);
-
-    rc = sqlite3_step(stmt);
-    int result = (rc == SQLITE_DONE) ? 0 : -1;
-
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    ActivityRecord record;
+    record.user_id = user_id;
+    snprintf(record.action_type, sizeof(record.action_type), "%s", action_type);
+    record.description = (char*)description;
+    activity_timestamp(record.timestamp, sizeof(record.timestamp));
 
-    return result;
+    return db_insert_activity(db, &record, 1);
 }
 
-int db_list_activity_logs(Database* db, int user_id_filter, const char* action_type_filter,
-                          const char* start_date, const char* end_date,
-                          int limit, char** json_result) {
-    pthread_mutex_lock(&db->mutex);
-
-    // Build dynamic SQL query with filters
+// Helper: append one partition's matches, newest first, to `buf`. Returns
+// the number of rows added or -1.
+static int list_activity_partition(Database* db, sqlite3* conn, const char* month, int user_id_filter,
+                                   const char* action_pattern, const char* start_date,
+                                   const char* end_time, int limit, JsonBuf* buf) {
     char sql[1024];
-    strcpy(sql, "SELECT al.id, al.user_id, u.username, al.action_type, "
-                "al.description, al.timestamp "
-                "FROM activity_logs al "
-                "LEFT JOIN users u ON al.user_id = u.id WHERE 1=1");
-
-    // Add filters to SQL
-    if (user_id_filter > 0) {
-        strcat(sql, " AND al.user_id = ?");
-    }
-    if (action_type_filter && strlen(action_type_filter) > 0) {
-        strcat(sql, " AND al.action_type LIKE ?");
-    }
-    if (start_date && strlen(start_date) > 0) {
-        strcat(sql, " AND al.timestamp >= ?");
-    }
-    if (end_date && strlen(end_date) > 0) {
-        strcat(sql, " AND al.timestamp <= ?");
-    }
-
-    strcat(sql, " ORDER BY al.timestamp DESC LIMIT ?");
+    snprintf(sql, sizeof(sql),
+             "SELECT l.id, l.user_id, u.username, a.name, l.description, l.timestamp "
+             "FROM activity_logs_%s l JOIN activity_actions a ON a.code = l.action "
+             "LEFT JOIN users u ON l.user_id = u.id WHERE 1=1%s%s%s%s "
+             "ORDER BY l.timestamp DESC, l.id DESC LIMIT ?",
+             month,
+             user_id_filter > 0 ? " AND l.user_id = ?" : "",
+             action_pattern ? " AND l.action IN (SELECT code FROM activity_actions WHERE name LIKE ?)" : "",
+             start_date ? " AND l.timestamp >= ?" : "",
+             end_time ? " AND l.timestamp <= ?" : "");
 
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+    if (stmt_prepare(db, conn, sql, &stmt) != SQLITE_OK) {
         return -1;
     }
 
-    // Bind parameters based on filters
     int param_index = 1;
     if (user_id_filter > 0) {
         sqlite3_bind_int(stmt, param_index++, user_id_filter);
     }
-    if (action_type_filter && strlen(action_type_filter) > 0) {
-        char pattern[256];
-        snprintf(pattern, sizeof(pattern), "%%%s%%", action_type_filter);
-        sqlite3_bind_text(stmt, param_index++, pattern, -1, SQLITE_TRANSIENT);
+    if (action_pattern) {
+        sqlite3_bind_text(stmt, param_index++, action_pattern, -1, SQLITE_STATIC);
     }
-    if (start_date && strlen(start_date) > 0) {
+    if (start_date) {
         sqlite3_bind_text(stmt, param_index++, start_date, -1, SQLITE_STATIC);
     }
-    if (end_date && strlen(end_date) > 0) {
-        char end_with_time[32];
-        snprintf(end_with_time, sizeof(end_with_time), "%s 23:59:59", end_date);
-        sqlite3_bind_text(stmt, param_index++, end_with_time, -1, SQLITE_TRANSIENT);
+    if (end_time) {
+        sqlite3_bind_text(stmt, param_index++, end_time, -1, SQLITE_STATIC);
     }
     sqlite3_bind_int(stmt, param_index++, limit);
 
-    // Build JSON result (allocate larger buffer for logs)
-    char* buffer = malloc(65536);  // 64KB for log entries
-    if (!buffer) {
-        sqlite3_finalize(stmt);
-        pthread_mutex_unlock(&db->mutex);
-        return -1;
-    }
-
-    strcpy(buffer, "[");
-    int first = 1;
-
+    int rows = 0;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        if (!first) strcat(buffer, ",");
-        first = 0;
-
-        int id = sqlite3_column_int(stmt, 0);
-        int user_id = sqlite3_column_int(stmt, 1);
         const char* username = (const char*)sqlite3_column_text(stmt, 2);
-        const char* action_type = (const char*)sqlite3_column_text(stmt, 3);
         const char* description = (const char*)sqlite3_column_text(stmt, 4);
         const char* timestamp = (const char*)sqlite3_column_text(stmt, 5);
 
-        // Handle NULL values
-        if (!username) username = "unknown";
-        if (!action_type) action_type = "";
-        if (!description) description = "";
-        if (!timestamp) timestamp = "";
+        json_buf_append(buf, buf->len > 1 ? ",{\"id\":" : "{\"id\":");
+        json_buf_number(buf, sqlite3_column_int(stmt, 0));
+        json_buf_append(buf, ",\"user_id\":");
+        json_buf_number(buf, sqlite3_column_int(stmt, 1));
+        json_buf_append(buf, ",\"username\":");
+        json_buf_string(buf, username ? username : "unknown");
+        json_buf_append(buf, ",\"action_type\":");
+        json_buf_string(buf, (const char*)sqlite3_column_text(stmt, 3));
+        json_buf_append(buf, ",\"description\":");
+        json_buf_string(buf, description ? description : "");
+        json_buf_append(buf, ",\"timestamp\":");
+        json_buf_string(buf, timestamp ? timestamp : "");
+        json_buf_append(buf, "}");
+        rows++;
+    }
+    stmt_release(stmt);
+    return rows;
+}
 
-        char entry[2048];
-        snprintf(entry, sizeof(entry),
-                 "{\"id\":%d,\"user_id\":%d,\"username\":\"%s\","
-                 "\"action_type\":\"%s\",\"description\":\"%s\","
-                 "\"timestamp\":\"%s\"}",
-                 id, user_id, username, action_type, description, timestamp);
-        strcat(buffer, entry);
+int db_list_activity_logs(Database* db, int user_id_filter, const char* action_type_filter,
+                          const char* start_date, const char* end_date,
+                          int limit, char** json_result) {
+    db_flush_activity(db);
+
+    if (action_type_filter && !*action_type_filter) action_type_filter = NULL;
+    if (start_date && !*start_date) start_date = NULL;
+    if (end_date && !*end_date) end_date = NULL;
+
+    char action_pattern[256];
+    if (action_type_filter) {
+        snprintf(action_pattern, sizeof(action_pattern), "%%%s%%", action_type_filter);
+    }
+    char end_time[32];
+    if (end_date) {
+        snprintf(end_time, sizeof(end_time), "%s 23:59:59", end_date);
     }
 
-    strcat(buffer, "]");
+    // Only the partitions of months the date range touches are read
+    char first_month[8] = "000000";
+    char last_month[8] = "999999";
+    if (start_date) timestamp_month(start_date, first_month);
+    if (end_date) timestamp_month(end_date, last_month);
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    sqlite3* conn = reader_acquire(db);
 
-    *json_result = buffer;
+    char (*months)[8];
+    int count;
+    if (list_activity_months(db, conn, &months, &count) < 0) {
+        reader_release(db, conn);
+        return -1;
+    }
+
+    JsonBuf buf;
+    json_buf_init(&buf);
+    json_buf_append(&buf, "[");
+
+    // Newest partition first, so rows come out in timestamp order across them
+    int remaining = limit;
+    int result = 0;
+    for (int i = count - 1; i >= 0 && remaining != 0 && result == 0; i--) {
+        if (strcmp(months[i], first_month) < 0 || strcmp(months[i], last_month) > 0) {
+            continue;
+        }
+        int rows = list_activity_partition(db, conn, months[i], user_id_filter,
+                                           action_type_filter ? action_pattern : NULL, start_date,
+                                           end_date ? end_time : NULL, remaining, &buf);
+        if (rows < 0) {
+            result = -1;
+        } else if (remaining > 0) {
+            remaining -= rows;
+        }
+    }
+
+    reader_release(db, conn);
+    free(months);
+
+    json_buf_append(&buf, "]");
+    if (result < 0 || buf.failed) {
+        json_buf_free(&buf);
+        return -1;
+    }
+
+    *json_result = buf.data;
     return 0;
 }
 
 // File operations - stub implementations for Phase 4
 int db_create_file(Database* db, int parent_id, const char* name, const char* physical_path,
                    int owner_id, long size, int is_directory, int permissions) {
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "INSERT INTO files (parent_id, name, physical_path, owner_id, size, is_directory, permissions) "
                       "VALUES (?, ?, ?, ?, ?, ?, ?)";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -354,31 +884,391 @@ int db_create_file(Database* db, int parent_id, const char* name, const char* ph
                   parent_id, name, owner_id, is_directory);
     }
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    file_id = write_end(db, group, file_id);
 
     return file_id;
 }
 
-int db_get_file_by_id(Database* db, int file_id, FileEntry* entry) {
-    pthread_mutex_lock(&db->mutex);
-
-    sqlite3_stmt* stmt;
-    const char* sql = "SELECT id, parent_id, name, physical_path, owner_id, size, is_directory, permissions, created_at "
-                      "FROM files WHERE id = ?";
+// Helper: insert the rows of an import batch (caller holds the transaction)
+static int import_rows(Database* db, int owner_id, ImportEntry* entries, int count) {
+    sqlite3_stmt* insert;
+    sqlite3_stmt* encoding;
+    const char* insert_sql = "INSERT INTO files (parent_id, name, physical_path, owner_id, size, is_directory, permissions) "
+                             "VALUES (?, ?, ?, ?, ?, ?, ?)";
+    const char* encoding_sql = "INSERT OR REPLACE INTO blob_encoding (physical_path, encoding, stored_size) "
+                               "VALUES (?, ?, ?)";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+    if (stmt_prepare(db, db->conn, insert_sql, &insert) != SQLITE_OK) {
+        log_error("db_import_entries: prepare failed: %s", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+    if (stmt_prepare(db, db->conn, encoding_sql, &encoding) != SQLITE_OK) {
+        log_error("db_import_entries: prepare failed: %s", sqlite3_errmsg(db->conn));
+        stmt_release(insert);
         return -1;
     }
 
-    sqlite3_bind_int(stmt, 1, file_id);
+    int result = 0;
+    for (int i = 0; i < count && result == 0; i++) {
+        ImportEntry* e = &entries[i];
+        if (e->parent_index >= i) {
+            log_error("db_import_entries: entry %d has a later parent", i);
+            result = -1;
+            break;
+        }
+        int parent_id = e->parent_index >= 0 ? entries[e->parent_index].id : e->parent_id;
 
-    rc = sqlite3_step(stmt);
+        sqlite3_reset(insert);
+        sqlite3_bind_int(insert, 1, parent_id);
+        sqlite3_bind_text(insert, 2, e->name, -1, SQLITE_STATIC);
+        if (e->physical_path[0] != '\0') {
+            sqlite3_bind_text(insert, 3, e->physical_path, -1, SQLITE_STATIC);
+        } else {
+            sqlite3_bind_null(insert, 3);
+        }
+        sqlite3_bind_int(insert, 4, owner_id);
+        sqlite3_bind_int64(insert, 5, e->size);
+        sqlite3_bind_int(insert, 6, e->is_directory);
+        sqlite3_bind_int(insert, 7, e->permissions);
+
+        if (sqlite3_step(insert) != SQLITE_DONE) {
+            log_error("db_import_entries: insert of '%s' failed: %s", e->name, sqlite3_errmsg(db->conn));
+            result = -1;
+            break;
+        }
+        e->id = (int)sqlite3_last_insert_rowid(db->conn);
+
+        if (e->encoding) {
+            sqlite3_reset(encoding);
+            sqlite3_bind_text(encoding, 1, e->physical_path, -1, SQLITE_STATIC);
+            sqlite3_bind_text(encoding, 2, e->encoding, -1, SQLITE_STATIC);
+            sqlite3_bind_int64(encoding, 3, e->stored_size);
+            if (sqlite3_step(encoding) != SQLITE_DONE) {
+                log_error("db_import_entries: encoding of '%s' failed: %s", e->name, sqlite3_errmsg(db->conn));
+                result = -1;
+            }
+        }
+    }
+
+    stmt_release(insert);
+    stmt_release(encoding);
+    return result;
+}
+
+// Insert a batch of files and directories (and the encoding rows of
+// compressed blobs) in one transaction. Entries may name an earlier entry
+// of the batch as their parent. All or nothing: on failure no row remains.
+int db_import_entries(Database* db, int owner_id, ImportEntry* entries, int count) {
+    if (!db || !entries || count < 0) return -1;
+    if (count == 0) return 0;
+
+    write_lock(db);
+
+    int result = exec_locked(db, "BEGIN");
+    if (result == 0) {
+        result = import_rows(db, owner_id, entries, count);
+        if (result == 0) {
+            result = exec_locked(db, "COMMIT");
+        }
+        if (result < 0) {
+            exec_locked(db, "ROLLBACK");
+            for (int i = 0; i < count; i++) {
+                entries[i].id = 0;
+            }
+        }
+    }
+
+    write_unlock(db);
+    return result;
+}
+
+// Helper: insert the checksum rows of an import batch (caller holds the transaction)
+static int import_checksum_rows(Database* db, const ImportEntry* entries, int count, int chunk_size) {
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT OR REPLACE INTO blob_checksums "
+                      "(physical_path, chunk_size, crcs, verified_at, corrupt) "
+                      "VALUES (?, ?, ?, strftime('%s','now'), 0)";
+
+    if (stmt_prepare(db, db->conn, sql, &stmt) != SQLITE_OK) {
+        log_error("db_import_checksums: prepare failed: %s", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+
+    uint8_t* blob = NULL;
+    int cap = 0;
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        const ImportEntry* e = &entries[i];
+        if (!e->crcs || e->physical_path[0] == '\0') continue;
+
+        // Stored little-endian regardless of host order
+        if (e->crc_count > cap) {
+            uint8_t* grown = realloc(blob, (size_t)e->crc_count * 4);
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            blob = grown;
+            cap = e->crc_count;
+        }
+        for (int c = 0; c < e->crc_count; c++) {
+            blob[c * 4] = e->crcs[c] & 0xFF;
+            blob[c * 4 + 1] = (e->crcs[c] >> 8) & 0xFF;
+            blob[c * 4 + 2] = (e->crcs[c] >> 16) & 0xFF;
+            blob[c * 4 + 3] = (e->crcs[c] >> 24) & 0xFF;
+        }
+
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, e->physical_path, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, chunk_size);
+        sqlite3_bind_blob(stmt, 3, blob, e->crc_count * 4, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            log_error("db_import_checksums: insert failed: %s", sqlite3_errmsg(db->conn));
+            result = -1;
+            break;
+        }
+    }
+
+    stmt_release(stmt);
+    free(blob);
+    return result;
+}
+
+// Record the chunk checksums of a batch of freshly written blobs in one
+// transaction (entries without checksums are skipped)
+int db_import_checksums(Database* db, const ImportEntry* entries, int count, int chunk_size) {
+    if (!db || !entries || count < 0 || chunk_size <= 0) return -1;
+
+    write_lock(db);
+
+    int result = exec_locked(db, "BEGIN");
+    if (result == 0) {
+        result = import_checksum_rows(db, entries, count, chunk_size);
+        if (result == 0) {
+            result = exec_locked(db, "COMMIT");
+        }
+        if (result < 0) {
+            exec_locked(db, "ROLLBACK");
+        }
+    }
+
+    write_unlock(db);
+    return result;
+}
+
+// Helper: code of an action name, added on first use (caller holds the transaction)
+static int activity_action_code(Database* db, const char* name) {
+    ActivityPartitions* parts = &db->activity_parts;
+    for (int i = 0; i < parts->action_count; i++) {
+        if (strcmp(parts->actions[i].name, name) == 0) {
+            return parts->actions[i].code;
+        }
+    }
+
+    sqlite3_stmt* stmt;
+    if (stmt_prepare(db, db->conn, "SELECT code FROM activity_actions WHERE name = ?", &stmt) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    int code = (sqlite3_step(stmt) == SQLITE_ROW) ? sqlite3_column_int(stmt, 0) : -1;
+    stmt_release(stmt);
+
+    if (code < 0) {
+        if (stmt_prepare(db, db->conn, "INSERT INTO activity_actions (name) VALUES (?)", &stmt) != SQLITE_OK) {
+            return -1;
+        }
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_DONE) {
+            code = (int)sqlite3_last_insert_rowid(db->conn);
+        } else {
+            log_error("db_insert_activity: action insert failed: %s", sqlite3_errmsg(db->conn));
+        }
+        stmt_release(stmt);
+    }
+
+    if (code >= 0 && parts->action_count < DB_ACTIVITY_ACTIONS_CACHED) {
+        snprintf(parts->actions[parts->action_count].name, sizeof(parts->actions[0].name), "%s", name);
+        parts->actions[parts->action_count++].code = code;
+    }
+    return code;
+}
+
+// Helper: next log ID. IDs stay unique across partitions: one past the
+// highest any of them has used.
+static long long activity_next_id(Database* db) {
+    ActivityPartitions* parts = &db->activity_parts;
+    if (parts->next_id == 0) {
+        sqlite3_stmt* stmt;
+        const char* sql = "SELECT COALESCE(MAX(seq), 0) + 1 FROM sqlite_sequence WHERE name GLOB 'activity_logs*'";
+        if (stmt_prepare(db, db->conn, sql, &stmt) != SQLITE_OK) {
+            return -1;
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            parts->next_id = sqlite3_column_int64(stmt, 0);
+        }
+        stmt_release(stmt);
+        if (parts->next_id == 0) {
+            return -1;
+        }
+    }
+    return parts->next_id++;
+}
+
+// Helper: insert one record into its month's partition (caller holds the transaction)
+static int insert_activity_row(Database* db, const ActivityRecord* record) {
+    char month[8];
+    timestamp_month(record->timestamp, month);
+    int action = activity_action_code(db, record->action_type);
+    if (action < 0 || ensure_activity_partition(db, month) < 0) {
+        return -1;
+    }
+    long long id = activity_next_id(db);
+    if (id < 0) {
+        return -1;
+    }
+
+    char sql[256];
+    snprintf(sql, sizeof(sql),
+             "INSERT INTO activity_logs_%s (id, user_id, action, description, timestamp) "
+             "VALUES (?, ?, ?, ?, ?)", month);
+    sqlite3_stmt* stmt;
+    if (stmt_prepare(db, db->conn, sql, &stmt) != SQLITE_OK) {
+        log_error("db_insert_activity: prepare failed: %s", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, id);
+    sqlite3_bind_int(stmt, 2, record->user_id);
+    sqlite3_bind_int(stmt, 3, action);
+    sqlite3_bind_text(stmt, 4, record->description ? record->description : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, record->timestamp, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    stmt_release(stmt);
+    if (rc != SQLITE_DONE) {
+        log_error("db_insert_activity: insert failed: %s", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+    return 0;
+}
+
+static int insert_activity_rows(Database* db, const ActivityRecord* records, int count) {
+    for (int i = 0; i < count; i++) {
+        if (insert_activity_row(db, &records[i]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int db_insert_activity(Database* db, const ActivityRecord* records, int count) {
+    if (count <= 0) return 0;
+
+    write_lock(db);
+
+    int result = exec_locked(db, "BEGIN");
+    if (result == 0) {
+        result = insert_activity_rows(db, records, count);
+        if (result == 0) {
+            result = exec_locked(db, "COMMIT");
+        }
+        if (result < 0) {
+            exec_locked(db, "ROLLBACK");
+            memset(&db->activity_parts, 0, sizeof(db->activity_parts));
+        }
+    }
+
+    write_unlock(db);
+    return result;
+}
+
+int db_prune_activity(Database* db) {
+    if (activity_retention_months <= 0) return 0;
+
+    char first_kept[8];
+    retention_cutoff(first_kept, sizeof(first_kept));
+
+    write_lock(db);
+
+    int dropped = exec_locked(db, "BEGIN");
+    if (dropped == 0) {
+        dropped = drop_activity_partitions(db, first_kept);
+        if (dropped > 0 && rebuild_activity_view(db) < 0) {
+            dropped = -1;
+        }
+        if (dropped >= 0 && exec_locked(db, "COMMIT") < 0) {
+            dropped = -1;
+        }
+        if (dropped < 0) {
+            exec_locked(db, "ROLLBACK");
+            memset(&db->activity_parts, 0, sizeof(db->activity_parts));
+        }
+    }
+
+    write_unlock(db);
+
+    if (dropped > 0) {
+        log_info("Dropped %d activity partitions before %s", dropped, first_kept);
+    }
+    return dropped;
+}
+
+// Helper: FileEntry of a snapshot node
+static void snapshot_entry(const VfsSnapshot* snap, const VfsNode* node, FileEntry* entry) {
+    memset(entry, 0, sizeof(*entry));
+    entry->id = node->id;
+    entry->parent_id = node->parent_id;
+    strncpy(entry->name, vfs_str(snap, node->name), sizeof(entry->name) - 1);
+    strncpy(entry->physical_path, vfs_str(snap, node->physical_path), sizeof(entry->physical_path) - 1);
+    entry->owner_id = node->owner_id;
+    entry->size = node->size;
+    entry->is_directory = node->is_directory;
+    entry->permissions = node->permissions;
+    strncpy(entry->created_at, vfs_str(snap, node->created_at), sizeof(entry->created_at) - 1);
+}
+
+int db_vfs_snapshot_current(Database* db) {
+    int slot;
+    const VfsSnapshot* snap = vfs_pin(db->vfs, &slot);
+    if (!snap) return 0;
+    vfs_unpin(db->vfs, slot);
+    return 1;
+}
+
+int db_get_file_by_id(Database* db, int file_id, FileEntry* entry) {
+    // A current snapshot answers without touching SQLite or any lock
+    int slot;
+    const VfsSnapshot* snap = vfs_pin(db->vfs, &slot);
+    if (snap) {
+        const VfsNode* node = vfs_find(snap, file_id);
+        if (node) snapshot_entry(snap, node, entry);
+        vfs_unpin(db->vfs, slot);
+        return node ? 0 : -1;
+    }
+
+    if (file_cache_get(db->file_cache, file_id, entry) == 0) {
+        return 0;
+    }
+    uint64_t generation = file_cache_generation(db->file_cache, file_id);
+
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT id, parent_id, name, physical_path, owner_id, size, is_directory, permissions, created_at "
+                      "FROM files WHERE id = ?";
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        reader_release(db, conn);
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, file_id);
+
+    rc = sqlite3_step(stmt);
     int result = -1;
 
     if (rc == SQLITE_ROW) {
+        memset(entry, 0, sizeof(*entry));
         entry->id = sqlite3_column_int(stmt, 0);
         entry->parent_id = sqlite3_column_int(stmt, 1);
         strncpy(entry->name, (const char*)sqlite3_column_text(stmt, 2), sizeof(entry->name) - 1);
@@ -393,20 +1283,23 @@ int db_get_file_by_id(Database* db, int file_id, FileEntry* entry) {
         result = 0;
     }
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    reader_release(db, conn);
 
+    if (result == 0) {
+        file_cache_put(db->file_cache, entry, generation);
+    }
     return result;
 }
 
 int db_list_directory(Database* db, int parent_id, FileEntry** entries, int* count) {
-    pthread_mutex_lock(&db->mutex);
+    sqlite3* conn = reader_acquire(db);
 
     // First, count entries
     sqlite3_stmt* stmt;
     const char* count_sql = "SELECT COUNT(*) FROM files WHERE parent_id = ?";
 
-    sqlite3_prepare_v2(db->conn, count_sql, -1, &stmt, NULL);
+    stmt_prepare(db, conn, count_sql, &stmt);
     sqlite3_bind_int(stmt, 1, parent_id);
 
     if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -414,18 +1307,18 @@ int db_list_directory(Database* db, int parent_id, FileEntry** entries, int* cou
     } else {
         *count = 0;
     }
-    sqlite3_finalize(stmt);
+    stmt_release(stmt);
 
     if (*count == 0) {
         *entries = NULL;
-        pthread_mutex_unlock(&db->mutex);
+        reader_release(db, conn);
         return 0;
     }
 
     // Allocate entries
     *entries = malloc(sizeof(FileEntry) * (*count));
     if (!*entries) {
-        pthread_mutex_unlock(&db->mutex);
+        reader_release(db, conn);
         return -1;
     }
 
@@ -433,7 +1326,7 @@ int db_list_directory(Database* db, int parent_id, FileEntry** entries, int* cou
     const char* sql = "SELECT id, parent_id, name, physical_path, owner_id, size, is_directory, permissions, created_at "
                       "FROM files WHERE parent_id = ? ORDER BY is_directory DESC, name ASC";
 
-    sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    stmt_prepare(db, conn, sql, &stmt);
     sqlite3_bind_int(stmt, 1, parent_id);
 
     int i = 0;
@@ -452,21 +1345,155 @@ int db_list_directory(Database* db, int parent_id, FileEntry** entries, int* cou
         i++;
     }
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    reader_release(db, conn);
+
+    return 0;
+}
+
+int db_scan_directory(Database* db, int parent_id, int user_id,
+                      int (*on_row)(void* ctx, const DirectoryRow* row), void* ctx) {
+    return db_scan_directory_page(db, parent_id, user_id, NULL, -1, on_row, ctx);
+}
+
+// Permission `bit` on `t` for the user bound to `user`, decided the same way
+// as check_permission: owner bits for the owner, other bits for everyone else
+#define SQL_ACCESS(t, user, bit) \
+    "(((CASE WHEN " t ".owner_id = " user " THEN " t ".permissions >> 6 " \
+    "ELSE " t ".permissions END) & " bit ") != 0)"
+#define SQL_READABLE(t, user) SQL_ACCESS(t, user, "4")
+#define SQL_WRITABLE(t, user) SQL_ACCESS(t, user, "2")
+
+// Every directory between the base `b` and the entry `f` (with file_paths
+// row `p`), read from the part of p's ancestry below b's, must be readable
+// too, as if the user had walked down to it
+#define SQL_PATH_READABLE(user) \
+    "NOT EXISTS (SELECT 1 FROM json_each('[' || replace(rtrim(substr(p.ancestry, " \
+    "length(b.ancestry) + 1), '/'), '/', ',') || ']') a " \
+    "JOIN files d ON d.id = a.value " \
+    "WHERE a.value != f.id AND NOT " SQL_READABLE("d", user) ")"
+
+// Before every row: directories sort first, so this is past both groups' start
+static const ListCursor list_start = { 2, "", 0 };
+
+// Helper: read permission on a snapshot node, as SQL_READABLE decides it
+static int node_readable(const VfsNode* node, int user_id) {
+    int bits = node->owner_id == user_id ? node->permissions >> 6 : node->permissions;
+    return (bits & 4) != 0;
+}
 
+// Helper: the same scan over a snapshot's child run of `parent_id`
+static int scan_snapshot(const VfsSnapshot* snap, int parent_id, int user_id, const ListCursor* after,
+                         int limit, int (*on_row)(void* ctx, const DirectoryRow* row), void* ctx) {
+    const VfsNode* dir = vfs_find(snap, parent_id);
+    if (!dir) return 0;
+
+    int sent = 0;
+    for (int i = vfs_seek_child(snap, dir, after); i < dir->child_count && (limit < 0 || sent < limit); i++) {
+        const VfsNode* node = vfs_child(snap, dir, i);
+        if (!node_readable(node, user_id)) continue;
+
+        DirectoryRow row;
+        row.id = node->id;
+        row.name = vfs_str(snap, node->name);
+        row.owner_id = node->owner_id;
+        row.owner = vfs_str(snap, node->owner);
+        row.size = node->size;
+        row.is_directory = node->is_directory;
+        row.permissions = node->permissions;
+        row.total_bytes = node->total_bytes;
+        row.total_files = node->total_files;
+        if (on_row(ctx, &row) < 0) return -1;
+        sent++;
+    }
     return 0;
 }
 
+int db_scan_directory_page(Database* db, int parent_id, int user_id, const ListCursor* after,
+                           int limit, int (*on_row)(void* ctx, const DirectoryRow* row), void* ctx) {
+    if (!after) after = &list_start;
+
+    int slot;
+    const VfsSnapshot* snap = vfs_pin(db->vfs, &slot);
+    if (snap) {
+        int result = scan_snapshot(snap, parent_id, user_id, after, limit, on_row, ctx);
+        vfs_unpin(db->vfs, slot);
+        return result;
+    }
+
+    sqlite3* conn = reader_acquire(db);
+
+    // The rest of the cursor's group, then the groups after it: each half is
+    // a seek on idx_files_listing and the merge keeps the order without sorting.
+    // Entries the user may not read are dropped as the rows go by.
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT f.id, f.name, f.owner_id, u.username, f.size, f.is_directory, f.permissions, "
+                      "       t.bytes, t.files "
+                      "FROM files f LEFT JOIN users u ON u.id = f.owner_id "
+                      "LEFT JOIN dir_totals t ON t.dir_id = f.id "
+                      "WHERE f.parent_id = ?1 AND f.is_directory = ?2 AND (f.name, f.id) > (?3, ?4) "
+                      "  AND " SQL_READABLE("f", "?6") " "
+                      "UNION ALL "
+                      "SELECT f.id, f.name, f.owner_id, u.username, f.size, f.is_directory, f.permissions, "
+                      "       t.bytes, t.files "
+                      "FROM files f LEFT JOIN users u ON u.id = f.owner_id "
+                      "LEFT JOIN dir_totals t ON t.dir_id = f.id "
+                      "WHERE f.parent_id = ?1 AND f.is_directory < ?2 "
+                      "  AND " SQL_READABLE("f", "?6") " "
+                      "ORDER BY 6 DESC, 2 ASC, 1 ASC LIMIT ?5";
+
+    if (stmt_prepare(db, conn, sql, &stmt) != SQLITE_OK) {
+        log_error("db_scan_directory: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        return -1;
+    }
+    sqlite3_bind_int(stmt, 1, parent_id);
+    sqlite3_bind_int(stmt, 2, after->is_directory);
+    sqlite3_bind_text(stmt, 3, after->name, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 4, after->id);
+    sqlite3_bind_int(stmt, 5, limit);
+    sqlite3_bind_int(stmt, 6, user_id);
+
+    int result = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        DirectoryRow row;
+        row.id = sqlite3_column_int(stmt, 0);
+        row.name = (const char*)sqlite3_column_text(stmt, 1);
+        row.owner_id = sqlite3_column_int(stmt, 2);
+        row.owner = (const char*)sqlite3_column_text(stmt, 3);
+        row.size = sqlite3_column_int64(stmt, 4);
+        row.is_directory = sqlite3_column_int(stmt, 5);
+        row.permissions = sqlite3_column_int(stmt, 6);
+        row.total_bytes = sqlite3_column_int64(stmt, 7);
+        row.total_files = sqlite3_column_int(stmt, 8);
+        if (!row.name) row.name = "";
+        if (!row.owner) row.owner = "unknown";
+
+        if (on_row(ctx, &row) < 0) {
+            result = -1;
+            break;
+        }
+    }
+    if (result == 0 && rc != SQLITE_DONE) {
+        log_error("db_scan_directory: step failed: %s", sqlite3_errmsg(conn));
+        result = -1;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+    return result;
+}
+
 int db_delete_file(Database* db, int file_id) {
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "DELETE FROM files WHERE id = ?";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -475,21 +1502,211 @@ int db_delete_file(Database* db, int file_id) {
     rc = sqlite3_step(stmt);
     int result = (rc == SQLITE_DONE) ? 0 : -1;
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    result = write_end(db, group, result);
+    file_cache_invalidate(db->file_cache, file_id);
+
+    return result;
+}
+
+// Everything below `dir_id` that `user_id` may read, parents before children,
+// as one range of the ancestry index at any depth. An entry is listed only
+// if it and every directory between it and `dir_id` are readable, so
+// unreadable directories are pruned with everything below them.
+int db_list_subtree(Database* db, int dir_id, int user_id, TreeEntry** entries, int* count) {
+    if (!db || !entries || !count) return -1;
+
+    *entries = NULL;
+    *count = 0;
+
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql =
+        "SELECT f.id, f.parent_id, f.name, f.physical_path, f.owner_id, f.size, f.is_directory, "
+        "       f.permissions, f.created_at, substr(p.path, length(rtrim(b.path, '/')) + 2), "
+        "       CAST(strftime('%s', f.created_at) AS INTEGER) "
+        "FROM file_paths b "
+        "JOIN file_paths p ON p.ancestry > b.ancestry AND p.ancestry < b.ancestry || ':' "
+        "JOIN files f ON f.id = p.file_id "
+        "WHERE b.file_id = ?1 AND " SQL_READABLE("f", "?2") " AND " SQL_PATH_READABLE("?2") " "
+        "ORDER BY p.path";
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_list_subtree: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, dir_id);
+    sqlite3_bind_int(stmt, 2, user_id);
+
+    int cap = 0;
+    int result = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (*count == cap) {
+            int new_cap = cap ? cap * 2 : 64;
+            TreeEntry* grown = realloc(*entries, sizeof(TreeEntry) * new_cap);
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            *entries = grown;
+            cap = new_cap;
+        }
+
+        TreeEntry* t = &(*entries)[(*count)++];
+        memset(t, 0, sizeof(*t));
+        t->file.id = sqlite3_column_int(stmt, 0);
+        t->file.parent_id = sqlite3_column_int(stmt, 1);
+        strncpy(t->file.name, (const char*)sqlite3_column_text(stmt, 2), sizeof(t->file.name) - 1);
+        const char* path = (const char*)sqlite3_column_text(stmt, 3);
+        if (path) strncpy(t->file.physical_path, path, sizeof(t->file.physical_path) - 1);
+        t->file.owner_id = sqlite3_column_int(stmt, 4);
+        t->file.size = sqlite3_column_int64(stmt, 5);
+        t->file.is_directory = sqlite3_column_int(stmt, 6);
+        t->file.permissions = sqlite3_column_int(stmt, 7);
+        const char* created = (const char*)sqlite3_column_text(stmt, 8);
+        if (created) strncpy(t->file.created_at, created, sizeof(t->file.created_at) - 1);
+        strncpy(t->path, (const char*)sqlite3_column_text(stmt, 9), sizeof(t->path) - 1);
+        t->mtime = (long)sqlite3_column_int64(stmt, 10);
+    }
+    if (result == 0 && rc != SQLITE_DONE) {
+        log_error("db_list_subtree: step failed: %s", sqlite3_errmsg(conn));
+        result = -1;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+
+    if (result < 0) {
+        free(*entries);
+        *entries = NULL;
+        *count = 0;
+    }
+    return result;
+}
+
+int db_get_dir_totals(Database* db, int dir_id, long* bytes, int* files) {
+    if (!db || !bytes || !files) return -1;
+
+    int slot;
+    const VfsSnapshot* snap = vfs_pin(db->vfs, &slot);
+    if (snap) {
+        const VfsNode* node = vfs_find(snap, dir_id);
+        int result = (node && node->is_directory) ? 0 : -1;
+        if (result == 0) {
+            *bytes = node->total_bytes;
+            *files = node->total_files;
+        }
+        vfs_unpin(db->vfs, slot);
+        return result;
+    }
+
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT bytes, files FROM dir_totals WHERE dir_id = ?";
+    if (stmt_prepare(db, conn, sql, &stmt) != SQLITE_OK) {
+        log_error("db_get_dir_totals: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        return -1;
+    }
+    sqlite3_bind_int(stmt, 1, dir_id);
+
+    int result = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        *bytes = sqlite3_column_int64(stmt, 0);
+        *files = sqlite3_column_int(stmt, 1);
+        result = 0;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+    return result;
+}
+
+// Every (file, bits) pair is checked by one query over a JSON list, the
+// way check_permission would one at a time; the root is open to everyone
+int db_check_access(Database* db, int user_id, const int* file_ids, const int* bits,
+                    int count, int* denied_id) {
+    if (!db || !file_ids || !bits || count < 0) return -1;
+    if (count == 0) return 1;
+
+    int slot;
+    const VfsSnapshot* snap = vfs_pin(db->vfs, &slot);
+    if (snap) {
+        int result = 1;
+        for (int i = 0; i < count && result; i++) {
+            if (file_ids[i] == 0) continue;
+            const VfsNode* node = vfs_find(snap, file_ids[i]);
+            int have = node ? (node->owner_id == user_id ? node->permissions >> 6 : node->permissions) : 0;
+            if (!node || (have & bits[i] & 7) != (bits[i] & 7)) {
+                if (denied_id) *denied_id = file_ids[i];
+                result = 0;
+            }
+        }
+        vfs_unpin(db->vfs, slot);
+        return result;
+    }
+
+    sqlite3_str* list = sqlite3_str_new(NULL);
+    for (int i = 0; i < count; i++) {
+        sqlite3_str_appendf(list, "%s[%d,%d]", i ? "," : "[", file_ids[i], bits[i] & 7);
+    }
+    sqlite3_str_appendchar(list, 1, ']');
+    char* json = sqlite3_str_finish(list);
+    if (!json) return -1;
+
+    sqlite3* conn = reader_acquire(db);
+
+    // The first pair whose file is missing or lacks one of the bits
+    sqlite3_stmt* stmt;
+    const char* sql =
+        "SELECT a.value ->> 0 FROM json_each(?1) a "
+        "LEFT JOIN files f ON f.id = a.value ->> 0 "
+        "WHERE a.value ->> 0 != 0 AND (f.id IS NULL OR "
+        "      ((CASE WHEN f.owner_id = ?2 THEN f.permissions >> 6 ELSE f.permissions END) "
+        "       & (a.value ->> 1)) != a.value ->> 1) "
+        "LIMIT 1";
+
+    if (stmt_prepare(db, conn, sql, &stmt) != SQLITE_OK) {
+        log_error("db_check_access: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        sqlite3_free(json);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, json, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, user_id);
+
+    int result;
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        if (denied_id) *denied_id = sqlite3_column_int(stmt, 0);
+        result = 0;
+    } else if (rc == SQLITE_DONE) {
+        result = 1;
+    } else {
+        log_error("db_check_access: step failed: %s", sqlite3_errmsg(conn));
+        result = -1;
+    }
 
+    stmt_release(stmt);
+    reader_release(db, conn);
+    sqlite3_free(json);
     return result;
 }
 
 int db_update_permissions(Database* db, int file_id, int permissions) {
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "UPDATE files SET permissions = ? WHERE id = ?";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -499,22 +1716,23 @@ int db_update_permissions(Database* db, int file_id, int permissions) {
     rc = sqlite3_step(stmt);
     int result = (rc == SQLITE_DONE) ? 0 : -1;
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    result = write_end(db, group, result);
+    file_cache_invalidate(db->file_cache, file_id);
 
     return result;
 }
 
 // Admin user operations
 int db_is_admin(Database* db, int user_id) {
-    pthread_mutex_lock(&db->mutex);
+    sqlite3* conn = reader_acquire(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "SELECT is_admin FROM users WHERE id = ? AND is_active = 1";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        reader_release(db, conn);
         return 0;
     }
 
@@ -527,29 +1745,29 @@ int db_is_admin(Database* db, int user_id) {
         is_admin = sqlite3_column_int(stmt, 0);
     }
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    reader_release(db, conn);
 
     return is_admin;
 }
 
 int db_list_users(Database* db, char** json_result) {
-    pthread_mutex_lock(&db->mutex);
+    sqlite3* conn = reader_acquire(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "SELECT id, username, is_active, is_admin, created_at FROM users ORDER BY id ASC";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        reader_release(db, conn);
         return -1;
     }
 
     // Build JSON manually (simple approach without cJSON dependency in db layer)
     char* buffer = malloc(4096);
     if (!buffer) {
-        sqlite3_finalize(stmt);
-        pthread_mutex_unlock(&db->mutex);
+        stmt_release(stmt);
+        reader_release(db, conn);
         return -1;
     }
 
@@ -575,8 +1793,8 @@ int db_list_users(Database* db, char** json_result) {
 
     strcat(buffer, "]");
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    reader_release(db, conn);
 
     *json_result = buffer;
     return 0;
@@ -589,14 +1807,14 @@ int db_delete_user(Database* db, int user_id) {
         return -1;
     }
 
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "DELETE FROM users WHERE id = ?";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -605,8 +1823,8 @@ int db_delete_user(Database* db, int user_id) {
     rc = sqlite3_step(stmt);
     int result = (rc == SQLITE_DONE) ? 0 : -1;
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    result = write_end(db, group, result);
 
     if (result == 0) {
         log_info("Deleted user with id=%d", user_id);
@@ -622,14 +1840,14 @@ int db_update_user(Database* db, int user_id, int is_admin, int is_active) {
         return -1;
     }
 
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "UPDATE users SET is_admin = ?, is_active = ? WHERE id = ?";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -640,8 +1858,8 @@ int db_update_user(Database* db, int user_id, int is_admin, int is_active) {
     rc = sqlite3_step(stmt);
     int result = (rc == SQLITE_DONE) ? 0 : -1;
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    result = write_end(db, group, result);
 
     if (result == 0) {
         log_info("Updated user id=%d: is_admin=%d, is_active=%d", user_id, is_admin, is_active);
@@ -651,14 +1869,14 @@ int db_update_user(Database* db, int user_id, int is_admin, int is_active) {
 }
 
 int db_create_user_admin(Database* db, const char* username, const char* password_hash, int is_admin) {
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     sqlite3_stmt* stmt;
     const char* sql = "INSERT INTO users (username, password_hash, is_admin) VALUES (?, ?, ?)";
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -669,8 +1887,8 @@ int db_create_user_admin(Database* db, const char* username, const char* passwor
     rc = sqlite3_step(stmt);
     int user_id = (rc == SQLITE_DONE) ? (int)sqlite3_last_insert_rowid(db->conn) : -1;
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    user_id = write_end(db, group, user_id);
 
     if (user_id > 0) {
         log_info("Created user: %s (id=%d, is_admin=%d)", username, user_id, is_admin);
@@ -707,78 +1925,94 @@ static void convert_wildcard_pattern(const char* input, char* output, size_t siz
     output[j] = '\0';
 }
 
-// Helper: Build full VFS path by traversing parent_id chain
-static int build_full_path(Database* db, int file_id, char* path, size_t size) {
-    (void)size;  // Unused parameter
-    char components[32][256];  // Max 32 levels deep
-    int depth = 0;
-    int current_id = file_id;
-
-    pthread_mutex_lock(&db->mutex);
-
-    // Traverse up to root
-    while (current_id > 0 && depth < 32) {
-        sqlite3_stmt* stmt;
-        const char* sql = "SELECT name, parent_id FROM files WHERE id = ?";
-
-        int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            pthread_mutex_unlock(&db->mutex);
-            return -1;
-        }
-
-        sqlite3_bind_int(stmt, 1, current_id);
-        rc = sqlite3_step(stmt);
-
-        if (rc == SQLITE_ROW) {
-            const char* name = (const char*)sqlite3_column_text(stmt, 0);
-            strncpy(components[depth], name, 255);
-            components[depth][255] = '\0';
-            current_id = sqlite3_column_int(stmt, 1);
-            depth++;
-        } else {
-            sqlite3_finalize(stmt);
-            break;
+// Helper: whether a LIKE pattern has three literal characters in a row,
+// the least the trigram index can look up
+static int has_trigram(const char* pattern) {
+    int run = 0;
+    for (const unsigned char* p = (const unsigned char*)pattern; *p; p++) {
+        if (*p == '%' || *p == '_') {
+            run = 0;
+        } else if ((*p & 0xC0) != 0x80 && ++run >= 3) {
+            return 1;
         }
-
-        sqlite3_finalize(stmt);
     }
+    return 0;
+}
 
-    pthread_mutex_unlock(&db->mutex);
+// Helper: an entry's VFS path from a snapshot's parent chain; 1 if it cannot tell
+static int snapshot_path(const VfsSnapshot* snap, int file_id, char* path, size_t size) {
+    const VfsNode* chain[VFS_MAX_DEPTH];
+    int depth = 0;
+    const VfsNode* node = vfs_find(snap, file_id);
+    if (!node) return -1;
+    while (node->id != 0) {
+        if (depth == VFS_MAX_DEPTH) return 1;
+        chain[depth++] = node;
+        node = vfs_find(snap, node->parent_id);
+        if (!node) return 1;
+    }
 
-    // Build path from root down
+    size_t len = 0;
     path[0] = '\0';
-
     if (depth == 0) {
-        strcpy(path, "/");
-        return 0;
+        snprintf(path, size, "/");
     }
+    while (depth > 0 && len < size) {
+        int n = snprintf(path + len, size - len, "/%s", vfs_str(snap, chain[--depth]->name));
+        if (n < 0) break;
+        len += (size_t)n;
+    }
+    return 0;
+}
 
-    for (int i = depth - 1; i >= 0; i--) {
-        // Skip root name
-        if (i == depth - 1 && strcmp(components[i], "/") == 0) {
-            continue;
-        }
+// Full VFS path of an entry from its materialized row in file_paths
+int db_get_file_path(Database* db, int file_id, char* path, size_t size) {
+    if (!db || !path || size == 0) return -1;
 
-        strcat(path, "/");
-        strcat(path, components[i]);
+    int slot;
+    const VfsSnapshot* snap = vfs_pin(db->vfs, &slot);
+    if (snap) {
+        int result = snapshot_path(snap, file_id, path, size);
+        vfs_unpin(db->vfs, slot);
+        if (result <= 0) return result;
     }
 
-    // Ensure leading slash
-    if (path[0] != '/') {
-        memmove(path + 1, path, strlen(path) + 1);
-        path[0] = '/';
+    sqlite3* conn = reader_acquire(db);
+
+    const char* sql = "SELECT path FROM file_paths WHERE file_id = ?";
+    sqlite3_stmt* stmt;
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_get_file_path: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        return -1;
     }
 
-    return 0;
+    sqlite3_bind_int(stmt, 1, file_id);
+
+    int result = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        snprintf(path, size, "%s", (const char*)sqlite3_column_text(stmt, 0));
+        result = 0;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+    return result;
 }
 
 // Main search function
 int db_search_files(Database* db, int base_dir_id, const char* pattern,
                     int recursive, int user_id, int limit,
                     FileEntry** entries, int* count) {
-    (void)user_id;  // Unused parameter (for future permission checks)
+    return db_search_files_page(db, base_dir_id, pattern, recursive, user_id, NULL, limit,
+                                entries, count);
+}
 
+int db_search_files_page(Database* db, int base_dir_id, const char* pattern,
+                         int recursive, int user_id, const ListCursor* after, int limit,
+                         FileEntry** entries, int* count) {
     if (!db || !pattern || !entries || !count) {
         log_error("db_search_files: Invalid parameters");
         return -1;
@@ -809,64 +2043,77 @@ int db_search_files(Database* db, int base_dir_id, const char* pattern,
         strncpy(sql_pattern, temp, sizeof(sql_pattern) - 1);
     }
 
-    pthread_mutex_lock(&db->mutex);
+    if (!after) after = &list_start;
+
+    sqlite3* conn = reader_acquire(db);
 
     sqlite3_stmt* stmt;
     const char* sql;
 
-    if (recursive) {
-        // Recursive search using CTE
-        sql = "WITH RECURSIVE file_tree(id, parent_id, name, physical_path, "
-              "owner_id, size, is_directory, permissions, created_at, level) AS ("
-              "  SELECT id, parent_id, name, physical_path, owner_id, size, "
-              "         is_directory, permissions, created_at, 0 as level "
-              "  FROM files WHERE id = ? "
-              "  UNION ALL "
-              "  SELECT f.id, f.parent_id, f.name, f.physical_path, f.owner_id, "
-              "         f.size, f.is_directory, f.permissions, f.created_at, ft.level + 1 "
-              "  FROM files f INNER JOIN file_tree ft ON f.parent_id = ft.id "
-              "  WHERE ft.level < 20 "  // Prevent infinite loops
-              ") "
-              "SELECT id, parent_id, name, physical_path, owner_id, size, "
-              "       is_directory, permissions, created_at "
-              "FROM file_tree "
-              "WHERE name LIKE ? COLLATE NOCASE AND id != ? "
-              "ORDER BY is_directory DESC, name ASC "
-              "LIMIT ?";
+    if (recursive && has_trigram(sql_pattern)) {
+        // Candidates come from the trigram index, then are kept if they lie
+        // under the base directory. CROSS JOIN pins that order; the LIKE
+        // on files re-checks what the index matched.
+        sql = "SELECT f.id, f.parent_id, f.name, f.physical_path, f.owner_id, f.size, "
+              "       f.is_directory, f.permissions, f.created_at "
+              "FROM file_paths b "
+              "CROSS JOIN files_name_fts s "
+              "CROSS JOIN files f "
+              "CROSS JOIN file_paths p "
+              "WHERE b.file_id = ?1 AND s.name LIKE ?2 "
+              "  AND f.id = s.rowid AND f.name LIKE ?2 COLLATE NOCASE "
+              "  AND p.file_id = f.id "
+              "  AND p.ancestry > b.ancestry AND p.ancestry < b.ancestry || ':' "
+              "  AND (f.is_directory < ?4 OR (f.is_directory = ?4 AND (f.name, f.id) > (?5, ?6))) "
+              "  AND " SQL_READABLE("f", "?7") " AND " SQL_PATH_READABLE("?7") " "
+              "ORDER BY f.is_directory DESC, f.name ASC, f.id ASC "
+              "LIMIT ?3";
+    } else if (recursive) {
+        // Too short for trigrams: every descendant is one range of the ancestry index
+        sql = "SELECT f.id, f.parent_id, f.name, f.physical_path, f.owner_id, f.size, "
+              "       f.is_directory, f.permissions, f.created_at "
+              "FROM file_paths b "
+              "JOIN file_paths p ON p.ancestry > b.ancestry AND p.ancestry < b.ancestry || ':' "
+              "JOIN files f ON f.id = p.file_id "
+              "WHERE b.file_id = ?1 AND f.name LIKE ?2 COLLATE NOCASE "
+              "  AND (f.is_directory < ?4 OR (f.is_directory = ?4 AND (f.name, f.id) > (?5, ?6))) "
+              "  AND " SQL_READABLE("f", "?7") " AND " SQL_PATH_READABLE("?7") " "
+              "ORDER BY f.is_directory DESC, f.name ASC, f.id ASC "
+              "LIMIT ?3";
     } else {
         // Non-recursive search (current directory only)
-        sql = "SELECT id, parent_id, name, physical_path, owner_id, size, "
-              "       is_directory, permissions, created_at "
-              "FROM files "
-              "WHERE parent_id = ? AND name LIKE ? COLLATE NOCASE "
-              "ORDER BY is_directory DESC, name ASC "
-              "LIMIT ?";
+        sql = "SELECT f.id, f.parent_id, f.name, f.physical_path, f.owner_id, f.size, "
+              "       f.is_directory, f.permissions, f.created_at "
+              "FROM files f "
+              "WHERE f.parent_id = ?1 AND f.name LIKE ?2 COLLATE NOCASE "
+              "  AND (f.is_directory < ?4 OR (f.is_directory = ?4 AND (f.name, f.id) > (?5, ?6))) "
+              "  AND " SQL_READABLE("f", "?7") " "
+              "ORDER BY f.is_directory DESC, f.name ASC, f.id ASC "
+              "LIMIT ?3";
     }
 
-    int rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    int rc = stmt_prepare(db, conn, sql, &stmt);
     if (rc != SQLITE_OK) {
-        log_error("db_search_files: prepare failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        log_error("db_search_files: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
         return -1;
     }
 
     // Bind parameters
     sqlite3_bind_int(stmt, 1, base_dir_id);
     sqlite3_bind_text(stmt, 2, sql_pattern, -1, SQLITE_STATIC);
-
-    if (recursive) {
-        sqlite3_bind_int(stmt, 3, base_dir_id);  // Exclude base dir itself
-        sqlite3_bind_int(stmt, 4, limit);
-    } else {
-        sqlite3_bind_int(stmt, 3, limit);
-    }
+    sqlite3_bind_int(stmt, 3, limit);
+    sqlite3_bind_int(stmt, 4, after->is_directory);
+    sqlite3_bind_text(stmt, 5, after->name, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 6, after->id);
+    sqlite3_bind_int(stmt, 7, user_id);
 
     // Allocate result array
     int capacity = 50;
     *entries = malloc(capacity * sizeof(FileEntry));
     if (!*entries) {
-        sqlite3_finalize(stmt);
-        pthread_mutex_unlock(&db->mutex);
+        stmt_release(stmt);
+        reader_release(db, conn);
         return -1;
     }
 
@@ -879,8 +2126,8 @@ int db_search_files(Database* db, int base_dir_id, const char* pattern,
             FileEntry* new_entries = realloc(*entries, capacity * sizeof(FileEntry));
             if (!new_entries) {
                 free(*entries);
-                sqlite3_finalize(stmt);
-                pthread_mutex_unlock(&db->mutex);
+                stmt_release(stmt);
+                reader_release(db, conn);
                 return -1;
             }
             *entries = new_entries;
@@ -909,11 +2156,11 @@ int db_search_files(Database* db, int base_dir_id, const char* pattern,
         (*count)++;
     }
 
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&db->mutex);
+    stmt_release(stmt);
+    reader_release(db, conn);
 
     if (rc != SQLITE_DONE) {
-        log_error("db_search_files: step failed: %s", sqlite3_errmsg(db->conn));
+        log_error("db_search_files: step failed: %s", sqlite3_errstr(rc));
         free(*entries);
         *entries = NULL;
         *count = 0;
@@ -936,26 +2183,26 @@ int db_rename_file(Database* db, int file_id, const char* new_name) {
         return -1;
     }
 
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     // Check if file exists
     const char* check_sql = "SELECT id FROM files WHERE id = ?";
     sqlite3_stmt* check_stmt;
 
-    int rc = sqlite3_prepare_v2(db->conn, check_sql, -1, &check_stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, check_sql, &check_stmt);
     if (rc != SQLITE_OK) {
         log_error("db_rename_file: prepare check failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
     sqlite3_bind_int(check_stmt, 1, file_id);
     rc = sqlite3_step(check_stmt);
-    sqlite3_finalize(check_stmt);
+    stmt_release(check_stmt);
 
     if (rc != SQLITE_ROW) {
         log_error("db_rename_file: File %d not found", file_id);
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -963,10 +2210,10 @@ int db_rename_file(Database* db, int file_id, const char* new_name) {
     const char* sql = "UPDATE files SET name = ? WHERE id = ?";
     sqlite3_stmt* stmt;
 
-    rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
         log_error("db_rename_file: prepare failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -974,15 +2221,16 @@ int db_rename_file(Database* db, int file_id, const char* new_name) {
     sqlite3_bind_int(stmt, 2, file_id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    stmt_release(stmt);
 
     if (rc != SQLITE_DONE) {
         log_error("db_rename_file: step failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
-    pthread_mutex_unlock(&db->mutex);
+    if (write_end(db, group, 0) < 0) return -1;
+    file_cache_invalidate(db->file_cache, file_id);
     log_info("Renamed file %d to '%s'", file_id, new_name);
     return 0;
 }
@@ -991,17 +2239,17 @@ int db_rename_file(Database* db, int file_id, const char* new_name) {
 int db_copy_file(Database* db, int source_id, int dest_parent_id, const char* new_name, int user_id) {
     if (!db || !new_name) return -1;
 
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
     // Get source file information
     const char* get_sql = "SELECT name, physical_path, size, is_directory, permissions "
                           "FROM files WHERE id = ?";
     sqlite3_stmt* get_stmt;
 
-    int rc = sqlite3_prepare_v2(db->conn, get_sql, -1, &get_stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, get_sql, &get_stmt);
     if (rc != SQLITE_OK) {
         log_error("db_copy_file: prepare get failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -1010,13 +2258,18 @@ int db_copy_file(Database* db, int source_id, int dest_parent_id, const char* ne
 
     if (rc != SQLITE_ROW) {
         log_error("db_copy_file: Source file %d not found", source_id);
-        sqlite3_finalize(get_stmt);
-        pthread_mutex_unlock(&db->mutex);
+        stmt_release(get_stmt);
+        write_end(db, group, -1);
         return -1;
     }
 
-    const char* orig_name = (const char*)sqlite3_column_text(get_stmt, 0);
-    const char* physical_path = (const char*)sqlite3_column_text(get_stmt, 1);
+    // Copy the columns out; they are invalid once the statement is reset
+    char orig_name[256] = "";
+    char physical_path[64] = "";
+    const char* text = (const char*)sqlite3_column_text(get_stmt, 0);
+    if (text) snprintf(orig_name, sizeof(orig_name), "%s", text);
+    text = (const char*)sqlite3_column_text(get_stmt, 1);
+    if (text) snprintf(physical_path, sizeof(physical_path), "%s", text);
     long size = sqlite3_column_int64(get_stmt, 2);
     int is_directory = sqlite3_column_int(get_stmt, 3);
     int permissions = sqlite3_column_int(get_stmt, 4);
@@ -1024,21 +2277,27 @@ int db_copy_file(Database* db, int source_id, int dest_parent_id, const char* ne
     // Use provided name or original name
     const char* use_name = (new_name && strlen(new_name) > 0) ? new_name : orig_name;
 
-    sqlite3_finalize(get_stmt);
+    stmt_release(get_stmt);
 
     // Generate new physical path (server will handle actual file copy)
+    // Physical paths are read back into 64-byte fields, so refuse one that does not fit
     char new_physical_path[64];
-    snprintf(new_physical_path, sizeof(new_physical_path), "copy_%d_%s", source_id, physical_path);
+    int len = snprintf(new_physical_path, sizeof(new_physical_path), "copy_%d_%s", source_id, physical_path);
+    if (len < 0 || (size_t)len >= sizeof(new_physical_path)) {
+        log_error("db_copy_file: physical path for a copy of %d is too long", source_id);
+        write_end(db, group, -1);
+        return -1;
+    }
 
     // Insert new file entry
     const char* insert_sql = "INSERT INTO files (parent_id, name, physical_path, owner_id, size, is_directory, permissions) "
                              "VALUES (?, ?, ?, ?, ?, ?, ?)";
     sqlite3_stmt* insert_stmt;
 
-    rc = sqlite3_prepare_v2(db->conn, insert_sql, -1, &insert_stmt, NULL);
+    rc = stmt_prepare(db, db->conn, insert_sql, &insert_stmt);
     if (rc != SQLITE_OK) {
         log_error("db_copy_file: prepare insert failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -1052,43 +2311,296 @@ int db_copy_file(Database* db, int source_id, int dest_parent_id, const char* ne
 
     rc = sqlite3_step(insert_stmt);
     int new_id = (int)sqlite3_last_insert_rowid(db->conn);
-    sqlite3_finalize(insert_stmt);
+    stmt_release(insert_stmt);
 
     if (rc != SQLITE_DONE) {
         log_error("db_copy_file: insert failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
-    pthread_mutex_unlock(&db->mutex);
+    new_id = write_end(db, group, new_id);
     log_info("Copied file %d to %d as '%s' (new id: %d)", source_id, dest_parent_id, use_name, new_id);
     return new_id;
 }
 
+// Helper: run one step of a subtree copy, binding ?1 source, ?2 destination,
+// ?3 name and ?4 user where the statement has them (caller holds the transaction)
+static int copy_exec(Database* db, const char* sql, int source_id, int dest_parent_id,
+                     const char* name, int user_id) {
+    sqlite3_stmt* stmt;
+    if (stmt_prepare(db, db->conn, sql, &stmt) != SQLITE_OK) {
+        log_error("db_copy_subtree: prepare failed: %s", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+
+    int params = sqlite3_bind_parameter_count(stmt);
+    if (params >= 1) {
+        sqlite3_bind_int(stmt, 1, source_id);
+    }
+    if (params >= 4) {
+        sqlite3_bind_int(stmt, 2, dest_parent_id);
+        sqlite3_bind_text(stmt, 3, name, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, user_id);
+    }
+
+    int rc = sqlite3_step(stmt);
+    stmt_release(stmt);
+    if (rc != SQLITE_DONE) {
+        log_error("db_copy_subtree: step failed: %s", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+    return sqlite3_changes(db->conn);
+}
+
+// Helper: list the blobs of a planned copy (caller holds the transaction)
+static int copy_blob_list(Database* db, BlobCopy** blobs, int* blob_count) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT f.physical_path, m.new_path FROM temp.copy_map m "
+                      "JOIN files f ON f.id = m.old_id WHERE m.new_path IS NOT NULL";
+
+    if (stmt_prepare(db, db->conn, sql, &stmt) != SQLITE_OK) {
+        log_error("db_copy_subtree: prepare failed: %s", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+
+    int capacity = 0;
+    int rc;
+    *blobs = NULL;
+    *blob_count = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (*blob_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            BlobCopy* grown = realloc(*blobs, (size_t)capacity * sizeof(BlobCopy));
+            if (!grown) break;
+            *blobs = grown;
+        }
+        BlobCopy* blob = &(*blobs)[(*blob_count)++];
+        snprintf(blob->source, sizeof(blob->source), "%s", (const char*)sqlite3_column_text(stmt, 0));
+        snprintf(blob->copy, sizeof(blob->copy), "%s", (const char*)sqlite3_column_text(stmt, 1));
+    }
+    stmt_release(stmt);
+
+    if (rc != SQLITE_DONE) {
+        log_error("db_copy_subtree: listing blobs failed: %s", sqlite3_errmsg(db->conn));
+        free(*blobs);
+        *blobs = NULL;
+        *blob_count = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Helper: plan and insert a subtree copy (caller holds the transaction)
+static int copy_subtree_rows(Database* db, int source_id, int dest_parent_id, const char* name,
+                             int user_id) {
+    // Old ID -> new ID and blob name for every entry the user may read,
+    // unreadable directories pruned with everything below them. New IDs
+    // follow the highest ever handed out, numbered in ancestry order so
+    // parents come first.
+    const char* plan_sql[] = {
+        "CREATE TEMP TABLE IF NOT EXISTS copy_map ("
+        "  old_id INTEGER PRIMARY KEY, new_id INTEGER NOT NULL, new_path TEXT)",
+        "DELETE FROM temp.copy_map",
+        "INSERT INTO temp.copy_map (old_id, new_id, new_path) "
+        "SELECT p.file_id, "
+        "       (SELECT MAX(COALESCE((SELECT seq FROM sqlite_sequence WHERE name = 'files'), 0), "
+        "                   (SELECT COALESCE(MAX(id), 0) FROM files))) "
+        "         + row_number() OVER (ORDER BY p.ancestry), "
+        "       CASE WHEN f.physical_path IS NULL THEN NULL ELSE "
+        "         lower(hex(randomblob(4)) || '-' || hex(randomblob(2)) || '-4' || "
+        "               substr(hex(randomblob(2)), 2) || '-' || "
+        "               substr('89ab', 1 + abs(random()) % 4, 1) || substr(hex(randomblob(2)), 2) || '-' || "
+        "               hex(randomblob(6))) END "
+        "FROM file_paths b "
+        "JOIN file_paths p ON p.ancestry >= b.ancestry AND p.ancestry < b.ancestry || ':' "
+        "JOIN files f ON f.id = p.file_id "
+        "WHERE b.file_id = ?1 AND " SQL_READABLE("f", "?4") " AND " SQL_PATH_READABLE("?4"),
+    };
+    for (size_t i = 0; i < sizeof(plan_sql) / sizeof(plan_sql[0]); i++) {
+        int changes = copy_exec(db, plan_sql[i], source_id, dest_parent_id, name, user_id);
+        if (changes < 0) return -1;
+        if (i == 2 && changes == 0) {
+            log_error("db_copy_subtree: Source %d not found", source_id);
+            return -1;
+        }
+    }
+
+    const char* copy_sql[] = {
+        "INSERT INTO files (id, parent_id, name, physical_path, owner_id, size, is_directory, permissions) "
+        "SELECT m.new_id, CASE WHEN f.id = ?1 THEN ?2 ELSE pm.new_id END, "
+        "       CASE WHEN f.id = ?1 AND ?3 != '' THEN ?3 ELSE f.name END, "
+        "       m.new_path, ?4, f.size, f.is_directory, f.permissions "
+        "FROM temp.copy_map m JOIN files f ON f.id = m.old_id "
+        "LEFT JOIN temp.copy_map pm ON pm.old_id = f.parent_id "
+        "ORDER BY m.new_id",
+        "INSERT INTO blob_encoding (physical_path, encoding, stored_size) "
+        "SELECT m.new_path, e.encoding, e.stored_size FROM temp.copy_map m "
+        "JOIN files f ON f.id = m.old_id JOIN blob_encoding e ON e.physical_path = f.physical_path "
+        "WHERE m.new_path IS NOT NULL",
+        // The scrubber re-verifies the copies (verified_at starts at 0)
+        "INSERT INTO blob_checksums (physical_path, chunk_size, crcs) "
+        "SELECT m.new_path, c.chunk_size, c.crcs FROM temp.copy_map m "
+        "JOIN files f ON f.id = m.old_id JOIN blob_checksums c ON c.physical_path = f.physical_path "
+        "WHERE m.new_path IS NOT NULL",
+    };
+    for (size_t i = 0; i < sizeof(copy_sql) / sizeof(copy_sql[0]); i++) {
+        if (copy_exec(db, copy_sql[i], source_id, dest_parent_id, name, user_id) < 0) return -1;
+    }
+    return 0;
+}
+
+int db_copy_subtree(Database* db, int source_id, int dest_parent_id, const char* new_name,
+                    int user_id, BlobCopy** blobs, int* blob_count) {
+    if (!db || !blobs || !blob_count || source_id == 0) return -1;
+
+    *blobs = NULL;
+    *blob_count = 0;
+    write_lock(db);
+
+    int result = exec_locked(db, "BEGIN");
+    if (result == 0) {
+        result = copy_subtree_rows(db, source_id, dest_parent_id, new_name ? new_name : "", user_id);
+        if (result == 0) {
+            result = copy_blob_list(db, blobs, blob_count);
+        }
+        if (result == 0) {
+            result = exec_locked(db, "COMMIT");
+        }
+        if (result < 0) {
+            exec_locked(db, "ROLLBACK");
+            free(*blobs);
+            *blobs = NULL;
+            *blob_count = 0;
+        }
+    }
+
+    // The top of the copy is first in ancestry order
+    int new_id = -1;
+    if (result == 0) {
+        sqlite3_stmt* stmt;
+        if (stmt_prepare(db, db->conn, "SELECT new_id FROM temp.copy_map WHERE old_id = ?", &stmt) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, source_id);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                new_id = sqlite3_column_int(stmt, 0);
+            }
+            stmt_release(stmt);
+        }
+    }
+
+    write_unlock(db);
+
+    if (new_id > 0) {
+        log_info("Copied subtree %d to %d (new id: %d, %d blobs)", source_id, dest_parent_id, new_id, *blob_count);
+    }
+    return new_id;
+}
+
+int db_delete_subtree(Database* db, int file_id, int user_id) {
+    if (!db || file_id == 0) return -1;
+
+    WriteGroup* group = write_begin(db);
+
+    // The ID list is materialized before any row goes, so the triggers
+    // removing file_paths rows do not disturb it. It is empty if any
+    // directory in the subtree is not both readable and writable.
+    const char* sql = "DELETE FROM files WHERE id IN ("
+                      "  SELECT p.file_id FROM file_paths r "
+                      "  JOIN file_paths p ON p.ancestry >= r.ancestry AND p.ancestry < r.ancestry || ':' "
+                      "  WHERE r.file_id = ?1 AND (?2 < 0 OR NOT EXISTS ("
+                      "    SELECT 1 FROM file_paths q JOIN files d ON d.id = q.file_id "
+                      "    WHERE q.ancestry >= r.ancestry AND q.ancestry < r.ancestry || ':' "
+                      "      AND d.is_directory = 1 "
+                      "      AND NOT (" SQL_READABLE("d", "?2") " AND " SQL_WRITABLE("d", "?2") ")))) "
+                      "RETURNING id";
+    sqlite3_stmt* stmt;
+
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_delete_subtree: prepare failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, file_id);
+    sqlite3_bind_int(stmt, 2, user_id);
+
+    // Cached rows are dropped once the delete has committed (right away
+    // if the list cannot grow)
+    int* ids = NULL;
+    int kept = 0;
+    int capacity = 0;
+    int deleted = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        deleted++;
+        if (kept == capacity) {
+            int* grown = realloc(ids, (size_t)(capacity ? capacity * 2 : 64) * sizeof(int));
+            if (!grown) {
+                file_cache_invalidate(db->file_cache, id);
+                continue;
+            }
+            ids = grown;
+            capacity = capacity ? capacity * 2 : 64;
+        }
+        ids[kept++] = id;
+    }
+    stmt_release(stmt);
+
+    if (rc != SQLITE_DONE) {
+        log_error("db_delete_subtree: step failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        free(ids);
+        return -1;
+    }
+
+    int result = write_end(db, group, deleted);
+    for (int i = 0; i < kept; i++) {
+        file_cache_invalidate(db->file_cache, ids[i]);
+    }
+    free(ids);
+
+    if (result >= 0) {
+        log_info("Deleted subtree %d (%d entries)", file_id, deleted);
+    }
+    return result;
+}
+
 // Move a file to a different parent directory
 int db_move_file(Database* db, int file_id, int new_parent_id) {
     if (!db) return -1;
 
-    pthread_mutex_lock(&db->mutex);
+    WriteGroup* group = write_begin(db);
 
-    // Check if file exists
-    const char* check_sql = "SELECT id FROM files WHERE id = ?";
+    // Check the file exists and the new parent is not inside it
+    const char* check_sql =
+        "SELECT EXISTS (SELECT 1 FROM file_paths a JOIN file_paths p ON p.file_id = ?2 "
+        "               WHERE a.file_id = ?1 AND p.ancestry >= a.ancestry "
+        "                 AND p.ancestry < a.ancestry || ':') "
+        "FROM files WHERE id = ?1";
     sqlite3_stmt* check_stmt;
 
-    int rc = sqlite3_prepare_v2(db->conn, check_sql, -1, &check_stmt, NULL);
+    int rc = stmt_prepare(db, db->conn, check_sql, &check_stmt);
     if (rc != SQLITE_OK) {
         log_error("db_move_file: prepare check failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
     sqlite3_bind_int(check_stmt, 1, file_id);
+    sqlite3_bind_int(check_stmt, 2, new_parent_id);
     rc = sqlite3_step(check_stmt);
-    sqlite3_finalize(check_stmt);
+    int cycle = (rc == SQLITE_ROW) ? sqlite3_column_int(check_stmt, 0) : 0;
+    stmt_release(check_stmt);
 
     if (rc != SQLITE_ROW) {
         log_error("db_move_file: File %d not found", file_id);
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
+        return -1;
+    }
+    if (cycle) {
+        log_error("db_move_file: Cannot move %d into its own subtree (%d)", file_id, new_parent_id);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -1096,10 +2608,10 @@ int db_move_file(Database* db, int file_id, int new_parent_id) {
     const char* sql = "UPDATE files SET parent_id = ? WHERE id = ?";
     sqlite3_stmt* stmt;
 
-    rc = sqlite3_prepare_v2(db->conn, sql, -1, &stmt, NULL);
+    rc = stmt_prepare(db, db->conn, sql, &stmt);
     if (rc != SQLITE_OK) {
         log_error("db_move_file: prepare failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
@@ -1107,15 +2619,479 @@ int db_move_file(Database* db, int file_id, int new_parent_id) {
     sqlite3_bind_int(stmt, 2, file_id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    stmt_release(stmt);
 
     if (rc != SQLITE_DONE) {
         log_error("db_move_file: step failed: %s", sqlite3_errmsg(db->conn));
-        pthread_mutex_unlock(&db->mutex);
+        write_end(db, group, -1);
         return -1;
     }
 
-    pthread_mutex_unlock(&db->mutex);
+    if (write_end(db, group, 0) < 0) return -1;
+    file_cache_invalidate(db->file_cache, file_id);
     log_info("Moved file %d to parent %d", file_id, new_parent_id);
     return 0;
 }
+
+// Point a file at a new blob (e.g. after a delta upload rebuilt it)
+int db_update_file_blob(Database* db, int file_id, const char* physical_path, long size) {
+    if (!db || !physical_path) return -1;
+
+    WriteGroup* group = write_begin(db);
+
+    const char* sql = "UPDATE files SET physical_path = ?, size = ? WHERE id = ? AND is_directory = 0";
+    sqlite3_stmt* stmt;
+
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_update_file_blob: prepare failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, physical_path, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, size);
+    sqlite3_bind_int(stmt, 3, file_id);
+
+    rc = sqlite3_step(stmt);
+    int changed = sqlite3_changes(db->conn);
+    stmt_release(stmt);
+
+    if (rc != SQLITE_DONE || changed != 1) {
+        log_error("db_update_file_blob: update of file %d failed: %s", file_id, sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        return -1;
+    }
+
+    if (write_end(db, group, 0) < 0) return -1;
+    file_cache_invalidate(db->file_cache, file_id);
+    return 0;
+}
+
+// Returns 1 if a file row points at this blob, 0 if none does, -1 on error
+int db_blob_referenced(Database* db, const char* physical_path) {
+    if (!db || !physical_path) return -1;
+
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT 1 FROM files WHERE physical_path = ? LIMIT 1";
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_blob_referenced: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, physical_path, -1, SQLITE_STATIC);
+
+    rc = sqlite3_step(stmt);
+    int result = (rc == SQLITE_ROW) ? 1 : (rc == SQLITE_DONE) ? 0 : -1;
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+
+    return result;
+}
+
+// List up to `limit` regular files with id > after_id, in id order
+int db_list_blob_refs(Database* db, int after_id, int limit, BlobRef** refs, int* count) {
+    if (!db || !refs || !count || limit <= 0) return -1;
+
+    *refs = malloc(limit * sizeof(BlobRef));
+    if (!*refs) return -1;
+    *count = 0;
+
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT f.id, f.physical_path, m.file_id IS NOT NULL "
+                      "FROM files f LEFT JOIN missing_blobs m ON m.file_id = f.id "
+                      "WHERE f.id > ? AND f.is_directory = 0 "
+                      "ORDER BY f.id LIMIT ?";
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_list_blob_refs: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        free(*refs);
+        *refs = NULL;
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, after_id);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        BlobRef* ref = &(*refs)[*count];
+        memset(ref, 0, sizeof(BlobRef));
+        ref->id = sqlite3_column_int(stmt, 0);
+        const char* path = (const char*)sqlite3_column_text(stmt, 1);
+        if (path) strncpy(ref->physical_path, path, sizeof(ref->physical_path) - 1);
+        ref->missing = sqlite3_column_int(stmt, 2);
+        (*count)++;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+
+    return (rc == SQLITE_DONE) ? 0 : -1;
+}
+
+int db_set_blob_missing(Database* db, int file_id, int missing) {
+    if (!db) return -1;
+
+    WriteGroup* group = write_begin(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = missing
+        ? "INSERT OR IGNORE INTO missing_blobs (file_id) VALUES (?)"
+        : "DELETE FROM missing_blobs WHERE file_id = ?";
+
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_set_blob_missing: prepare failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, file_id);
+
+    rc = sqlite3_step(stmt);
+    int result = (rc == SQLITE_DONE) ? 0 : -1;
+
+    stmt_release(stmt);
+    result = write_end(db, group, result);
+
+    return result;
+}
+
+int db_set_blob_checksums(Database* db, const char* physical_path, int chunk_size,
+                          const uint32_t* crcs, int count) {
+    if (!db || !physical_path || chunk_size <= 0 || count < 0 || (count > 0 && !crcs)) return -1;
+
+    // Stored little-endian regardless of host order
+    uint8_t* blob = malloc(count > 0 ? count * 4 : 1);
+    if (!blob) return -1;
+    for (int i = 0; i < count; i++) {
+        blob[i * 4] = crcs[i] & 0xFF;
+        blob[i * 4 + 1] = (crcs[i] >> 8) & 0xFF;
+        blob[i * 4 + 2] = (crcs[i] >> 16) & 0xFF;
+        blob[i * 4 + 3] = (crcs[i] >> 24) & 0xFF;
+    }
+
+    WriteGroup* group = write_begin(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT OR REPLACE INTO blob_checksums "
+                      "(physical_path, chunk_size, crcs, verified_at, corrupt) "
+                      "VALUES (?, ?, ?, strftime('%s','now'), 0)";
+
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_set_blob_checksums: prepare failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        free(blob);
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, physical_path, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, chunk_size);
+    sqlite3_bind_blob(stmt, 3, blob, count * 4, SQLITE_STATIC);
+
+    rc = sqlite3_step(stmt);
+    int result = (rc == SQLITE_DONE) ? 0 : -1;
+
+    stmt_release(stmt);
+    result = write_end(db, group, result);
+    free(blob);
+
+    return result;
+}
+
+// Returns 0 with a malloc'd CRC array, 1 if the blob has no checksums, -1 on error
+int db_get_blob_checksums(Database* db, const char* physical_path, int* chunk_size,
+                          uint32_t** crcs, int* count) {
+    if (!db || !physical_path || !chunk_size || !crcs || !count) return -1;
+
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT chunk_size, crcs FROM blob_checksums WHERE physical_path = ?";
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_get_blob_checksums: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, physical_path, -1, SQLITE_STATIC);
+
+    int result = 1;
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        *chunk_size = sqlite3_column_int(stmt, 0);
+        const uint8_t* blob = sqlite3_column_blob(stmt, 1);
+        int n = sqlite3_column_bytes(stmt, 1) / 4;
+
+        *crcs = malloc(n > 0 ? n * sizeof(uint32_t) : 1);
+        if (*crcs) {
+            for (int i = 0; i < n; i++) {
+                (*crcs)[i] = (uint32_t)blob[i * 4] | ((uint32_t)blob[i * 4 + 1] << 8) |
+                             ((uint32_t)blob[i * 4 + 2] << 16) | ((uint32_t)blob[i * 4 + 3] << 24);
+            }
+            *count = n;
+            result = 0;
+        } else {
+            result = -1;
+        }
+    } else if (rc != SQLITE_DONE) {
+        result = -1;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+
+    return result;
+}
+
+// Blobs last verified before `verified_before` (unix time), coldest first
+int db_list_scrub_candidates(Database* db, long verified_before, int limit,
+                             char (**paths)[64], int* count) {
+    if (!db || !paths || !count || limit <= 0) return -1;
+
+    *paths = malloc((size_t)limit * 64);
+    if (!*paths) return -1;
+    *count = 0;
+
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT physical_path FROM blob_checksums "
+                      "WHERE verified_at < ? AND corrupt = 0 "
+                      "ORDER BY verified_at LIMIT ?";
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_list_scrub_candidates: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        free(*paths);
+        *paths = NULL;
+        return -1;
+    }
+
+    sqlite3_bind_int64(stmt, 1, verified_before);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* path = (const char*)sqlite3_column_text(stmt, 0);
+        if (!path) continue;
+        strncpy((*paths)[*count], path, 63);
+        (*paths)[*count][63] = '\0';
+        (*count)++;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+
+    return (rc == SQLITE_DONE) ? 0 : -1;
+}
+
+int db_mark_blob_verified(Database* db, const char* physical_path, int corrupt) {
+    if (!db || !physical_path) return -1;
+
+    WriteGroup* group = write_begin(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "UPDATE blob_checksums SET verified_at = strftime('%s','now'), corrupt = ? "
+                      "WHERE physical_path = ?";
+
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_mark_blob_verified: prepare failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, corrupt);
+    sqlite3_bind_text(stmt, 2, physical_path, -1, SQLITE_STATIC);
+
+    rc = sqlite3_step(stmt);
+    int result = (rc == SQLITE_DONE) ? 0 : -1;
+
+    stmt_release(stmt);
+    result = write_end(db, group, result);
+
+    return result;
+}
+
+int db_set_blob_encoding(Database* db, const char* physical_path, const char* encoding, long stored_size) {
+    if (!db || !physical_path || !encoding) return -1;
+
+    WriteGroup* group = write_begin(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT OR REPLACE INTO blob_encoding (physical_path, encoding, stored_size) "
+                      "VALUES (?, ?, ?)";
+
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_set_blob_encoding: prepare failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, physical_path, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, encoding, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, stored_size);
+
+    rc = sqlite3_step(stmt);
+    int result = (rc == SQLITE_DONE) ? 0 : -1;
+
+    stmt_release(stmt);
+    result = write_end(db, group, result);
+
+    return result;
+}
+
+// Forget a blob's encoding (its write failed, so it is not stored at all)
+int db_clear_blob_encoding(Database* db, const char* physical_path) {
+    if (!db || !physical_path) return -1;
+
+    WriteGroup* group = write_begin(db);
+
+    sqlite3_stmt* stmt;
+    int rc = stmt_prepare(db, db->conn, "DELETE FROM blob_encoding WHERE physical_path = ?", &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_clear_blob_encoding: prepare failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, physical_path, -1, SQLITE_STATIC);
+
+    rc = sqlite3_step(stmt);
+    int result = (rc == SQLITE_DONE) ? 0 : -1;
+
+    stmt_release(stmt);
+    result = write_end(db, group, result);
+
+    return result;
+}
+
+// Returns 0 if the blob is encoded, 1 if it is stored raw, -1 on error
+int db_get_blob_encoding(Database* db, const char* physical_path, char* encoding, int encoding_size,
+                         long* stored_size) {
+    if (!db || !physical_path || !encoding || encoding_size <= 0) return -1;
+
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT encoding, stored_size FROM blob_encoding WHERE physical_path = ?";
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_get_blob_encoding: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, physical_path, -1, SQLITE_STATIC);
+
+    int result = 1;
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        const char* enc = (const char*)sqlite3_column_text(stmt, 0);
+        strncpy(encoding, enc ? enc : "", encoding_size - 1);
+        encoding[encoding_size - 1] = '\0';
+        if (stored_size) *stored_size = sqlite3_column_int64(stmt, 1);
+        result = 0;
+    } else if (rc != SQLITE_DONE) {
+        result = -1;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+
+    return result;
+}
+
+// Usage and limits for a user; zeros if the user has no files and no quota
+int db_get_quota(Database* db, int user_id, UserQuota* quota) {
+    if (!db || !quota) return -1;
+
+    memset(quota, 0, sizeof(*quota));
+    sqlite3* conn = reader_acquire(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT max_bytes, max_files, bytes_used, files_used "
+                      "FROM user_quotas WHERE user_id = ?";
+
+    int rc = stmt_prepare(db, conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_get_quota: prepare failed: %s", sqlite3_errmsg(conn));
+        reader_release(db, conn);
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, user_id);
+
+    int result = 0;
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        quota->max_bytes = sqlite3_column_int64(stmt, 0);
+        quota->max_files = sqlite3_column_int64(stmt, 1);
+        quota->bytes_used = sqlite3_column_int64(stmt, 2);
+        quota->files_used = sqlite3_column_int64(stmt, 3);
+    } else if (rc != SQLITE_DONE) {
+        result = -1;
+    }
+
+    stmt_release(stmt);
+    reader_release(db, conn);
+
+    return result;
+}
+
+int db_set_quota(Database* db, int user_id, long max_bytes, long max_files) {
+    if (!db || max_bytes < 0 || max_files < 0) return -1;
+
+    WriteGroup* group = write_begin(db);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO user_quotas (user_id, max_bytes, max_files) VALUES (?, ?, ?) "
+                      "ON CONFLICT(user_id) DO UPDATE SET max_bytes = excluded.max_bytes, "
+                      "max_files = excluded.max_files";
+
+    int rc = stmt_prepare(db, db->conn, sql, &stmt);
+    if (rc != SQLITE_OK) {
+        log_error("db_set_quota: prepare failed: %s", sqlite3_errmsg(db->conn));
+        write_end(db, group, -1);
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, user_id);
+    sqlite3_bind_int64(stmt, 2, max_bytes);
+    sqlite3_bind_int64(stmt, 3, max_files);
+
+    rc = sqlite3_step(stmt);
+    stmt_release(stmt);
+    return write_end(db, group, (rc == SQLITE_DONE) ? 0 : -1);
+}
+
+// Returns 1 if the user may add `add_bytes` bytes in `add_files` new files,
+// 0 if that would exceed their quota, -1 on error
+int db_quota_allows(Database* db, int user_id, long add_bytes, int add_files) {
+    UserQuota quota;
+    if (db_get_quota(db, user_id, &quota) < 0) return -1;
+
+    if (quota.max_bytes > 0 && add_bytes > 0 && quota.bytes_used + add_bytes > quota.max_bytes) {
+        return 0;
+    }
+    if (quota.max_files > 0 && add_files > 0 && quota.files_used + add_files > quota.max_files) {
+        return 0;
+    }
+    return 1;
+}
@@ -3,11 +3,63 @@
 
 #include <sqlite3.h>
 #include <pthread.h>
+#include <stdint.h>
 
-// Database handle
+#define DB_MAX_READERS 32
+#define DB_BUSY_TIMEOUT_MS 5000
+#define DB_FILE_CACHE_DEFAULT_ENTRIES 16384
+#define DB_STMT_CACHE_INITIAL 64        // Slots per connection (power of two)
+#define DB_GROUP_COMMIT_DEFAULT_US 1000 // Longest a group waits for more writers
+#define DB_GROUP_COMMIT_DEFAULT_MAX 64  // Writes per group transaction
+
+// Prepared statements of one connection, keyed by their SQL text. They are
+// reset rather than finalized after each call and live until db_close.
+typedef struct {
+    uint32_t hash;
+    sqlite3_stmt* stmt;                 // NULL for a free slot
+} CachedStatement;
+
+typedef struct {
+    CachedStatement* slots;
+    int capacity;
+    int count;
+} StatementCache;
+
+// What the writer knows about the monthly activity partitions, so inserts
+// skip the catalog lookups (under `mutex`; cleared when a transaction that
+// may have changed it rolls back)
+#define DB_ACTIVITY_ACTIONS_CACHED 64
+
+typedef struct {
+    char month[8];                      // Newest partition known to exist
+    long long next_id;                  // 0 until read from sqlite_sequence
+    int action_count;
+    struct {
+        char name[32];
+        int code;
+    } actions[DB_ACTIVITY_ACTIONS_CACHED];
+} ActivityPartitions;
+
+// Database handle. All writes go through the single writer connection,
+// serialized by `mutex`. Pure queries borrow one of the read-only
+// connections instead, so they run concurrently (WAL mode) with each
+// other and with the writer.
 typedef struct {
-    sqlite3* conn;
+    sqlite3* conn;                      // Writer
     pthread_mutex_t mutex;
+    sqlite3* readers[DB_MAX_READERS];
+    int reader_count;
+    sqlite3* idle[DB_MAX_READERS];      // Readers not checked out
+    int idle_count;
+    pthread_mutex_t pool_mutex;
+    pthread_cond_t pool_cond;
+    StatementCache writer_cache;
+    StatementCache reader_caches[DB_MAX_READERS];
+    struct ActivityWriter* activity;    // Asynchronous log writer, if started
+    struct FileCache* file_cache;       // FileEntry rows by ID (NULL if disabled)
+    struct GroupCommit* group_commit;   // Shared transactions for concurrent writes (NULL if off)
+    struct VfsTree* vfs;                // In-memory snapshot of the file tree (NULL if off)
+    ActivityPartitions activity_parts;
 } Database;
 
 // File entry structure (for VFS operations)
@@ -23,6 +75,65 @@ typedef struct {
     char created_at[32];
 } FileEntry;
 
+// Blob reference (for storage garbage collection)
+typedef struct {
+    int id;
+    char physical_path[64];
+    int missing;            // Currently flagged in missing_blobs
+} BlobRef;
+
+// Entry of a subtree listing, with its path below the subtree root
+typedef struct {
+    FileEntry file;
+    char path[1024];
+    long mtime;             // created_at as a Unix timestamp
+} TreeEntry;
+
+// Entry of a batched folder import
+typedef struct {
+    int parent_id;              // Parent directory when parent_index < 0
+    int parent_index;           // Earlier entry of the same batch holding the parent
+    char name[256];
+    char physical_path[64];     // Empty for directories
+    long size;
+    int is_directory;
+    int permissions;
+    const char* encoding;       // Blob encoding, or NULL if stored raw
+    long stored_size;
+    uint32_t* crcs;             // Chunk checksums of the stored blob
+    int crc_count;
+    int id;                     // Set by db_import_entries
+} ImportEntry;
+
+// Per-user quota limits (0 = unlimited) and current usage
+typedef struct {
+    long max_bytes;
+    long max_files;
+    long bytes_used;
+    long files_used;
+} UserQuota;
+
+// Number of read-only connections opened by db_init (default: one per
+// core, at least 2; 0 sends queries through the writer)
+void db_set_reader_count(int count);
+
+// Capacity of the FileEntry cache behind db_get_file_by_id (0 disables it)
+void db_set_file_cache_entries(int entries);
+
+// Group commit: concurrent metadata writes share one transaction, waiting
+// at most `window_us` for each other, up to `max_writes` per transaction
+// (window 0: every write commits on its own)
+void db_set_group_commit(int window_us, int max_writes);
+
+// In-memory snapshot of the whole file tree for lock-free lookups,
+// listings and path and permission checks, rebuilt once writes have been
+// quiet for `quiet_ms` (0: off). Until then a changed tree is read from
+// SQLite as usual.
+void db_set_vfs_snapshot(int quiet_ms);
+
+// Whether reads are currently answered from an up-to-date snapshot
+int db_vfs_snapshot_current(Database* db);
+
 // Initialize database connection
 Database* db_init(const char* db_path);
 
@@ -45,8 +156,47 @@ int db_delete_user(Database* db, int user_id);
 int db_update_user(Database* db, int user_id, int is_admin, int is_active);
 int db_create_user_admin(Database* db, const char* username, const char* password_hash, int is_admin);
 
-// Activity logging
+// Activity logging. Records are stored in one table per UTC month
+// (activity_logs_YYYYMM) with the action as an integer code; the
+// activity_logs view reads them all. Once the asynchronous writer is started,
+// db_log_activity only queues the record; the writer thread inserts queued
+// records every `flush_ms` or as soon as `batch` of them are waiting, one
+// transaction per batch. When the queue is full, producers block, drop the
+// record, or spill it (insert it synchronously as before).
+#define ACTIVITY_DEFAULT_FLUSH_MS 100
+#define ACTIVITY_DEFAULT_BATCH 256
+#define ACTIVITY_ACTION_MAX 32
+
+typedef enum {
+    ACTIVITY_OVERFLOW_BLOCK,
+    ACTIVITY_OVERFLOW_DROP,
+    ACTIVITY_OVERFLOW_SPILL
+} ActivityOverflow;
+
+typedef struct {
+    int user_id;
+    char action_type[ACTIVITY_ACTION_MAX];
+    char* description;                  // Owned by the record
+    char timestamp[20];                 // UTC, same format as CURRENT_TIMESTAMP
+} ActivityRecord;
+
+int db_start_activity_writer(Database* db, int flush_ms, int batch, ActivityOverflow overflow);
+
+// Wait until every record queued so far is in the table
+void db_flush_activity(Database* db);
+
+// Insert records in one transaction (the writer thread, or a record written synchronously)
+int db_insert_activity(Database* db, const ActivityRecord* records, int count);
+
 int db_log_activity(Database* db, int user_id, const char* action_type, const char* description);
+
+// Keep only the newest `months` monthly partitions, counting the current
+// one (0 keeps everything). Applied at startup and whenever a new month
+// begins; db_prune_activity applies it now and returns the number dropped.
+void db_set_activity_retention(int months);
+int db_prune_activity(Database* db);
+
+// Newest first; the action filter matches any part of the action name
 int db_list_activity_logs(Database* db, int user_id_filter, const char* action_type_filter,
                           const char* start_date, const char* end_date,
                           int limit, char** json_result);
@@ -55,18 +205,118 @@ int db_list_activity_logs(Database* db, int user_id_filter, const char* action_t
 int db_create_file(Database* db, int parent_id, const char* name, const char* physical_path,
                    int owner_id, long size, int is_directory, int permissions);
 int db_get_file_by_id(Database* db, int file_id, FileEntry* entry);
+int db_get_file_path(Database* db, int file_id, char* path, size_t size);
 int db_list_directory(Database* db, int parent_id, FileEntry** entries, int* count);
+
+// One row of a directory scan; the strings are only valid during the callback
+typedef struct {
+    int id;
+    const char* name;
+    int owner_id;
+    const char* owner;          // Owner's username, or "unknown"
+    long size;
+    int is_directory;
+    int permissions;
+    long total_bytes;           // Directories: bytes of every file below
+    int total_files;            // Directories: number of files below
+} DirectoryRow;
+
+// Position in the order of listings and searches: directories first, then
+// by name, then by ID. Pages resume strictly after it.
+typedef struct {
+    int is_directory;
+    char name[256];
+    int id;
+} ListCursor;
+
+// Stream the entries of a directory that `user_id` may read (directories
+// first, then by name) together with their owners' names from a single
+// query. `on_row` returns 0 to continue or -1 to stop, which makes the scan
+// return -1.
+int db_scan_directory(Database* db, int parent_id, int user_id,
+                      int (*on_row)(void* ctx, const DirectoryRow* row), void* ctx);
+
+// Same, starting after `after` (NULL: from the start) and stopping after
+// `limit` rows (< 0: no limit). Each page is an index seek, not an offset.
+int db_scan_directory_page(Database* db, int parent_id, int user_id, const ListCursor* after,
+                           int limit, int (*on_row)(void* ctx, const DirectoryRow* row), void* ctx);
 int db_delete_file(Database* db, int file_id);
+int db_import_entries(Database* db, int owner_id, ImportEntry* entries, int count);
+int db_import_checksums(Database* db, const ImportEntry* entries, int count, int chunk_size);
+int db_list_subtree(Database* db, int dir_id, int user_id, TreeEntry** entries, int* count);
 int db_update_permissions(Database* db, int file_id, int permissions);
 
-// Search operations
+// Bytes and number of files in the whole subtree of a directory, kept up
+// to date by the schema's triggers (one row lookup, no walk)
+int db_get_dir_totals(Database* db, int dir_id, long* bytes, int* files);
+
+// Whether `user_id` holds permission bits `bits[i]` (4 read, 2 write, 1
+// execute) on every `file_ids[i]`, all answered by one query. Returns 1 if
+// so, 0 if not (a missing file counts as denied; `denied_id`, if given,
+// gets the first one refused) or -1 on error.
+int db_check_access(Database* db, int user_id, const int* file_ids, const int* bits,
+                    int count, int* denied_id);
+
+// Search operations. Only entries `user_id` may read are returned, and
+// recursive searches skip whatever lies below a directory it may not read.
 int db_search_files(Database* db, int base_dir_id, const char* pattern,
                     int recursive, int user_id, int limit,
                     FileEntry** entries, int* count);
+// One page of results, those sorting after `after` (NULL: the first page)
+int db_search_files_page(Database* db, int base_dir_id, const char* pattern,
+                         int recursive, int user_id, const ListCursor* after, int limit,
+                         FileEntry** entries, int* count);
 
 // File management operations
 int db_rename_file(Database* db, int file_id, const char* new_name);
 int db_copy_file(Database* db, int source_id, int dest_parent_id, const char* new_name, int user_id);
 int db_move_file(Database* db, int file_id, int new_parent_id);
 
+// Blob duplicated by db_copy_subtree, whose contents the caller copies
+typedef struct {
+    char source[64];
+    char copy[64];
+} BlobCopy;
+
+// Copy an entry and everything below it that `user_id` may read under
+// `dest_parent_id` (the top renamed to `new_name` unless it is empty),
+// owned by `user_id`, in one transaction. Copies of files get new blob
+// names along with the encoding and checksum rows of the originals;
+// `blobs` lists the contents to copy.
+// Returns the ID of the copied top entry, or -1.
+int db_copy_subtree(Database* db, int source_id, int dest_parent_id, const char* new_name,
+                    int user_id, BlobCopy** blobs, int* blob_count);
+
+// Delete an entry and everything below it in one statement, leaving their
+// blobs to the storage GC. Nothing is deleted unless `user_id` may read and
+// write every directory in the subtree (a negative `user_id` skips the
+// check). Returns the number of rows deleted (0 if refused), or -1.
+int db_delete_subtree(Database* db, int file_id, int user_id);
+int db_update_file_blob(Database* db, int file_id, const char* physical_path, long size);
+
+// Storage GC operations
+int db_blob_referenced(Database* db, const char* physical_path);
+int db_list_blob_refs(Database* db, int after_id, int limit, BlobRef** refs, int* count);
+int db_set_blob_missing(Database* db, int file_id, int missing);
+
+// Blob checksum operations
+int db_set_blob_checksums(Database* db, const char* physical_path, int chunk_size,
+                          const uint32_t* crcs, int count);
+int db_get_blob_checksums(Database* db, const char* physical_path, int* chunk_size,
+                          uint32_t** crcs, int* count);
+int db_list_scrub_candidates(Database* db, long verified_before, int limit,
+                             char (**paths)[64], int* count);
+int db_mark_blob_verified(Database* db, const char* physical_path, int corrupt);
+
+// Blob encoding operations
+int db_set_blob_encoding(Database* db, const char* physical_path, const char* encoding, long stored_size);
+int db_clear_blob_encoding(Database* db, const char* physical_path);
+int db_get_blob_encoding(Database* db, const char* physical_path, char* encoding, int encoding_size,
+                         long* stored_size);
+
+// Quota operations (usage counters are maintained by triggers on files)
+int db_get_quota(Database* db, int user_id, UserQuota* quota);
+int db_set_quota(Database* db, int user_id, long max_bytes, long max_files);
+int db_quota_allows(Database* db, int user_id, long add_bytes, int add_files);
+
 #endif
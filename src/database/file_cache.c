@@ -0,0 +1,153 @@
+#include "file_cache.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    FileEntry entry;
+    int valid;
+    uint32_t last_used;
+} CacheWay;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    uint64_t generation;    // Bumped by every invalidation
+    uint32_t clock;         // LRU tick
+    CacheWay* ways;         // sets * FILE_CACHE_WAYS
+} CacheShard;
+
+struct FileCache {
+    CacheShard shards[FILE_CACHE_SHARDS];
+    int sets;               // Sets per shard
+};
+
+// IDs are sequential, so mix them before picking a shard and a set
+static uint32_t id_hash(int file_id) {
+    uint32_t h = (uint32_t)file_id * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+static CacheShard* shard_for(FileCache* cache, int file_id) {
+    return &cache->shards[id_hash(file_id) % FILE_CACHE_SHARDS];
+}
+
+static CacheWay* set_for(FileCache* cache, CacheShard* shard, int file_id) {
+    int set = (int)((id_hash(file_id) / FILE_CACHE_SHARDS) % (uint32_t)cache->sets);
+    return &shard->ways[set * FILE_CACHE_WAYS];
+}
+
+FileCache* file_cache_create(int entries) {
+    if (entries <= 0) {
+        return NULL;
+    }
+
+    FileCache* cache = calloc(1, sizeof(FileCache));
+    if (!cache) return NULL;
+
+    cache->sets = entries / (FILE_CACHE_SHARDS * FILE_CACHE_WAYS);
+    if (cache->sets < 1) cache->sets = 1;
+
+    for (int i = 0; i < FILE_CACHE_SHARDS; i++) {
+        CacheShard* shard = &cache->shards[i];
+        shard->ways = calloc((size_t)cache->sets * FILE_CACHE_WAYS, sizeof(CacheWay));
+        if (!shard->ways) {
+            for (int j = 0; j < i; j++) {
+                pthread_mutex_destroy(&cache->shards[j].mutex);
+                free(cache->shards[j].ways);
+            }
+            free(cache);
+            return NULL;
+        }
+        pthread_mutex_init(&shard->mutex, NULL);
+    }
+    return cache;
+}
+
+void file_cache_free(FileCache* cache) {
+    if (!cache) return;
+
+    for (int i = 0; i < FILE_CACHE_SHARDS; i++) {
+        pthread_mutex_destroy(&cache->shards[i].mutex);
+        free(cache->shards[i].ways);
+    }
+    free(cache);
+}
+
+int file_cache_get(FileCache* cache, int file_id, FileEntry* entry) {
+    if (!cache) return -1;
+
+    CacheShard* shard = shard_for(cache, file_id);
+    pthread_mutex_lock(&shard->mutex);
+
+    CacheWay* set = set_for(cache, shard, file_id);
+    int result = -1;
+    for (int i = 0; i < FILE_CACHE_WAYS; i++) {
+        if (set[i].valid && set[i].entry.id == file_id) {
+            *entry = set[i].entry;
+            set[i].last_used = ++shard->clock;
+            result = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+    return result;
+}
+
+uint64_t file_cache_generation(FileCache* cache, int file_id) {
+    if (!cache) return 0;
+
+    CacheShard* shard = shard_for(cache, file_id);
+    pthread_mutex_lock(&shard->mutex);
+    uint64_t generation = shard->generation;
+    pthread_mutex_unlock(&shard->mutex);
+    return generation;
+}
+
+void file_cache_put(FileCache* cache, const FileEntry* entry, uint64_t generation) {
+    if (!cache) return;
+
+    CacheShard* shard = shard_for(cache, entry->id);
+    pthread_mutex_lock(&shard->mutex);
+
+    // The row may have changed since it was read
+    if (shard->generation == generation) {
+        // Replace the same ID, else a free way, else the least recently used
+        CacheWay* set = set_for(cache, shard, entry->id);
+        CacheWay* victim = NULL;
+        for (int i = 0; i < FILE_CACHE_WAYS && !victim; i++) {
+            if (set[i].valid && set[i].entry.id == entry->id) victim = &set[i];
+        }
+        for (int i = 0; i < FILE_CACHE_WAYS && !victim; i++) {
+            if (!set[i].valid) victim = &set[i];
+        }
+        if (!victim) {
+            victim = &set[0];
+            for (int i = 1; i < FILE_CACHE_WAYS; i++) {
+                if (set[i].last_used < victim->last_used) victim = &set[i];
+            }
+        }
+        victim->entry = *entry;
+        victim->valid = 1;
+        victim->last_used = ++shard->clock;
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+void file_cache_invalidate(FileCache* cache, int file_id) {
+    if (!cache) return;
+
+    CacheShard* shard = shard_for(cache, file_id);
+    pthread_mutex_lock(&shard->mutex);
+
+    shard->generation++;
+    CacheWay* set = set_for(cache, shard, file_id);
+    for (int i = 0; i < FILE_CACHE_WAYS; i++) {
+        if (set[i].valid && set[i].entry.id == file_id) {
+            set[i].valid = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+}
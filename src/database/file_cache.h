@@ -0,0 +1,34 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <stdint.h>
+#include "db_manager.h"
+
+// In-memory cache of FileEntry rows by ID, internal to the database
+// module. Entries are spread over independently locked shards; each shard
+// is a 4-way set-associative table with LRU replacement within a set.
+//
+// Mutators invalidate an ID after changing its row. To keep a lookup that
+// raced with such a change from caching the old row, readers take the
+// shard's generation before querying and file_cache_put() drops the row
+// if an invalidation happened in between.
+
+#define FILE_CACHE_SHARDS 64
+#define FILE_CACHE_WAYS 4
+
+typedef struct FileCache FileCache;
+
+// NULL (caching disabled) if `entries` <= 0
+FileCache* file_cache_create(int entries);
+void file_cache_free(FileCache* cache);
+
+// Returns 0 and fills `entry` on a hit, -1 on a miss
+int file_cache_get(FileCache* cache, int file_id, FileEntry* entry);
+
+// Take before reading a row that will be passed to file_cache_put
+uint64_t file_cache_generation(FileCache* cache, int file_id);
+void file_cache_put(FileCache* cache, const FileEntry* entry, uint64_t generation);
+
+void file_cache_invalidate(FileCache* cache, int file_id);
+
+#endif
@@ -0,0 +1,169 @@
+#include "group_commit.h"
+#include "../common/utils.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct WriteGroup {
+    pthread_t leader;       // Member that opened the transaction and commits it
+    int members;            // Joined so far
+    int refs;               // Members that have not yet read the outcome
+    int done;               // Committed (or given up)
+    int failed;
+};
+
+struct GroupCommit {
+    int window_us;
+    int max_writes;
+    WriteGroup* open;       // Group taking new members (under db->mutex)
+    int in_transaction;     // A group's transaction has not ended yet
+    atomic_int active;      // Threads between write_begin and write_end
+    int exclusive_waiting;  // write_lock callers waiting for the group to end
+    pthread_cond_t cond;    // Used with db->mutex
+};
+
+GroupCommit* group_commit_create(int window_us, int max_writes) {
+    if (window_us <= 0) {
+        return NULL;
+    }
+
+    GroupCommit* gc = calloc(1, sizeof(GroupCommit));
+    if (!gc) return NULL;
+    gc->window_us = window_us;
+    gc->max_writes = max_writes > 0 ? max_writes : DB_GROUP_COMMIT_DEFAULT_MAX;
+    atomic_init(&gc->active, 0);
+    pthread_cond_init(&gc->cond, NULL);
+    return gc;
+}
+
+void group_commit_free(GroupCommit* gc) {
+    if (!gc) return;
+    pthread_cond_destroy(&gc->cond);
+    free(gc);
+}
+
+// Helper: run transaction control on the writer; 0 on success
+static int exec_control(Database* db, const char* sql) {
+    char* err = NULL;
+    if (sqlite3_exec(db->conn, sql, NULL, NULL, &err) != SQLITE_OK) {
+        log_error("Group commit: %s failed: %s", sql, err ? err : sqlite3_errmsg(db->conn));
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+WriteGroup* write_begin(Database* db) {
+    GroupCommit* gc = db->group_commit;
+    if (!gc) {
+        pthread_mutex_lock(&db->mutex);
+        return NULL;
+    }
+
+    atomic_fetch_add(&gc->active, 1);
+    pthread_mutex_lock(&db->mutex);
+
+    // A closed group must finish first; a waiting exclusive writer goes
+    // before the next group
+    while (!gc->open && (gc->in_transaction || gc->exclusive_waiting > 0)) {
+        pthread_cond_wait(&gc->cond, &db->mutex);
+    }
+
+    WriteGroup* group = gc->open;
+    if (!group) {
+        group = calloc(1, sizeof(WriteGroup));
+        if (!group || exec_control(db, "BEGIN") < 0) {
+            free(group);
+            atomic_fetch_sub(&gc->active, 1);
+            return NULL;    // Autocommit this one
+        }
+        group->leader = pthread_self();
+        gc->open = group;
+        gc->in_transaction = 1;
+    }
+    group->members++;
+    group->refs++;
+    if (group->members >= gc->max_writes) {
+        gc->open = NULL;
+    }
+    return group;
+}
+
+// Helper: commit once every active writer has joined, the group is full
+// or the window has passed (leader only, db->mutex held)
+static void lead_commit(Database* db, GroupCommit* gc, WriteGroup* group) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)gc->window_us * 1000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    while (gc->open == group && atomic_load(&gc->active) > group->members) {
+        if (pthread_cond_timedwait(&gc->cond, &db->mutex, &deadline) == ETIMEDOUT) break;
+    }
+    if (gc->open == group) {
+        gc->open = NULL;
+    }
+
+    // An error that rolled the transaction back already failed the group
+    if (!group->failed && exec_control(db, "COMMIT") < 0) {
+        if (!sqlite3_get_autocommit(db->conn)) {
+            exec_control(db, "ROLLBACK");
+        }
+        group->failed = 1;
+    }
+    group->done = 1;
+    gc->in_transaction = 0;
+}
+
+int write_end(Database* db, WriteGroup* group, int result) {
+    if (!group) {
+        pthread_mutex_unlock(&db->mutex);
+        return result;
+    }
+    GroupCommit* gc = db->group_commit;
+
+    // Some errors (I/O, disk full) roll back the whole transaction
+    if (!group->done && sqlite3_get_autocommit(db->conn)) {
+        group->failed = 1;
+        if (gc->open == group) gc->open = NULL;
+    }
+
+    if (pthread_equal(group->leader, pthread_self())) {
+        lead_commit(db, gc, group);
+    } else {
+        pthread_cond_broadcast(&gc->cond);      // The leader may be waiting for us
+        while (!group->done) {
+            pthread_cond_wait(&gc->cond, &db->mutex);
+        }
+    }
+
+    int failed = group->failed;
+    if (--group->refs == 0) {
+        free(group);
+    }
+    atomic_fetch_sub(&gc->active, 1);
+    pthread_cond_broadcast(&gc->cond);
+    pthread_mutex_unlock(&db->mutex);
+    return failed ? -1 : result;
+}
+
+void write_lock(Database* db) {
+    GroupCommit* gc = db->group_commit;
+    pthread_mutex_lock(&db->mutex);
+    if (!gc) return;
+
+    gc->exclusive_waiting++;
+    while (gc->in_transaction) {
+        pthread_cond_wait(&gc->cond, &db->mutex);
+    }
+    gc->exclusive_waiting--;
+}
+
+void write_unlock(Database* db) {
+    if (db->group_commit) {
+        pthread_cond_broadcast(&db->group_commit->cond);
+    }
+    pthread_mutex_unlock(&db->mutex);
+}
@@ -0,0 +1,35 @@
+#ifndef GROUP_COMMIT_H
+#define GROUP_COMMIT_H
+
+#include "db_manager.h"
+
+// Group commit for the writer connection, internal to the database module.
+// The first mutation to arrive opens a transaction and leads the group;
+// mutations from other sessions that arrive while it is open run inside the
+// same transaction. The leader commits once nobody else is about to write,
+// the group is full or the window ends, and every member then gets the
+// result of its own statements, or -1 if the commit failed. One WAL sync
+// is shared by the whole group.
+
+typedef struct GroupCommit GroupCommit;
+typedef struct WriteGroup WriteGroup;
+
+// NULL (every write commits on its own) if `window_us` <= 0
+GroupCommit* group_commit_create(int window_us, int max_writes);
+void group_commit_free(GroupCommit* gc);
+
+// Take the writer for one mutation and join (or open) the current group.
+// Returns with db->mutex held; NULL means the write autocommits.
+WriteGroup* write_begin(Database* db);
+
+// Finish a mutation whose own outcome is `result`: wait for the group to
+// commit, release the writer and return `result`, or -1 if the group failed.
+// Cache invalidation for the mutation belongs after this call.
+int write_end(Database* db, WriteGroup* group, int result);
+
+// Take the writer for work that runs its own transaction, once no group
+// is open. Returns with db->mutex held; release with write_unlock().
+void write_lock(Database* db);
+void write_unlock(Database* db);
+
+#endif
@@ -0,0 +1,478 @@
+#include "vfs_snapshot.h"
+#include "../common/utils.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct VfsSnapshot {
+    uint64_t version;       // tree->changes when it was read
+    VfsNode* nodes;
+    int count;
+    int* children;          // Node indices, grouped by parent in listing order
+    int* index;             // ID -> node index + 1 (0: empty), open addressing
+    int index_mask;
+    char* strings;          // Offset 0 is ""
+};
+
+struct VfsTree {
+    _Atomic(VfsSnapshot*) current;
+    _Atomic(VfsSnapshot*) hazards[VFS_READER_SLOTS];
+    atomic_uint_fast64_t changes;   // Committed changes seen so far
+    int pending;                    // Uncommitted change on the writer (writer held)
+    sqlite3* writer;
+    sqlite3* conn;                  // Read connection of the rebuild thread
+    int quiet_ms;
+    int stopping;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+};
+
+static uint32_t id_hash(int id) {
+    uint32_t h = (uint32_t)id * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+const VfsNode* vfs_find(const VfsSnapshot* snap, int id) {
+    for (uint32_t i = id_hash(id) & (uint32_t)snap->index_mask; snap->index[i]; i = (i + 1) & (uint32_t)snap->index_mask) {
+        const VfsNode* node = &snap->nodes[snap->index[i] - 1];
+        if (node->id == id) return node;
+    }
+    return NULL;
+}
+
+const VfsNode* vfs_child(const VfsSnapshot* snap, const VfsNode* dir, int index) {
+    return &snap->nodes[snap->children[dir->first_child + index]];
+}
+
+const char* vfs_str(const VfsSnapshot* snap, uint32_t offset) {
+    return snap->strings + offset;
+}
+
+// Helper: listing order of a node against a cursor's key (<0, 0, >0)
+static int compare_key(const VfsSnapshot* snap, const VfsNode* node, int is_directory,
+                       const char* name, int id) {
+    if (node->is_directory != is_directory) return node->is_directory > is_directory ? -1 : 1;
+    int c = strcmp(vfs_str(snap, node->name), name);
+    if (c != 0) return c;
+    return node->id < id ? -1 : (node->id > id ? 1 : 0);
+}
+
+int vfs_seek_child(const VfsSnapshot* snap, const VfsNode* dir, const ListCursor* after) {
+    int lo = 0, hi = dir->child_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (compare_key(snap, vfs_child(snap, dir, mid), after->is_directory, after->name, after->id) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void snapshot_free(VfsSnapshot* snap) {
+    if (!snap) return;
+    free(snap->nodes);
+    free(snap->children);
+    free(snap->index);
+    free(snap->strings);
+    free(snap);
+}
+
+// Strings and owner names collected while reading the rows
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    int* owner_ids;         // Owner ID -> offset of the name, open addressing
+    uint32_t* owner_names;
+    int owner_mask;
+    int owner_count;
+    int failed;
+} SnapshotBuilder;
+
+static uint32_t add_string(SnapshotBuilder* b, const char* s) {
+    if (!s || !*s) return 0;
+    size_t n = strlen(s) + 1;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap;
+        while (b->len + n > cap) cap *= 2;
+        char* grown = realloc(b->data, cap);
+        if (!grown) {
+            b->failed = 1;
+            return 0;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    if (b->len + n > UINT32_MAX) {
+        b->failed = 1;
+        return 0;
+    }
+    memcpy(b->data + b->len, s, n);
+    uint32_t offset = (uint32_t)b->len;
+    b->len += n;
+    return offset;
+}
+
+// Helper: one copy of each owner's name (the table grows to stay half empty)
+static uint32_t owner_name(SnapshotBuilder* b, int owner_id, const char* name) {
+    if ((b->owner_count + 1) * 2 > b->owner_mask + 1) {
+        int cap = b->owner_mask < 0 ? 64 : (b->owner_mask + 1) * 2;
+        int* ids = malloc(sizeof(int) * (size_t)cap);
+        uint32_t* names = malloc(sizeof(uint32_t) * (size_t)cap);
+        if (!ids || !names) {
+            free(ids);
+            free(names);
+            b->failed = 1;
+            return 0;
+        }
+        memset(ids, 0xff, sizeof(int) * (size_t)cap);     // -1: empty
+        for (int i = 0; i <= b->owner_mask; i++) {
+            if (b->owner_ids[i] < 0) continue;
+            uint32_t j = id_hash(b->owner_ids[i]) & (uint32_t)(cap - 1);
+            while (ids[j] >= 0) j = (j + 1) & (uint32_t)(cap - 1);
+            ids[j] = b->owner_ids[i];
+            names[j] = b->owner_names[i];
+        }
+        free(b->owner_ids);
+        free(b->owner_names);
+        b->owner_ids = ids;
+        b->owner_names = names;
+        b->owner_mask = cap - 1;
+    }
+
+    uint32_t i = id_hash(owner_id) & (uint32_t)b->owner_mask;
+    while (b->owner_ids[i] >= 0) {
+        if (b->owner_ids[i] == owner_id) return b->owner_names[i];
+        i = (i + 1) & (uint32_t)b->owner_mask;
+    }
+    b->owner_ids[i] = owner_id;
+    b->owner_names[i] = add_string(b, name ? name : "unknown");
+    b->owner_count++;
+    return b->owner_names[i];
+}
+
+// Only the rebuild thread sorts, so the comparator can find the snapshot here
+static _Thread_local const VfsSnapshot* sorting;
+
+static int compare_children(const void* a, const void* b) {
+    const VfsNode* x = &sorting->nodes[*(const int*)a];
+    const VfsNode* y = &sorting->nodes[*(const int*)b];
+    if (x->parent_id != y->parent_id) return x->parent_id < y->parent_id ? -1 : 1;
+    return compare_key(sorting, x, y->is_directory, vfs_str(sorting, y->name), y->id);
+}
+
+// Helper: hash and child runs over the loaded nodes
+static int index_snapshot(VfsSnapshot* snap) {
+    int cap = 16;
+    while (cap < snap->count * 2) cap *= 2;
+    snap->index = calloc((size_t)cap, sizeof(int));
+    snap->children = malloc(sizeof(int) * (size_t)(snap->count ? snap->count : 1));
+    if (!snap->index || !snap->children) return -1;
+    snap->index_mask = cap - 1;
+
+    for (int n = 0; n < snap->count; n++) {
+        uint32_t i = id_hash(snap->nodes[n].id) & (uint32_t)snap->index_mask;
+        while (snap->index[i]) i = (i + 1) & (uint32_t)snap->index_mask;
+        snap->index[i] = n + 1;
+        snap->children[n] = n;
+    }
+
+    sorting = snap;
+    qsort(snap->children, (size_t)snap->count, sizeof(int), compare_children);
+    sorting = NULL;
+
+    for (int start = 0, end; start < snap->count; start = end) {
+        int parent_id = snap->nodes[snap->children[start]].parent_id;
+        end = start + 1;
+        while (end < snap->count && snap->nodes[snap->children[end]].parent_id == parent_id) {
+            end++;
+        }
+        const VfsNode* found = vfs_find(snap, parent_id);
+        if (found) {
+            VfsNode* parent = &snap->nodes[found - snap->nodes];
+            parent->first_child = start;
+            parent->child_count = end - start;
+        }
+    }
+    return 0;
+}
+
+// Helper: read every entry (one statement, so one consistent read transaction)
+static VfsSnapshot* snapshot_load(VfsTree* tree, uint64_t version) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT f.id, f.parent_id, f.name, f.physical_path, f.owner_id, f.size, "
+                      "       f.is_directory, f.permissions, f.created_at, t.bytes, t.files, u.username "
+                      "FROM files f LEFT JOIN dir_totals t ON t.dir_id = f.id "
+                      "LEFT JOIN users u ON u.id = f.owner_id";
+    if (sqlite3_prepare_v2(tree->conn, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("VFS snapshot: prepare failed: %s", sqlite3_errmsg(tree->conn));
+        return NULL;
+    }
+
+    VfsSnapshot* snap = calloc(1, sizeof(VfsSnapshot));
+    SnapshotBuilder b;
+    memset(&b, 0, sizeof(b));
+    b.owner_mask = -1;
+    b.cap = 4096;
+    b.data = malloc(b.cap);
+    if (b.data) {
+        b.data[b.len++] = '\0';
+    } else {
+        b.failed = 1;
+    }
+    int cap = 0;
+    int rc = SQLITE_ERROR;
+
+    while (snap && !b.failed && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (snap->count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            VfsNode* grown = realloc(snap->nodes, sizeof(VfsNode) * (size_t)cap);
+            if (!grown) {
+                b.failed = 1;
+                break;
+            }
+            snap->nodes = grown;
+        }
+        VfsNode* node = &snap->nodes[snap->count++];
+        memset(node, 0, sizeof(*node));
+        node->id = sqlite3_column_int(stmt, 0);
+        node->parent_id = sqlite3_column_int(stmt, 1);
+        node->name = add_string(&b, (const char*)sqlite3_column_text(stmt, 2));
+        node->physical_path = add_string(&b, (const char*)sqlite3_column_text(stmt, 3));
+        node->owner_id = sqlite3_column_int(stmt, 4);
+        node->size = sqlite3_column_int64(stmt, 5);
+        node->is_directory = sqlite3_column_int(stmt, 6);
+        node->permissions = sqlite3_column_int(stmt, 7);
+        node->created_at = add_string(&b, (const char*)sqlite3_column_text(stmt, 8));
+        node->total_bytes = sqlite3_column_int64(stmt, 9);
+        node->total_files = sqlite3_column_int(stmt, 10);
+        node->owner = owner_name(&b, node->owner_id, (const char*)sqlite3_column_text(stmt, 11));
+    }
+    if (rc != SQLITE_DONE && !b.failed) {
+        log_error("VFS snapshot: step failed: %s", sqlite3_errmsg(tree->conn));
+    }
+    sqlite3_finalize(stmt);
+    free(b.owner_ids);
+    free(b.owner_names);
+
+    if (!snap || rc != SQLITE_DONE || b.failed) {
+        free(b.data);
+        snapshot_free(snap);
+        return NULL;
+    }
+    snap->strings = b.data;
+    snap->version = version;
+    if (index_snapshot(snap) < 0) {
+        snapshot_free(snap);
+        return NULL;
+    }
+    return snap;
+}
+
+// Helper: swap in a new snapshot, then wait out the readers of the old one
+static void publish(VfsTree* tree, VfsSnapshot* snap) {
+    VfsSnapshot* old = atomic_exchange(&tree->current, snap);
+    if (!old) return;
+
+    for (int i = 0; i < VFS_READER_SLOTS; i++) {
+        while (atomic_load(&tree->hazards[i]) == old) {
+            sched_yield();
+        }
+    }
+    snapshot_free(old);
+}
+
+static void* rebuild_main(void* arg) {
+    VfsTree* tree = arg;
+    uint64_t failed_version = UINT64_MAX;
+
+    pthread_mutex_lock(&tree->mutex);
+    while (!tree->stopping) {
+        uint64_t changes = atomic_load(&tree->changes);
+        VfsSnapshot* current = atomic_load(&tree->current);
+        if ((current && current->version == changes) || changes == failed_version) {
+            pthread_cond_wait(&tree->wake, &tree->mutex);
+            continue;
+        }
+
+        // Wait for a quiet period; another change starts it over
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)tree->quiet_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        if (pthread_cond_timedwait(&tree->wake, &tree->mutex, &deadline) != ETIMEDOUT ||
+            atomic_load(&tree->changes) != changes || tree->stopping) {
+            continue;
+        }
+        pthread_mutex_unlock(&tree->mutex);
+
+        // Changes committed from here on make the new snapshot stale at once
+        VfsSnapshot* snap = snapshot_load(tree, changes);
+        if (snap) {
+            publish(tree, snap);
+        } else {
+            failed_version = changes;
+        }
+
+        pthread_mutex_lock(&tree->mutex);
+    }
+    pthread_mutex_unlock(&tree->mutex);
+    return NULL;
+}
+
+static void note_change(VfsTree* tree) {
+    pthread_mutex_lock(&tree->mutex);
+    atomic_fetch_add(&tree->changes, 1);
+    pthread_cond_signal(&tree->wake);
+    pthread_mutex_unlock(&tree->mutex);
+}
+
+// Writer hooks: a row change marks the transaction, its commit bumps `changes`
+static void row_changed(void* arg, int op, const char* db_name, const char* table, sqlite3_int64 rowid) {
+    (void)op;
+    (void)db_name;
+    (void)rowid;
+    VfsTree* tree = arg;
+    if (strcmp(table, "files") == 0 || strcmp(table, "dir_totals") == 0 || strcmp(table, "users") == 0) {
+        tree->pending = 1;
+    }
+}
+
+static int committed(void* arg, sqlite3* conn, const char* db_name, int frames) {
+    VfsTree* tree = arg;
+    if (tree->pending) {
+        tree->pending = 0;
+        note_change(tree);
+    }
+    if (frames >= VFS_WAL_CHECKPOINT_FRAMES) {
+        sqlite3_wal_checkpoint(conn, db_name);
+    }
+    return SQLITE_OK;
+}
+
+// Helper: whether the writer's journal is a WAL (the commit hook needs one)
+static int in_wal_mode(sqlite3* writer) {
+    sqlite3_stmt* stmt;
+    int wal = 0;
+    if (sqlite3_prepare_v2(writer, "PRAGMA journal_mode", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* mode = (const char*)sqlite3_column_text(stmt, 0);
+            wal = mode && strcmp(mode, "wal") == 0;
+        }
+        sqlite3_finalize(stmt);
+    }
+    return wal;
+}
+
+VfsTree* vfs_tree_create(sqlite3* writer, const char* db_path, int quiet_ms) {
+    if (quiet_ms <= 0) {
+        return NULL;
+    }
+    if (!in_wal_mode(writer)) {
+        log_error("VFS snapshot: database is not in WAL mode, snapshots disabled");
+        return NULL;
+    }
+
+    VfsTree* tree = calloc(1, sizeof(VfsTree));
+    if (!tree) return NULL;
+    if (sqlite3_open_v2(db_path, &tree->conn, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK) {
+        log_error("VFS snapshot: cannot open read connection");
+        sqlite3_close(tree->conn);
+        free(tree);
+        return NULL;
+    }
+    sqlite3_busy_timeout(tree->conn, DB_BUSY_TIMEOUT_MS);
+
+    tree->writer = writer;
+    tree->quiet_ms = quiet_ms;
+    atomic_init(&tree->current, NULL);
+    atomic_init(&tree->changes, 0);
+    for (int i = 0; i < VFS_READER_SLOTS; i++) {
+        atomic_init(&tree->hazards[i], NULL);
+    }
+    pthread_mutex_init(&tree->mutex, NULL);
+    pthread_cond_init(&tree->wake, NULL);
+
+    if (pthread_create(&tree->thread, NULL, rebuild_main, tree) != 0) {
+        pthread_mutex_destroy(&tree->mutex);
+        pthread_cond_destroy(&tree->wake);
+        sqlite3_close(tree->conn);
+        free(tree);
+        return NULL;
+    }
+
+    sqlite3_update_hook(writer, row_changed, tree);
+    sqlite3_wal_hook(writer, committed, tree);
+    log_info("VFS snapshot enabled (rebuilt after %d ms without changes)", quiet_ms);
+    return tree;
+}
+
+void vfs_tree_free(VfsTree* tree) {
+    if (!tree) return;
+
+    sqlite3_update_hook(tree->writer, NULL, NULL);
+    sqlite3_wal_autocheckpoint(tree->writer, VFS_WAL_CHECKPOINT_FRAMES);
+
+    pthread_mutex_lock(&tree->mutex);
+    tree->stopping = 1;
+    pthread_cond_signal(&tree->wake);
+    pthread_mutex_unlock(&tree->mutex);
+    pthread_join(tree->thread, NULL);
+
+    snapshot_free(atomic_load(&tree->current));
+    sqlite3_close(tree->conn);
+    pthread_mutex_destroy(&tree->mutex);
+    pthread_cond_destroy(&tree->wake);
+    free(tree);
+}
+
+void vfs_tree_changed(VfsTree* tree) {
+    if (tree) note_change(tree);
+}
+
+// Each thread starts looking for a free slot at its own place
+static atomic_uint next_hint;
+static _Thread_local int slot_hint = -1;
+
+const VfsSnapshot* vfs_pin(VfsTree* tree, int* slot) {
+    if (!tree) return NULL;
+    if (slot_hint < 0) {
+        slot_hint = (int)(atomic_fetch_add(&next_hint, 1) % VFS_READER_SLOTS);
+    }
+
+    for (int n = 0; n < VFS_READER_SLOTS; n++) {
+        VfsSnapshot* snap = atomic_load(&tree->current);
+        if (!snap) return NULL;
+
+        int i = (slot_hint + n) % VFS_READER_SLOTS;
+        VfsSnapshot* expected = NULL;
+        if (!atomic_compare_exchange_strong(&tree->hazards[i], &expected, snap)) {
+            continue;
+        }
+        // Swapped out before the rebuild thread could see our slot: try again
+        if (atomic_load(&tree->current) != snap) {
+            atomic_store(&tree->hazards[i], NULL);
+            continue;
+        }
+
+        // Safe to look inside now; a stale snapshot is never used
+        if (snap->version != atomic_load(&tree->changes)) {
+            atomic_store(&tree->hazards[i], NULL);
+            return NULL;
+        }
+        *slot = i;
+        return snap;
+    }
+    return NULL;
+}
+
+void vfs_unpin(VfsTree* tree, int slot) {
+    atomic_store(&tree->hazards[slot], NULL);
+}
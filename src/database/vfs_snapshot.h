@@ -0,0 +1,68 @@
+#ifndef VFS_SNAPSHOT_H
+#define VFS_SNAPSHOT_H
+
+#include <stdint.h>
+#include "db_manager.h"
+
+// In-memory copy of the whole files hierarchy, internal to the database
+// module. A snapshot is immutable: entries are found by ID through an
+// open-addressing hash, and each directory's children sit in one run of
+// an array, in listing order (directories first, then by name and ID).
+//
+// Readers pin the current snapshot by publishing it in a hazard slot, with
+// no lock, and unpin when done. A background thread rebuilds the snapshot
+// once writes have been quiet for a while, swaps it in and frees the old
+// one after every slot has let go of it.
+//
+// A snapshot is only handed out while it is current: hooks on the writer
+// connection notice committed changes to files, dir_totals or users, and
+// from then until the next rebuild vfs_pin() returns NULL and callers
+// read SQLite as before. A session therefore always sees its own writes.
+
+#define VFS_READER_SLOTS 64             // Snapshots pinned at once; beyond that, read SQLite
+#define VFS_WAL_CHECKPOINT_FRAMES 1000  // SQLite's automatic checkpoint, which the hook replaces
+#define VFS_MAX_DEPTH 256               // Longest parent chain a path walk follows
+
+typedef struct VfsTree VfsTree;
+typedef struct VfsSnapshot VfsSnapshot;
+
+typedef struct {
+    int id;
+    int parent_id;
+    int owner_id;
+    int is_directory;
+    int permissions;
+    int total_files;        // Directories: files below (dir_totals)
+    long size;
+    long total_bytes;       // Directories: bytes below (dir_totals)
+    uint32_t name;          // Strings, as offsets for vfs_str()
+    uint32_t physical_path;
+    uint32_t created_at;
+    uint32_t owner;         // Owner's username, or "unknown"
+    int first_child;        // Run of the children in vfs_child() order
+    int child_count;
+} VfsNode;
+
+// NULL (snapshots disabled) if `quiet_ms` <= 0 or the database is not in
+// WAL mode. Installs the change hooks on `writer`, which the caller holds.
+VfsTree* vfs_tree_create(sqlite3* writer, const char* db_path, int quiet_ms);
+
+// Stop the rebuild thread, remove the hooks (writer held) and free everything
+void vfs_tree_free(VfsTree* tree);
+
+// Treat the current snapshot as stale (after schema changes)
+void vfs_tree_changed(VfsTree* tree);
+
+// The current snapshot, or NULL if there is none that is up to date or no
+// free slot. Every non-NULL pin must be matched by vfs_unpin(tree, slot).
+const VfsSnapshot* vfs_pin(VfsTree* tree, int* slot);
+void vfs_unpin(VfsTree* tree, int slot);
+
+const VfsNode* vfs_find(const VfsSnapshot* snap, int id);
+const VfsNode* vfs_child(const VfsSnapshot* snap, const VfsNode* dir, int index);
+const char* vfs_str(const VfsSnapshot* snap, uint32_t offset);
+
+// Index of the first child of `dir` sorting after `after`
+int vfs_seek_child(const VfsSnapshot* snap, const VfsNode* dir, const ListCursor* after);
+
+#endif
@@ -0,0 +1,526 @@
+#include "archive.h"
+#include "compression.h"
+#include "integrity.h"
+#include "storage.h"
+#include "../common/crc32c.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+// Helper: send the staged bytes as one data packet
+static int flush_staging(ArchiveStream* as) {
+    if (as->staged == 0 || as->failed) {
+        as->staged = 0;
+        return as->failed ? -1 : 0;
+    }
+    if (packet_send_data(as->socket_fd, CMD_SUCCESS, as->staging, (uint32_t)as->staged) < 0) {
+        log_error("Archive stream: send failed after %llu bytes",
+                  (unsigned long long)as->bytes_sent);
+        as->failed = 1;
+        return -1;
+    }
+    as->bytes_sent += as->staged;
+    as->staged = 0;
+    return 0;
+}
+
+// Helper: run deflate over `len` input bytes (or finish the stream),
+// flushing the staging buffer whenever it fills
+static int deflate_emit(ArchiveStream* as, const uint8_t* data, size_t len, int finish) {
+    z_stream* zs = as->zstream;
+    int rc;
+
+    do {
+        size_t chunk = len > ARCHIVE_PACKET_MAX ? ARCHIVE_PACKET_MAX : len;
+        zs->next_in = (Bytef*)data;
+        zs->avail_in = (uInt)chunk;
+        int flush = (finish && chunk == len) ? Z_FINISH : Z_NO_FLUSH;
+
+        do {
+            if (as->staged == ARCHIVE_STAGING_SIZE && flush_staging(as) < 0) {
+                return -1;
+            }
+            zs->next_out = as->staging + as->staged;
+            zs->avail_out = (uInt)(ARCHIVE_STAGING_SIZE - as->staged);
+            rc = deflate(zs, flush);
+            as->staged = ARCHIVE_STAGING_SIZE - zs->avail_out;
+        } while (zs->avail_in > 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+
+        data += chunk;
+        len -= chunk;
+    } while (len > 0);
+
+    return 0;
+}
+
+// Helper: append archive bytes to the stream
+static int emit(ArchiveStream* as, const uint8_t* data, size_t len, int zero_copy) {
+    if (as->failed) return -1;
+    if (len == 0) return 0;
+
+    if (as->compress) {
+        return deflate_emit(as, data, len, 0);
+    }
+
+    // Large contents skip the staging buffer entirely
+    if (zero_copy && len >= ARCHIVE_ZERO_COPY_MIN) {
+        if (flush_staging(as) < 0) return -1;
+        while (len > 0) {
+            size_t chunk = len > ARCHIVE_PACKET_MAX ? ARCHIVE_PACKET_MAX : len;
+            if (packet_send_data(as->socket_fd, CMD_SUCCESS, data, (uint32_t)chunk) < 0) {
+                as->failed = 1;
+                return -1;
+            }
+            as->bytes_sent += chunk;
+            data += chunk;
+            len -= chunk;
+        }
+        return 0;
+    }
+
+    while (len > 0) {
+        size_t room = ARCHIVE_STAGING_SIZE - as->staged;
+        size_t take = len < room ? len : room;
+        memcpy(as->staging + as->staged, data, take);
+        as->staged += take;
+        data += take;
+        len -= take;
+        if (as->staged == ARCHIVE_STAGING_SIZE && flush_staging(as) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int archive_open(ArchiveStream* as, int socket_fd, int compress) {
+    memset(as, 0, sizeof(*as));
+    as->socket_fd = socket_fd;
+    as->compress = compress;
+
+    as->staging = malloc(ARCHIVE_STAGING_SIZE);
+    if (!as->staging) return -1;
+
+    if (compress) {
+        z_stream* zs = calloc(1, sizeof(z_stream));
+        // windowBits 15 + 16: gzip framing, so the result is a plain .tar.gz
+        if (!zs || deflateInit2(zs, COMPRESS_DEFAULT_LEVEL, Z_DEFLATED, 15 + 16, 8,
+                                Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(zs);
+            free(as->staging);
+            as->staging = NULL;
+            return -1;
+        }
+        as->zstream = zs;
+    }
+    return 0;
+}
+
+int archive_add_dir(ArchiveStream* as, const char* path, int mode, long mtime) {
+    uint8_t header[TAR_HEADER_MAX];
+    size_t len = tar_header(header, path, TAR_TYPE_DIR, 0, mode, mtime);
+    if (len == 0) {
+        log_error("Archive stream: path too long: %s", path);
+        return 1;
+    }
+    return emit(as, header, len, 0);
+}
+
+int archive_add_file(ArchiveStream* as, const char* path, int mode, long mtime,
+                     const uint8_t* data, size_t size) {
+    uint8_t header[TAR_HEADER_MAX];
+    size_t len = tar_header(header, path, TAR_TYPE_FILE, size, mode, mtime);
+    if (len == 0) {
+        log_error("Archive stream: path too long: %s", path);
+        return 1;
+    }
+
+    static const uint8_t zeros[TAR_BLOCK];
+    if (emit(as, header, len, 0) < 0 ||
+        emit(as, data, size, 1) < 0 ||
+        emit(as, zeros, tar_padding(size), 0) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int archive_close(ArchiveStream* as, int finish) {
+    int rc = 0;
+
+    if (finish) {
+        // End-of-archive marker: two zero blocks
+        static const uint8_t zeros[2 * TAR_BLOCK];
+        rc = emit(as, zeros, sizeof(zeros), 0);
+        if (rc == 0 && as->compress) {
+            rc = deflate_emit(as, NULL, 0, 1);
+        }
+        if (rc == 0) {
+            rc = flush_staging(as);
+        }
+    }
+
+    if (as->zstream) {
+        deflateEnd(as->zstream);
+        free(as->zstream);
+        as->zstream = NULL;
+    }
+    free(as->staging);
+    as->staging = NULL;
+    return rc;
+}
+
+// Buffered state of one pending batch entry
+struct ImportSlot {
+    char path[TAR_PATH_MAX];
+    uint8_t* data;
+    size_t filled;
+    uint8_t* encoded;
+};
+
+static void import_fail(ArchiveImport* imp, const char* error) {
+    if (!imp->failed) {
+        imp->failed = 1;
+        snprintf(imp->error, sizeof(imp->error), "%s", error);
+    }
+}
+
+// Helper: release the buffers of the pending batch
+static void clear_batch(ArchiveImport* imp) {
+    for (int i = 0; i < imp->batch_count; i++) {
+        free(imp->slots[i].data);
+        free(imp->slots[i].encoded);
+        free(imp->batch[i].crcs);
+    }
+    imp->batch_count = 0;
+    imp->batch_bytes = 0;
+    imp->current = -1;
+}
+
+static int remember_path(ArchiveImport* imp, const char* path, int id) {
+    if (imp->imported_count == imp->imported_cap) {
+        int cap = imp->imported_cap ? imp->imported_cap * 2 : 256;
+        ImportedPath* grown = realloc(imp->imported, sizeof(ImportedPath) * cap);
+        if (!grown) return -1;
+        imp->imported = grown;
+        imp->imported_cap = cap;
+    }
+    char* copy = strdup(path);
+    if (!copy) return -1;
+    imp->imported[imp->imported_count].path = copy;
+    imp->imported[imp->imported_count].id = id;
+    imp->imported_count++;
+    return 0;
+}
+
+// Helper: hash-table slot of a directory path (its own or the free one
+// where it belongs)
+static int dir_slot(const ArchiveImport* imp, const char* path, size_t len) {
+    uint32_t h = 2166136261u;   // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)path[i]) * 16777619u;
+    }
+
+    int mask = imp->dir_cap - 1;
+    int i = (int)(h & (uint32_t)mask);
+    while (imp->dirs[i].path &&
+           (strncmp(imp->dirs[i].path, path, len) != 0 || imp->dirs[i].path[len] != '\0')) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int dir_insert(ArchiveImport* imp, const char* path, size_t len, int index) {
+    // Keep the table at most half full
+    if ((imp->dir_count + 1) * 2 > imp->dir_cap) {
+        int old_cap = imp->dir_cap;
+        ImportDir* old = imp->dirs;
+        int cap = old_cap ? old_cap * 2 : 256;
+        ImportDir* grown = calloc((size_t)cap, sizeof(ImportDir));
+        if (!grown) return -1;
+
+        imp->dirs = grown;
+        imp->dir_cap = cap;
+        for (int i = 0; i < old_cap; i++) {
+            if (old[i].path) {
+                imp->dirs[dir_slot(imp, old[i].path, strlen(old[i].path))] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    char* copy = strndup(path, len);
+    if (!copy) return -1;
+    int slot = dir_slot(imp, path, len);
+    imp->dirs[slot].path = copy;
+    imp->dirs[slot].id = 0;
+    imp->dirs[slot].index = index;
+    imp->dir_count++;
+    return 0;
+}
+
+// Helper: commit the pending batch. Rows first (so garbage collection
+// never sees an unreferenced new blob), then the blobs, then one
+// transaction for all of their checksums.
+static int flush_batch(ArchiveImport* imp) {
+    if (imp->batch_count == 0 || imp->failed) {
+        clear_batch(imp);
+        return imp->failed ? -1 : 0;
+    }
+
+    long bytes = 0, files = 0;
+    for (int i = 0; i < imp->batch_count; i++) {
+        if (!imp->batch[i].is_directory) {
+            bytes += imp->batch[i].size;
+            files++;
+        }
+    }
+    int allowed = files > 0 ? db_quota_allows(imp->db, imp->owner_id, bytes, files) : 1;
+    if (allowed != 1) {
+        import_fail(imp, allowed == 0 ? "Quota exceeded" : "Quota check failed");
+        clear_batch(imp);
+        return -1;
+    }
+
+    for (int i = 0; i < imp->batch_count; i++) {
+        ImportEntry* e = &imp->batch[i];
+        struct ImportSlot* slot = &imp->slots[i];
+        if (e->is_directory) continue;
+
+        char* uuid = generate_uuid();
+        if (!uuid) {
+            import_fail(imp, "Failed to generate UUID");
+            clear_batch(imp);
+            return -1;
+        }
+        snprintf(e->physical_path, sizeof(e->physical_path), "%s", uuid);
+        free(uuid);
+
+        size_t encoded_size = 0;
+        if (compression_encode(slot->data, (size_t)e->size, &slot->encoded, &encoded_size) == 1) {
+            e->encoding = COMPRESS_ENCODING;
+            e->stored_size = (long)encoded_size;
+        }
+    }
+
+    if (db_import_entries(imp->db, imp->owner_id, imp->batch, imp->batch_count) < 0) {
+        import_fail(imp, "Failed to create entries");
+        clear_batch(imp);
+        return -1;
+    }
+    for (int i = 0; i < imp->batch_count; i++) {
+        if (remember_path(imp, imp->slots[i].path, imp->batch[i].id) < 0) {
+            import_fail(imp, "Out of memory");
+            clear_batch(imp);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < imp->batch_count; i++) {
+        ImportEntry* e = &imp->batch[i];
+        struct ImportSlot* slot = &imp->slots[i];
+        if (e->is_directory) {
+            // Later batches refer to it by ID
+            ImportDir* dir = &imp->dirs[dir_slot(imp, slot->path, strlen(slot->path))];
+            dir->id = e->id;
+            dir->index = -1;
+            imp->directories++;
+            continue;
+        }
+
+        const uint8_t* stored = slot->encoded ? slot->encoded : slot->data;
+        size_t stored_size = slot->encoded ? (size_t)e->stored_size : (size_t)e->size;
+        if (storage_write_file(e->physical_path, stored, stored_size) < 0) {
+            import_fail(imp, "Failed to write file to storage");
+            clear_batch(imp);
+            return -1;
+        }
+        if (crc32c_chunks(stored, stored_size, INTEGRITY_CHUNK_SIZE, &e->crcs, &e->crc_count) < 0) {
+            e->crcs = NULL;
+        }
+        imp->files++;
+        imp->bytes += (uint64_t)e->size;
+    }
+
+    if (db_import_checksums(imp->db, imp->batch, imp->batch_count, INTEGRITY_CHUNK_SIZE) < 0) {
+        log_error("Folder upload: failed to record checksums for a batch of %d entries",
+                  imp->batch_count);
+    }
+
+    clear_batch(imp);
+    return 0;
+}
+
+// Helper: queue one entry. Its parent is the directory at the first
+// `parent_len` bytes of `path` (the import root if 0), which must exist.
+static int add_entry(ArchiveImport* imp, const char* path, size_t parent_len, int is_directory, uint64_t size) {
+    if (imp->batch_count == ARCHIVE_IMPORT_BATCH ||
+        (!is_directory && imp->batch_bytes + size > ARCHIVE_IMPORT_BATCH_BYTES)) {
+        if (flush_batch(imp) < 0) return -1;
+    }
+
+    int i = imp->batch_count;
+    ImportEntry* e = &imp->batch[i];
+    struct ImportSlot* slot = &imp->slots[i];
+    memset(e, 0, sizeof(*e));
+    memset(slot, 0, sizeof(*slot));
+
+    e->parent_id = imp->parent_id;
+    e->parent_index = -1;
+    if (parent_len > 0) {
+        const ImportDir* parent = &imp->dirs[dir_slot(imp, path, parent_len)];
+        e->parent_id = parent->id;
+        e->parent_index = parent->index;
+    }
+
+    const char* name = path + parent_len + (parent_len > 0 ? 1 : 0);
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    e->is_directory = is_directory;
+    e->permissions = is_directory ? 0755 : 0644;
+
+    if (is_directory) {
+        if (dir_insert(imp, path, strlen(path), i) < 0) {
+            import_fail(imp, "Out of memory");
+            return -1;
+        }
+    } else {
+        e->size = (long)size;
+        slot->data = malloc((size_t)size);
+        if (!slot->data) {
+            import_fail(imp, "Out of memory");
+            return -1;
+        }
+        imp->batch_bytes += size;
+    }
+
+    imp->batch_count++;
+    return i;
+}
+
+// Helper: make sure the directory at the first `len` bytes of `path`
+// exists, creating missing ancestors first
+static int ensure_dir(ArchiveImport* imp, const char* path, size_t len) {
+    if (len == 0 || (imp->dirs && imp->dirs[dir_slot(imp, path, len)].path)) {
+        return 0;
+    }
+
+    size_t parent_len = len;
+    while (parent_len > 0 && path[parent_len - 1] != '/') parent_len--;
+    if (parent_len > 0) parent_len--;   // Drop the separator
+    if (ensure_dir(imp, path, parent_len) < 0) return -1;
+
+    char dir[TAR_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%.*s", (int)len, path);
+    return add_entry(imp, dir, parent_len, 1, 0) < 0 ? -1 : 0;
+}
+
+static int import_entry(void* ctx, const TarEntry* entry) {
+    ArchiveImport* imp = ctx;
+    imp->current = -1;
+    if (imp->failed) return 0;      // Keep reading up to the end marker
+
+    int is_directory = entry->type == TAR_TYPE_DIR;
+    int valid = tar_path_safe(entry->path) &&
+                (is_directory || (entry->size > 0 && entry->size <= ARCHIVE_IMPORT_FILE_MAX));
+
+    // Every component must fit a file name
+    for (const char* p = entry->path; valid && *p; ) {
+        size_t n = strcspn(p, "/");
+        if (n >= sizeof(imp->batch[0].name)) valid = 0;
+        p += n;
+        if (*p == '/') p++;
+    }
+    if (!valid) {
+        log_info("Folder upload: skipping '%s'", entry->path);
+        imp->skipped++;
+        return 0;
+    }
+
+    const char* slash = strrchr(entry->path, '/');
+    size_t parent_len = slash ? (size_t)(slash - entry->path) : 0;
+    if (ensure_dir(imp, entry->path, parent_len) < 0) return 0;
+
+    if (is_directory) {
+        ensure_dir(imp, entry->path, strlen(entry->path));
+    } else {
+        imp->current = add_entry(imp, entry->path, parent_len, 0, entry->size);
+    }
+    return 0;
+}
+
+static int import_data(void* ctx, const uint8_t* data, size_t len) {
+    ArchiveImport* imp = ctx;
+    if (imp->failed || imp->current < 0) return 0;
+
+    struct ImportSlot* slot = &imp->slots[imp->current];
+    memcpy(slot->data + slot->filled, data, len);
+    slot->filled += len;
+    return 0;
+}
+
+ArchiveImport* archive_import_begin(Database* db, int owner_id, int parent_id) {
+    ArchiveImport* imp = calloc(1, sizeof(ArchiveImport));
+    if (!imp) return NULL;
+
+    imp->batch = calloc(ARCHIVE_IMPORT_BATCH, sizeof(ImportEntry));
+    imp->slots = calloc(ARCHIVE_IMPORT_BATCH, sizeof(struct ImportSlot));
+    if (!imp->batch || !imp->slots) {
+        free(imp->batch);
+        free(imp->slots);
+        free(imp);
+        return NULL;
+    }
+
+    imp->db = db;
+    imp->owner_id = owner_id;
+    imp->parent_id = parent_id;
+    imp->current = -1;
+    tar_reader_init(&imp->reader, import_entry, import_data, imp);
+    return imp;
+}
+
+int archive_import_feed(ArchiveImport* imp, const uint8_t* data, size_t len) {
+    return tar_reader_feed(&imp->reader, data, len);
+}
+
+int archive_import_finish(ArchiveImport* imp) {
+    if (flush_batch(imp) < 0) {
+        archive_import_abort(imp);
+        return -1;
+    }
+    return 0;
+}
+
+void archive_import_abort(ArchiveImport* imp) {
+    clear_batch(imp);
+
+    // Children before parents
+    for (int i = imp->imported_count - 1; i >= 0; i--) {
+        db_delete_file(imp->db, imp->imported[i].id);
+        free(imp->imported[i].path);
+    }
+    if (imp->imported_count > 0) {
+        log_info("Folder upload: removed %d partially imported entries", imp->imported_count);
+    }
+    imp->imported_count = 0;
+    imp->directories = 0;
+    imp->files = 0;
+    imp->bytes = 0;
+}
+
+void archive_import_free(ArchiveImport* imp) {
+    if (!imp) return;
+    clear_batch(imp);
+    for (int i = 0; i < imp->imported_count; i++) {
+        free(imp->imported[i].path);
+    }
+    free(imp->imported);
+    for (int i = 0; i < imp->dir_cap; i++) {
+        free(imp->dirs[i].path);
+    }
+    free(imp->dirs);
+    free(imp->batch);
+    free(imp->slots);
+    free(imp);
+}
@@ -0,0 +1,105 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/protocol.h"
+#include "../common/tar.h"
+#include "../database/db_manager.h"
+
+// Streams a tar archive (optionally gzip-compressed) to a socket as a
+// sequence of CMD_SUCCESS data packets. Headers and small files are
+// batched in a staging buffer; larger uncompressed blobs are sent straight
+// from the caller's buffer (e.g. a blob mapping) without a copy.
+
+#define ARCHIVE_STAGING_SIZE (256 * 1024)
+#define ARCHIVE_ZERO_COPY_MIN (64 * 1024)       // Smaller files are staged
+#define ARCHIVE_PACKET_MAX (4 * 1024 * 1024)    // Largest data packet sent
+
+typedef struct {
+    int socket_fd;
+    int compress;
+    uint8_t* staging;
+    size_t staged;
+    void* zstream;          // z_stream when compressing
+    uint64_t bytes_sent;    // Payload bytes written to the socket
+    int failed;             // A send failed; further output is dropped
+} ArchiveStream;
+
+int archive_open(ArchiveStream* as, int socket_fd, int compress);
+
+int archive_add_dir(ArchiveStream* as, const char* path, int mode, long mtime);
+int archive_add_file(ArchiveStream* as, const char* path, int mode, long mtime,
+                     const uint8_t* data, size_t size);
+
+// Write the end-of-archive marker (if `finish`), flush and release the stream
+int archive_close(ArchiveStream* as, int finish);
+
+// Expands an uploaded tar archive below a directory. Entries may come in
+// any order; missing parent directories are created. Rows are inserted in
+// batched transactions, and a failed or interrupted import is removed
+// again (its blobs are left to garbage collection).
+
+#define ARCHIVE_IMPORT_BATCH 512                        // Entries per transaction
+#define ARCHIVE_IMPORT_BATCH_BYTES (8 * 1024 * 1024)    // File data buffered per batch
+#define ARCHIVE_IMPORT_FILE_MAX MAX_PAYLOAD_SIZE        // Same limit as single uploads
+
+// Path (relative to the import root) and ID of an imported entry
+typedef struct {
+    char* path;
+    int id;
+} ImportedPath;
+
+// Directory created by the import, found by path
+typedef struct {
+    char* path;             // NULL for a free hash slot
+    int id;                 // Once committed
+    int index;              // Position in the pending batch, or -1
+} ImportDir;
+
+struct ImportSlot;
+
+typedef struct {
+    Database* db;
+    int owner_id;
+    int parent_id;
+    TarReader reader;
+
+    ImportEntry* batch;
+    struct ImportSlot* slots;
+    int batch_count;
+    size_t batch_bytes;
+    int current;            // Slot receiving file data, or -1
+
+    ImportDir* dirs;        // Open-addressing hash table
+    int dir_cap;
+    int dir_count;
+
+    ImportedPath* imported;
+    int imported_count;
+    int imported_cap;
+
+    int directories;
+    int files;
+    int skipped;
+    uint64_t bytes;
+    int failed;
+    char error[128];
+} ArchiveImport;
+
+ArchiveImport* archive_import_begin(Database* db, int owner_id, int parent_id);
+
+// Returns 0 if more input is expected, 1 once the archive is complete,
+// -1 if it is malformed
+int archive_import_feed(ArchiveImport* imp, const uint8_t* data, size_t len);
+
+// Commit the last batch. On failure (imp->error says why) everything
+// imported so far is removed. Returns 0 or -1.
+int archive_import_finish(ArchiveImport* imp);
+
+// Remove everything imported so far (interrupted upload)
+void archive_import_abort(ArchiveImport* imp);
+
+void archive_import_free(ArchiveImport* imp);
+
+#endif
@@ -1,5 +1,12 @@
 #include "commands.h"
 #include "storage.h"
+#include "storage_gc.h"
+#include "integrity.h"
+#include "compression.h"
+#include "archive.h"
+#include "../common/delta.h"
+#include "../common/crc32c.h"
+#include "../common/json_buf.h"
 #include "permissions.h"
 #include "../common/utils.h"
 #include "../common/crypto.h"
@@ -46,9 +53,24 @@ int dispatch_command(ClientSession* session, Packet* pkt) {
         case CMD_UPLOAD_DATA:
             handle_upload_data(session, pkt);
             break;
+        case CMD_UPLOAD_TREE:
+            handle_upload_tree(session, pkt);
+            break;
+        case CMD_DELTA_SIG_REQ:
+            handle_delta_sig(session, pkt);
+            break;
+        case CMD_DELTA_REQ:
+            handle_delta_req(session, pkt);
+            break;
+        case CMD_DELTA_DATA:
+            handle_delta_data(session, pkt);
+            break;
         case CMD_DOWNLOAD_REQ:
             handle_download(session, pkt);
             break;
+        case CMD_DOWNLOAD_TREE:
+            handle_download_tree(session, pkt);
+            break;
         case CMD_CHMOD:
             handle_chmod(session, pkt);
             break;
@@ -70,6 +92,9 @@ int dispatch_command(ClientSession* session, Packet* pkt) {
         case CMD_MOVE:
             handle_move(session, pkt);
             break;
+        case CMD_GET_QUOTA:
+            handle_get_quota(session, pkt);
+            break;
         case CMD_ADMIN_LIST_USERS:
             handle_admin_list_users(session, pkt);
             break;
@@ -82,6 +107,12 @@ int dispatch_command(ClientSession* session, Packet* pkt) {
         case CMD_ADMIN_UPDATE_USER:
             handle_admin_update_user(session, pkt);
             break;
+        case CMD_ADMIN_STORAGE_GC:
+            handle_admin_storage_gc(session, pkt);
+            break;
+        case CMD_ADMIN_SET_QUOTA:
+            handle_admin_set_quota(session, pkt);
+            break;
         default:
             send_error(session, "Unknown command");
             return -1;
@@ -181,6 +212,114 @@ void handle_login(ClientSession* session, Packet* pkt) {
     cJSON_Delete(json);
 }
 
+// Helper: one LIST_DIR entry (same fields and order as before)
+static int append_listing_row(void* ctx, const DirectoryRow* row) {
+    JsonBuf* out = ctx;
+    if (out->len > 0 && out->data[out->len - 1] != '[') {
+        json_buf_append(out, ",");
+    }
+    json_buf_append(out, "{\"id\":");
+    json_buf_number(out, row->id);
+    json_buf_append(out, ",\"name\":");
+    json_buf_string(out, row->name);
+    json_buf_append(out, ",\"is_directory\":");
+    json_buf_bool(out, row->is_directory);
+    json_buf_append(out, ",\"size\":");
+    json_buf_number(out, row->size);
+    json_buf_append(out, ",\"permissions\":");
+    json_buf_number(out, row->permissions);
+    json_buf_append(out, ",\"owner_id\":");
+    json_buf_number(out, row->owner_id);
+    json_buf_append(out, ",\"owner\":");
+    json_buf_string(out, row->owner);
+    if (row->is_directory) {
+        json_buf_append(out, ",\"total_size\":");
+        json_buf_number(out, row->total_bytes);
+        json_buf_append(out, ",\"file_count\":");
+        json_buf_number(out, row->total_files);
+    }
+    json_buf_append(out, "}");
+
+    // Stop early rather than build a reply that cannot be sent
+    return (out->failed || out->len > MAX_PAYLOAD_SIZE) ? -1 : 0;
+}
+
+// Largest page a LIST_DIR or SEARCH request may ask for
+#define LIST_PAGE_MAX 10000
+#define SEARCH_PAGE_MAX 1000
+
+// Page cursors are opaque to clients: "<is_directory>:<id>:<name>"
+static void format_cursor(const ListCursor* cursor, char* out, size_t size) {
+    snprintf(out, size, "%d:%d:%s", cursor->is_directory, cursor->id, cursor->name);
+}
+
+static int parse_cursor(const char* text, ListCursor* cursor) {
+    if (!text) return -1;
+
+    char* end;
+    cursor->is_directory = (int)strtol(text, &end, 10);
+    if (*end != ':' || (cursor->is_directory != 0 && cursor->is_directory != 1)) return -1;
+    cursor->id = (int)strtol(end + 1, &end, 10);
+    if (*end != ':') return -1;
+    snprintf(cursor->name, sizeof(cursor->name), "%s", end + 1);
+    return 0;
+}
+
+// Helper: whether a request flag is set (true or non-zero)
+static int json_flag(cJSON* json, const char* key) {
+    cJSON* item = json ? cJSON_GetObjectItem(json, key) : NULL;
+    return item && (cJSON_IsTrue(item) || (cJSON_IsNumber(item) && item->valueint != 0));
+}
+
+// A LIST_DIR reply being built. With a page size, the row after a full
+// page ends the scan and the page gets a next_cursor; streaming sends it
+// and scans again from there.
+typedef struct {
+    ClientSession* session;
+    JsonBuf out;
+    int limit;              // Rows per reply, 0 for the whole directory
+    int stream;
+    int rows;               // Rows in `out`
+    ListCursor last;        // Key of the last of them
+    int more;               // Stopped with rows left
+} ListingReply;
+
+static void listing_begin(ListingReply* reply) {
+    json_buf_reset(&reply->out);
+    json_buf_append(&reply->out, "{\"status\":\"OK\",\"files\":[");
+    reply->rows = 0;
+}
+
+static int listing_send(ListingReply* reply, int has_next) {
+    json_buf_append(&reply->out, "]");
+    if (has_next) {
+        char cursor[300];
+        format_cursor(&reply->last, cursor, sizeof(cursor));
+        json_buf_append(&reply->out, ",\"next_cursor\":");
+        json_buf_string(&reply->out, cursor);
+    }
+    json_buf_append(&reply->out, "}");
+    if (reply->out.failed) return -1;
+
+    return packet_send_data(reply->session->client_socket, CMD_LIST_DIR,
+                            (const uint8_t*)reply->out.data, (uint32_t)reply->out.len);
+}
+
+static int append_listing_page_row(void* ctx, const DirectoryRow* row) {
+    ListingReply* reply = ctx;
+
+    if (reply->limit > 0 && reply->rows == reply->limit) {
+        reply->more = 1;
+        return -1;
+    }
+
+    reply->last.is_directory = row->is_directory ? 1 : 0;
+    reply->last.id = row->id;
+    snprintf(reply->last.name, sizeof(reply->last.name), "%s", row->name);
+    reply->rows++;
+    return append_listing_row(&reply->out, row);
+}
+
 void handle_list_dir(ClientSession* session, Packet* pkt) {
     cJSON* json = cJSON_Parse(pkt->payload);
     int dir_id = session->current_directory;
@@ -190,53 +329,64 @@ void handle_list_dir(ClientSession* session, Packet* pkt) {
         dir_id = cJSON_GetObjectItem(json, "directory_id")->valueint;
     }
 
+    // Optional paging: "limit" rows per reply, resuming after "cursor";
+    // "stream" sends every page in turn instead of only the first
+    ListingReply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.session = session;
+    cJSON* limit_item = json ? cJSON_GetObjectItem(json, "limit") : NULL;
+    if (limit_item && limit_item->valueint > 0) {
+        reply.limit = limit_item->valueint < LIST_PAGE_MAX ? limit_item->valueint : LIST_PAGE_MAX;
+    }
+    reply.stream = json_flag(json, "stream");
+    if (reply.stream && reply.limit == 0) {
+        reply.limit = LIST_PAGE_MAX;
+    }
+
+    ListCursor after;
+    cJSON* cursor_item = json ? cJSON_GetObjectItem(json, "cursor") : NULL;
+    int has_cursor = cursor_item != NULL;
+    if (has_cursor && parse_cursor(cJSON_GetStringValue(cursor_item), &after) < 0) {
+        send_error(session, "Invalid cursor");
+        cJSON_Delete(json);
+        return;
+    }
+    if (json) cJSON_Delete(json);
+
     // Check READ permission on directory
     if (!check_permission(global_db, session->user_id, dir_id, ACCESS_READ)) {
         send_error(session, "Permission denied");
         db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "LIST_DIR");
-        if (json) cJSON_Delete(json);
         return;
     }
 
-    FileEntry* entries = NULL;
-    int count = 0;
-    if (db_list_directory(global_db, dir_id, &entries, &count) < 0) {
-        send_error(session, "Failed to list directory");
-        if (json) cJSON_Delete(json);
-        return;
-    }
-
-    cJSON* response = cJSON_CreateObject();
-    cJSON_AddStringToObject(response, "status", "OK");
-    cJSON* files_array = cJSON_AddArrayToObject(response, "files");
-
-    for (int i = 0; i < count; i++) {
-        // Fetch username from owner_id
-        char owner_username[256] = "unknown";
-        if (db_get_user_by_id(global_db, entries[i].owner_id,
-                              owner_username, sizeof(owner_username)) != 0) {
-            // If lookup fails, show "unknown"
-            strcpy(owner_username, "unknown");
+    // Rows go straight from the query into the response text. A page is
+    // sent only after its scan has ended, so a slow client never holds a
+    // reader, the database mutex or a snapshot pin; the next page resumes
+    // from the last row's key.
+    json_buf_init(&reply.out);
+    const ListCursor* resume = has_cursor ? &after : NULL;
+    for (;;) {
+        listing_begin(&reply);
+        reply.more = 0;
+        int rc = db_scan_directory_page(global_db, dir_id, session->user_id, resume,
+                                        reply.limit > 0 ? reply.limit + 1 : -1,
+                                        append_listing_page_row, &reply);
+        if (rc < 0 && !reply.more) {
+            send_error(session, "Failed to list directory");
+            json_buf_free(&reply.out);
+            return;
         }
 
-        cJSON* item = cJSON_CreateObject();
-        cJSON_AddNumberToObject(item, "id", entries[i].id);
-        cJSON_AddStringToObject(item, "name", entries[i].name);
-        cJSON_AddBoolToObject(item, "is_directory", entries[i].is_directory);
-        cJSON_AddNumberToObject(item, "size", entries[i].size);
-        cJSON_AddNumberToObject(item, "permissions", entries[i].permissions);
-        cJSON_AddNumberToObject(item, "owner_id", entries[i].owner_id);
-        cJSON_AddStringToObject(item, "owner", owner_username);
-        cJSON_AddItemToArray(files_array, item);
+        if (listing_send(&reply, reply.more) < 0) {
+            log_error("LIST_DIR: failed to send listing of %d", dir_id);
+            break;
+        }
+        if (!reply.stream || !reply.more) break;
+        after = reply.last;
+        resume = &after;
     }
-
-    char* payload = cJSON_PrintUnformatted(response);
-    send_success(session, CMD_LIST_DIR, payload);
-
-    free(entries);
-    free(payload);
-    if (json) cJSON_Delete(json);
-    cJSON_Delete(response);
+    json_buf_free(&reply.out);
 
     db_log_activity(global_db, session->user_id, "LIST_DIR", NULL);
 }
@@ -304,10 +454,10 @@ void handle_mkdir(ClientSession* session, Packet* pkt) {
     send_success(session, CMD_SUCCESS, payload);
 
     free(payload);
-    cJSON_Delete(json);
     cJSON_Delete(response);
 
     db_log_activity(global_db, session->user_id, "MAKE_DIR", name);
+    cJSON_Delete(json);
 }
 
 void handle_upload_req(ClientSession* session, Packet* pkt) {
@@ -344,6 +494,14 @@ void handle_upload_req(ClientSession* session, Packet* pkt) {
         return;
     }
 
+    // Reject over-quota uploads before any data is sent (a primary-key
+    // lookup of the user's usage counters)
+    if (size < 0 || db_quota_allows(global_db, session->user_id, size, 1) != 1) {
+        send_error(session, size < 0 ? "Invalid size" : "Quota exceeded");
+        cJSON_Delete(json);
+        return;
+    }
+
     // Generate UUID for file storage
     char* uuid = generate_uuid();
     if (!uuid) {
@@ -367,6 +525,7 @@ void handle_upload_req(ClientSession* session, Packet* pkt) {
     if (session->pending_upload_uuid) {
         free(session->pending_upload_uuid);
     }
+    session->pending_delta_file_id = 0;
     session->pending_upload_uuid = uuid;
     session->pending_upload_size = size;
     session->state = STATE_TRANSFERRING;
@@ -387,9 +546,64 @@ void handle_upload_req(ClientSession* session, Packet* pkt) {
     log_info("Upload request accepted: file_id=%d, uuid=%s, size=%ld", file_id, uuid, size);
 }
 
+// Helper: write a blob, compressed when worthwhile, and record its encoding
+// and the checksums of the bytes actually stored
+static int store_blob(const char* uuid, const uint8_t* data, size_t size) {
+    uint8_t* encoded = NULL;
+    size_t encoded_size = 0;
+    const uint8_t* stored = data;
+    size_t stored_size = size;
+
+    if (compression_encode(data, size, &encoded, &encoded_size) == 1) {
+        // Metadata first, so a reader never sees compressed bytes as raw
+        if (db_set_blob_encoding(global_db, uuid, COMPRESS_ENCODING, (long)encoded_size) < 0) {
+            free(encoded);
+            return -1;
+        }
+        stored = encoded;
+        stored_size = encoded_size;
+    }
+
+    int rc = storage_write_file(uuid, stored, stored_size);
+    if (rc < 0 && encoded) {
+        db_clear_blob_encoding(global_db, uuid);
+    }
+    if (rc == 0 && integrity_record(global_db, uuid, stored, stored_size) < 0) {
+        log_error("Failed to record checksums for %s", uuid);
+    }
+    if (rc == 0 && encoded) {
+        log_info("Stored %s compressed: %zu -> %zu bytes", uuid, size, encoded_size);
+    }
+
+    free(encoded);
+    return rc;
+}
+
+// Helper: uncompressed contents of a file's mapped blob. Raw blobs are
+// returned in place; encoded ones are decoded into *decoded (caller frees).
+static const uint8_t* blob_contents(const FileEntry* entry, const StorageView* view,
+                                    size_t* size, uint8_t** decoded) {
+    char encoding[16];
+    *decoded = NULL;
+    *size = view->size;
+
+    if (db_get_blob_encoding(global_db, entry->physical_path, encoding, sizeof(encoding), NULL) != 0) {
+        return view->data;
+    }
+
+    *decoded = malloc(entry->size > 0 ? (size_t)entry->size : 1);
+    if (!*decoded || compression_decode(view->data, view->size, *decoded, (size_t)entry->size) < 0) {
+        free(*decoded);
+        *decoded = NULL;
+        return NULL;
+    }
+    *size = (size_t)entry->size;
+    return *decoded;
+}
+
 void handle_upload_data(ClientSession* session, Packet* pkt) {
     // Check that upload request was made
-    if (!session->pending_upload_uuid) {
+    if (!session->pending_upload_uuid || session->pending_delta_file_id) {
         send_error(session, "No pending upload. Send UPLOAD_REQ first");
         return;
     }
@@ -416,9 +630,9 @@ void handle_upload_data(ClientSession* session, Packet* pkt) {
     }
 
     // Write file to storage
-    if (storage_write_file(session->pending_upload_uuid,
-                          (uint8_t*)pkt->payload,
-                          pkt->data_length) < 0) {
+    if (store_blob(session->pending_upload_uuid,
+                   (const uint8_t*)pkt->payload,
+                   pkt->data_length) < 0) {
         send_error(session, "Failed to write file to storage");
         free(session->pending_upload_uuid);
         session->pending_upload_uuid = NULL;
@@ -441,14 +655,411 @@ void handle_upload_data(ClientSession* session, Packet* pkt) {
     free(payload);
     cJSON_Delete(response);
 
-    log_info("Upload completed: uuid=%s, size=%ld",
-             session->pending_upload_uuid, session->pending_upload_size);
+    log_info("Upload completed: uuid=%s, size=%ld",
+             session->pending_upload_uuid, session->pending_upload_size);
+
+    // Clear pending upload
+    free(session->pending_upload_uuid);
+    session->pending_upload_uuid = NULL;
+    session->pending_upload_size = 0;
+    session->state = STATE_AUTHENTICATED;
+}
+
+// Helper: final reply of a folder upload, mapping each path to its new ID
+static void send_tree_result(ClientSession* session, const ArchiveImport* imp) {
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "status", "OK");
+    cJSON_AddNumberToObject(response, "directories", imp->directories);
+    cJSON_AddNumberToObject(response, "files", imp->files);
+    cJSON_AddNumberToObject(response, "skipped", imp->skipped);
+    cJSON_AddNumberToObject(response, "bytes", (double)imp->bytes);
+
+    cJSON* ids = cJSON_AddObjectToObject(response, "ids");
+    for (int i = 0; i < imp->imported_count; i++) {
+        cJSON_AddNumberToObject(ids, imp->imported[i].path, imp->imported[i].id);
+    }
+
+    char* payload = cJSON_PrintUnformatted(response);
+    if (payload && strlen(payload) > MAX_PAYLOAD_SIZE) {
+        // Huge trees: the counts still fit, the map does not
+        free(payload);
+        cJSON_DeleteItemFromObject(response, "ids");
+        cJSON_AddTrueToObject(response, "ids_truncated");
+        payload = cJSON_PrintUnformatted(response);
+    }
+    if (payload) {
+        send_success(session, CMD_SUCCESS, payload);
+    }
+
+    free(payload);
+    cJSON_Delete(response);
+}
+
+// Upload a whole folder as one tar stream: after READY the client sends
+// the archive in CMD_UPLOAD_DATA packets followed by an empty one, and the
+// server expands it below `parent_id` in batched transactions. Either the
+// whole tree is created or none of it is.
+void handle_upload_tree(ClientSession* session, Packet* pkt) {
+    cJSON* json = cJSON_Parse(pkt->payload);
+    if (!json) {
+        send_error(session, "Invalid JSON");
+        return;
+    }
+
+    int parent_id = session->current_directory;
+    cJSON* parent_item = cJSON_GetObjectItem(json, "parent_id");
+    if (cJSON_IsNumber(parent_item)) {
+        parent_id = parent_item->valueint;
+    }
+    cJSON_Delete(json);
+
+    // Check WRITE permission on parent directory
+    if (!check_permission(global_db, session->user_id, parent_id, ACCESS_WRITE)) {
+        send_error(session, "Permission denied");
+        db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "UPLOAD_TREE");
+        return;
+    }
+    if (parent_id != 0) {
+        FileEntry parent;
+        if (db_get_file_by_id(global_db, parent_id, &parent) < 0 || !parent.is_directory) {
+            send_error(session, "Parent is not a directory");
+            return;
+        }
+    }
+
+    ArchiveImport* imp = archive_import_begin(global_db, session->user_id, parent_id);
+    if (!imp) {
+        send_error(session, "Failed to start folder upload");
+        return;
+    }
+
+    send_success(session, CMD_SUCCESS, "{\"status\":\"READY\"}");
+    session->state = STATE_TRANSFERRING;
+
+    // Read up to the empty packet that ends the stream, even past a
+    // malformed archive, so the connection stays usable
+    int rc = 0;
+    for (;;) {
+        Packet data = {0};
+        if (packet_recv(session->client_socket, &data) < 0 || data.command != CMD_UPLOAD_DATA) {
+            free(data.payload);
+            archive_import_abort(imp);
+            archive_import_free(imp);
+            log_error("Folder upload interrupted: user_id=%d, parent_id=%d", session->user_id, parent_id);
+            session->state = STATE_DISCONNECTED;
+            return;
+        }
+        if (data.data_length == 0) {
+            break;
+        }
+        if (rc == 0) {
+            rc = archive_import_feed(imp, (const uint8_t*)data.payload, data.data_length);
+        }
+        free(data.payload);
+    }
+    session->state = STATE_AUTHENTICATED;
+
+    if (rc != 1) {
+        archive_import_abort(imp);
+        archive_import_free(imp);
+        send_error(session, rc < 0 ? "Malformed folder archive" : "Incomplete folder archive");
+        return;
+    }
+
+    if (archive_import_finish(imp) < 0) {
+        send_error(session, imp->error);
+        log_error("Folder upload failed: %s (user_id=%d)", imp->error, session->user_id);
+        archive_import_free(imp);
+        return;
+    }
+
+    send_tree_result(session, imp);
+
+    char log_desc[256];
+    snprintf(log_desc, sizeof(log_desc), "parent %d (%d files, %d directories, %llu bytes)",
+             parent_id, imp->files, imp->directories, (unsigned long long)imp->bytes);
+    db_log_activity(global_db, session->user_id, "UPLOAD_TREE", log_desc);
+    log_info("Folder upload completed: %s", log_desc);
+
+    archive_import_free(imp);
+}
+
+// Helper: drop any pending delta upload state
+static void clear_pending_delta(ClientSession* session) {
+    free(session->pending_upload_uuid);
+    session->pending_upload_uuid = NULL;
+    session->pending_upload_size = 0;
+    free(session->pending_delta_crcs);
+    session->pending_delta_crcs = NULL;
+    session->pending_delta_crc_count = 0;
+    session->pending_delta_file_id = 0;
+    session->pending_delta_block_size = 0;
+    session->state = STATE_AUTHENTICATED;
+}
+
+// Helper: look up a regular file the session may overwrite
+static int get_writable_file(ClientSession* session, int file_id, FileEntry* entry) {
+    if (!check_permission(global_db, session->user_id, file_id, ACCESS_WRITE)) {
+        send_error(session, "Permission denied");
+        db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "DELTA_UPLOAD");
+        return -1;
+    }
+
+    if (db_get_file_by_id(global_db, file_id, entry) < 0) {
+        send_error(session, "File not found");
+        return -1;
+    }
+
+    if (entry->is_directory) {
+        send_error(session, "Cannot upload into a directory entry");
+        return -1;
+    }
+    return 0;
+}
+
+void handle_delta_sig(ClientSession* session, Packet* pkt) {
+    cJSON* json = cJSON_Parse(pkt->payload);
+    if (!json) {
+        send_error(session, "Invalid JSON");
+        return;
+    }
+
+    cJSON* file_id_item = cJSON_GetObjectItem(json, "file_id");
+    if (!file_id_item) {
+        send_error(session, "Missing 'file_id' parameter");
+        cJSON_Delete(json);
+        return;
+    }
+    int file_id = file_id_item->valueint;
+    cJSON_Delete(json);
+
+    FileEntry entry;
+    if (get_writable_file(session, file_id, &entry) < 0) {
+        return;
+    }
+
+    StorageView* view = storage_map_file(entry.physical_path);
+    if (!view) {
+        send_error(session, "Failed to read file from storage");
+        return;
+    }
+
+    size_t size = 0;
+    uint8_t* decoded = NULL;
+    const uint8_t* contents = blob_contents(&entry, view, &size, &decoded);
+
+    size_t block_size = delta_block_size(size);
+    DeltaSig* sigs = NULL;
+    int count = 0;
+    uint8_t* wire = NULL;
+    size_t wire_len = 0;
+    int rc = contents ? delta_signatures(contents, size, block_size, &sigs, &count) : -1;
+    if (rc == 0) {
+        rc = delta_sigs_encode(sigs, count, &wire, &wire_len);
+    }
+    storage_view_release(view);
+    free(decoded);
+    free(sigs);
+
+    if (rc < 0 || wire_len > MAX_PAYLOAD_SIZE) {
+        send_error(session, "Failed to compute signatures");
+        free(wire);
+        return;
+    }
+
+    // STEP 1: Signature parameters
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "status", "OK");
+    cJSON_AddNumberToObject(response, "size", (double)size);
+    cJSON_AddNumberToObject(response, "block_size", (double)block_size);
+    cJSON_AddNumberToObject(response, "blocks", count);
+    cJSON_AddNumberToObject(response, "checksum_chunk", INTEGRITY_CHUNK_SIZE);
+
+    char* payload = cJSON_PrintUnformatted(response);
+    send_success(session, CMD_SUCCESS, payload);
+    free(payload);
+    cJSON_Delete(response);
+
+    // STEP 2: Packed signatures
+    packet_send_data(session->client_socket, CMD_SUCCESS, wire, (uint32_t)wire_len);
+    free(wire);
+
+    log_info("Sent %d delta signatures for file_id=%d (block=%zu)", count, file_id, block_size);
+}
+
+void handle_delta_req(ClientSession* session, Packet* pkt) {
+    cJSON* json = cJSON_Parse(pkt->payload);
+    if (!json) {
+        send_error(session, "Invalid JSON");
+        return;
+    }
+
+    cJSON* file_id_item = cJSON_GetObjectItem(json, "file_id");
+    cJSON* size_item = cJSON_GetObjectItem(json, "size");
+    cJSON* block_item = cJSON_GetObjectItem(json, "block_size");
+    cJSON* crcs_item = cJSON_GetObjectItem(json, "crcs");
+
+    if (!file_id_item || !size_item || !block_item || !cJSON_IsArray(crcs_item)) {
+        send_error(session, "Missing 'file_id', 'size', 'block_size' or 'crcs' parameter");
+        cJSON_Delete(json);
+        return;
+    }
+
+    int file_id = file_id_item->valueint;
+    long size = (long)size_item->valuedouble;
+    long block_size = (long)block_item->valuedouble;
+    int crc_count = cJSON_GetArraySize(crcs_item);
+
+    // The rebuilt file is assembled in memory and downloads go out as one
+    // packet, so it may not outgrow a payload
+    if (size <= 0 || size > MAX_PAYLOAD_SIZE ||
+        block_size < DELTA_MIN_BLOCK || block_size > DELTA_MAX_BLOCK ||
+        crc_count != (int)((size + INTEGRITY_CHUNK_SIZE - 1) / INTEGRITY_CHUNK_SIZE)) {
+        send_error(session, "Invalid delta parameters");
+        cJSON_Delete(json);
+        return;
+    }
+
+    FileEntry entry;
+    if (get_writable_file(session, file_id, &entry) < 0) {
+        cJSON_Delete(json);
+        return;
+    }
+
+    // Growth is charged to the file's owner
+    if (size > entry.size && db_quota_allows(global_db, entry.owner_id, size - entry.size, 0) != 1) {
+        send_error(session, "Quota exceeded");
+        cJSON_Delete(json);
+        return;
+    }
+
+    uint32_t* crcs = malloc(crc_count * sizeof(uint32_t));
+    char* uuid = generate_uuid();
+    if (!crcs || !uuid) {
+        send_error(session, "Out of memory");
+        free(crcs);
+        free(uuid);
+        cJSON_Delete(json);
+        return;
+    }
+    int n = 0;
+    cJSON* crc_item;
+    cJSON_ArrayForEach(crc_item, crcs_item) {
+        crcs[n++] = (uint32_t)crc_item->valuedouble;
+    }
+    cJSON_Delete(json);
+
+    // The rebuilt blob gets a fresh UUID next to the old one
+    clear_pending_delta(session);
+    session->pending_upload_uuid = uuid;
+    session->pending_upload_size = size;
+    session->pending_delta_file_id = file_id;
+    session->pending_delta_block_size = block_size;
+    session->pending_delta_crcs = crcs;
+    session->pending_delta_crc_count = crc_count;
+    session->state = STATE_TRANSFERRING;
+
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "status", "READY");
+    cJSON_AddNumberToObject(response, "file_id", file_id);
+
+    char* payload = cJSON_PrintUnformatted(response);
+    send_success(session, CMD_SUCCESS, payload);
+
+    free(payload);
+    cJSON_Delete(response);
+}
+
+void handle_delta_data(ClientSession* session, Packet* pkt) {
+    if (!session->pending_delta_file_id || !session->pending_upload_uuid) {
+        send_error(session, "No pending delta upload. Send DELTA_REQ first");
+        return;
+    }
+
+    int file_id = session->pending_delta_file_id;
+    size_t new_size = (size_t)session->pending_upload_size;
+
+    FileEntry entry;
+    if (db_get_file_by_id(global_db, file_id, &entry) < 0 || entry.is_directory) {
+        send_error(session, "File not found");
+        clear_pending_delta(session);
+        return;
+    }
+
+    StorageView* old = storage_map_file(entry.physical_path);
+    uint8_t* rebuilt = malloc(new_size);
+    if (!old || !rebuilt) {
+        send_error(session, "Failed to read file from storage");
+        if (old) storage_view_release(old);
+        free(rebuilt);
+        clear_pending_delta(session);
+        return;
+    }
+
+    size_t old_size = 0;
+    uint8_t* decoded = NULL;
+    const uint8_t* old_contents = blob_contents(&entry, old, &old_size, &decoded);
+    int rc = old_contents ? delta_apply(old_contents, old_size, (size_t)session->pending_delta_block_size,
+                                        (const uint8_t*)pkt->payload, pkt->data_length,
+                                        rebuilt, new_size) : -1;
+    storage_view_release(old);
+    free(decoded);
+
+    // The client's chunk CRCs prove the rebuild matches its file
+    uint32_t* crcs = NULL;
+    int crc_count = 0;
+    if (rc == 0) {
+        rc = crc32c_chunks(rebuilt, new_size, INTEGRITY_CHUNK_SIZE, &crcs, &crc_count);
+    }
+    if (rc == 0 && (crc_count != session->pending_delta_crc_count ||
+                    memcmp(crcs, session->pending_delta_crcs, crc_count * sizeof(uint32_t)) != 0)) {
+        rc = -1;
+    }
+    if (rc < 0) {
+        send_error(session, "Delta verification failed");
+        log_error("Delta upload for file_id=%d did not reproduce the client's file", file_id);
+        free(crcs);
+        free(rebuilt);
+        clear_pending_delta(session);
+        return;
+    }
+
+    free(crcs);
+
+    const char* new_uuid = session->pending_upload_uuid;
+    if (store_blob(new_uuid, rebuilt, new_size) < 0) {
+        send_error(session, "Failed to write file to storage");
+        free(rebuilt);
+        clear_pending_delta(session);
+        return;
+    }
+    free(rebuilt);
+
+    // Swap the row over to the new blob; the old one is no longer referenced
+    if (db_update_file_blob(global_db, file_id, new_uuid, (long)new_size) < 0) {
+        send_error(session, "Failed to update file entry");
+        storage_delete_file(new_uuid);
+        clear_pending_delta(session);
+        return;
+    }
+    storage_delete_file(entry.physical_path);
+
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "status", "OK");
+    cJSON_AddStringToObject(response, "message", "File updated successfully");
+    cJSON_AddNumberToObject(response, "delta_bytes", pkt->data_length);
+
+    char* payload = cJSON_PrintUnformatted(response);
+    send_success(session, CMD_SUCCESS, payload);
+
+    free(payload);
+    cJSON_Delete(response);
+
+    db_log_activity(global_db, session->user_id, "DELTA_UPLOAD", entry.name);
+    log_info("Delta upload completed: file_id=%d, size=%zu, delta=%u bytes",
+             file_id, new_size, pkt->data_length);
 
-    // Clear pending upload
-    free(session->pending_upload_uuid);
-    session->pending_upload_uuid = NULL;
-    session->pending_upload_size = 0;
-    session->state = STATE_AUTHENTICATED;
+    clear_pending_delta(session);
 }
 
 void handle_download(ClientSession* session, Packet* pkt) {
@@ -467,6 +1078,11 @@ void handle_download(ClientSession* session, Packet* pkt) {
 
     int file_id = file_id_item->valueint;
 
+    // Clients that can inflate themselves get compressed blobs as stored
+    cJSON* accept_item = cJSON_GetObjectItem(json, "accept_encoding");
+    int accept_deflate = cJSON_IsString(accept_item) &&
+                         strcmp(accept_item->valuestring, COMPRESS_ENCODING) == 0;
+
     // DEBUG: Log download attempt
     log_info("DOWNLOAD REQUEST: user_id=%d, file_id=%d", session->user_id, file_id);
 
@@ -496,19 +1112,39 @@ void handle_download(ClientSession* session, Packet* pkt) {
         return;
     }
 
-    // Read file from storage
-    uint8_t* data = NULL;
-    size_t size = 0;
-    if (storage_read_file(entry.physical_path, &data, &size) < 0) {
+    // Map file from storage (shared with any concurrent downloads of it)
+    StorageView* view = storage_map_file(entry.physical_path);
+    if (!view) {
         send_error(session, "Failed to read file from storage");
         cJSON_Delete(json);
         return;
     }
+    size_t size = view->size;
+
+    // Catch silent corruption before any of it reaches the client
+    if (integrity_verify_view(global_db, view) < 0) {
+        send_error(session, "File failed integrity check");
+        storage_view_release(view);
+        cJSON_Delete(json);
+        return;
+    }
+
+    // Compressed blobs: "size" stays the file's logical size
+    char encoding[16];
+    int encoded = db_get_blob_encoding(global_db, entry.physical_path,
+                                       encoding, sizeof(encoding), NULL) == 0;
+    if (encoded) {
+        size = (size_t)entry.size;
+    }
 
     // STEP 1: Send metadata JSON first
     cJSON* metadata = cJSON_CreateObject();
     cJSON_AddNumberToObject(metadata, "size", (double)size);
     cJSON_AddStringToObject(metadata, "name", entry.name);
+    if (encoded && accept_deflate) {
+        cJSON_AddStringToObject(metadata, "encoding", COMPRESS_ENCODING);
+        cJSON_AddNumberToObject(metadata, "stored_size", (double)view->size);
+    }
 
     char* json_str = cJSON_PrintUnformatted(metadata);
     Packet* meta_pkt = packet_create(CMD_DOWNLOAD_RES, json_str, strlen(json_str));
@@ -519,17 +1155,149 @@ void handle_download(ClientSession* session, Packet* pkt) {
     cJSON_Delete(metadata);
 
     // STEP 2: Send file data with CMD_SUCCESS (client expects non-CMD_DOWNLOAD_RES for data)
-    Packet* data_pkt = packet_create(CMD_SUCCESS, (char*)data, size);
-    packet_send(session->client_socket, data_pkt);
-    packet_free(data_pkt);
+    // Payload goes to the socket straight from the mapping, no heap copy
+    if (!encoded || accept_deflate) {
+        packet_send_data(session->client_socket, CMD_SUCCESS, view->data, (uint32_t)view->size);
+    } else {
+        compression_send_decoded(session->client_socket, CMD_SUCCESS,
+                                 view->data, view->size, size);
+    }
 
-    free(data);
+    storage_view_release(view);
     cJSON_Delete(json);
 
     db_log_activity(global_db, session->user_id, "DOWNLOAD", entry.name);
     log_info("Download completed: file_id=%d, name=%s, size=%zu", file_id, entry.name, size);
 }
 
+// Helper: append one stored file to an archive stream.
+// Returns 0 if added, 1 if skipped (unreadable blob), -1 if the stream failed.
+static int archive_blob(ArchiveStream* as, const TreeEntry* t) {
+    int mode = t->file.permissions & 0777;
+    if (t->file.size == 0) {
+        return archive_add_file(as, t->path, mode, t->mtime, NULL, 0);
+    }
+
+    StorageView* view = storage_map_file(t->file.physical_path);
+    if (!view) {
+        return 1;
+    }
+    if (integrity_verify_view(global_db, view) < 0) {
+        storage_view_release(view);
+        return 1;
+    }
+
+    size_t size = 0;
+    uint8_t* decoded = NULL;
+    const uint8_t* contents = blob_contents(&t->file, view, &size, &decoded);
+    int rc = contents ? archive_add_file(as, t->path, mode, t->mtime, contents, size) : 1;
+
+    free(decoded);
+    storage_view_release(view);
+    return rc;
+}
+
+// Stream a whole directory tree as one tar archive (gzip-compressed on
+// request). Response: CMD_DOWNLOAD_RES metadata, CMD_SUCCESS data packets,
+// then a CMD_DOWNLOAD_RES summary. Entries the user can't read are left out.
+void handle_download_tree(ClientSession* session, Packet* pkt) {
+    cJSON* json = cJSON_Parse(pkt->payload);
+    if (!json) {
+        send_error(session, "Invalid JSON");
+        return;
+    }
+
+    cJSON* dir_item = cJSON_GetObjectItem(json, "directory_id");
+    if (!cJSON_IsNumber(dir_item)) {
+        send_error(session, "Missing 'directory_id' parameter");
+        cJSON_Delete(json);
+        return;
+    }
+    int dir_id = dir_item->valueint;
+    int compress = cJSON_IsTrue(cJSON_GetObjectItem(json, "compress"));
+    cJSON_Delete(json);
+
+    if (!check_permission(global_db, session->user_id, dir_id, ACCESS_READ)) {
+        send_error(session, "Permission denied");
+        db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "DOWNLOAD_TREE");
+        return;
+    }
+
+    FileEntry dir;
+    memset(&dir, 0, sizeof(dir));
+    if (dir_id != 0) {
+        if (db_get_file_by_id(global_db, dir_id, &dir) < 0) {
+            send_error(session, "Directory not found");
+            return;
+        }
+        if (!dir.is_directory) {
+            send_error(session, "Not a directory");
+            return;
+        }
+    } else {
+        strcpy(dir.name, "/");
+    }
+
+    // One query for the whole permitted tree
+    TreeEntry* entries = NULL;
+    int count = 0;
+    if (db_list_subtree(global_db, dir_id, session->user_id, &entries, &count) < 0) {
+        send_error(session, "Failed to list directory tree");
+        return;
+    }
+
+    cJSON* metadata = cJSON_CreateObject();
+    cJSON_AddStringToObject(metadata, "name", dir.name);
+    cJSON_AddStringToObject(metadata, "format", compress ? "tar+gzip" : "tar");
+    cJSON_AddNumberToObject(metadata, "entries", count);
+    char* meta_str = cJSON_PrintUnformatted(metadata);
+    send_success(session, CMD_DOWNLOAD_RES, meta_str);
+    free(meta_str);
+    cJSON_Delete(metadata);
+
+    ArchiveStream as;
+    if (archive_open(&as, session->client_socket, compress) < 0) {
+        send_error(session, "Failed to start archive");
+        free(entries);
+        return;
+    }
+
+    int files = 0, dirs = 0, skipped = 0;
+    int rc = 0;
+    for (int i = 0; i < count && rc >= 0; i++) {
+        const TreeEntry* t = &entries[i];
+        if (t->file.is_directory) {
+            rc = archive_add_dir(&as, t->path, t->file.permissions & 0777, t->mtime);
+            if (rc == 0) dirs++;
+        } else {
+            rc = archive_blob(&as, t);
+            if (rc == 0) files++;
+        }
+        if (rc == 1) {
+            log_error("Download tree: skipped '%s' (file_id=%d)", t->path, t->file.id);
+            skipped++;
+        }
+    }
+    free(entries);
+
+    if (archive_close(&as, rc >= 0) < 0 || rc < 0) {
+        log_error("Download tree aborted: dir_id=%d, user_id=%d", dir_id, session->user_id);
+        return;
+    }
+
+    char summary[128];
+    snprintf(summary, sizeof(summary),
+             "{\"status\":\"OK\",\"files\":%d,\"directories\":%d,\"skipped\":%d}",
+             files, dirs, skipped);
+    send_success(session, CMD_DOWNLOAD_RES, summary);
+
+    char log_desc[512];
+    snprintf(log_desc, sizeof(log_desc), "%s (%d files, %d directories, %llu bytes)",
+             dir.name, files, dirs, (unsigned long long)as.bytes_sent);
+    db_log_activity(global_db, session->user_id, "DOWNLOAD_TREE", log_desc);
+    log_info("Download tree completed: dir_id=%d, %s", dir_id, log_desc);
+}
+
 void handle_change_dir(ClientSession* session, Packet* pkt) {
     cJSON* json = cJSON_Parse(pkt->payload);
     if (!json) {
@@ -704,24 +1472,35 @@ void handle_delete(ClientSession* session, Packet* pkt) {
         return;
     }
 
-    // Delete the file from database
-    if (db_delete_file(global_db, file_id) < 0) {
+    // Delete the entry and, for a directory, everything below it; refused
+    // unless the user may read and write every directory in it
+    int deleted = db_delete_subtree(global_db, file_id, session->user_id);
+    if (deleted < 0) {
         send_error(session, "Failed to delete file");
         cJSON_Delete(json);
         return;
     }
+    if (deleted == 0) {
+        send_error(session, "Permission denied: directory contains entries you cannot delete");
+        cJSON_Delete(json);
+        db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "DELETE");
+        return;
+    }
 
-    // If it's a regular file (not directory), delete physical file
+    // A file's blob goes now; a directory's blobs are left to the storage GC
     if (!entry.is_directory && entry.physical_path[0] != '\0') {
-        unlink(entry.physical_path);  // Delete physical file, ignore errors
+        storage_delete_file(entry.physical_path);  // Ignore errors; GC reclaims leftovers
+    } else if (deleted > 1) {
+        gc_trigger();
     }
 
-    log_info("User %d deleted %s (ID: %d)",
-             session->user_id, entry.name, file_id);
+    log_info("User %d deleted %s (ID: %d, %d entries)",
+             session->user_id, entry.name, file_id, deleted);
 
     cJSON* response = cJSON_CreateObject();
     cJSON_AddStringToObject(response, "status", "OK");
     cJSON_AddStringToObject(response, "message", "File deleted successfully");
+    cJSON_AddNumberToObject(response, "deleted", deleted);
 
     char* payload = cJSON_PrintUnformatted(response);
     send_success(session, CMD_SUCCESS, payload);
@@ -779,6 +1558,14 @@ void handle_file_info(ClientSession* session, Packet* pkt) {
 
     cJSON_AddStringToObject(response, "created_at", entry.created_at);
 
+    // Directories: everything below them, from the maintained totals
+    long total_bytes;
+    int total_files;
+    if (entry.is_directory && db_get_dir_totals(global_db, entry.id, &total_bytes, &total_files) == 0) {
+        cJSON_AddNumberToObject(response, "total_size", (double)total_bytes);
+        cJSON_AddNumberToObject(response, "file_count", total_files);
+    }
+
     if (!entry.is_directory && entry.physical_path[0] != '\0') {
         cJSON_AddStringToObject(response, "physical_path", entry.physical_path);
     }
@@ -1046,103 +1833,100 @@ void handle_admin_update_user(ClientSession* session, Packet* pkt) {
     cJSON_Delete(response);
 }
 
-// Helper: Build full VFS path by traversing parent_id chain
-static void build_full_path(Database* db, int file_id, char* path, size_t size) {
-    char components[32][256];
-    int depth = 0;
-    int current_id = file_id;
-
-    // Traverse up to root
-    while (current_id > 0 && depth < 32) {
-        FileEntry entry;
-        if (db_get_file_by_id(db, current_id, &entry) != 0) break;
-
-        strncpy(components[depth++], entry.name, 255);
-        components[depth-1][255] = '\0';
-        current_id = entry.parent_id;
+void handle_admin_storage_gc(ClientSession* session, Packet* pkt) {
+    // Check admin authorization
+    if (!db_is_admin(global_db, session->user_id)) {
+        send_error(session, "Admin access required");
+        log_info("Non-admin user %d attempted to query storage GC", session->user_id);
+        return;
     }
 
-    // Build path from root down
-    path[0] = '\0';
-    for (int i = depth - 1; i >= 0; i--) {
-        if (i == depth - 1 && strcmp(components[i], "/") == 0) {
-            // Skip root name if it's "/"
-            continue;
-        }
-        if (strlen(path) > 0 && path[strlen(path)-1] != '/') {
-            strncat(path, "/", size - strlen(path) - 1);
+    // Optional {"run": true} starts a pass immediately
+    int run = 0;
+    if (pkt->payload && pkt->data_length > 0) {
+        cJSON* json = cJSON_Parse(pkt->payload);
+        if (json) {
+            run = cJSON_IsTrue(cJSON_GetObjectItem(json, "run"));
+            cJSON_Delete(json);
         }
-        strncat(path, components[i], size - strlen(path) - 1);
     }
 
-    // Ensure leading slash
-    if (path[0] != '/' && strlen(path) > 0) {
-        memmove(path + 1, path, strlen(path) + 1);
-        path[0] = '/';
-    } else if (path[0] == '\0') {
-        strcpy(path, "/");
+    if (run) {
+        gc_trigger();
+        db_log_activity(global_db, session->user_id, "ADMIN_STORAGE_GC", "Triggered storage GC pass");
     }
+
+    GcStats stats;
+    gc_get_stats(&stats);
+
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "status", "OK");
+    cJSON_AddBoolToObject(response, "running", stats.running);
+    cJSON_AddNumberToObject(response, "passes", stats.passes);
+    cJSON_AddNumberToObject(response, "shards_done", stats.shards_done);
+    cJSON_AddNumberToObject(response, "shards_total", 256);
+    cJSON_AddNumberToObject(response, "row_cursor", stats.row_cursor);
+    cJSON_AddNumberToObject(response, "blobs_scanned", stats.blobs_scanned);
+    cJSON_AddNumberToObject(response, "blobs_deleted", stats.blobs_deleted);
+    cJSON_AddNumberToObject(response, "rows_scanned", stats.rows_scanned);
+    cJSON_AddNumberToObject(response, "rows_missing", stats.rows_missing);
+    cJSON_AddNumberToObject(response, "last_started", (double)stats.last_started);
+    cJSON_AddNumberToObject(response, "last_finished", (double)stats.last_finished);
+
+    char* payload = cJSON_PrintUnformatted(response);
+    send_success(session, CMD_SUCCESS, payload);
+
+    free(payload);
+    cJSON_Delete(response);
 }
 
-// Handler: Search files
-void handle_search(ClientSession* session, Packet* pkt) {
-    if (!pkt->payload) {
-        send_error(session, "Empty payload");
+void handle_admin_set_quota(ClientSession* session, Packet* pkt) {
+    // Check admin authorization
+    if (!db_is_admin(global_db, session->user_id)) {
+        send_error(session, "Admin access required");
+        log_info("Non-admin user %d attempted to set a quota", session->user_id);
         return;
     }
 
-    cJSON* json = cJSON_Parse(pkt->payload);
+    cJSON* json = pkt->payload ? cJSON_Parse(pkt->payload) : NULL;
     if (!json) {
         send_error(session, "Invalid JSON");
         return;
     }
 
-    // Extract parameters
-    cJSON* pattern_item = cJSON_GetObjectItem(json, "pattern");
-    cJSON* dir_item = cJSON_GetObjectItem(json, "directory_id");
-    cJSON* recursive_item = cJSON_GetObjectItem(json, "recursive");
-    cJSON* limit_item = cJSON_GetObjectItem(json, "limit");
+    cJSON* user_id_item = cJSON_GetObjectItem(json, "user_id");
+    cJSON* max_bytes_item = cJSON_GetObjectItem(json, "max_bytes");
+    cJSON* max_files_item = cJSON_GetObjectItem(json, "max_files");
 
-    if (!pattern_item || !dir_item) {
-        send_error(session, "Missing required fields");
+    if (!user_id_item) {
+        send_error(session, "Missing user_id");
         cJSON_Delete(json);
         return;
     }
 
-    const char* pattern = cJSON_GetStringValue(pattern_item);
-    int directory_id = dir_item->valueint;
-    int recursive = recursive_item ? (recursive_item->valueint != 0) : 0;
-    int limit = limit_item ? limit_item->valueint : 100;
-
-    // Validate limit
-    if (limit <= 0 || limit > 1000) {
-        limit = 100;
-    }
+    // 0 (or omitted) means unlimited
+    int target_user_id = user_id_item->valueint;
+    long max_bytes = max_bytes_item ? (long)max_bytes_item->valuedouble : 0;
+    long max_files = max_files_item ? (long)max_files_item->valuedouble : 0;
+    cJSON_Delete(json);
 
-    // Validate pattern
-    if (!pattern || strlen(pattern) == 0) {
-        send_error(session, "Invalid search pattern");
-        cJSON_Delete(json);
+    if (db_set_quota(global_db, target_user_id, max_bytes, max_files) < 0) {
+        send_error(session, "Failed to set quota");
         return;
     }
 
-    log_info("Search request from user %d: pattern='%s', dir=%d, recursive=%d, limit=%d",
-             session->user_id, pattern, directory_id, recursive, limit);
-
-    // Perform search
-    FileEntry* entries = NULL;
-    int count = 0;
-
-    int result = db_search_files(global_db, directory_id, pattern, recursive,
-                                  session->user_id, limit, &entries, &count);
+    char log_desc[256];
+    snprintf(log_desc, sizeof(log_desc), "Set quota for user %d (max_bytes=%ld, max_files=%ld)",
+             target_user_id, max_bytes, max_files);
+    db_log_activity(global_db, session->user_id, "ADMIN_SET_QUOTA", log_desc);
+    log_info("Admin user %d: %s", session->user_id, log_desc);
 
-    if (result != 0) {
-        send_error(session, "Search failed");
-        cJSON_Delete(json);
-        return;
-    }
+    send_success(session, CMD_SUCCESS, "{\"status\":\"OK\",\"message\":\"Quota updated\"}");
+}
 
-    // Build response
+// Helper: send `count` search results, with a cursor if more follow
+static void send_search_page(ClientSession* session, FileEntry* entries, int count,
+                             const ListCursor* next) {
     cJSON* response = cJSON_CreateObject();
     cJSON_AddStringToObject(response, "status", "OK");
     cJSON_AddNumberToObject(response, "count", count);
@@ -1152,7 +1936,9 @@ void handle_search(ClientSession* session, Packet* pkt) {
     for (int i = 0; i < count; i++) {
         // Build full path for each result
         char full_path[1024];
-        build_full_path(global_db, entries[i].id, full_path, sizeof(full_path));
+        if (db_get_file_path(global_db, entries[i].id, full_path, sizeof(full_path)) != 0) {
+            strcpy(full_path, "/");
+        }
 
         // Fetch username from owner_id
         char owner_username[256] = "unknown";
@@ -1177,21 +1963,123 @@ void handle_search(ClientSession* session, Packet* pkt) {
         cJSON_AddItemToArray(results_array, item);
     }
 
+    if (next) {
+        char cursor[300];
+        format_cursor(next, cursor, sizeof(cursor));
+        cJSON_AddStringToObject(response, "next_cursor", cursor);
+    }
+
     char* payload = cJSON_PrintUnformatted(response);
     send_success(session, CMD_SEARCH_RES, payload);
 
-    free(entries);
     free(payload);
-    cJSON_Delete(json);
     cJSON_Delete(response);
+}
+
+// Handler: Search files
+void handle_search(ClientSession* session, Packet* pkt) {
+    if (!pkt->payload) {
+        send_error(session, "Empty payload");
+        return;
+    }
+
+    cJSON* json = cJSON_Parse(pkt->payload);
+    if (!json) {
+        send_error(session, "Invalid JSON");
+        return;
+    }
+
+    // Extract parameters
+    cJSON* pattern_item = cJSON_GetObjectItem(json, "pattern");
+    cJSON* dir_item = cJSON_GetObjectItem(json, "directory_id");
+    cJSON* recursive_item = cJSON_GetObjectItem(json, "recursive");
+    cJSON* limit_item = cJSON_GetObjectItem(json, "limit");
+    cJSON* cursor_item = cJSON_GetObjectItem(json, "cursor");
+
+    if (!pattern_item || !dir_item) {
+        send_error(session, "Missing required fields");
+        cJSON_Delete(json);
+        return;
+    }
+
+    const char* pattern = cJSON_GetStringValue(pattern_item);
+    int directory_id = dir_item->valueint;
+    int recursive = recursive_item ? (recursive_item->valueint != 0) : 0;
+    int limit = limit_item ? limit_item->valueint : 100;
+    int stream = json_flag(json, "stream");
+
+    // Validate limit (the page size when paging)
+    if (limit <= 0 || limit > SEARCH_PAGE_MAX) {
+        limit = 100;
+    }
+
+    // Validate pattern
+    if (!pattern || strlen(pattern) == 0) {
+        send_error(session, "Invalid search pattern");
+        cJSON_Delete(json);
+        return;
+    }
+
+    // Resume after a previous page's next_cursor
+    ListCursor after;
+    int has_cursor = cursor_item != NULL;
+    if (has_cursor && parse_cursor(cJSON_GetStringValue(cursor_item), &after) < 0) {
+        send_error(session, "Invalid cursor");
+        cJSON_Delete(json);
+        return;
+    }
+
+    log_info("Search request from user %d: pattern='%s', dir=%d, recursive=%d, limit=%d",
+             session->user_id, pattern, directory_id, recursive, limit);
+
+    // Check READ permission on the base directory; the query filters the rest
+    if (!check_permission(global_db, session->user_id, directory_id, ACCESS_READ)) {
+        send_error(session, "Permission denied");
+        db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "SEARCH");
+        cJSON_Delete(json);
+        return;
+    }
+
+    // One extra row tells whether another page follows; when streaming,
+    // keep going from each page's last key until the results run out
+    int total = 0;
+    for (;;) {
+        FileEntry* entries = NULL;
+        int count = 0;
+
+        int result = db_search_files_page(global_db, directory_id, pattern, recursive,
+                                          session->user_id, has_cursor ? &after : NULL,
+                                          limit + 1, &entries, &count);
+        if (result != 0) {
+            send_error(session, "Search failed");
+            cJSON_Delete(json);
+            return;
+        }
+
+        int more = count > limit;
+        if (more) {
+            count = limit;
+            after.is_directory = entries[count - 1].is_directory ? 1 : 0;
+            after.id = entries[count - 1].id;
+            snprintf(after.name, sizeof(after.name), "%s", entries[count - 1].name);
+            has_cursor = 1;
+        }
+
+        send_search_page(session, entries, count, more ? &after : NULL);
+        free(entries);
+        total += count;
+
+        if (!more || !stream) break;
+    }
 
     log_info("Search completed for user %d: pattern='%s', found=%d",
-             session->user_id, pattern, count);
+             session->user_id, pattern, total);
 
     char log_desc[512];
     snprintf(log_desc, sizeof(log_desc), "Searched for '%s' (recursive=%d, found=%d)",
-             pattern, recursive, count);
+             pattern, recursive, total);
     db_log_activity(global_db, session->user_id, "SEARCH", log_desc);
+    cJSON_Delete(json);
 }
 
 // Rename file or directory
@@ -1225,6 +2113,19 @@ void handle_rename(ClientSession* session, Packet* pkt) {
         return;
     }
 
+    // WRITE on the entry and on the directory holding it
+    FileEntry entry;
+    PermissionCheck checks[2] = {
+        { file_id, ACCESS_WRITE },
+        { db_get_file_by_id(global_db, file_id, &entry) == 0 ? entry.parent_id : file_id, ACCESS_WRITE }
+    };
+    if (!check_permissions(global_db, session->user_id, checks, 2)) {
+        cJSON_Delete(json);
+        send_error(session, "Permission denied");
+        db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "RENAME");
+        return;
+    }
+
     // Rename in database
     int result = db_rename_file(global_db, file_id, new_name);
 
@@ -1275,8 +2176,39 @@ void handle_copy(ClientSession* session, Packet* pkt) {
     int dest_parent_id = dest_parent_obj->valueint;
     const char* new_name = new_name_obj ? cJSON_GetStringValue(new_name_obj) : "";
 
-    // Copy in database (creates new entry, physical copy would be handled separately)
-    int new_id = db_copy_file(global_db, source_id, dest_parent_id, new_name, session->user_id);
+    // READ on the source and WRITE on the destination, checked together
+    PermissionCheck checks[2] = {
+        { source_id, ACCESS_READ },
+        { dest_parent_id, ACCESS_WRITE }
+    };
+    if (!check_permissions(global_db, session->user_id, checks, 2)) {
+        cJSON_Delete(json);
+        send_error(session, "Permission denied");
+        db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "COPY");
+        return;
+    }
+
+    // The copy is charged to the copying user; a directory by its subtree totals
+    FileEntry source;
+    if (db_get_file_by_id(global_db, source_id, &source) == 0) {
+        long bytes = source.size;
+        int files = 1;
+        if (source.is_directory && db_get_dir_totals(global_db, source_id, &bytes, &files) < 0) {
+            bytes = 0;
+            files = 0;
+        }
+        if (db_quota_allows(global_db, session->user_id, bytes, files) != 1) {
+            cJSON_Delete(json);
+            send_error(session, "Quota exceeded");
+            return;
+        }
+    }
+
+    // Copy the entry and anything below it in one transaction, then the blobs
+    BlobCopy* blobs = NULL;
+    int blob_count = 0;
+    int new_id = db_copy_subtree(global_db, source_id, dest_parent_id, new_name,
+                                 session->user_id, &blobs, &blob_count);
 
     if (new_id < 0) {
         cJSON_Delete(json);
@@ -1284,6 +2216,27 @@ void handle_copy(ClientSession* session, Packet* pkt) {
         return;
     }
 
+    // Any blob that cannot be copied undoes the whole copy; blobs already
+    // written are left to the storage GC
+    int copied = 1;
+    for (int i = 0; i < blob_count && copied; i++) {
+        StorageView* view = storage_map_file(blobs[i].source);
+        if (!view || (view->size > 0 && storage_write_file(blobs[i].copy, view->data, view->size) < 0)) {
+            log_error("Copy %d: failed to copy blob %s", new_id, blobs[i].source);
+            copied = 0;
+        }
+        if (view) storage_view_release(view);
+    }
+    free(blobs);
+
+    if (!copied) {
+        db_delete_subtree(global_db, new_id, -1);
+        gc_trigger();
+        cJSON_Delete(json);
+        send_error(session, "Failed to copy file");
+        return;
+    }
+
     // Send success response with new file ID
     char success_msg[256];
     snprintf(success_msg, sizeof(success_msg), "{\"message\":\"File copied successfully\",\"source_id\":%d,\"new_id\":%d}", source_id, new_id);
@@ -1323,6 +2276,20 @@ void handle_move(ClientSession* session, Packet* pkt) {
     int file_id = file_id_obj->valueint;
     int new_parent_id = new_parent_obj->valueint;
 
+    // WRITE on the entry, the directory it leaves and the one it joins
+    FileEntry entry;
+    PermissionCheck checks[3] = {
+        { file_id, ACCESS_WRITE },
+        { db_get_file_by_id(global_db, file_id, &entry) == 0 ? entry.parent_id : file_id, ACCESS_WRITE },
+        { new_parent_id, ACCESS_WRITE }
+    };
+    if (!check_permissions(global_db, session->user_id, checks, 3)) {
+        cJSON_Delete(json);
+        send_error(session, "Permission denied");
+        db_log_activity(global_db, session->user_id, "ACCESS_DENIED", "MOVE");
+        return;
+    }
+
     // Move in database
     int result = db_move_file(global_db, file_id, new_parent_id);
 
@@ -1345,3 +2312,43 @@ void handle_move(ClientSession* session, Packet* pkt) {
     snprintf(log_desc, sizeof(log_desc), "Moved file %d to parent %d", file_id, new_parent_id);
     db_log_activity(global_db, session->user_id, "MOVE", log_desc);
 }
+
+// Quota and usage of the current user (admins may ask about any user)
+void handle_get_quota(ClientSession* session, Packet* pkt) {
+    if (!session->authenticated) {
+        send_error(session, "Not authenticated");
+        return;
+    }
+
+    int target_user_id = session->user_id;
+    cJSON* json = (pkt->payload && pkt->data_length > 0) ? cJSON_Parse(pkt->payload) : NULL;
+    cJSON* user_id_item = json ? cJSON_GetObjectItem(json, "user_id") : NULL;
+    if (user_id_item) {
+        target_user_id = user_id_item->valueint;
+    }
+    cJSON_Delete(json);
+
+    if (target_user_id != session->user_id && !db_is_admin(global_db, session->user_id)) {
+        send_error(session, "Permission denied");
+        return;
+    }
+
+    UserQuota quota;
+    if (db_get_quota(global_db, target_user_id, &quota) < 0) {
+        send_error(session, "Failed to read quota");
+        return;
+    }
+
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(response, "user_id", target_user_id);
+    cJSON_AddNumberToObject(response, "bytes_used", (double)quota.bytes_used);
+    cJSON_AddNumberToObject(response, "files_used", (double)quota.files_used);
+    cJSON_AddNumberToObject(response, "max_bytes", (double)quota.max_bytes);
+    cJSON_AddNumberToObject(response, "max_files", (double)quota.max_files);
+
+    char* payload = cJSON_PrintUnformatted(response);
+    send_success(session, CMD_SUCCESS, payload);
+
+    free(payload);
+    cJSON_Delete(response);
+}
@@ -17,7 +17,12 @@ void handle_change_dir(ClientSession* session, Packet* pkt);
 void handle_mkdir(ClientSession* session, Packet* pkt);
 void handle_upload_req(ClientSession* session, Packet* pkt);
 void handle_upload_data(ClientSession* session, Packet* pkt);
+void handle_upload_tree(ClientSession* session, Packet* pkt);
+void handle_delta_sig(ClientSession* session, Packet* pkt);
+void handle_delta_req(ClientSession* session, Packet* pkt);
+void handle_delta_data(ClientSession* session, Packet* pkt);
 void handle_download(ClientSession* session, Packet* pkt);
+void handle_download_tree(ClientSession* session, Packet* pkt);
 void handle_chmod(ClientSession* session, Packet* pkt);
 void handle_delete(ClientSession* session, Packet* pkt);
 void handle_file_info(ClientSession* session, Packet* pkt);
@@ -25,12 +30,15 @@ void handle_search(ClientSession* session, Packet* pkt);
 void handle_rename(ClientSession* session, Packet* pkt);
 void handle_copy(ClientSession* session, Packet* pkt);
 void handle_move(ClientSession* session, Packet* pkt);
+void handle_get_quota(ClientSession* session, Packet* pkt);
 
 // Admin command handlers
 void handle_admin_list_users(ClientSession* session, Packet* pkt);
 void handle_admin_create_user(ClientSession* session, Packet* pkt);
 void handle_admin_delete_user(ClientSession* session, Packet* pkt);
 void handle_admin_update_user(ClientSession* session, Packet* pkt);
+void handle_admin_storage_gc(ClientSession* session, Packet* pkt);
+void handle_admin_set_quota(ClientSession* session, Packet* pkt);
 
 // Helper: Send error response
 void send_error(ClientSession* session, const char* message);
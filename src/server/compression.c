@@ -0,0 +1,167 @@
+#include "compression.h"
+#include "../common/protocol.h"
+#include "../common/utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+static int compress_level = COMPRESS_DEFAULT_LEVEL;
+
+void compression_set_level(int level) {
+    if (level < 0) level = 0;
+    if (level > 9) level = 9;
+    compress_level = level;
+}
+
+// Helper: deflate `size` bytes into `out` (capacity `cap`).
+// Returns the compressed length, or 0 if it did not fit.
+static size_t deflate_into(const uint8_t* data, size_t size, uint8_t* out, size_t cap) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, compress_level) != Z_OK) {
+        return 0;
+    }
+
+    zs.next_in = (Bytef*)data;
+    zs.next_out = out;
+    zs.avail_out = 0;
+    size_t in_left = size;
+    size_t out_left = cap;
+    int rc;
+
+    // zlib counts in uInt, so feed large buffers piecewise
+    do {
+        if (zs.avail_in == 0 && in_left > 0) {
+            zs.avail_in = in_left > UINT32_MAX ? UINT32_MAX : (uInt)in_left;
+            in_left -= zs.avail_in;
+        }
+        if (zs.avail_out == 0) {
+            if (out_left == 0) break;
+            zs.avail_out = out_left > UINT32_MAX ? UINT32_MAX : (uInt)out_left;
+            out_left -= zs.avail_out;
+        }
+        rc = deflate(&zs, in_left == 0 && zs.avail_in == 0 ? Z_FINISH : Z_NO_FLUSH);
+    } while (rc == Z_OK || rc == Z_BUF_ERROR);
+
+    size_t produced = (rc == Z_STREAM_END) ? (size_t)zs.total_out : 0;
+    deflateEnd(&zs);
+    return produced;
+}
+
+int compression_encode(const uint8_t* data, size_t size, uint8_t** out, size_t* out_size) {
+    if (compress_level == 0 || size < COMPRESS_MIN_SIZE) {
+        return 0;
+    }
+
+    // Skip already-compressed content (media, archives) cheaply: if a
+    // sample from the middle doesn't shrink, the whole blob won't either
+    size_t probe = size < COMPRESS_PROBE_SIZE ? size : COMPRESS_PROBE_SIZE;
+    size_t probe_off = (size - probe) / 2;
+    size_t limit = probe - probe * COMPRESS_MIN_SAVING_PCT / 100;
+    uint8_t* sample = malloc(limit);
+    if (!sample) return -1;
+    size_t sample_len = deflate_into(data + probe_off, probe, sample, limit);
+    free(sample);
+    if (sample_len == 0) {
+        return 0;
+    }
+
+    // Compress for real; give up if the saving target isn't met
+    limit = size - size * COMPRESS_MIN_SAVING_PCT / 100;
+    uint8_t* buf = malloc(limit);
+    if (!buf) return -1;
+    size_t len = deflate_into(data, size, buf, limit);
+    if (len == 0) {
+        free(buf);
+        return 0;
+    }
+
+    *out = buf;
+    *out_size = len;
+    return 1;
+}
+
+int compression_decode(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        return -1;
+    }
+
+    zs.next_in = (Bytef*)in;
+    zs.next_out = out;
+    size_t in_left = in_size;
+    size_t out_left = out_size;
+    int rc;
+
+    do {
+        if (zs.avail_in == 0 && in_left > 0) {
+            zs.avail_in = in_left > UINT32_MAX ? UINT32_MAX : (uInt)in_left;
+            in_left -= zs.avail_in;
+        }
+        if (zs.avail_out == 0 && out_left > 0) {
+            zs.avail_out = out_left > UINT32_MAX ? UINT32_MAX : (uInt)out_left;
+            out_left -= zs.avail_out;
+        }
+        rc = inflate(&zs, Z_NO_FLUSH);
+    } while (rc == Z_OK);
+
+    int ok = (rc == Z_STREAM_END && zs.total_out == out_size);
+    inflateEnd(&zs);
+    if (!ok) {
+        log_error("Failed to decompress blob (zlib rc=%d)", rc);
+        return -1;
+    }
+    return 0;
+}
+
+int compression_send_decoded(int socket_fd, uint8_t command,
+                             const uint8_t* in, size_t in_size, size_t out_size) {
+    uint8_t* chunk = malloc(COMPRESS_STREAM_CHUNK);
+    if (!chunk) return -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        free(chunk);
+        return -1;
+    }
+
+    zs.next_in = (Bytef*)in;
+    size_t in_left = in_size;
+    size_t sent = 0;
+    int rc = Z_OK;
+    int result = 0;
+
+    while (sent < out_size) {
+        zs.next_out = chunk;
+        zs.avail_out = COMPRESS_STREAM_CHUNK;
+
+        // Fill one chunk (or reach the end of the stream)
+        while (zs.avail_out > 0 && rc != Z_STREAM_END) {
+            if (zs.avail_in == 0 && in_left > 0) {
+                zs.avail_in = in_left > UINT32_MAX ? UINT32_MAX : (uInt)in_left;
+                in_left -= zs.avail_in;
+            }
+            rc = inflate(&zs, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END) break;
+        }
+
+        size_t produced = COMPRESS_STREAM_CHUNK - zs.avail_out;
+        if ((rc != Z_OK && rc != Z_STREAM_END) || produced == 0 || sent + produced > out_size) {
+            log_error("Failed to decompress blob while streaming (zlib rc=%d)", rc);
+            result = -1;
+            break;
+        }
+
+        if (packet_send_data(socket_fd, command, chunk, (uint32_t)produced) < 0) {
+            result = -1;
+            break;
+        }
+        sent += produced;
+    }
+
+    inflateEnd(&zs);
+    free(chunk);
+    return result;
+}
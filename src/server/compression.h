@@ -0,0 +1,34 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-blob at-rest compression (zlib/deflate). Whether a blob is stored
+// compressed is decided at upload time and recorded in blob_encoding;
+// files.size always holds the uncompressed length.
+
+#define COMPRESS_ENCODING "deflate"
+#define COMPRESS_DEFAULT_LEVEL 3            // Favour speed; 0 disables compression
+#define COMPRESS_MIN_SIZE 4096              // Smaller blobs are stored raw
+#define COMPRESS_PROBE_SIZE (64 * 1024)     // Sample compressed to judge compressibility
+#define COMPRESS_MIN_SAVING_PCT 10          // Keep compressed form only if this much smaller
+#define COMPRESS_STREAM_CHUNK (1024 * 1024) // Decompressed bytes per packet when streaming
+
+// Set the compression level used for new uploads (0 disables)
+void compression_set_level(int level);
+
+// Compress a blob for storage if it is worth it.
+// Returns 1 with *out/*out_size set (malloc'd), 0 if the blob should be
+// stored raw, -1 on error.
+int compression_encode(const uint8_t* data, size_t size, uint8_t** out, size_t* out_size);
+
+// Decompress a whole blob into `out`, which must hold exactly `out_size` bytes
+int compression_decode(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size);
+
+// Decompress a blob onto a socket as a sequence of packets of up to
+// COMPRESS_STREAM_CHUNK bytes each, carrying `out_size` bytes in total
+int compression_send_decoded(int socket_fd, uint8_t command,
+                             const uint8_t* in, size_t in_size, size_t out_size);
+
+#endif
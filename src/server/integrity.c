@@ -0,0 +1,213 @@
+#include "integrity.h"
+#include "../common/crc32c.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+static Database* scrub_db = NULL;
+static long scrub_rate = SCRUB_DEFAULT_RATE;
+
+static pthread_t scrub_thread;
+static int scrub_running = 0;
+static pthread_mutex_t scrub_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scrub_cond = PTHREAD_COND_INITIALIZER;
+
+// Pacing window (scrubber thread only)
+static long window_bytes = 0;
+static struct timespec window_start;
+
+int integrity_record(Database* db, const char* uuid, const uint8_t* data, size_t size) {
+    uint32_t* crcs = NULL;
+    int count = 0;
+
+    if (crc32c_chunks(data, size, INTEGRITY_CHUNK_SIZE, &crcs, &count) < 0) {
+        log_error("Failed to checksum blob %s", uuid);
+        return -1;
+    }
+
+    int rc = db_set_blob_checksums(db, uuid, INTEGRITY_CHUNK_SIZE, crcs, count);
+    free(crcs);
+    return rc;
+}
+
+// Helper: wait on the scrub condition until `deadline` or stop.
+// Returns -1 if the scrubber is being stopped.
+static int scrub_wait_until(const struct timespec* deadline) {
+    pthread_mutex_lock(&scrub_mutex);
+    while (scrub_running) {
+        if (pthread_cond_timedwait(&scrub_cond, &scrub_mutex, deadline) != 0) break;
+    }
+    int stopping = !scrub_running;
+    pthread_mutex_unlock(&scrub_mutex);
+    return stopping ? -1 : 0;
+}
+
+// Helper: account for verified bytes, sleeping once the per-second budget is spent
+static int scrub_pace(size_t bytes) {
+    window_bytes += (long)bytes;
+    if (window_bytes < scrub_rate) {
+        return 0;
+    }
+
+    struct timespec deadline = window_start;
+    deadline.tv_sec += 1;
+    int rc = scrub_wait_until(&deadline);
+
+    window_bytes = 0;
+    clock_gettime(CLOCK_REALTIME, &window_start);
+    return rc;
+}
+
+// Helper: compare each chunk of a view with its expected CRC.
+// Returns 0 if intact, 1 on mismatch, -1 if the scrubber was stopped.
+static int verify_chunks(const StorageView* view, int chunk_size,
+                         const uint32_t* crcs, int count, int paced) {
+    size_t expected = (view->size + chunk_size - 1) / chunk_size;
+    if ((size_t)count != expected) {
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        size_t off = (size_t)i * chunk_size;
+        size_t len = (view->size - off < (size_t)chunk_size) ? view->size - off : (size_t)chunk_size;
+        if (crc32c(0, view->data + off, len) != crcs[i]) {
+            log_error("Checksum mismatch in blob %s, chunk %d", view->uuid, i);
+            return 1;
+        }
+        if (paced && scrub_pace(len) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int integrity_verify_view(Database* db, StorageView* view) {
+    // Readers sharing a mapping only pay for verification once
+    if (__atomic_load_n(&view->verified, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    int chunk_size = 0;
+    uint32_t* crcs = NULL;
+    int count = 0;
+    int rc = db_get_blob_checksums(db, view->uuid, &chunk_size, &crcs, &count);
+    if (rc != 0) {
+        // No checksums recorded (e.g. uploaded before checksumming): nothing to check
+        return 0;
+    }
+
+    int bad = verify_chunks(view, chunk_size, crcs, count, 0);
+    free(crcs);
+
+    if (bad) {
+        db_mark_blob_verified(db, view->uuid, 1);
+        return -1;
+    }
+
+    __atomic_store_n(&view->verified, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Helper: verify one blob for the scrubber. Returns -1 if stopped.
+static int scrub_blob(const char* uuid) {
+    int chunk_size = 0;
+    uint32_t* crcs = NULL;
+    int count = 0;
+    if (db_get_blob_checksums(scrub_db, uuid, &chunk_size, &crcs, &count) != 0) {
+        return 0;
+    }
+
+    StorageView* view = storage_map_file(uuid);
+    if (!view) {
+        // Missing blobs are the GC's business; just don't retry immediately
+        free(crcs);
+        db_mark_blob_verified(scrub_db, uuid, 0);
+        return 0;
+    }
+
+    int rc = verify_chunks(view, chunk_size, crcs, count, 1);
+    free(crcs);
+
+    if (rc >= 0) {
+        if (rc == 0) {
+            __atomic_store_n(&view->verified, 1, __ATOMIC_RELEASE);
+        }
+        db_mark_blob_verified(scrub_db, uuid, rc);
+    }
+    storage_view_release(view);
+    return rc < 0 ? -1 : 0;
+}
+
+static void* scrub_main(void* arg) {
+    (void)arg;
+
+    window_bytes = 0;
+    clock_gettime(CLOCK_REALTIME, &window_start);
+
+    for (;;) {
+        char (*uuids)[64] = NULL;
+        int count = 0;
+        long cutoff = (long)time(NULL) - SCRUB_REVERIFY_SEC;
+
+        if (db_list_scrub_candidates(scrub_db, cutoff, SCRUB_BATCH, &uuids, &count) < 0) {
+            count = 0;
+        }
+
+        int stopped = 0;
+        for (int i = 0; i < count && !stopped; i++) {
+            stopped = scrub_blob(uuids[i]) < 0;
+        }
+        free(uuids);
+        if (stopped) break;
+
+        // Nothing due: idle until more blobs age past the re-verify window
+        if (count < SCRUB_BATCH) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += SCRUB_IDLE_SEC;
+            if (scrub_wait_until(&deadline) < 0) break;
+        }
+    }
+    return NULL;
+}
+
+int scrub_start(Database* db, long bytes_per_sec) {
+    if (!db || bytes_per_sec <= 0) {
+        log_error("Invalid scrubber parameters");
+        return -1;
+    }
+
+    pthread_mutex_lock(&scrub_mutex);
+    if (scrub_running) {
+        pthread_mutex_unlock(&scrub_mutex);
+        return 0;
+    }
+    scrub_db = db;
+    scrub_rate = bytes_per_sec;
+    scrub_running = 1;
+    pthread_mutex_unlock(&scrub_mutex);
+
+    if (pthread_create(&scrub_thread, NULL, scrub_main, NULL) != 0) {
+        log_error("Failed to start integrity scrubber");
+        scrub_running = 0;
+        return -1;
+    }
+
+    log_info("Integrity scrubber started (%ld bytes/s)", bytes_per_sec);
+    return 0;
+}
+
+void scrub_stop(void) {
+    pthread_mutex_lock(&scrub_mutex);
+    int was_running = scrub_running;
+    scrub_running = 0;
+    pthread_cond_broadcast(&scrub_cond);
+    pthread_mutex_unlock(&scrub_mutex);
+
+    if (was_running) {
+        pthread_join(scrub_thread, NULL);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef INTEGRITY_H
+#define INTEGRITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "storage.h"
+#include "../database/db_manager.h"
+
+// End-to-end blob integrity. A CRC-32C is recorded per fixed-size chunk
+// when a blob is written; downloads verify the mapping the first time it
+// is served, and a background scrubber re-verifies blobs that have not
+// been checked recently, paced to a byte rate.
+
+#define INTEGRITY_CHUNK_SIZE (1024 * 1024)          // Bytes covered by one CRC
+#define SCRUB_DEFAULT_RATE (16 * 1024 * 1024)       // Bytes verified per second
+#define SCRUB_REVERIFY_SEC (7 * 24 * 3600)          // Re-verify blobs older than this
+#define SCRUB_BATCH 32                              // Blobs fetched per query
+#define SCRUB_IDLE_SEC 300                          // Sleep when nothing is due
+
+// Compute and store chunk checksums for a freshly written blob
+int integrity_record(Database* db, const char* uuid, const uint8_t* data, size_t size);
+
+// Verify a mapped blob against its stored checksums, once per mapping.
+// Returns 0 if intact (or no checksums exist), -1 on mismatch; mismatching
+// blobs are flagged corrupt in the database.
+int integrity_verify_view(Database* db, StorageView* view);
+
+// Start / stop the background scrubber
+int scrub_start(Database* db, long bytes_per_sec);
+void scrub_stop(void);
+
+#endif
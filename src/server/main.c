@@ -1,11 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <unistd.h>
 #include "socket_mgr.h"
 #include "thread_pool.h"
 #include "commands.h"
 #include "storage.h"
+#include "storage_gc.h"
+#include "integrity.h"
+#include "compression.h"
 #include "../common/protocol.h"
 #include "../common/utils.h"
 #include "../database/db_manager.h"
@@ -23,10 +27,7 @@ void shutdown_handler(int sig) {
     if (server_fd >= 0) {
         socket_close(server_fd);
     }
-    if (global_db) {
-        db_close(global_db);
-        global_db = NULL;
-    }
+    // The database is closed by main() once background threads have stopped
 }
 
 int main(int argc, char** argv) {
@@ -43,6 +44,38 @@ int main(int argc, char** argv) {
     // Initialize logging
     log_init("server.log");
 
+    // Read connections beside the single writer (default: one per core, 0 = writer only)
+    const char* readers_env = getenv("FILESHARE_DB_READERS");
+    if (readers_env) {
+        db_set_reader_count(atoi(readers_env));
+    }
+
+    // FileEntry cache size in entries (FILESHARE_FILE_CACHE, 0 disables)
+    const char* file_cache_env = getenv("FILESHARE_FILE_CACHE");
+    if (file_cache_env) {
+        db_set_file_cache_entries(atoi(file_cache_env));
+    }
+
+    // Group commit window in microseconds (FILESHARE_DB_GROUP_COMMIT_US, 0 disables;
+    // FILESHARE_DB_GROUP_COMMIT_MAX writes per transaction)
+    const char* group_us_env = getenv("FILESHARE_DB_GROUP_COMMIT_US");
+    const char* group_max_env = getenv("FILESHARE_DB_GROUP_COMMIT_MAX");
+    db_set_group_commit(group_us_env ? atoi(group_us_env) : DB_GROUP_COMMIT_DEFAULT_US,
+                        group_max_env ? atoi(group_max_env) : DB_GROUP_COMMIT_DEFAULT_MAX);
+
+    // Months of activity log partitions to keep (FILESHARE_LOG_RETENTION_MONTHS, 0 keeps all)
+    const char* retention_env = getenv("FILESHARE_LOG_RETENTION_MONTHS");
+    if (retention_env) {
+        db_set_activity_retention(atoi(retention_env));
+    }
+
+    // In-memory file tree for reads, rebuilt after this many quiet ms of
+    // writes (FILESHARE_VFS_SNAPSHOT_MS, 0 disables)
+    const char* vfs_env = getenv("FILESHARE_VFS_SNAPSHOT_MS");
+    if (vfs_env) {
+        db_set_vfs_snapshot(atoi(vfs_env));
+    }
+
     // Initialize database
     global_db = db_init("fileshare.db");
     if (!global_db) {
@@ -57,6 +90,34 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    // Asynchronous activity log (FILESHARE_LOG_FLUSH_MS, 0 writes synchronously;
+    // FILESHARE_LOG_BATCH records per transaction; FILESHARE_LOG_OVERFLOW=block|drop|spill)
+    const char* log_flush_env = getenv("FILESHARE_LOG_FLUSH_MS");
+    const char* log_batch_env = getenv("FILESHARE_LOG_BATCH");
+    const char* log_overflow_env = getenv("FILESHARE_LOG_OVERFLOW");
+    int log_flush_ms = log_flush_env ? atoi(log_flush_env) : ACTIVITY_DEFAULT_FLUSH_MS;
+    ActivityOverflow log_overflow = ACTIVITY_OVERFLOW_BLOCK;
+    if (log_overflow_env && strcmp(log_overflow_env, "drop") == 0) {
+        log_overflow = ACTIVITY_OVERFLOW_DROP;
+    } else if (log_overflow_env && strcmp(log_overflow_env, "spill") == 0) {
+        log_overflow = ACTIVITY_OVERFLOW_SPILL;
+    }
+    if (log_flush_ms > 0 &&
+        db_start_activity_writer(global_db, log_flush_ms,
+                                 log_batch_env ? atoi(log_batch_env) : ACTIVITY_DEFAULT_BATCH,
+                                 log_overflow) < 0) {
+        log_error("Failed to start activity log writer");
+        db_close(global_db);
+        return 1;
+    }
+
+    // Directory fan-out for new volumes (FILESHARE_STORAGE_FANOUT=2 for very large stores)
+    const char* fanout_env = getenv("FILESHARE_STORAGE_FANOUT");
+    if (fanout_env && storage_set_fanout(atoi(fanout_env)) < 0) {
+        db_close(global_db);
+        return 1;
+    }
+
     // Initialize storage
     if (storage_init("storage") < 0) {
         log_error("Failed to initialize storage");
@@ -64,6 +125,68 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    // Optional: extra volumes as "path:weight,path:weight" (FILESHARE_STORAGE_VOLUMES)
+    const char* volumes_env = getenv("FILESHARE_STORAGE_VOLUMES");
+    if (volumes_env && *volumes_env) {
+        char spec[1024];
+        strncpy(spec, volumes_env, sizeof(spec) - 1);
+        spec[sizeof(spec) - 1] = '\0';
+
+        char* saveptr = NULL;
+        for (char* item = strtok_r(spec, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+            int weight = 1;
+            char* colon = strrchr(item, ':');
+            if (colon) {
+                *colon = '\0';
+                weight = atoi(colon + 1);
+            }
+            if (storage_add_volume(item, weight) < 0) {
+                log_error("Failed to add storage volume '%s'", item);
+                storage_shutdown();
+                db_close(global_db);
+                return 1;
+            }
+        }
+    }
+
+    // Optional: pack small files into segment files (FILESHARE_PACK_SMALL_FILES=1)
+    const char* pack_env = getenv("FILESHARE_PACK_SMALL_FILES");
+    if (pack_env && strcmp(pack_env, "1") == 0) {
+        if (storage_enable_packing() < 0) {
+            log_error("Failed to enable small-file packing");
+            db_close(global_db);
+            return 1;
+        }
+    }
+
+    // At-rest compression level for new uploads (FILESHARE_COMPRESS_LEVEL, 0 disables)
+    const char* compress_env = getenv("FILESHARE_COMPRESS_LEVEL");
+    compression_set_level(compress_env ? atoi(compress_env) : COMPRESS_DEFAULT_LEVEL);
+
+    // Background orphan GC (FILESHARE_GC_INTERVAL seconds, 0 disables;
+    // FILESHARE_GC_RATE checks per second)
+    const char* gc_interval_env = getenv("FILESHARE_GC_INTERVAL");
+    const char* gc_rate_env = getenv("FILESHARE_GC_RATE");
+    int gc_interval = gc_interval_env ? atoi(gc_interval_env) : GC_DEFAULT_INTERVAL_SEC;
+    int gc_rate = gc_rate_env ? atoi(gc_rate_env) : GC_DEFAULT_RATE;
+    if (gc_interval > 0 && gc_start(global_db, gc_interval, gc_rate) < 0) {
+        log_error("Failed to start storage GC");
+        storage_shutdown();
+        db_close(global_db);
+        return 1;
+    }
+
+    // Background integrity scrubber (FILESHARE_SCRUB_RATE bytes/s, 0 disables)
+    const char* scrub_rate_env = getenv("FILESHARE_SCRUB_RATE");
+    long scrub_rate = scrub_rate_env ? atol(scrub_rate_env) : SCRUB_DEFAULT_RATE;
+    if (scrub_rate > 0 && scrub_start(global_db, scrub_rate) < 0) {
+        log_error("Failed to start integrity scrubber");
+        gc_stop();
+        storage_shutdown();
+        db_close(global_db);
+        return 1;
+    }
+
     // Initialize command handlers
     commands_init();
 
@@ -109,6 +232,9 @@ int main(int argc, char** argv) {
     // Cleanup
     printf("Shutting down client handlers...\n");
     thread_pool_shutdown();
+    scrub_stop();
+    gc_stop();
+    storage_shutdown();
 
     // Close database if not already closed
     if (global_db) {
@@ -49,6 +49,32 @@ int check_permission(Database* db, int user_id, int file_id, AccessType access)
     return allowed;
 }
 
+int check_permissions(Database* db, int user_id, const PermissionCheck* checks, int count) {
+    if (count <= 0) return 1;
+
+    int* file_ids = malloc(sizeof(int) * (size_t)count * 2);
+    if (!file_ids) return 0;
+    int* bits = file_ids + count;
+
+    for (int i = 0; i < count; i++) {
+        file_ids[i] = checks[i].file_id;
+        switch (checks[i].access) {
+            case ACCESS_READ:    bits[i] = PERM_READ; break;
+            case ACCESS_WRITE:   bits[i] = PERM_WRITE; break;
+            case ACCESS_EXECUTE: bits[i] = PERM_EXECUTE; break;
+            default:             bits[i] = PERM_READ | PERM_WRITE | PERM_EXECUTE; break;
+        }
+    }
+
+    int denied_id = -1;
+    int allowed = db_check_access(db, user_id, file_ids, bits, count, &denied_id);
+    free(file_ids);
+    if (allowed == 0) {
+        log_info("Permission denied: user %d on file %d (batch of %d)", user_id, denied_id, count);
+    }
+    return allowed == 1;
+}
+
 char* format_permissions(int permissions) {
     char* str = malloc(10);
     if (!str) return NULL;
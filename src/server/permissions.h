@@ -24,6 +24,16 @@ typedef enum {
 // Returns 1 if allowed, 0 if denied
 int check_permission(Database* db, int user_id, int file_id, AccessType access);
 
+// One file and the access wanted on it
+typedef struct {
+    int file_id;
+    AccessType access;
+} PermissionCheck;
+
+// Check several files at once with a single query
+// Returns 1 if every check passes, 0 if any is denied
+int check_permissions(Database* db, int user_id, const PermissionCheck* checks, int count);
+
 // Extract permission bits for a scope
 int get_permission_bits(int permissions, int shift);
 
@@ -1,54 +1,678 @@
 #include "storage.h"
+#include "storage_pack.h"
 #include "../common/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <time.h>
+
+#define STORAGE_MAX_VOLUMES 16
+#define STORAGE_VNODES_PER_WEIGHT 64   // Ring points per unit of volume weight
+#define STORAGE_SHARDS 256             // Shard directories per level (two hex UUID chars)
+#define STORAGE_FANOUT_FILE ".fanout"  // Records a volume's directory layout
+
+typedef struct {
+    char path[256];
+    int weight;
+    int levels;                     // Fan-out: 1 = <ab>/<uuid>, 2 = <ab>/<cd>/<uuid>
+    int shard_fds[STORAGE_SHARDS];  // First-level shard directories, kept open
+} StorageVolume;
+
+typedef struct {
+    uint64_t point;
+    int volume;
+} RingPoint;
+
+// Volumes and the consistent-hash ring that places blobs on them.
+// Volume 0 is the base path given to storage_init; packed segments live there.
+static StorageVolume volumes[STORAGE_MAX_VOLUMES];
+static int volume_count = 0;
+static RingPoint* ring = NULL;
+static int ring_size = 0;
+static pthread_rwlock_t volume_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Serializes blob moves against deletes so a rebalance can't resurrect a blob
+static pthread_mutex_t move_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Background rebalancer state
+static pthread_t rebalance_thread;
+static int rebalance_running = 0;
+static int rebalance_pending = 0;
+static int rebalance_stop = 0;
+static pthread_mutex_t rebalance_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rebalance_cond = PTHREAD_COND_INITIALIZER;
+
+// Fan-out for volumes created from now on
+static int default_levels = 1;
+
+static int packing_enabled = 0;
+static int pack_opened = 0;
+
+// Registry of live blob mappings, hashed by UUID. The lock covers only
+// the registry; mapping a blob happens outside it.
+#define VIEW_BUCKETS 1024
+static StorageView* view_buckets[VIEW_BUCKETS];
+static unsigned long view_deletes = 0;  // Bumped by every delete, under view_mutex
+static pthread_mutex_t view_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Helper: 64-bit FNV-1a with a finalizer so nearby keys spread over the ring
+static uint64_t hash64(const char* s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Helper: registry chain for a UUID
+static StorageView** view_bucket(const char* uuid) {
+    return &view_buckets[hash64(uuid) % VIEW_BUCKETS];
+}
+
+// Helper: registered view of a UUID, or NULL (caller holds view_mutex)
+static StorageView* view_find_locked(const char* uuid) {
+    for (StorageView* v = *view_bucket(uuid); v; v = v->next) {
+        if (strcmp(v->uuid, uuid) == 0) return v;
+    }
+    return NULL;
+}
+
+// Helper: unlink a view from the registry (caller holds view_mutex)
+static void view_detach_locked(StorageView* view) {
+    StorageView** link = view_bucket(view->uuid);
+    while (*link) {
+        if (*link == view) {
+            *link = view->next;
+            view->next = NULL;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+static int ring_point_cmp(const void* a, const void* b) {
+    uint64_t x = ((const RingPoint*)a)->point;
+    uint64_t y = ((const RingPoint*)b)->point;
+    return (x > y) - (x < y);
+}
+
+// Helper: rebuild the ring from volumes[] (caller holds volume_lock for writing)
+static int ring_rebuild_locked(void) {
+    int total = 0;
+    for (int v = 0; v < volume_count; v++) {
+        total += volumes[v].weight * STORAGE_VNODES_PER_WEIGHT;
+    }
+
+    RingPoint* points = malloc(sizeof(RingPoint) * (total > 0 ? total : 1));
+    if (!points) return -1;
+
+    int n = 0;
+    for (int v = 0; v < volume_count; v++) {
+        for (int i = 0; i < volumes[v].weight * STORAGE_VNODES_PER_WEIGHT; i++) {
+            char key[300];
+            snprintf(key, sizeof(key), "%s#%d", volumes[v].path, i);
+            points[n].point = hash64(key);
+            points[n].volume = v;
+            n++;
+        }
+    }
+    qsort(points, n, sizeof(RingPoint), ring_point_cmp);
+
+    free(ring);
+    ring = points;
+    ring_size = n;
+    return 0;
+}
+
+// Helper: owning volume for a UUID (caller holds volume_lock)
+static int volume_for_locked(const char* uuid) {
+    if (ring_size == 0) return 0;
+
+    uint64_t h = hash64(uuid);
+    int lo = 0, hi = ring_size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ring[mid].point < h) lo = mid + 1;
+        else hi = mid;
+    }
+    return ring[lo == ring_size ? 0 : lo].volume;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Helper: first-level shard of a UUID, or -1 if it doesn't start with two hex digits
+static int shard_index(const char* uuid) {
+    int hi = hex_digit(uuid[0]);
+    int lo = hi < 0 ? -1 : hex_digit(uuid[1]);
+    return lo < 0 ? -1 : hi * 16 + lo;
+}
+
+// Helper: where a blob lives on a volume, as a cached shard directory fd plus
+// the name to resolve under it (the bare UUID, or "<cd>/<uuid>" with two
+// levels). Returns -1 for malformed UUIDs.
+static int blob_at(int volume, const char* uuid, char* name, size_t size) {
+    int shard = shard_index(uuid);
+    if (shard < 0 || (volumes[volume].levels == 2 && shard_index(uuid + 2) < 0)) {
+        return -1;
+    }
+
+    if (volumes[volume].levels == 2) {
+        snprintf(name, size, "%c%c/%s", uuid[2], uuid[3], uuid);
+    } else {
+        snprintf(name, size, "%s", uuid);
+    }
+    return volumes[volume].shard_fds[shard];
+}
+
+static void blob_path(int volume, const char* uuid, char* out, size_t size) {
+    // Path format: <volume>/<first_2_chars>/[<next_2_chars>/]<uuid>
+    if (volumes[volume].levels == 2) {
+        snprintf(out, size, "%s/%c%c/%c%c/%s", volumes[volume].path,
+                 uuid[0], uuid[1], uuid[2], uuid[3], uuid);
+    } else {
+        snprintf(out, size, "%s/%c%c/%s", volumes[volume].path, uuid[0], uuid[1], uuid);
+    }
+}
+
+// Helper: find the volume currently holding a blob. Checks the ring owner
+// first, then the other volumes (blobs not yet moved by the rebalancer).
+// Returns the volume index, or -1 with *dirfd/name set to the placement on
+// the owner (*dirfd is -1 if the UUID is malformed).
+static int locate_blob(const char* uuid, int* dirfd, char* name, size_t size) {
+    pthread_rwlock_rdlock(&volume_lock);
+
+    int owner = volume_for_locked(uuid);
+    struct stat st;
+    *dirfd = blob_at(owner, uuid, name, size);
+    if (*dirfd < 0) {
+        pthread_rwlock_unlock(&volume_lock);
+        return -1;
+    }
+
+    // A move can land on a volume already probed and drop the source before
+    // it is probed. It renames first and unlinks second, so a blob that one
+    // pass missed is in its new place for the next one.
+    int passes = volume_count > 1 ? 2 : 1;
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < volume_count; i++) {
+            int v = (owner + i) % volume_count;
+            *dirfd = blob_at(v, uuid, name, size);
+            if (*dirfd >= 0 && fstatat(*dirfd, name, &st, 0) == 0) {
+                pthread_rwlock_unlock(&volume_lock);
+                return v;
+            }
+        }
+    }
+
+    *dirfd = blob_at(owner, uuid, name, size);
+    pthread_rwlock_unlock(&volume_lock);
+    return -1;
+}
+
+static int ensure_dir(const char* path) {
+    struct stat st = {0};
+    if (stat(path, &st) == -1 && mkdir(path, 0755) == -1 && errno != EEXIST) {
+        log_error("Failed to create directory '%s': %s", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Helper: create `name` under `dirfd` unless it already exists
+static int ensure_dir_at(int dirfd, const char* name) {
+    if (mkdirat(dirfd, name, 0755) == -1 && errno != EEXIST) {
+        log_error("Failed to create shard directory '%s': %s", name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Helper: fan-out of a volume. New volumes get the configured default; a
+// volume that already has shard directories but no marker predates
+// configurable fan-out and is single-level. The result is recorded, and
+// *fresh set when this call chose it.
+static int volume_layout(const char* path, int* fresh) {
+    char marker[300];
+    snprintf(marker, sizeof(marker), "%s/%s", path, STORAGE_FANOUT_FILE);
+
+    *fresh = 0;
+    FILE* fp = fopen(marker, "r");
+    if (fp) {
+        int levels = 0;
+        if (fscanf(fp, "%d", &levels) != 1) levels = 0;
+        fclose(fp);
+        if (levels != 1 && levels != 2) {
+            log_error("Invalid storage layout in '%s'", marker);
+            return -1;
+        }
+        return levels;
+    }
+
+    int levels = default_levels;
+    DIR* d = opendir(path);
+    if (d) {
+        struct dirent* de;
+        while ((de = readdir(d)) != NULL) {
+            if (strlen(de->d_name) == 2 && shard_index(de->d_name) >= 0) {
+                levels = 1;
+                break;
+            }
+        }
+        closedir(d);
+    }
+
+    fp = fopen(marker, "w");
+    if (!fp) {
+        log_error("Failed to record storage layout in '%s': %s", marker, strerror(errno));
+        return -1;
+    }
+    fprintf(fp, "%d\n", levels);
+    fclose(fp);
+    *fresh = 1;
+    return levels;
+}
+
+static void volume_close(StorageVolume* vol) {
+    for (int i = 0; i < STORAGE_SHARDS; i++) {
+        if (vol->shard_fds[i] >= 0) close(vol->shard_fds[i]);
+        vol->shard_fds[i] = -1;
+    }
+}
+
+// Helper: set up a volume directory: create the shard directories up front
+// and keep the first level open, so blob operations never build paths,
+// stat shard directories or mkdir on the request path. The 65536
+// second-level directories are only created when the layout is chosen.
+static int volume_open(StorageVolume* vol, const char* path, int weight) {
+    memset(vol, 0, sizeof(*vol));
+    for (int i = 0; i < STORAGE_SHARDS; i++) vol->shard_fds[i] = -1;
+
+    if (ensure_dir(path) < 0) {
+        return -1;
+    }
+    int fresh = 0;
+    int levels = volume_layout(path, &fresh);
+    if (levels < 0) {
+        return -1;
+    }
+
+    int root = open(path, O_RDONLY | O_DIRECTORY);
+    if (root < 0) {
+        log_error("Failed to open storage volume '%s': %s", path, strerror(errno));
+        return -1;
+    }
+
+    strcpy(vol->path, path);
+    vol->weight = weight;
+    vol->levels = levels;
+
+    for (int i = 0; i < STORAGE_SHARDS; i++) {
+        char name[3];
+        snprintf(name, sizeof(name), "%02x", i);
+        if (ensure_dir_at(root, name) < 0 ||
+            (vol->shard_fds[i] = openat(root, name, O_RDONLY | O_DIRECTORY)) < 0) {
+            log_error("Failed to open shard '%s/%s'", path, name);
+            volume_close(vol);
+            close(root);
+            return -1;
+        }
+
+        for (int j = 0; levels == 2 && fresh && j < STORAGE_SHARDS; j++) {
+            char sub[3];
+            snprintf(sub, sizeof(sub), "%02x", j);
+            if (ensure_dir_at(vol->shard_fds[i], sub) < 0) {
+                volume_close(vol);
+                close(root);
+                return -1;
+            }
+        }
+    }
+
+    close(root);
+    return 0;
+}
+
+// Called for each loose blob found by scan_shard with the directory holding
+// it; returning -1 stops the scan
+typedef int (*BlobVisitor)(int volume, int dirfd, const char* name, void* ctx);
+
+// Helper: visit the blobs in `sub` under `parent_fd`. The directory is
+// reopened so concurrent scans don't share a cached fd's read offset.
+static int scan_dir(int volume, int parent_fd, const char* sub, BlobVisitor visit, void* ctx) {
+    int fd = openat(parent_fd, sub, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return 0;
+    DIR* d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return 0;
+    }
+
+    int rc = 0;
+    struct dirent* de;
+    while (rc == 0 && (de = readdir(d)) != NULL) {
+        // Skip dotfiles and in-flight temp files (e.g. "<uuid>.rebalance")
+        if (de->d_name[0] == '.' || strchr(de->d_name, '.') ||
+            strlen(de->d_name) >= 64) continue;
+        rc = visit(volume, dirfd(d), de->d_name, ctx);
+    }
+    closedir(d);
+    return rc;
+}
+
+// Helper: visit every loose blob in one first-level shard of a volume
+static int scan_shard(int volume, int shard, BlobVisitor visit, void* ctx) {
+    int shard_fd = volumes[volume].shard_fds[shard];
+    if (volumes[volume].levels == 1) {
+        return scan_dir(volume, shard_fd, ".", visit, ctx);
+    }
+
+    for (int sub = 0; sub < STORAGE_SHARDS; sub++) {
+        char name[3];
+        snprintf(name, sizeof(name), "%02x", sub);
+        if (scan_dir(volume, shard_fd, name, visit, ctx) < 0) return -1;
+    }
+    return 0;
+}
 
-static char storage_base[256] = {0};
+// Helper: write a whole buffer to a descriptor
+static int write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t w = write(fd, data, size);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += w;
+        size -= (size_t)w;
+    }
+    return 0;
+}
 
 int storage_init(const char* base_path) {
-    if (!base_path || strlen(base_path) == 0) {
+    if (!base_path || strlen(base_path) == 0 ||
+        strlen(base_path) >= sizeof(volumes[0].path)) {
         log_error("Invalid storage base path");
         return -1;
     }
 
-    strncpy(storage_base, base_path, sizeof(storage_base) - 1);
-    storage_base[sizeof(storage_base) - 1] = '\0';
+    // Create base storage directory and its shards
+    StorageVolume vol;
+    if (volume_open(&vol, base_path, 1) < 0) {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&volume_lock);
+    volumes[0] = vol;
+    volume_count = 1;
+    int rc = ring_rebuild_locked();
+    pthread_rwlock_unlock(&volume_lock);
+    if (rc < 0) {
+        log_error("Failed to build storage placement ring");
+        return -1;
+    }
 
-    // Create base storage directory
+    // Keep previously packed blobs readable even if packing is now off
+    char pack_dir[512];
     struct stat st = {0};
-    if (stat(storage_base, &st) == -1) {
-        if (mkdir(storage_base, 0755) == -1) {
-            log_error("Failed to create storage directory '%s': %s",
-                     storage_base, strerror(errno));
+    snprintf(pack_dir, sizeof(pack_dir), "%s/packs", base_path);
+    if (stat(pack_dir, &st) == 0) {
+        if (pack_init(pack_dir) < 0) {
+            log_error("Failed to open pack storage at '%s'", pack_dir);
             return -1;
         }
+        pack_opened = 1;
     }
 
-    log_info("Storage initialized at: %s", storage_base);
+    log_info("Storage initialized at: %s (%d-level fan-out)", base_path, volumes[0].levels);
     return 0;
 }
 
+// Helper: copy one blob to its ring owner, then drop the source copy
+static void rebalance_move(int from, int to, const char* uuid) {
+    char src[80], dst[80], tmp[96];
+
+    pthread_mutex_lock(&move_mutex);
+    pthread_rwlock_rdlock(&volume_lock);
+    int src_fd = blob_at(from, uuid, src, sizeof(src));
+    int dst_fd = blob_at(to, uuid, dst, sizeof(dst));
+    pthread_rwlock_unlock(&volume_lock);
+    snprintf(tmp, sizeof(tmp), "%s.rebalance", dst);
+
+    struct stat st;
+    if (src_fd < 0 || dst_fd < 0 ||
+        fstatat(src_fd, src, &st, 0) != 0 || fstatat(dst_fd, dst, &st, 0) == 0) {
+        pthread_mutex_unlock(&move_mutex);
+        return;
+    }
+
+    int in = openat(src_fd, src, O_RDONLY);
+    int out = openat(dst_fd, tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok = (in >= 0 && out >= 0);
+
+    char buf[64 * 1024];
+    ssize_t n;
+    while (ok && (n = read(in, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = 0;
+            break;
+        }
+        if (write_all(out, (const uint8_t*)buf, (size_t)n) < 0) ok = 0;
+    }
+
+    if (ok && fsync(out) < 0) ok = 0;
+    if (in >= 0) close(in);
+    if (out >= 0) close(out);
+
+    // Destination becomes visible before the source disappears; a reader
+    // whose probes straddle the two steps finds it on a second pass (see
+    // locate_blob)
+    if (ok && renameat(dst_fd, tmp, dst_fd, dst) == 0) {
+        unlinkat(src_fd, src, 0);
+        log_info("Rebalanced blob %s: %s -> %s", uuid, volumes[from].path, volumes[to].path);
+    } else {
+        log_error("Failed to rebalance blob %s to %s", uuid, volumes[to].path);
+        unlinkat(dst_fd, tmp, 0);
+    }
+
+    pthread_mutex_unlock(&move_mutex);
+}
+
+static int rebalance_visit(int volume, int dirfd, const char* name, void* ctx) {
+    (void)dirfd;
+    (void)ctx;
+    if (rebalance_stop) return -1;
+
+    pthread_rwlock_rdlock(&volume_lock);
+    int owner = volume_for_locked(name);
+    pthread_rwlock_unlock(&volume_lock);
+
+    if (owner != volume) {
+        rebalance_move(volume, owner, name);
+    }
+    return 0;
+}
+
+// Helper: one pass over every volume, moving blobs the ring places elsewhere
+static void rebalance_pass(void) {
+    pthread_rwlock_rdlock(&volume_lock);
+    int count = volume_count;
+    pthread_rwlock_unlock(&volume_lock);
+
+    for (int v = 0; v < count && !rebalance_stop; v++) {
+        for (int shard = 0; shard < STORAGE_SHARDS; shard++) {
+            if (scan_shard(v, shard, rebalance_visit, NULL) < 0) break;
+        }
+    }
+}
+
+static void* rebalance_main(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&rebalance_mutex);
+    while (!rebalance_stop) {
+        while (!rebalance_pending && !rebalance_stop) {
+            pthread_cond_wait(&rebalance_cond, &rebalance_mutex);
+        }
+        if (rebalance_stop) break;
+        rebalance_pending = 0;
+        pthread_mutex_unlock(&rebalance_mutex);
+
+        log_info("Storage rebalance started");
+        rebalance_pass();
+        log_info("Storage rebalance finished");
+
+        pthread_mutex_lock(&rebalance_mutex);
+    }
+    pthread_mutex_unlock(&rebalance_mutex);
+    return NULL;
+}
+
+int storage_add_volume(const char* path, int weight) {
+    if (!path || strlen(path) == 0 || strlen(path) >= sizeof(volumes[0].path) || weight <= 0) {
+        log_error("Invalid storage volume '%s' (weight %d)", path ? path : "", weight);
+        return -1;
+    }
+
+    StorageVolume vol;
+    if (volume_open(&vol, path, weight) < 0) {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&volume_lock);
+    if (volume_count == 0 || volume_count >= STORAGE_MAX_VOLUMES) {
+        pthread_rwlock_unlock(&volume_lock);
+        log_error("Cannot add storage volume '%s' (have %d volumes)", path, volume_count);
+        volume_close(&vol);
+        return -1;
+    }
+    for (int v = 0; v < volume_count; v++) {
+        if (strcmp(volumes[v].path, path) == 0) {
+            pthread_rwlock_unlock(&volume_lock);
+            log_error("Storage volume '%s' already added", path);
+            volume_close(&vol);
+            return -1;
+        }
+    }
+
+    volumes[volume_count++] = vol;
+    if (ring_rebuild_locked() < 0) {
+        volume_count--;
+        pthread_rwlock_unlock(&volume_lock);
+        volume_close(&vol);
+        return -1;
+    }
+    pthread_rwlock_unlock(&volume_lock);
+
+    log_info("Added storage volume %s (weight %d, %d-level fan-out)", path, weight, vol.levels);
+
+    // Existing blobs may now belong elsewhere; let the rebalancer move them
+    pthread_mutex_lock(&rebalance_mutex);
+    rebalance_pending = 1;
+    if (!rebalance_running) {
+        rebalance_stop = 0;
+        if (pthread_create(&rebalance_thread, NULL, rebalance_main, NULL) == 0) {
+            rebalance_running = 1;
+        } else {
+            log_error("Failed to start storage rebalancer");
+        }
+    }
+    pthread_cond_signal(&rebalance_cond);
+    pthread_mutex_unlock(&rebalance_mutex);
+
+    return 0;
+}
+
+int storage_set_fanout(int levels) {
+    if (levels != 1 && levels != 2) {
+        log_error("Invalid storage fan-out %d (expected 1 or 2)", levels);
+        return -1;
+    }
+    default_levels = levels;
+    return 0;
+}
+
+int storage_enable_packing(void) {
+    if (volume_count == 0) {
+        log_error("storage_enable_packing called before storage_init");
+        return -1;
+    }
+
+    if (!pack_opened) {
+        char pack_dir[512];
+        snprintf(pack_dir, sizeof(pack_dir), "%s/packs", volumes[0].path);
+        if (pack_init(pack_dir) < 0) {
+            return -1;
+        }
+        pack_opened = 1;
+    }
+
+    packing_enabled = 1;
+    log_info("Small-file packing enabled (threshold %d bytes)", PACK_SMALL_BLOB_MAX);
+    return 0;
+}
+
+void storage_shutdown(void) {
+    pthread_mutex_lock(&rebalance_mutex);
+    int was_running = rebalance_running;
+    rebalance_stop = 1;
+    rebalance_running = 0;
+    pthread_cond_signal(&rebalance_cond);
+    pthread_mutex_unlock(&rebalance_mutex);
+    if (was_running) pthread_join(rebalance_thread, NULL);
+
+    if (pack_opened) {
+        pack_shutdown();
+        pack_opened = 0;
+    }
+    packing_enabled = 0;
+
+    pthread_rwlock_wrlock(&volume_lock);
+    for (int v = 0; v < volume_count; v++) {
+        volume_close(&volumes[v]);
+    }
+    volume_count = 0;
+    pthread_rwlock_unlock(&volume_lock);
+}
+
 char* storage_get_path(const char* uuid) {
     if (!uuid || strlen(uuid) < 2) {
         log_error("Invalid UUID");
         return NULL;
     }
 
-    // Path format: storage/<first_2_chars>/<uuid>
     char* full_path = malloc(512);
     if (!full_path) {
         log_error("Memory allocation failed");
         return NULL;
     }
 
-    char subdir[3] = {uuid[0], uuid[1], '\0'};
-    snprintf(full_path, 512, "%s/%s/%s", storage_base, subdir, uuid);
-
+    // Where the blob is now, or where a new one would be placed
+    int dirfd;
+    char name[80];
+    int v = locate_blob(uuid, &dirfd, name, sizeof(name));
+    pthread_rwlock_rdlock(&volume_lock);
+    if (v < 0) v = volume_for_locked(uuid);
+    blob_path(v, uuid, full_path, 512);
+    pthread_rwlock_unlock(&volume_lock);
     return full_path;
 }
 
@@ -58,48 +682,46 @@ int storage_write_file(const char* uuid, const uint8_t* data, size_t size) {
         return -1;
     }
 
-    char* full_path = storage_get_path(uuid);
-    if (!full_path) {
-        return -1;
+    // Small blobs go to a shared segment instead of their own inode
+    if (packing_enabled && size <= PACK_SMALL_BLOB_MAX) {
+        return pack_write(uuid, data, size);
     }
 
-    // Create subdirectory if needed
-    char subdir_path[512];
-    char subdir[3] = {uuid[0], uuid[1], '\0'};
-    snprintf(subdir_path, sizeof(subdir_path), "%s/%s", storage_base, subdir);
+    // New blobs go to their ring owner; the shard directory already exists
+    char name[80];
+    pthread_rwlock_rdlock(&volume_lock);
+    int v = volume_for_locked(uuid);
+    int dirfd = blob_at(v, uuid, name, sizeof(name));
+    pthread_rwlock_unlock(&volume_lock);
+    if (dirfd < 0) {
+        log_error("Invalid UUID '%s'", uuid);
+        return -1;
+    }
 
-    struct stat st = {0};
-    if (stat(subdir_path, &st) == -1) {
-        if (mkdir(subdir_path, 0755) == -1) {
-            log_error("Failed to create subdirectory '%s': %s",
-                     subdir_path, strerror(errno));
-            free(full_path);
-            return -1;
+    int fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 && errno == ENOENT && volumes[v].levels == 2) {
+        // Second-level directory lost (or creation interrupted): recreate it
+        char sub[3] = { uuid[2], uuid[3], '\0' };
+        if (ensure_dir_at(dirfd, sub) == 0) {
+            fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
         }
     }
-
-    // Write file
-    FILE* fp = fopen(full_path, "wb");
-    if (!fp) {
-        log_error("Failed to open file '%s' for writing: %s",
-                 full_path, strerror(errno));
-        free(full_path);
+    if (fd < 0) {
+        log_error("Failed to open blob '%s' on %s for writing: %s",
+                 uuid, volumes[v].path, strerror(errno));
         return -1;
     }
 
-    size_t written = fwrite(data, 1, size, fp);
-    fclose(fp);
-
-    if (written != size) {
-        log_error("Failed to write complete file. Expected %zu bytes, wrote %zu",
-                 size, written);
-        unlink(full_path);  // Clean up partial file
-        free(full_path);
+    if (write_all(fd, data, size) < 0) {
+        log_error("Failed to write complete file %s (%zu bytes): %s",
+                 uuid, size, strerror(errno));
+        close(fd);
+        unlinkat(dirfd, name, 0);  // Clean up partial file
         return -1;
     }
+    close(fd);
 
-    log_info("Wrote file to storage: %s (%zu bytes)", full_path, size);
-    free(full_path);
+    log_info("Wrote file to storage: %s/%s (%zu bytes)", volumes[v].path, name, size);
     return 0;
 }
 
@@ -109,56 +731,57 @@ int storage_read_file(const char* uuid, uint8_t** data, size_t* size) {
         return -1;
     }
 
-    char* full_path = storage_get_path(uuid);
-    if (!full_path) {
-        return -1;
+    int packed = pack_read(uuid, data, size);
+    if (packed <= 0) {
+        return packed;
     }
 
-    FILE* fp = fopen(full_path, "rb");
-    if (!fp) {
-        log_error("Failed to open file '%s' for reading: %s",
-                 full_path, strerror(errno));
-        free(full_path);
+    int dirfd;
+    char name[80];
+    int v = locate_blob(uuid, &dirfd, name, sizeof(name));
+    int fd = v >= 0 ? openat(dirfd, name, O_RDONLY) : -1;
+    if (fd < 0) {
+        log_error("Failed to open blob '%s' for reading: %s",
+                 uuid, v >= 0 ? strerror(errno) : "not found");
         return -1;
     }
 
     // Get file size
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    if (file_size < 0) {
-        log_error("Failed to get file size for '%s'", full_path);
-        fclose(fp);
-        free(full_path);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        log_error("Failed to get file size for blob '%s'", uuid);
+        close(fd);
         return -1;
     }
 
     // Allocate buffer
-    *data = malloc(file_size);
+    *data = malloc(st.st_size > 0 ? (size_t)st.st_size : 1);
     if (!*data) {
         log_error("Memory allocation failed for file read");
-        fclose(fp);
-        free(full_path);
+        close(fd);
         return -1;
     }
 
     // Read file
-    size_t read_bytes = fread(*data, 1, file_size, fp);
-    fclose(fp);
+    size_t read_bytes = 0;
+    while (read_bytes < (size_t)st.st_size) {
+        ssize_t n = read(fd, *data + read_bytes, (size_t)st.st_size - read_bytes);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        read_bytes += (size_t)n;
+    }
+    close(fd);
 
-    if (read_bytes != (size_t)file_size) {
+    if (read_bytes != (size_t)st.st_size) {
         log_error("Failed to read complete file. Expected %ld bytes, read %zu",
-                 file_size, read_bytes);
+                 (long)st.st_size, read_bytes);
         free(*data);
         *data = NULL;
-        free(full_path);
         return -1;
     }
 
-    *size = file_size;
-    log_info("Read file from storage: %s (%zu bytes)", full_path, *size);
-    free(full_path);
+    *size = read_bytes;
+    log_info("Read file from storage: %s/%s (%zu bytes)", volumes[v].path, name, *size);
     return 0;
 }
 
@@ -168,19 +791,87 @@ int storage_delete_file(const char* uuid) {
         return -1;
     }
 
-    char* full_path = storage_get_path(uuid);
-    if (!full_path) {
+    // Existing holders keep their mapping; new readers must not reuse it,
+    // nor register one they are mapping right now
+    pthread_mutex_lock(&view_mutex);
+    StorageView* stale = view_find_locked(uuid);
+    if (stale) view_detach_locked(stale);
+    view_deletes++;
+    pthread_mutex_unlock(&view_mutex);
+
+    int packed = pack_delete(uuid);
+    if (packed <= 0) {
+        return packed;
+    }
+
+    // Hold move_mutex so the rebalancer can't copy the blob back mid-delete
+    pthread_mutex_lock(&move_mutex);
+    int dirfd;
+    char name[80];
+    int v = locate_blob(uuid, &dirfd, name, sizeof(name));
+    if (v < 0 || unlinkat(dirfd, name, 0) == -1) {
+        pthread_mutex_unlock(&move_mutex);
+        log_error("Failed to delete blob '%s': %s", uuid, v >= 0 ? strerror(errno) : "not found");
+        return -1;
+    }
+    pthread_mutex_unlock(&move_mutex);
+
+    log_info("Deleted file from storage: %s/%s", volumes[v].path, name);
+    return 0;
+}
+
+typedef struct {
+    char (**uuids)[64];
+    int* count;
+    int cap;
+    int min_age_sec;
+    time_t now;
+} ShardListing;
+
+static int list_visit(int volume, int dirfd, const char* name, void* ctx) {
+    (void)volume;
+    ShardListing* l = ctx;
+
+    struct stat st;
+    if (fstatat(dirfd, name, &st, 0) != 0 || !S_ISREG(st.st_mode)) return 0;
+    if (l->now - st.st_mtime < l->min_age_sec) return 0;
+
+    if (*l->count == l->cap) {
+        int new_cap = l->cap ? l->cap * 2 : 64;
+        void* grown = realloc(*l->uuids, (size_t)new_cap * 64);
+        if (!grown) return -1;
+        *l->uuids = grown;
+        l->cap = new_cap;
+    }
+    strcpy((*l->uuids)[(*l->count)++], name);
+    return 0;
+}
+
+int storage_list_shard(const char* prefix, int min_age_sec, char (**uuids)[64], int* count) {
+    if (!prefix || strlen(prefix) != 2 || shard_index(prefix) < 0 || !uuids || !count) {
         return -1;
     }
 
-    if (unlink(full_path) == -1) {
-        log_error("Failed to delete file '%s': %s", full_path, strerror(errno));
-        free(full_path);
+    if (pack_list_prefix(prefix, min_age_sec, uuids, count) < 0) {
         return -1;
     }
 
-    log_info("Deleted file from storage: %s", full_path);
-    free(full_path);
+    ShardListing listing = { uuids, count, *count, min_age_sec, time(NULL) };
+    int shard = shard_index(prefix);
+
+    pthread_rwlock_rdlock(&volume_lock);
+    int nvol = volume_count;
+    pthread_rwlock_unlock(&volume_lock);
+
+    for (int v = 0; v < nvol; v++) {
+        if (scan_shard(v, shard, list_visit, &listing) < 0) {
+            free(*uuids);
+            *uuids = NULL;
+            *count = 0;
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -189,14 +880,133 @@ int storage_file_exists(const char* uuid) {
         return 0;
     }
 
-    char* full_path = storage_get_path(uuid);
-    if (!full_path) {
-        return 0;
+    if (pack_contains(uuid)) {
+        return 1;
     }
 
-    struct stat st = {0};
-    int exists = (stat(full_path, &st) == 0);
+    int dirfd;
+    char name[80];
+    return locate_blob(uuid, &dirfd, name, sizeof(name)) >= 0;
+}
 
-    free(full_path);
-    return exists;
+// Helper: register a freshly mapped view, or hand back the one another
+// reader registered meanwhile (dropping ours). A view mapped across a delete
+// is returned unregistered, so nobody else picks it up.
+static StorageView* view_publish(StorageView* view, unsigned long deletes) {
+    pthread_mutex_lock(&view_mutex);
+    StorageView* existing = view_find_locked(view->uuid);
+    if (existing) {
+        existing->refcount++;
+    } else if (deletes == view_deletes) {
+        StorageView** bucket = view_bucket(view->uuid);
+        view->next = *bucket;
+        *bucket = view;
+    }
+    pthread_mutex_unlock(&view_mutex);
+
+    if (existing) {
+        if (view->map_base) munmap(view->map_base, view->map_length);
+        free(view);
+        return existing;
+    }
+    return view;
+}
+
+StorageView* storage_map_file(const char* uuid) {
+    if (!uuid || strlen(uuid) >= sizeof(((StorageView*)0)->uuid)) {
+        log_error("Invalid UUID for storage_map_file");
+        return NULL;
+    }
+
+    // Share an existing mapping if another reader already has this blob
+    pthread_mutex_lock(&view_mutex);
+    StorageView* shared = view_find_locked(uuid);
+    if (shared) shared->refcount++;
+    unsigned long deletes = view_deletes;
+    pthread_mutex_unlock(&view_mutex);
+    if (shared) return shared;
+
+    StorageView* view = calloc(1, sizeof(StorageView));
+    if (!view) {
+        log_error("Memory allocation failed for storage view");
+        return NULL;
+    }
+    view->refcount = 1;
+    strcpy(view->uuid, uuid);
+
+    // Packed blobs map a window of their segment file
+    const uint8_t* pack_data = NULL;
+    int packed = pack_map(uuid, &view->map_base, &view->map_length, &pack_data, &view->size);
+    if (packed < 0) {
+        free(view);
+        return NULL;
+    }
+    if (packed == 0) {
+        view->data = pack_data;
+        return view_publish(view, deletes);
+    }
+
+    int dirfd;
+    char name[80];
+    int v = locate_blob(uuid, &dirfd, name, sizeof(name));
+    int fd = v >= 0 ? openat(dirfd, name, O_RDONLY) : -1;
+    if (fd < 0) {
+        log_error("Failed to open blob '%s' for mapping: %s",
+                 uuid, v >= 0 ? strerror(errno) : "not found");
+        free(view);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        log_error("Failed to stat blob '%s': %s", uuid, strerror(errno));
+        close(fd);
+        free(view);
+        return NULL;
+    }
+
+    // mmap() rejects zero-length mappings; an empty blob is just an empty view
+    if (st.st_size > 0) {
+        void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            log_error("Failed to mmap blob '%s': %s", uuid, strerror(errno));
+            free(view);
+            close(fd);
+            return NULL;
+        }
+        madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+        view->map_base = base;
+        view->map_length = (size_t)st.st_size;
+        view->data = base;
+    }
+    close(fd);  // The mapping stays valid after the descriptor is closed
+    view->size = (size_t)st.st_size;
+
+    log_info("Mapped file from storage: %s/%s (%zu bytes)", volumes[v].path, name, view->size);
+    return view_publish(view, deletes);
+}
+
+void storage_view_retain(StorageView* view) {
+    if (!view) return;
+    pthread_mutex_lock(&view_mutex);
+    view->refcount++;
+    pthread_mutex_unlock(&view_mutex);
+}
+
+void storage_view_release(StorageView* view) {
+    if (!view) return;
+
+    pthread_mutex_lock(&view_mutex);
+    int remaining = --view->refcount;
+    if (remaining == 0) {
+        view_detach_locked(view);
+    }
+    pthread_mutex_unlock(&view_mutex);
+
+    if (remaining == 0) {
+        if (view->map_base) {
+            munmap(view->map_base, view->map_length);
+        }
+        free(view);
+    }
 }
@@ -4,9 +4,27 @@
 #include <stddef.h>
 #include <stdint.h>
 
-// Initialize storage directory
+// Directory fan-out for volumes created from now on: 1 = <ab>/<uuid>,
+// 2 = <ab>/<cd>/<uuid> for stores with tens of millions of blobs. Existing
+// volumes keep the layout they were created with. Call before storage_init.
+int storage_set_fanout(int levels);
+
+// Initialize storage directory. Shard directories are created up front
+// and kept open; blobs are then opened relative to them by UUID.
 int storage_init(const char* base_path);
 
+// Add a storage volume. Blobs are spread across volumes by consistent
+// hashing of their UUID, proportionally to `weight`; blobs already stored
+// are moved to their new owner by a background rebalancer.
+int storage_add_volume(const char* path, int weight);
+
+// Pack small blobs (<= PACK_SMALL_BLOB_MAX) into shared segment files
+// instead of one file each. Call after storage_init.
+int storage_enable_packing(void);
+
+// Stop background storage work and release resources
+void storage_shutdown(void);
+
 // Get full path for a UUID
 char* storage_get_path(const char* uuid);
 
@@ -22,4 +40,32 @@ int storage_delete_file(const char* uuid);
 // Check if file exists
 int storage_file_exists(const char* uuid);
 
+// Collect the UUIDs of all blobs in shard `prefix` (first two UUID chars),
+// across every volume and the pack index, into a malloc'd array. Blobs
+// written (or packed) less than `min_age_sec` ago are skipped.
+int storage_list_shard(const char* prefix, int min_age_sec, char (**uuids)[64], int* count);
+
+// Read-only, reference-counted mapping of a stored blob.
+// Concurrent readers of the same UUID share one mapping (and so the same
+// page-cache pages) instead of each holding a private heap copy.
+typedef struct StorageView {
+    const uint8_t* data;        // Blob contents (NULL for empty blobs)
+    size_t size;                // Blob length in bytes
+    void* map_base;             // Start of the mmap'd region
+    size_t map_length;          // Length of the mmap'd region
+    int refcount;               // Protected by the view registry lock
+    int verified;               // Contents checked against stored checksums
+    char uuid[64];
+    struct StorageView* next;   // Registry chaining
+} StorageView;
+
+// Map a blob read-only. Returns a view holding one reference, or NULL.
+StorageView* storage_map_file(const char* uuid);
+
+// Take an additional reference on a view
+void storage_view_retain(StorageView* view);
+
+// Drop a reference; the mapping is released with the last one
+void storage_view_release(StorageView* view);
+
 #endif
@@ -0,0 +1,238 @@
+#include "storage_gc.h"
+#include "storage.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+static Database* gc_db = NULL;
+static int gc_interval = GC_DEFAULT_INTERVAL_SEC;
+static int gc_rate = GC_DEFAULT_RATE;
+
+static pthread_t gc_thread;
+static int gc_running = 0;
+static int gc_requested = 0;
+static pthread_mutex_t gc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gc_cond = PTHREAD_COND_INITIALIZER;
+
+// Protected by gc_mutex
+static GcStats stats;
+
+// Pacing window
+static int window_items = 0;
+static struct timespec window_start;
+
+// Helper: account for one unit of work, sleeping once the per-second budget
+// is spent. Returns -1 if the collector is being stopped.
+static int gc_throttle(void) {
+    if (++window_items < gc_rate) {
+        return 0;
+    }
+
+    struct timespec deadline = window_start;
+    deadline.tv_sec += 1;
+
+    pthread_mutex_lock(&gc_mutex);
+    while (gc_running) {
+        if (pthread_cond_timedwait(&gc_cond, &gc_mutex, &deadline) != 0) break;
+    }
+    int stopping = !gc_running;
+    pthread_mutex_unlock(&gc_mutex);
+
+    window_items = 0;
+    clock_gettime(CLOCK_REALTIME, &window_start);
+    return stopping ? -1 : 0;
+}
+
+// Phase 1: delete blobs that no file row refers to
+static int gc_scan_shards(void) {
+    for (int shard = 0; shard < 256; shard++) {
+        char prefix[3];
+        snprintf(prefix, sizeof(prefix), "%02x", shard);
+
+        char (*uuids)[64] = NULL;
+        int count = 0;
+        if (storage_list_shard(prefix, GC_BLOB_GRACE_SEC, &uuids, &count) < 0) {
+            log_error("GC: failed to list shard %s", prefix);
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (gc_throttle() < 0) {
+                free(uuids);
+                return -1;
+            }
+
+            int deleted = 0;
+            if (db_blob_referenced(gc_db, uuids[i]) == 0) {
+                if (storage_delete_file(uuids[i]) == 0) {
+                    log_info("GC: deleted unreferenced blob %s", uuids[i]);
+                    deleted = 1;
+                }
+            }
+
+            pthread_mutex_lock(&gc_mutex);
+            stats.blobs_scanned++;
+            stats.blobs_deleted += deleted;
+            pthread_mutex_unlock(&gc_mutex);
+        }
+        free(uuids);
+
+        pthread_mutex_lock(&gc_mutex);
+        stats.shards_done = shard + 1;
+        pthread_mutex_unlock(&gc_mutex);
+    }
+    return 0;
+}
+
+// Phase 2: flag rows whose blob is gone, unflag rows whose blob came back
+static int gc_scan_rows(void) {
+    int cursor = -1;
+
+    for (;;) {
+        BlobRef* refs = NULL;
+        int count = 0;
+        if (db_list_blob_refs(gc_db, cursor, GC_ROW_BATCH, &refs, &count) < 0) {
+            log_error("GC: failed to list files after id %d", cursor);
+            return -1;
+        }
+        if (count == 0) {
+            free(refs);
+            return 0;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (gc_throttle() < 0) {
+                free(refs);
+                return -1;
+            }
+
+            int exists = refs[i].physical_path[0] != '\0' &&
+                         storage_file_exists(refs[i].physical_path);
+            if (!exists && !refs[i].missing) {
+                log_info("GC: file %d has no blob (%s)", refs[i].id, refs[i].physical_path);
+                db_set_blob_missing(gc_db, refs[i].id, 1);
+            } else if (exists && refs[i].missing) {
+                db_set_blob_missing(gc_db, refs[i].id, 0);
+            }
+
+            pthread_mutex_lock(&gc_mutex);
+            stats.rows_scanned++;
+            stats.rows_missing += !exists;
+            stats.row_cursor = refs[i].id;
+            pthread_mutex_unlock(&gc_mutex);
+        }
+
+        cursor = refs[count - 1].id;
+        free(refs);
+    }
+}
+
+static void gc_pass(void) {
+    pthread_mutex_lock(&gc_mutex);
+    stats.running = 1;
+    stats.shards_done = 0;
+    stats.row_cursor = 0;
+    stats.blobs_scanned = 0;
+    stats.blobs_deleted = 0;
+    stats.rows_scanned = 0;
+    stats.rows_missing = 0;
+    stats.last_started = time(NULL);
+    pthread_mutex_unlock(&gc_mutex);
+
+    log_info("GC: pass started");
+    window_items = 0;
+    clock_gettime(CLOCK_REALTIME, &window_start);
+
+    int rc = gc_scan_shards();
+    if (rc == 0) {
+        rc = gc_scan_rows();
+    }
+
+    pthread_mutex_lock(&gc_mutex);
+    stats.running = 0;
+    if (rc == 0) {
+        stats.passes++;
+        stats.last_finished = time(NULL);
+    }
+    log_info("GC: pass %s: %ld blobs scanned, %ld deleted, %ld rows scanned, %ld missing blobs",
+             rc == 0 ? "finished" : "aborted", stats.blobs_scanned, stats.blobs_deleted,
+             stats.rows_scanned, stats.rows_missing);
+    pthread_mutex_unlock(&gc_mutex);
+}
+
+static void* gc_main(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&gc_mutex);
+    while (gc_running) {
+        if (!gc_requested) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += gc_interval;
+            pthread_cond_timedwait(&gc_cond, &gc_mutex, &deadline);
+            if (!gc_running) break;
+        }
+        gc_requested = 0;
+
+        pthread_mutex_unlock(&gc_mutex);
+        gc_pass();
+        pthread_mutex_lock(&gc_mutex);
+    }
+    pthread_mutex_unlock(&gc_mutex);
+    return NULL;
+}
+
+int gc_start(Database* db, int interval_sec, int rate_per_sec) {
+    if (!db || interval_sec <= 0 || rate_per_sec <= 0) {
+        log_error("Invalid storage GC parameters");
+        return -1;
+    }
+
+    pthread_mutex_lock(&gc_mutex);
+    if (gc_running) {
+        pthread_mutex_unlock(&gc_mutex);
+        return 0;
+    }
+    gc_db = db;
+    gc_interval = interval_sec;
+    gc_rate = rate_per_sec;
+    gc_running = 1;
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&gc_mutex);
+
+    if (pthread_create(&gc_thread, NULL, gc_main, NULL) != 0) {
+        log_error("Failed to start storage GC thread");
+        gc_running = 0;
+        return -1;
+    }
+
+    log_info("Storage GC started (every %d s, %d checks/s)", interval_sec, rate_per_sec);
+    return 0;
+}
+
+void gc_stop(void) {
+    pthread_mutex_lock(&gc_mutex);
+    int was_running = gc_running;
+    gc_running = 0;
+    pthread_cond_broadcast(&gc_cond);
+    pthread_mutex_unlock(&gc_mutex);
+
+    if (was_running) {
+        pthread_join(gc_thread, NULL);
+    }
+}
+
+void gc_trigger(void) {
+    pthread_mutex_lock(&gc_mutex);
+    gc_requested = 1;
+    pthread_cond_broadcast(&gc_cond);
+    pthread_mutex_unlock(&gc_mutex);
+}
+
+void gc_get_stats(GcStats* out) {
+    pthread_mutex_lock(&gc_mutex);
+    *out = stats;
+    pthread_mutex_unlock(&gc_mutex);
+}
@@ -0,0 +1,44 @@
+#ifndef STORAGE_GC_H
+#define STORAGE_GC_H
+
+#include <time.h>
+#include "../database/db_manager.h"
+
+// Background reconciliation between the files table and blob storage.
+// Each pass walks the 256 storage shards, deleting blobs no row refers to,
+// then walks the files table in id order, flagging rows whose blob is
+// missing (missing_blobs table). Work is paced to a fixed number of checks
+// per second so foreground I/O is not starved.
+
+#define GC_DEFAULT_INTERVAL_SEC 3600    // Time between passes
+#define GC_DEFAULT_RATE 200             // Blobs/rows checked per second
+#define GC_ROW_BATCH 128                // Rows fetched per database query
+#define GC_BLOB_GRACE_SEC 300           // Loose blobs younger than this are left alone
+
+// Progress of the current (or last) pass
+typedef struct {
+    int running;            // A pass is in progress
+    long passes;            // Completed passes
+    int shards_done;        // Shards scanned so far (of 256)
+    int row_cursor;         // Last files.id checked
+    long blobs_scanned;
+    long blobs_deleted;
+    long rows_scanned;
+    long rows_missing;      // Rows whose blob is missing
+    time_t last_started;
+    time_t last_finished;
+} GcStats;
+
+// Start the collector thread
+int gc_start(Database* db, int interval_sec, int rate_per_sec);
+
+// Stop the collector, abandoning any pass in progress
+void gc_stop(void);
+
+// Start a pass now instead of waiting for the interval
+void gc_trigger(void);
+
+// Snapshot the collector's progress counters
+void gc_get_stats(GcStats* stats);
+
+#endif
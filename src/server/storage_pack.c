@@ -0,0 +1,688 @@
+#include "storage_pack.h"
+#include "../common/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define PACK_KEY_SIZE 64
+#define PACK_INDEX_BUCKETS_MIN 1024
+
+#define PACK_OP_PUT 1
+#define PACK_OP_DEL 2
+
+// In-memory index entry (chained hash table)
+typedef struct PackEntry {
+    char uuid[PACK_KEY_SIZE];
+    uint32_t segment;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t appended_at;   // Unix time the blob was appended
+    struct PackEntry* next;
+} PackEntry;
+
+// On-disk index record (fixed size, appended to index.log)
+typedef struct {
+    uint8_t op;
+    uint8_t reserved[3];
+    uint32_t segment;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t appended_at;   // 0 in records written before it was kept
+    char uuid[PACK_KEY_SIZE];
+} PackRecord;
+
+typedef struct {
+    int fd;             // -1 once the segment has been reclaimed
+    uint64_t size;      // Bytes appended so far
+    uint64_t live;      // Bytes still referenced by the index
+} PackSegment;
+
+static char pack_dir[256] = {0};
+static int pack_ready = 0;
+
+static PackSegment* segments = NULL;
+static uint32_t segment_count = 0;      // segments[] covers ids [0, segment_count)
+static uint32_t active_segment = 0;
+
+static PackEntry** buckets = NULL;
+static size_t bucket_count = 0;
+static size_t entry_count = 0;
+
+static int index_fd = -1;
+
+// Readers (lookup, pread, mmap) share; appends, deletes and compaction exclude
+static pthread_rwlock_t pack_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static pthread_t compactor_thread;
+static int compactor_running = 0;
+static pthread_mutex_t compactor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compactor_cond = PTHREAD_COND_INITIALIZER;
+
+// Helper: FNV-1a hash of a UUID string
+static size_t hash_key(const char* key) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return (size_t)h;
+}
+
+static PackEntry* index_find(const char* uuid) {
+    if (!buckets) return NULL;
+    for (PackEntry* e = buckets[hash_key(uuid) & (bucket_count - 1)]; e; e = e->next) {
+        if (strcmp(e->uuid, uuid) == 0) return e;
+    }
+    return NULL;
+}
+
+static int index_grow(void) {
+    size_t new_count = bucket_count ? bucket_count * 2 : PACK_INDEX_BUCKETS_MIN;
+    PackEntry** new_buckets = calloc(new_count, sizeof(PackEntry*));
+    if (!new_buckets) return -1;
+
+    for (size_t i = 0; i < bucket_count; i++) {
+        PackEntry* e = buckets[i];
+        while (e) {
+            PackEntry* next = e->next;
+            size_t b = hash_key(e->uuid) & (new_count - 1);
+            e->next = new_buckets[b];
+            new_buckets[b] = e;
+            e = next;
+        }
+    }
+
+    free(buckets);
+    buckets = new_buckets;
+    bucket_count = new_count;
+    return 0;
+}
+
+// Helper: insert or replace an entry, keeping per-segment live counters in step
+static int index_put(const char* uuid, uint32_t segment, uint64_t offset, uint32_t length,
+                     uint32_t appended_at) {
+    PackEntry* e = index_find(uuid);
+    if (e) {
+        if (e->segment < segment_count) segments[e->segment].live -= e->length;
+    } else {
+        if (entry_count + 1 > bucket_count * 2 && index_grow() < 0) return -1;
+        e = calloc(1, sizeof(PackEntry));
+        if (!e) return -1;
+        strncpy(e->uuid, uuid, PACK_KEY_SIZE - 1);
+        size_t b = hash_key(uuid) & (bucket_count - 1);
+        e->next = buckets[b];
+        buckets[b] = e;
+        entry_count++;
+    }
+
+    e->segment = segment;
+    e->offset = offset;
+    e->length = length;
+    e->appended_at = appended_at;
+    if (segment < segment_count) segments[segment].live += length;
+    return 0;
+}
+
+static void index_remove(const char* uuid) {
+    if (!buckets) return;
+    PackEntry** link = &buckets[hash_key(uuid) & (bucket_count - 1)];
+    while (*link) {
+        PackEntry* e = *link;
+        if (strcmp(e->uuid, uuid) == 0) {
+            if (e->segment < segment_count) segments[e->segment].live -= e->length;
+            *link = e->next;
+            free(e);
+            entry_count--;
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+// Helper: make sure segments[] can hold `id`
+static int segments_reserve(uint32_t id) {
+    if (id < segment_count) return 0;
+    PackSegment* grown = realloc(segments, (id + 1) * sizeof(PackSegment));
+    if (!grown) return -1;
+    for (uint32_t i = segment_count; i <= id; i++) {
+        grown[i].fd = -1;
+        grown[i].size = 0;
+        grown[i].live = 0;
+    }
+    segments = grown;
+    segment_count = id + 1;
+    return 0;
+}
+
+static void segment_path(uint32_t id, char* path, size_t size) {
+    snprintf(path, size, "%s/seg_%06u.dat", pack_dir, id);
+}
+
+static int segment_open(uint32_t id, int create) {
+    if (segments_reserve(id) < 0) return -1;
+
+    char path[512];
+    segment_path(id, path, sizeof(path));
+
+    int fd = open(path, O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        log_error("Failed to open pack segment '%s': %s", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    segments[id].fd = fd;
+    segments[id].size = (uint64_t)st.st_size;
+    return 0;
+}
+
+static int index_append(uint8_t op, const char* uuid, uint32_t segment,
+                        uint64_t offset, uint32_t length, uint32_t appended_at) {
+    PackRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.op = op;
+    rec.segment = segment;
+    rec.offset = offset;
+    rec.length = length;
+    rec.appended_at = appended_at;
+    strncpy(rec.uuid, uuid, PACK_KEY_SIZE - 1);
+
+    if (write(index_fd, &rec, sizeof(rec)) != (ssize_t)sizeof(rec)) {
+        log_error("Failed to append pack index record: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Helper: replay index.log into memory, dropping any torn trailing record
+static int index_replay(const char* index_path) {
+    index_fd = open(index_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (index_fd < 0) {
+        log_error("Failed to open pack index '%s': %s", index_path, strerror(errno));
+        return -1;
+    }
+
+    PackRecord rec;
+    off_t valid = 0;
+    ssize_t n;
+    while ((n = pread(index_fd, &rec, sizeof(rec), valid)) == (ssize_t)sizeof(rec)) {
+        rec.uuid[PACK_KEY_SIZE - 1] = '\0';
+        if (rec.op == PACK_OP_PUT) {
+            if (segments_reserve(rec.segment) < 0 ||
+                index_put(rec.uuid, rec.segment, rec.offset, rec.length, rec.appended_at) < 0) {
+                return -1;
+            }
+        } else if (rec.op == PACK_OP_DEL) {
+            index_remove(rec.uuid);
+        }
+        valid += sizeof(rec);
+    }
+
+    if (n > 0) {
+        log_error("Pack index has a torn record at offset %lld, truncating",
+                 (long long)valid);
+        if (ftruncate(index_fd, valid) < 0) return -1;
+    }
+    return 0;
+}
+
+// Helper: fsync segments `first` through `last` (caller holds write lock)
+static int segments_sync(uint32_t first, uint32_t last) {
+    for (uint32_t id = first; id <= last && id < segment_count; id++) {
+        if (segments[id].fd >= 0 && fsync(segments[id].fd) < 0) {
+            log_error("Failed to sync pack segment %u: %s", id, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Helper: rewrite index.log with only the live entries (caller holds write lock)
+static int index_checkpoint(void) {
+    char path[512], tmp_path[512];
+    snprintf(path, sizeof(path), "%s/index.log", pack_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/index.log.tmp", pack_dir);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (PackEntry* e = buckets[i]; e; e = e->next) {
+            PackRecord rec;
+            memset(&rec, 0, sizeof(rec));
+            rec.op = PACK_OP_PUT;
+            rec.segment = e->segment;
+            rec.offset = e->offset;
+            rec.length = e->length;
+            rec.appended_at = e->appended_at;
+            memcpy(rec.uuid, e->uuid, PACK_KEY_SIZE);
+            if (write(fd, &rec, sizeof(rec)) != (ssize_t)sizeof(rec)) {
+                close(fd);
+                unlink(tmp_path);
+                return -1;
+            }
+        }
+    }
+
+    if (fsync(fd) < 0 || rename(tmp_path, path) < 0) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+
+    close(index_fd);
+    index_fd = open(path, O_RDWR | O_APPEND);
+    return index_fd < 0 ? -1 : 0;
+}
+
+static void* compactor_main(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&compactor_mutex);
+    while (compactor_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PACK_COMPACT_INTERVAL_SEC;
+        pthread_cond_timedwait(&compactor_cond, &compactor_mutex, &deadline);
+        if (!compactor_running) break;
+
+        pthread_mutex_unlock(&compactor_mutex);
+        pack_compact(PACK_COMPACT_DEAD_RATIO);
+        pthread_mutex_lock(&compactor_mutex);
+    }
+    pthread_mutex_unlock(&compactor_mutex);
+    return NULL;
+}
+
+int pack_init(const char* dir) {
+    if (!dir || strlen(dir) == 0 || strlen(dir) >= sizeof(pack_dir)) {
+        log_error("Invalid pack directory");
+        return -1;
+    }
+
+    strcpy(pack_dir, dir);
+
+    struct stat st = {0};
+    if (stat(pack_dir, &st) == -1 && mkdir(pack_dir, 0755) == -1) {
+        log_error("Failed to create pack directory '%s': %s", pack_dir, strerror(errno));
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&pack_lock);
+
+    if (index_grow() < 0) {
+        pthread_rwlock_unlock(&pack_lock);
+        return -1;
+    }
+
+    // Open every segment present on disk; the highest id becomes active
+    DIR* d = opendir(pack_dir);
+    if (d) {
+        struct dirent* de;
+        while ((de = readdir(d)) != NULL) {
+            unsigned int id;
+            if (sscanf(de->d_name, "seg_%06u.dat", &id) == 1) {
+                if (segment_open(id, 0) == 0 && id >= active_segment) {
+                    active_segment = id;
+                }
+            }
+        }
+        closedir(d);
+    }
+
+    if (active_segment >= segment_count || segments[active_segment].fd < 0) {
+        if (segment_open(active_segment, 1) < 0) {
+            pthread_rwlock_unlock(&pack_lock);
+            return -1;
+        }
+    }
+
+    char index_path[512];
+    snprintf(index_path, sizeof(index_path), "%s/index.log", pack_dir);
+    if (index_replay(index_path) < 0) {
+        pthread_rwlock_unlock(&pack_lock);
+        return -1;
+    }
+
+    pack_ready = 1;
+    pthread_rwlock_unlock(&pack_lock);
+
+    compactor_running = 1;
+    if (pthread_create(&compactor_thread, NULL, compactor_main, NULL) != 0) {
+        log_error("Failed to start pack compactor thread");
+        compactor_running = 0;
+    }
+
+    log_info("Pack storage initialized at %s (%zu blobs, %u segments)",
+             pack_dir, entry_count, segment_count);
+    return 0;
+}
+
+void pack_shutdown(void) {
+    if (!pack_ready) return;
+
+    pthread_mutex_lock(&compactor_mutex);
+    int was_running = compactor_running;
+    compactor_running = 0;
+    pthread_cond_signal(&compactor_cond);
+    pthread_mutex_unlock(&compactor_mutex);
+    if (was_running) pthread_join(compactor_thread, NULL);
+
+    pthread_rwlock_wrlock(&pack_lock);
+    for (uint32_t i = 0; i < segment_count; i++) {
+        if (segments[i].fd >= 0) close(segments[i].fd);
+    }
+    free(segments);
+    segments = NULL;
+    segment_count = 0;
+
+    for (size_t i = 0; i < bucket_count; i++) {
+        PackEntry* e = buckets[i];
+        while (e) {
+            PackEntry* next = e->next;
+            free(e);
+            e = next;
+        }
+    }
+    free(buckets);
+    buckets = NULL;
+    bucket_count = 0;
+    entry_count = 0;
+
+    if (index_fd >= 0) close(index_fd);
+    index_fd = -1;
+    pack_ready = 0;
+    pthread_rwlock_unlock(&pack_lock);
+}
+
+// Helper: append to the active segment (caller holds write lock)
+static int pack_append_locked(const char* uuid, const uint8_t* data, size_t size) {
+    PackSegment* seg = &segments[active_segment];
+    if (seg->size > 0 && seg->size + size > PACK_SEGMENT_MAX) {
+        if (segment_open(segment_count, 1) < 0) return -1;
+        active_segment = segment_count - 1;
+        seg = &segments[active_segment];
+    }
+
+    uint64_t offset = seg->size;
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = pwrite(seg->fd, data + written, size - written, offset + written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("Failed to append to pack segment %u: %s",
+                     active_segment, strerror(errno));
+            return -1;
+        }
+        written += n;
+    }
+
+    // Data first, then the index record that makes it visible
+    uint32_t now = (uint32_t)time(NULL);
+    if (index_append(PACK_OP_PUT, uuid, active_segment, offset, (uint32_t)size, now) < 0) {
+        return -1;
+    }
+    seg->size += size;
+    return index_put(uuid, active_segment, offset, (uint32_t)size, now);
+}
+
+int pack_write(const char* uuid, const uint8_t* data, size_t size) {
+    if (!pack_ready || !uuid || strlen(uuid) >= PACK_KEY_SIZE ||
+        size > PACK_SMALL_BLOB_MAX) {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&pack_lock);
+    int result = pack_append_locked(uuid, data, size);
+    pthread_rwlock_unlock(&pack_lock);
+
+    if (result == 0) {
+        log_info("Packed blob %s into segment (%zu bytes)", uuid, size);
+    }
+    return result;
+}
+
+// Helper: pread a located blob (caller holds at least the read lock)
+static int pack_read_locked(const PackEntry* e, uint8_t** data, size_t* size) {
+    *data = malloc(e->length > 0 ? e->length : 1);
+    if (!*data) return -1;
+
+    size_t got = 0;
+    while (got < e->length) {
+        ssize_t n = pread(segments[e->segment].fd, *data + got, e->length - got,
+                          e->offset + got);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            free(*data);
+            *data = NULL;
+            return -1;
+        }
+        got += n;
+    }
+
+    *size = e->length;
+    return 0;
+}
+
+int pack_read(const char* uuid, uint8_t** data, size_t* size) {
+    if (!pack_ready || !uuid) return 1;
+
+    pthread_rwlock_rdlock(&pack_lock);
+    PackEntry* e = index_find(uuid);
+    int result = e ? pack_read_locked(e, data, size) : 1;
+    pthread_rwlock_unlock(&pack_lock);
+
+    return result;
+}
+
+int pack_map(const char* uuid, void** map_base, size_t* map_length,
+             const uint8_t** data, size_t* size) {
+    if (!pack_ready || !uuid) return 1;
+
+    pthread_rwlock_rdlock(&pack_lock);
+    PackEntry* e = index_find(uuid);
+    if (!e) {
+        pthread_rwlock_unlock(&pack_lock);
+        return 1;
+    }
+
+    *size = e->length;
+    if (e->length == 0) {
+        *map_base = NULL;
+        *map_length = 0;
+        *data = NULL;
+        pthread_rwlock_unlock(&pack_lock);
+        return 0;
+    }
+
+    // mmap offsets must be page aligned; map from the enclosing page
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t aligned = e->offset - (e->offset % page);
+    size_t length = (size_t)(e->offset - aligned) + e->length;
+
+    void* base = mmap(NULL, length, PROT_READ, MAP_SHARED,
+                      segments[e->segment].fd, (off_t)aligned);
+    if (base == MAP_FAILED) {
+        log_error("Failed to mmap packed blob %s: %s", uuid, strerror(errno));
+        pthread_rwlock_unlock(&pack_lock);
+        return -1;
+    }
+
+    *map_base = base;
+    *map_length = length;
+    *data = (const uint8_t*)base + (e->offset - aligned);
+    pthread_rwlock_unlock(&pack_lock);
+    return 0;
+}
+
+int pack_delete(const char* uuid) {
+    if (!pack_ready || !uuid) return 1;
+
+    pthread_rwlock_wrlock(&pack_lock);
+    if (!index_find(uuid)) {
+        pthread_rwlock_unlock(&pack_lock);
+        return 1;
+    }
+
+    int result = index_append(PACK_OP_DEL, uuid, 0, 0, 0, 0);
+    if (result == 0) {
+        index_remove(uuid);
+    }
+    pthread_rwlock_unlock(&pack_lock);
+
+    if (result == 0) {
+        log_info("Deleted packed blob: %s", uuid);
+    }
+    return result;
+}
+
+int pack_contains(const char* uuid) {
+    if (!pack_ready || !uuid) return 0;
+
+    pthread_rwlock_rdlock(&pack_lock);
+    int found = index_find(uuid) != NULL;
+    pthread_rwlock_unlock(&pack_lock);
+    return found;
+}
+
+// Collect packed UUIDs under `prefix`, skipping blobs appended in the last `min_age_sec`
+int pack_list_prefix(const char* prefix, int min_age_sec, char (**uuids)[64], int* count) {
+    *uuids = NULL;
+    *count = 0;
+    if (!pack_ready || !prefix) return 0;
+
+    size_t prefix_len = strlen(prefix);
+    uint32_t now = (uint32_t)time(NULL);
+    int cap = 0;
+
+    pthread_rwlock_rdlock(&pack_lock);
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (PackEntry* e = buckets[i]; e; e = e->next) {
+            if (strncmp(e->uuid, prefix, prefix_len) != 0) continue;
+            if ((int64_t)now - e->appended_at < min_age_sec) continue;
+            if (*count == cap) {
+                int new_cap = cap ? cap * 2 : 64;
+                void* grown = realloc(*uuids, (size_t)new_cap * PACK_KEY_SIZE);
+                if (!grown) {
+                    pthread_rwlock_unlock(&pack_lock);
+                    free(*uuids);
+                    *uuids = NULL;
+                    *count = 0;
+                    return -1;
+                }
+                *uuids = grown;
+                cap = new_cap;
+            }
+            memcpy((*uuids)[(*count)++], e->uuid, PACK_KEY_SIZE);
+        }
+    }
+    pthread_rwlock_unlock(&pack_lock);
+    return 0;
+}
+
+// Helper: move one live blob out of `segment` into the active segment.
+// Each blob takes the locks on its own so foreground I/O is never stalled
+// for a whole segment.
+static void compact_move_blob(const char* uuid, uint32_t segment) {
+    uint8_t* data = NULL;
+    size_t size = 0;
+    uint64_t offset = 0;
+
+    pthread_rwlock_rdlock(&pack_lock);
+    PackEntry* e = index_find(uuid);
+    int ok = e && e->segment == segment && pack_read_locked(e, &data, &size) == 0;
+    if (ok) offset = e->offset;
+    pthread_rwlock_unlock(&pack_lock);
+    if (!ok) return;
+
+    pthread_rwlock_wrlock(&pack_lock);
+    e = index_find(uuid);
+    // Skip if the blob was deleted or rewritten while we were reading it
+    if (e && e->segment == segment && e->offset == offset) {
+        pack_append_locked(uuid, data, size);
+    }
+    pthread_rwlock_unlock(&pack_lock);
+
+    free(data);
+}
+
+int pack_compact(double min_dead_ratio) {
+    if (!pack_ready) return 0;
+
+    int reclaimed = 0;
+
+    for (uint32_t s = 0; ; s++) {
+        // Pick the next sealed segment worth compacting and snapshot its keys
+        pthread_rwlock_rdlock(&pack_lock);
+        if (s >= segment_count) {
+            pthread_rwlock_unlock(&pack_lock);
+            break;
+        }
+        PackSegment seg = segments[s];
+        if (s == active_segment || seg.fd < 0 || seg.size == 0 ||
+            (double)(seg.size - seg.live) / (double)seg.size < min_dead_ratio) {
+            pthread_rwlock_unlock(&pack_lock);
+            continue;
+        }
+
+        size_t key_count = 0;
+        char (*keys)[PACK_KEY_SIZE] = NULL;
+        size_t key_cap = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            for (PackEntry* e = buckets[i]; e; e = e->next) {
+                if (e->segment != s) continue;
+                if (key_count == key_cap) {
+                    size_t new_cap = key_cap ? key_cap * 2 : 64;
+                    void* grown = realloc(keys, new_cap * PACK_KEY_SIZE);
+                    if (!grown) break;
+                    keys = grown;
+                    key_cap = new_cap;
+                }
+                memcpy(keys[key_count++], e->uuid, PACK_KEY_SIZE);
+            }
+        }
+        uint32_t first_target = active_segment;
+        pthread_rwlock_unlock(&pack_lock);
+
+        for (size_t i = 0; i < key_count; i++) {
+            compact_move_blob(keys[i], s);
+        }
+        free(keys);
+
+        // Drop the segment once nothing in the index points into it. The
+        // moved copies (in the segments appended to meanwhile) reach disk
+        // before the index that points at them, and both before the
+        // originals go.
+        pthread_rwlock_wrlock(&pack_lock);
+        if (segments[s].live == 0 && s != active_segment &&
+            segments_sync(first_target, active_segment) == 0 && index_checkpoint() == 0) {
+            char path[512];
+            segment_path(s, path, sizeof(path));
+            close(segments[s].fd);
+            segments[s].fd = -1;
+            segments[s].size = 0;
+            unlink(path);
+            reclaimed++;
+            log_info("Compacted pack segment %u (%llu bytes reclaimed)",
+                     s, (unsigned long long)seg.size);
+        }
+        pthread_rwlock_unlock(&pack_lock);
+    }
+
+    return reclaimed;
+}
@@ -0,0 +1,50 @@
+#ifndef STORAGE_PACK_H
+#define STORAGE_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-structured packing of small blobs into large append-only segment
+// files (storage/packs/seg_NNNNNN.dat). An index maps each physical_path
+// to (segment, offset, length); it lives in memory and is persisted as an
+// append-only record log (storage/packs/index.log) replayed at startup.
+
+#define PACK_SMALL_BLOB_MAX (64 * 1024)          // Blobs up to 64KB are packed
+#define PACK_SEGMENT_MAX (256 * 1024 * 1024)     // Roll to a new segment at 256MB
+#define PACK_COMPACT_DEAD_RATIO 0.5              // Compact when half a segment is dead
+#define PACK_COMPACT_INTERVAL_SEC 60             // Background compaction period
+
+// Open (or create) the pack directory and replay its index
+int pack_init(const char* pack_dir);
+
+// Stop the compactor and close all segments
+void pack_shutdown(void);
+
+// Append a blob to the active segment
+int pack_write(const char* uuid, const uint8_t* data, size_t size);
+
+// Read a packed blob into a malloc'd buffer
+// Returns 0 on success, 1 if the UUID is not packed, -1 on error
+int pack_read(const char* uuid, uint8_t** data, size_t* size);
+
+// Map a packed blob read-only. `map_base`/`map_length` describe the
+// page-aligned mapping to munmap; `data` points at the blob inside it.
+// Returns 0 on success, 1 if the UUID is not packed, -1 on error
+int pack_map(const char* uuid, void** map_base, size_t* map_length,
+             const uint8_t** data, size_t* size);
+
+// Mark a packed blob dead. Returns 0 if deleted, 1 if not packed
+int pack_delete(const char* uuid);
+
+// Check whether a UUID is held in a segment
+int pack_contains(const char* uuid);
+
+// Collect the UUIDs of packed blobs starting with `prefix` into a malloc'd
+// array; blobs appended less than `min_age_sec` ago are skipped
+int pack_list_prefix(const char* prefix, int min_age_sec, char (**uuids)[64], int* count);
+
+// Rewrite live blobs out of sealed segments whose dead ratio is at least
+// `min_dead_ratio`, then drop those segments. Returns segments reclaimed.
+int pack_compact(double min_dead_ratio);
+
+#endif
@@ -144,6 +144,8 @@ void cleanup_session(ClientSession* session) {
         free(session->pending_upload_uuid);
         session->pending_upload_uuid = NULL;
     }
+    free(session->pending_delta_crcs);
+    session->pending_delta_crcs = NULL;
 
     // Remove from sessions array
     pthread_mutex_lock(&sessions_mutex);
@@ -193,6 +195,7 @@ void thread_pool_shutdown(void) {
             if (sessions[i]->pending_upload_uuid) {
                 free(sessions[i]->pending_upload_uuid);
             }
+            free(sessions[i]->pending_delta_crcs);
             free(sessions[i]);
             sessions[i] = NULL;
         }
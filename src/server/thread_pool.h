@@ -2,6 +2,7 @@
 #define THREAD_POOL_H
 
 #include <pthread.h>
+#include <stdint.h>
 #include <netinet/in.h>
 
 #define MAX_CLIENTS 100
@@ -23,6 +24,10 @@ typedef struct {
     int authenticated;
     char* pending_upload_uuid;
     long pending_upload_size;
+    int pending_delta_file_id;          // Target of a pending delta upload (0 if none)
+    long pending_delta_block_size;
+    uint32_t* pending_delta_crcs;       // Client's chunk CRCs of the new content
+    int pending_delta_crc_count;
 } ClientSession;
 
 // Initialize thread management
@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 #include "../src/database/db_manager.h"
 #include "../src/common/crypto.h"
 
@@ -198,6 +200,1094 @@ void test_file_operations(void) {
     printf(" PASSED\n");
 }
 
+void test_blob_checksums(void) {
+    printf("[TEST] test_blob_checksums...");
+
+    cleanup_test_db();
+
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int file_id = db_create_file(db, 0, "data.bin", "uuid-checksum", 1, 3000000, 0, 644);
+    assert(file_id > 0);
+
+    // Store and read back per-chunk CRCs
+    uint32_t crcs[3] = {0xE3069283, 0x00000001, 0xFFFFFFFF};
+    int result = db_set_blob_checksums(db, "uuid-checksum", 1048576, crcs, 3);
+    assert(result == 0);
+
+    int chunk_size = 0;
+    uint32_t* stored = NULL;
+    int count = 0;
+    result = db_get_blob_checksums(db, "uuid-checksum", &chunk_size, &stored, &count);
+    assert(result == 0);
+    assert(chunk_size == 1048576);
+    assert(count == 3);
+    assert(memcmp(stored, crcs, sizeof(crcs)) == 0);
+    free(stored);
+
+    // Unknown blobs have no checksums
+    result = db_get_blob_checksums(db, "uuid-unknown", &chunk_size, &stored, &count);
+    assert(result == 1);
+
+    // Freshly recorded blobs are not due for scrubbing yet
+    char (*paths)[64] = NULL;
+    result = db_list_scrub_candidates(db, 0, 10, &paths, &count);
+    assert(result == 0);
+    assert(count == 0);
+    free(paths);
+
+    // Deleting the file drops its checksums
+    result = db_delete_file(db, file_id);
+    assert(result == 0);
+    result = db_get_blob_checksums(db, "uuid-checksum", &chunk_size, &stored, &count);
+    assert(result == 1);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_blob_encoding(void) {
+    printf("[TEST] test_blob_encoding...");
+
+    cleanup_test_db();
+
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int file_id = db_create_file(db, 0, "notes.txt", "uuid-encoded", 1, 100000, 0, 644);
+    assert(file_id > 0);
+
+    // Blobs are raw until an encoding is recorded
+    char encoding[16];
+    long stored_size = 0;
+    int result = db_get_blob_encoding(db, "uuid-encoded", encoding, sizeof(encoding), &stored_size);
+    assert(result == 1);
+
+    result = db_set_blob_encoding(db, "uuid-encoded", "deflate", 12345);
+    assert(result == 0);
+    result = db_get_blob_encoding(db, "uuid-encoded", encoding, sizeof(encoding), &stored_size);
+    assert(result == 0);
+    assert(strcmp(encoding, "deflate") == 0);
+    assert(stored_size == 12345);
+
+    // A blob whose write failed is forgotten again
+    assert(db_set_blob_encoding(db, "uuid-unstored", "deflate", 10) == 0);
+    assert(db_clear_blob_encoding(db, "uuid-unstored") == 0);
+    assert(db_get_blob_encoding(db, "uuid-unstored", encoding, sizeof(encoding), &stored_size) == 1);
+
+    // Deleting the file drops its encoding
+    result = db_delete_file(db, file_id);
+    assert(result == 0);
+    result = db_get_blob_encoding(db, "uuid-encoded", encoding, sizeof(encoding), &stored_size);
+    assert(result == 1);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_user_quota(void) {
+    printf("[TEST] test_user_quota...");
+
+    cleanup_test_db();
+
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "quotauser", "hash");
+    assert(user_id > 0);
+
+    // Usage follows creates, copies and blob updates without rescanning files
+    int a = db_create_file(db, 0, "a.bin", "uuid-quota-a", user_id, 1000, 0, 644);
+    int dir = db_create_file(db, 0, "dir", NULL, user_id, 0, 1, 755);
+    assert(a > 0 && dir > 0);
+    int b = db_copy_file(db, a, dir, "b.bin", user_id);
+    assert(b > 0);
+    assert(db_update_file_blob(db, a, "uuid-quota-a2", 1500) == 0);
+
+    UserQuota quota;
+    assert(db_get_quota(db, user_id, &quota) == 0);
+    assert(quota.bytes_used == 2500);
+    assert(quota.files_used == 2);
+    assert(quota.max_bytes == 0 && quota.max_files == 0);
+
+    // Limits are enforced by the pre-check and by the database itself
+    assert(db_set_quota(db, user_id, 3000, 10) == 0);
+    assert(db_quota_allows(db, user_id, 500, 1) == 1);
+    assert(db_quota_allows(db, user_id, 501, 1) == 0);
+    assert(db_create_file(db, 0, "big.bin", "uuid-quota-big", user_id, 501, 0, 644) < 0);
+    assert(db_update_file_blob(db, a, "uuid-quota-a3", 2001) < 0);
+
+    // Deleting frees quota
+    assert(db_delete_file(db, b) == 0);
+    assert(db_get_quota(db, user_id, &quota) == 0);
+    assert(quota.bytes_used == 1500);
+    assert(quota.files_used == 1);
+    assert(quota.max_bytes == 3000 && quota.max_files == 10);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_list_subtree(void) {
+    printf("[TEST] test_list_subtree...");
+
+    cleanup_test_db();
+
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int owner = db_create_user(db, "treeowner", "hash");
+    int other = db_create_user(db, "treeother", "hash");
+    assert(owner > 0 && other > 0);
+
+    int top = db_create_file(db, 0, "top", NULL, owner, 0, 1, 0755);
+    int sub = db_create_file(db, top, "sub", NULL, owner, 0, 1, 0755);
+    int priv = db_create_file(db, top, "private", NULL, owner, 0, 1, 0700);
+    assert(top > 0 && sub > 0 && priv > 0);
+    assert(db_create_file(db, sub, "a.txt", "uuid-tree-a", owner, 10, 0, 0644) > 0);
+    assert(db_create_file(db, priv, "secret.txt", "uuid-tree-s", owner, 20, 0, 0600) > 0);
+
+    // The owner sees everything, with paths relative to the listed directory
+    TreeEntry* entries = NULL;
+    int count = 0;
+    assert(db_list_subtree(db, top, owner, &entries, &count) == 0);
+    assert(count == 4);
+    assert(strcmp(entries[0].path, "private") == 0);
+    assert(strcmp(entries[1].path, "private/secret.txt") == 0);
+    assert(strcmp(entries[2].path, "sub") == 0);
+    assert(strcmp(entries[3].path, "sub/a.txt") == 0 && entries[3].file.size == 10);
+    free(entries);
+
+    // Unreadable directories are pruned for everyone else
+    assert(db_list_subtree(db, top, other, &entries, &count) == 0);
+    assert(count == 2);
+    assert(strcmp(entries[0].path, "sub") == 0);
+    assert(strcmp(entries[1].path, "sub/a.txt") == 0);
+    free(entries);
+
+    // No depth limit: a chain of 100 directories is listed to the bottom
+    int parent = sub;
+    for (int i = 0; i < 100; i++) {
+        parent = db_create_file(db, parent, "d", NULL, owner, 0, 1, 0755);
+        assert(parent > 0);
+    }
+    assert(db_list_subtree(db, sub, other, &entries, &count) == 0);
+    assert(count == 101);
+    assert(entries[count - 1].file.id == parent);
+    assert(strlen(entries[count - 1].path) == 199);
+    free(entries);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_import_entries(void) {
+    printf("[TEST] test_import_entries...");
+
+    cleanup_test_db();
+
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "importuser", "hash");
+    assert(user_id > 0);
+
+    // A directory and its contents in one batch; children name it by index
+    ImportEntry batch[3];
+    memset(batch, 0, sizeof(batch));
+    strcpy(batch[0].name, "src");
+    batch[0].parent_index = -1;
+    batch[0].is_directory = 1;
+    batch[0].permissions = 0755;
+    strcpy(batch[1].name, "main.c");
+    strcpy(batch[1].physical_path, "uuid-import-1");
+    batch[1].parent_index = 0;
+    batch[1].size = 100;
+    batch[1].permissions = 0644;
+    batch[1].encoding = "deflate";
+    batch[1].stored_size = 40;
+    strcpy(batch[2].name, "util.c");
+    strcpy(batch[2].physical_path, "uuid-import-2");
+    batch[2].parent_index = 0;
+    batch[2].size = 50;
+    batch[2].permissions = 0644;
+
+    assert(db_import_entries(db, user_id, batch, 3) == 0);
+    assert(batch[0].id > 0 && batch[1].id > 0 && batch[2].id > 0);
+
+    FileEntry entry;
+    assert(db_get_file_by_id(db, batch[2].id, &entry) == 0);
+    assert(entry.parent_id == batch[0].id && entry.owner_id == user_id);
+
+    char encoding[16];
+    long stored = 0;
+    assert(db_get_blob_encoding(db, "uuid-import-1", encoding, sizeof(encoding), &stored) == 0);
+    assert(stored == 40);
+
+    uint32_t crcs[2] = { 0x11111111, 0x22222222 };
+    batch[1].crcs = crcs;
+    batch[1].crc_count = 2;
+    assert(db_import_checksums(db, batch, 3, 1024) == 0);
+    int chunk_size = 0, count = 0;
+    uint32_t* stored_crcs = NULL;
+    assert(db_get_blob_checksums(db, "uuid-import-1", &chunk_size, &stored_crcs, &count) == 0);
+    assert(chunk_size == 1024 && count == 2 && stored_crcs[1] == 0x22222222);
+    free(stored_crcs);
+
+    // A failing batch leaves nothing behind (duplicate physical path)
+    ImportEntry bad[2];
+    memset(bad, 0, sizeof(bad));
+    strcpy(bad[0].name, "fresh.c");
+    strcpy(bad[0].physical_path, "uuid-import-3");
+    bad[0].parent_index = -1;
+    bad[0].size = 1;
+    strcpy(bad[1].name, "dup.c");
+    strcpy(bad[1].physical_path, "uuid-import-1");
+    bad[1].parent_index = -1;
+    bad[1].size = 1;
+    assert(db_import_entries(db, user_id, bad, 2) < 0);
+    assert(bad[0].id == 0);
+
+    UserQuota quota;
+    assert(db_get_quota(db, user_id, &quota) == 0);
+    assert(quota.files_used == 2 && quota.bytes_used == 150);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+static void* pool_reader(void* arg) {
+    Database* db = arg;
+    for (int i = 0; i < 200; i++) {
+        assert(db_user_exists(db, "pooluser") == 1);
+        assert(db_is_admin(db, 1) == 1);
+    }
+    return NULL;
+}
+
+void test_reader_pool(void) {
+    printf("[TEST] test_reader_pool...");
+
+    cleanup_test_db();
+    db_set_reader_count(2);
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    assert(db->reader_count == 2);
+    db_init_schema(db, TEST_SCHEMA);
+
+    // Writes through the writer are visible to the read connections
+    int user_id = db_create_user(db, "pooluser", "hash");
+    assert(user_id > 0);
+
+    // More threads than connections: readers wait for a free one
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        assert(pthread_create(&threads[i], NULL, pool_reader, db) == 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(db->idle_count == 2);
+    db_close(db);
+
+    // Without read connections, queries go through the writer
+    db_set_reader_count(0);
+    db = db_init(TEST_DB);
+    assert(db != NULL && db->reader_count == 0);
+    assert(db_user_exists(db, "pooluser") == 1);
+    db_close(db);
+    db_set_reader_count(-1);
+
+    printf(" PASSED\n");
+}
+
+void test_statement_cache(void) {
+    printf("[TEST] test_statement_cache...");
+
+    cleanup_test_db();
+    db_set_reader_count(0);
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    // Repeated calls reuse the statement prepared by the first one
+    assert(db_user_exists(db, "admin") == 1);
+    int cached = db->writer_cache.count;
+    assert(cached > 0);
+    for (int i = 0; i < 100; i++) {
+        assert(db_user_exists(db, "admin") == 1);
+        assert(db_user_exists(db, "nobody") == 0);
+    }
+    assert(db->writer_cache.count == cached);
+
+    db_close(db);
+    db_set_reader_count(-1);
+
+    printf(" PASSED\n");
+}
+
+static int count_activity(Database* db, const char* action) {
+    db_flush_activity(db);
+    sqlite3_stmt* stmt;
+    assert(sqlite3_prepare_v2(db->conn, "SELECT COUNT(*) FROM activity_logs WHERE action_type = ?",
+                              -1, &stmt, NULL) == SQLITE_OK);
+    sqlite3_bind_text(stmt, 1, action, -1, SQLITE_STATIC);
+    assert(sqlite3_step(stmt) == SQLITE_ROW);
+    int count = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+static void* activity_producer(void* arg) {
+    Database* db = arg;
+    for (int i = 0; i < 500; i++) {
+        db_log_activity(db, 1, "ASYNC", "queued record");
+    }
+    return NULL;
+}
+
+void test_async_activity_log(void) {
+    printf("[TEST] test_async_activity_log...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+    assert(db_start_activity_writer(db, 50, 64, ACTIVITY_OVERFLOW_BLOCK) == 0);
+
+    // Records from several threads all arrive once flushed
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        assert(pthread_create(&threads[i], NULL, activity_producer, db) == 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(count_activity(db, "ASYNC") == 2000);
+
+    // Records still queued at close are written, not lost
+    assert(db_log_activity(db, 1, "LATE", "written on close") == 0);
+    db_close(db);
+
+    db = db_init(TEST_DB);
+    assert(db != NULL);
+    assert(count_activity(db, "LATE") == 1);
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_activity_partitions(void) {
+    printf("[TEST] test_activity_partitions...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+
+    // Rows of the old single table move into monthly partitions
+    assert(sqlite3_exec(db->conn,
+                        "CREATE TABLE activity_logs (id INTEGER PRIMARY KEY AUTOINCREMENT, user_id INTEGER NOT NULL, "
+                        "action_type TEXT NOT NULL, description TEXT, timestamp TEXT DEFAULT CURRENT_TIMESTAMP);"
+                        "INSERT INTO activity_logs (user_id, action_type, description, timestamp) VALUES "
+                        "(1, 'LOGIN', 'old', '2020-01-05 10:00:00'), (1, 'UPLOAD', 'a \"b\"', '2020-02-07 11:00:00');",
+                        NULL, NULL, NULL) == SQLITE_OK);
+    assert(db_init_schema(db, TEST_SCHEMA) == 0);
+    assert(count_activity(db, "LOGIN") == 1 && count_activity(db, "UPLOAD") == 1);
+
+    // New records land in their month's partition and keep unique IDs
+    ActivityRecord records[3] = {
+        {2, "DOWNLOAD", "jan", "2020-01-20 08:00:00"},
+        {1, "ADMIN_LIST_USERS", "feb", "2020-02-01 09:00:00"},
+        {1, "LOGIN", "new", ""},
+    };
+    time_t now = time(NULL);
+    strftime(records[2].timestamp, sizeof(records[2].timestamp), "%Y-%m-%d %H:%M:%S", gmtime(&now));
+    assert(db_insert_activity(db, records, 3) == 0);
+
+    sqlite3_stmt* stmt;
+    assert(sqlite3_prepare_v2(db->conn, "SELECT COUNT(*), COUNT(DISTINCT id) FROM activity_logs",
+                              -1, &stmt, NULL) == SQLITE_OK);
+    assert(sqlite3_step(stmt) == SQLITE_ROW);
+    assert(sqlite3_column_int(stmt, 0) == 5 && sqlite3_column_int(stmt, 1) == 5);
+    sqlite3_finalize(stmt);
+
+    char* json = NULL;
+    assert(db_list_activity_logs(db, 0, NULL, "2020-01-01", "2020-01-31", 10, &json) == 0);
+    assert(strstr(json, "\"jan\"") && strstr(json, "\"old\"") && !strstr(json, "feb"));
+    assert(strstr(json, "\"jan\"") < strstr(json, "\"old\""));
+    free(json);
+
+    // Action filter matches part of the name; user filter; escaped text
+    assert(db_list_activity_logs(db, 1, "LIST", NULL, NULL, 10, &json) == 0);
+    assert(strstr(json, "ADMIN_LIST_USERS") && !strstr(json, "LOGIN"));
+    free(json);
+    assert(db_list_activity_logs(db, 0, "UPLOAD", NULL, NULL, 10, &json) == 0);
+    assert(strstr(json, "\"a \\\"b\\\"\""));
+    free(json);
+
+    // The limit spans partitions, newest first
+    assert(db_list_activity_logs(db, 0, NULL, NULL, NULL, 2, &json) == 0);
+    assert(strstr(json, "\"new\"") && strstr(json, "UPLOAD") && !strstr(json, "\"feb\""));
+    free(json);
+
+    // Large results are not cut off
+    char description[200];
+    memset(description, 'x', sizeof(description) - 1);
+    description[sizeof(description) - 1] = '\0';
+    for (int i = 0; i < 500; i++) {
+        assert(db_log_activity(db, 1, "BULK", description) == 0);
+    }
+    assert(db_list_activity_logs(db, 0, "BULK", NULL, NULL, 1000, &json) == 0);
+    assert(strlen(json) > 100000 && json[strlen(json) - 1] == ']');
+    free(json);
+
+    // Retention drops whole months
+    db_set_activity_retention(2);
+    assert(db_prune_activity(db) == 2);
+    assert(count_activity(db, "DOWNLOAD") == 0 && count_activity(db, "LOGIN") == 1);
+    db_set_activity_retention(0);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_file_cache(void) {
+    printf("[TEST] test_file_cache...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL && db->file_cache != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "cacheuser", "hash");
+    int dir_id = db_create_file(db, 0, "cached", NULL, user_id, 0, 1, 0755);
+    int file_id = db_create_file(db, dir_id, "a.txt", "uuid-cache-1", user_id, 10, 0, 0644);
+    assert(dir_id > 0 && file_id > 0);
+
+    // First lookup fills the cache, the second is served from it
+    FileEntry entry;
+    assert(db_get_file_by_id(db, file_id, &entry) == 0);
+    assert(db_get_file_by_id(db, file_id, &entry) == 0);
+    assert(strcmp(entry.name, "a.txt") == 0 && entry.permissions == 0644);
+
+    // Every mutator is seen by the next lookup
+    assert(db_update_permissions(db, file_id, 0600) == 0);
+    assert(db_get_file_by_id(db, file_id, &entry) == 0 && entry.permissions == 0600);
+    assert(db_rename_file(db, file_id, "b.txt") == 0);
+    assert(db_get_file_by_id(db, file_id, &entry) == 0 && strcmp(entry.name, "b.txt") == 0);
+    assert(db_move_file(db, file_id, 0) == 0);
+    assert(db_get_file_by_id(db, file_id, &entry) == 0 && entry.parent_id == 0);
+    assert(db_update_file_blob(db, file_id, "uuid-cache-2", 20) == 0);
+    assert(db_get_file_by_id(db, file_id, &entry) == 0 && entry.size == 20);
+    assert(strcmp(entry.physical_path, "uuid-cache-2") == 0);
+    assert(db_delete_file(db, file_id) == 0);
+    assert(db_get_file_by_id(db, file_id, &entry) < 0);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+static int collect_row(void* ctx, const DirectoryRow* row) {
+    char* names = ctx;
+    strcat(names, row->name);
+    strcat(names, row->is_directory ? "/" : "");
+    strcat(names, ":");
+    strcat(names, row->owner);
+    strcat(names, ";");
+    return 0;
+}
+
+static int stop_after_one(void* ctx, const DirectoryRow* row) {
+    (void)row;
+    int* seen = ctx;
+    return ++(*seen) == 1 ? -1 : 0;
+}
+
+void test_scan_directory(void) {
+    printf("[TEST] test_scan_directory...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "scanuser", "hash");
+    int dir_id = db_create_file(db, 0, "scan", NULL, user_id, 0, 1, 0755);
+    db_create_file(db, dir_id, "b.txt", "uuid-scan-1", user_id, 1, 0, 0644);
+    db_create_file(db, dir_id, "a.txt", "uuid-scan-2", 1, 1, 0, 0644);
+    db_create_file(db, dir_id, "z", NULL, 999, 0, 1, 0755);
+
+    // Directories first, then by name; owners joined in (missing: "unknown")
+    char names[256] = "";
+    assert(db_scan_directory(db, dir_id, user_id, collect_row, names) == 0);
+    assert(strcmp(names, "z/:unknown;a.txt:admin;b.txt:scanuser;") == 0);
+
+    int seen = 0;
+    assert(db_scan_directory(db, dir_id, user_id, stop_after_one, &seen) < 0);
+    assert(seen == 1);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_file_paths(void) {
+    printf("[TEST] test_file_paths...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "pathuser", "hash");
+    int docs = db_create_file(db, 0, "docs", NULL, user_id, 0, 1, 0755);
+    int sub = db_create_file(db, docs, "sub", NULL, user_id, 0, 1, 0755);
+    int file_id = db_create_file(db, sub, "report.txt", "uuid-path-1", user_id, 1, 0, 0644);
+    int other = db_create_file(db, 0, "other", NULL, user_id, 0, 1, 0755);
+    assert(docs > 0 && sub > 0 && file_id > 0 && other > 0);
+
+    char path[1024];
+    assert(db_get_file_path(db, 0, path, sizeof(path)) == 0 && strcmp(path, "/") == 0);
+    assert(db_get_file_path(db, file_id, path, sizeof(path)) == 0);
+    assert(strcmp(path, "/docs/sub/report.txt") == 0);
+
+    // Renames and moves rewrite every descendant
+    assert(db_rename_file(db, docs, "papers") == 0);
+    assert(db_get_file_path(db, file_id, path, sizeof(path)) == 0);
+    assert(strcmp(path, "/papers/sub/report.txt") == 0);
+    assert(db_move_file(db, sub, other) == 0);
+    assert(db_get_file_path(db, file_id, path, sizeof(path)) == 0);
+    assert(strcmp(path, "/other/sub/report.txt") == 0);
+
+    // A directory cannot move into itself or below itself
+    assert(db_move_file(db, other, other) < 0);
+    assert(db_move_file(db, other, sub) < 0);
+
+    // Recursive search covers the subtree only
+    FileEntry* entries = NULL;
+    int count = 0;
+    assert(db_search_files(db, other, "report", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == file_id);
+    free(entries);
+    assert(db_search_files(db, docs, "report", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 0);
+    free(entries);
+
+    assert(db_delete_file(db, file_id) == 0);
+    assert(db_get_file_path(db, file_id, path, sizeof(path)) < 0);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_search_index(void) {
+    printf("[TEST] test_search_index...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "ftsuser", "hash");
+    int dir_id = db_create_file(db, 0, "music", NULL, user_id, 0, 1, 0755);
+    int file_id = db_create_file(db, dir_id, "Quarterly_Report.PDF", "uuid-fts-1", user_id, 1, 0, 0644);
+    db_create_file(db, 0, "report-draft.txt", "uuid-fts-2", user_id, 1, 0, 0644);
+    assert(dir_id > 0 && file_id > 0);
+
+    // Substring, case-insensitive, and limited to the base directory
+    FileEntry* entries = NULL;
+    int count = 0;
+    assert(db_search_files(db, 0, "REPORT", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 2);
+    free(entries);
+    assert(db_search_files(db, dir_id, "report", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == file_id);
+    free(entries);
+
+    // Wildcards and patterns too short for trigrams still match
+    assert(db_search_files(db, 0, "quart*pdf", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == file_id);
+    free(entries);
+    assert(db_search_files(db, 0, "pd", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 1);
+    free(entries);
+
+    // The index follows renames and deletes
+    assert(db_rename_file(db, file_id, "summary.pdf") == 0);
+    assert(db_search_files(db, 0, "quarterly", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 0);
+    free(entries);
+    assert(db_search_files(db, 0, "summ", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == file_id);
+    free(entries);
+    assert(db_delete_file(db, file_id) == 0);
+    assert(db_search_files(db, 0, "summ", 1, user_id, 10, &entries, &count) == 0);
+    assert(count == 0);
+    free(entries);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+static int remember_row(void* ctx, const DirectoryRow* row) {
+    ListCursor* last = ctx;
+    last->is_directory = row->is_directory;
+    last->id = row->id;
+    snprintf(last->name, sizeof(last->name), "%s", row->name);
+    return 0;
+}
+
+void test_paging(void) {
+    printf("[TEST] test_paging...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "pageuser", "hash");
+    int dir_id = db_create_file(db, 0, "paged", NULL, user_id, 0, 1, 0755);
+    db_create_file(db, dir_id, "c.txt", "uuid-page-1", user_id, 1, 0, 0644);
+    db_create_file(db, dir_id, "a.txt", "uuid-page-2", user_id, 1, 0, 0644);
+    db_create_file(db, dir_id, "sub", NULL, user_id, 0, 1, 0755);
+    db_create_file(db, dir_id, "b.txt", "uuid-page-3", user_id, 1, 0, 0644);
+
+    // Pages of two, each resuming after the previous page's last row
+    char full[256] = "", paged[256] = "";
+    assert(db_scan_directory(db, dir_id, user_id, collect_row, full) == 0);
+    ListCursor after;
+    int has_cursor = 0;
+    for (int page = 0; page < 3; page++) {
+        assert(db_scan_directory_page(db, dir_id, user_id, has_cursor ? &after : NULL, 2,
+                                      collect_row, paged) == 0);
+        assert(db_scan_directory_page(db, dir_id, user_id, has_cursor ? &after : NULL, 2,
+                                      remember_row, &after) == 0);
+        has_cursor = 1;
+    }
+    assert(strcmp(full, "sub/:pageuser;a.txt:pageuser;b.txt:pageuser;c.txt:pageuser;") == 0);
+    assert(strcmp(paged, full) == 0);
+
+    // Equal names are told apart by ID
+    int sub_id = db_create_file(db, 0, "other", NULL, user_id, 0, 1, 0755);
+    int first = db_create_file(db, dir_id, "same.log", "uuid-page-4", user_id, 1, 0, 0644);
+    int second = db_create_file(db, sub_id, "same.log", "uuid-page-5", user_id, 1, 0, 0644);
+    FileEntry* entries = NULL;
+    int count = 0;
+    assert(db_search_files_page(db, 0, "same", 1, user_id, NULL, 1, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == first);
+    after.is_directory = 0;
+    after.id = entries[0].id;
+    snprintf(after.name, sizeof(after.name), "%s", entries[0].name);
+    free(entries);
+    assert(db_search_files_page(db, 0, "same", 1, user_id, &after, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == second);
+    free(entries);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_permission_filtering(void) {
+    printf("[TEST] test_permission_filtering...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int owner = db_create_user(db, "permowner", "hash");
+    int guest = db_create_user(db, "permguest", "hash");
+    int open_dir = db_create_file(db, 0, "open", NULL, owner, 0, 1, 0755);
+    int closed_dir = db_create_file(db, open_dir, "closed", NULL, owner, 0, 1, 0700);
+    int shared = db_create_file(db, open_dir, "plan-shared.txt", "uuid-perm-1", owner, 1, 0, 0644);
+    int secret = db_create_file(db, open_dir, "plan-secret.txt", "uuid-perm-2", owner, 1, 0, 0600);
+    int hidden = db_create_file(db, closed_dir, "plan-hidden.txt", "uuid-perm-3", owner, 1, 0, 0644);
+    assert(closed_dir > 0 && shared > 0 && secret > 0 && hidden > 0);
+
+    // Listings leave out what the user may not read
+    char names[256] = "";
+    assert(db_scan_directory(db, open_dir, guest, collect_row, names) == 0);
+    assert(strcmp(names, "plan-shared.txt:permowner;") == 0);
+    names[0] = '\0';
+    assert(db_scan_directory(db, open_dir, owner, collect_row, names) == 0);
+    assert(strcmp(names, "closed/:permowner;plan-secret.txt:permowner;plan-shared.txt:permowner;") == 0);
+
+    // So do searches, including anything below an unreadable directory
+    FileEntry* entries = NULL;
+    int count = 0;
+    assert(db_search_files(db, 0, "plan", 1, guest, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == shared);
+    free(entries);
+    assert(db_search_files(db, 0, "pl", 1, guest, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == shared);
+    free(entries);
+    assert(db_search_files(db, open_dir, "plan", 0, guest, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].id == shared);
+    free(entries);
+    assert(db_search_files(db, 0, "plan", 1, owner, 10, &entries, &count) == 0);
+    assert(count == 3);
+    free(entries);
+
+    // Batched checks: every pair must pass, missing files are denied
+    int ids[3] = { 0, shared, open_dir };
+    int reads[3] = { 4, 4, 4 };
+    int writes[3] = { 2, 2, 2 };
+    int denied = -1;
+    assert(db_check_access(db, guest, ids, reads, 3, &denied) == 1);
+    assert(db_check_access(db, owner, ids, writes, 3, &denied) == 1);
+    assert(db_check_access(db, guest, ids, writes, 3, &denied) == 0 && denied == shared);
+    ids[1] = secret;
+    assert(db_check_access(db, guest, ids, reads, 3, &denied) == 0 && denied == secret);
+    ids[1] = 99999;
+    assert(db_check_access(db, owner, ids, reads, 3, &denied) == 0 && denied == 99999);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+static int sum_dir_totals(void* ctx, const DirectoryRow* row) {
+    long* sum = ctx;
+    if (row->is_directory) *sum += row->total_bytes;
+    return 0;
+}
+
+static void assert_totals(Database* db, int dir_id, long bytes, int files) {
+    long got_bytes = -1;
+    int got_files = -1;
+    assert(db_get_dir_totals(db, dir_id, &got_bytes, &got_files) == 0);
+    assert(got_bytes == bytes && got_files == files);
+}
+
+void test_dir_totals(void) {
+    printf("[TEST] test_dir_totals...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "sizeuser", "hash");
+    int top = db_create_file(db, 0, "top", NULL, user_id, 0, 1, 0755);
+    int mid = db_create_file(db, top, "mid", NULL, user_id, 0, 1, 0755);
+    int other = db_create_file(db, 0, "other", NULL, user_id, 0, 1, 0755);
+    int a = db_create_file(db, mid, "a.bin", "uuid-size-1", user_id, 100, 0, 0644);
+    db_create_file(db, top, "b.bin", "uuid-size-2", user_id, 20, 0, 0644);
+    assert(top > 0 && mid > 0 && other > 0 && a > 0);
+
+    // Uploads add to every ancestor, the root included
+    assert_totals(db, mid, 100, 1);
+    assert_totals(db, top, 120, 2);
+    assert_totals(db, 0, 120, 2);
+    assert_totals(db, other, 0, 0);
+
+    // Listings carry them for directories
+    long listed = 0;
+    assert(db_scan_directory(db, 0, user_id, sum_dir_totals, &listed) == 0);
+    assert(listed == 120);
+
+    // New contents and moves shift the difference
+    assert(db_update_file_blob(db, a, "uuid-size-3", 150) == 0);
+    assert_totals(db, top, 170, 2);
+    assert(db_move_file(db, mid, other) == 0);
+    assert_totals(db, top, 20, 1);
+    assert_totals(db, other, 150, 1);
+    assert_totals(db, 0, 170, 2);
+
+    // Copies add theirs, subtree deletes take the whole subtree off
+    BlobCopy* blobs = NULL;
+    int blob_count = 0;
+    int copy = db_copy_subtree(db, other, top, "other-copy", user_id, &blobs, &blob_count);
+    assert(copy > 0 && blob_count == 1);
+    free(blobs);
+    assert_totals(db, copy, 150, 1);
+    assert_totals(db, top, 170, 2);
+    assert_totals(db, 0, 320, 3);
+    assert(db_delete_subtree(db, top, user_id) == 5);
+    assert_totals(db, 0, 150, 1);
+    assert(db_get_dir_totals(db, copy, &(long){0}, &(int){0}) < 0);
+
+    // Databases from before the totals are filled in once
+    assert(sqlite3_exec(db->conn, "DROP TABLE dir_totals", NULL, NULL, NULL) == SQLITE_OK);
+    assert(db_init_schema(db, TEST_SCHEMA) == 0);
+    assert_totals(db, 0, 150, 1);
+    assert_totals(db, other, 150, 1);
+    assert_totals(db, mid, 150, 1);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+void test_subtree_operations(void) {
+    printf("[TEST] test_subtree_operations...");
+
+    cleanup_test_db();
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int user_id = db_create_user(db, "treeuser", "hash");
+    int other_id = db_create_user(db, "copier", "hash");
+    int top = db_create_file(db, 0, "proj", NULL, user_id, 0, 1, 0755);
+    int src = db_create_file(db, top, "src", NULL, user_id, 0, 1, 0755);
+    int file_id = db_create_file(db, src, "main.c", "uuid-tree-1", user_id, 10, 0, 0644);
+    db_create_file(db, top, "README", "uuid-tree-2", user_id, 5, 0, 0644);
+    int secret = db_create_file(db, src, "secret.key", "uuid-tree-3", user_id, 7, 0, 0600);
+    int dest = db_create_file(db, 0, "backup", NULL, other_id, 0, 1, 0755);
+    assert(top > 0 && src > 0 && file_id > 0 && secret > 0 && dest > 0);
+
+    // Copy: the whole tree the copier can read, new blob names, charged to the copier
+    BlobCopy* blobs = NULL;
+    int blob_count = 0;
+    int copy = db_copy_subtree(db, top, dest, "proj-copy", other_id, &blobs, &blob_count);
+    assert(copy > 0 && blob_count == 2);
+    assert(strcmp(blobs[0].source, blobs[0].copy) != 0 && strlen(blobs[0].copy) == 36);
+    free(blobs);
+
+    char path[1024];
+    FileEntry* entries = NULL;
+    int count = 0;
+    assert(db_search_files(db, copy, "main", 1, other_id, 10, &entries, &count) == 0);
+    assert(count == 1 && entries[0].owner_id == other_id && entries[0].size == 10);
+    assert(db_get_file_path(db, entries[0].id, path, sizeof(path)) == 0);
+    assert(strcmp(path, "/backup/proj-copy/src/main.c") == 0);
+    free(entries);
+
+    UserQuota quota;
+    assert(db_get_quota(db, other_id, &quota) == 0);
+    assert(quota.bytes_used == 15 && quota.files_used == 2);
+
+    // Unknown sources copy nothing
+    assert(db_copy_subtree(db, 99999, dest, "", other_id, &blobs, &blob_count) < 0);
+    assert(blobs == NULL && blob_count == 0);
+
+    // Delete: refused while a directory in the subtree is not writable by
+    // the caller, then the entry and every descendant, nothing else
+    int locked = db_create_file(db, src, "locked", NULL, other_id, 0, 1, 0755);
+    assert(locked > 0);
+    assert(db_delete_subtree(db, top, user_id) == 0);
+    assert(db_get_file_by_id(db, file_id, &(FileEntry){0}) == 0);
+    assert(db_delete_subtree(db, locked, -1) == 1);
+    assert(db_delete_subtree(db, top, user_id) == 5);
+    FileEntry entry;
+    assert(db_get_file_by_id(db, file_id, &entry) < 0);
+    assert(db_get_file_by_id(db, copy, &entry) == 0);
+    assert(db_get_quota(db, user_id, &quota) == 0 && quota.files_used == 0);
+    assert(db_delete_subtree(db, 0, user_id) < 0);
+
+    db_close(db);
+
+    printf(" PASSED\n");
+}
+
+typedef struct {
+    Database* db;
+    int parent_id;
+    int base;
+    int blob_base;
+    int ids[50];
+} GroupWriter;
+
+static void* group_writer(void* arg) {
+    GroupWriter* w = arg;
+    for (int i = 0; i < 50; i++) {
+        char name[32];
+        char blob[32];
+        snprintf(name, sizeof(name), "g%d-%d", w->base, i);
+        snprintf(blob, sizeof(blob), "uuid-group-%d-%d", w->blob_base, i);
+        w->ids[i] = db_create_file(w->db, w->parent_id, name, blob, 1, 1, 0, 0644);
+    }
+    return NULL;
+}
+
+void test_group_commit(void) {
+    printf("[TEST] test_group_commit...");
+
+    cleanup_test_db();
+    db_set_reader_count(2);
+    db_set_group_commit(5000, 16);
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL && db->group_commit != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int dir = db_create_file(db, 0, "grouped", NULL, 1, 0, 1, 0755);
+    assert(dir > 0);
+
+    // Concurrent writers share transactions; the last one reuses the first
+    // one's blob names, so exactly one of each pair fails and only that
+    // caller sees it
+    GroupWriter writers[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        writers[i].db = db;
+        writers[i].parent_id = dir;
+        writers[i].base = i;
+        writers[i].blob_base = (i == 3) ? 0 : i;
+        assert(pthread_create(&threads[i], NULL, group_writer, &writers[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int j = 0; j < 50; j++) {
+        assert((writers[0].ids[j] > 0) != (writers[3].ids[j] > 0));
+        for (int i = 0; i < 4; i++) {
+            FileEntry entry;
+            if (writers[i].ids[j] < 0) continue;
+            assert(db_get_file_by_id(db, writers[i].ids[j], &entry) == 0);
+            assert(entry.parent_id == dir);
+        }
+    }
+
+    FileEntry* entries = NULL;
+    int count = 0;
+    assert(db_list_directory(db, dir, &entries, &count) == 0);
+    assert(count == 150);
+    free(entries);
+
+    assert(db_create_file(db, dir, "after", "uuid-group-after", 1, 1, 0, 0644) > 0);
+
+    db_close(db);
+    db_set_group_commit(DB_GROUP_COMMIT_DEFAULT_US, DB_GROUP_COMMIT_DEFAULT_MAX);
+
+    printf(" PASSED\n");
+}
+
+static void wait_for_snapshot(Database* db) {
+    for (int i = 0; i < 2000 && !db_vfs_snapshot_current(db); i++) {
+        usleep(1000);
+    }
+    assert(db_vfs_snapshot_current(db));
+}
+
+typedef struct {
+    Database* db;
+    int dir_id;
+    int file_id;
+    int failures;
+} SnapshotReader;
+
+static void* snapshot_reader(void* arg) {
+    SnapshotReader* r = arg;
+    for (int i = 0; i < 2000; i++) {
+        FileEntry entry;
+        char names[256] = "";
+        if (db_get_file_by_id(r->db, r->file_id, &entry) < 0 || entry.parent_id != r->dir_id ||
+            db_scan_directory_page(r->db, r->dir_id, 1, NULL, 2, collect_row, names) < 0 || names[0] == '\0') {
+            r->failures++;
+        }
+    }
+    return NULL;
+}
+
+void test_vfs_snapshot(void) {
+    printf("[TEST] test_vfs_snapshot...");
+
+    cleanup_test_db();
+    db_set_vfs_snapshot(5);
+    Database* db = db_init(TEST_DB);
+    assert(db != NULL && db->vfs != NULL);
+    db_init_schema(db, TEST_SCHEMA);
+
+    int owner = db_create_user(db, "snapowner", "hash");
+    int guest = db_create_user(db, "snapguest", "hash");
+    int dir_id = db_create_file(db, 0, "snap", NULL, owner, 0, 1, 0755);
+    int sub = db_create_file(db, dir_id, "sub", NULL, owner, 0, 1, 0755);
+    int shared = db_create_file(db, dir_id, "b.txt", "uuid-snap-1", owner, 10, 0, 0644);
+    int secret = db_create_file(db, dir_id, "a.txt", "uuid-snap-2", owner, 20, 0, 0600);
+    int deep = db_create_file(db, sub, "c.txt", "uuid-snap-3", owner, 30, 0, 0644);
+    assert(sub > 0 && shared > 0 && secret > 0 && deep > 0);
+
+    // Once writes stop, lookups come from the snapshot and match SQLite
+    wait_for_snapshot(db);
+    FileEntry entry;
+    assert(db_get_file_by_id(db, deep, &entry) == 0);
+    assert(entry.parent_id == sub && entry.size == 30 && strcmp(entry.name, "c.txt") == 0);
+    assert(strcmp(entry.physical_path, "uuid-snap-3") == 0 && entry.created_at[0] != '\0');
+    assert(db_get_file_by_id(db, 99999, &entry) < 0);
+
+    char names[256] = "";
+    assert(db_scan_directory(db, dir_id, guest, collect_row, names) == 0);
+    assert(strcmp(names, "sub/:snapowner;b.txt:snapowner;") == 0);
+    names[0] = '\0';
+    assert(db_scan_directory(db, dir_id, owner, collect_row, names) == 0);
+    assert(strcmp(names, "sub/:snapowner;a.txt:snapowner;b.txt:snapowner;") == 0);
+
+    char paged[256] = "";
+    ListCursor after;
+    int has_cursor = 0;
+    for (int page = 0; page < 3; page++) {
+        assert(db_scan_directory_page(db, dir_id, owner, has_cursor ? &after : NULL, 1,
+                                      collect_row, paged) == 0);
+        assert(db_scan_directory_page(db, dir_id, owner, has_cursor ? &after : NULL, 1,
+                                      remember_row, &after) == 0);
+        has_cursor = 1;
+    }
+    assert(strcmp(paged, names) == 0);
+
+    char path[1024];
+    assert(db_get_file_path(db, deep, path, sizeof(path)) == 0 && strcmp(path, "/snap/sub/c.txt") == 0);
+    assert(db_get_file_path(db, 0, path, sizeof(path)) == 0 && strcmp(path, "/") == 0);
+    long bytes = 0;
+    int files = 0;
+    assert(db_get_dir_totals(db, dir_id, &bytes, &files) == 0 && bytes == 60 && files == 3);
+    int ids[2] = { shared, secret };
+    int reads[2] = { 4, 4 };
+    int denied = -1;
+    assert(db_check_access(db, owner, ids, reads, 2, &denied) == 1);
+    assert(db_check_access(db, guest, ids, reads, 2, &denied) == 0 && denied == secret);
+
+    // A committed change is visible at once, before the next rebuild
+    assert(db_rename_file(db, shared, "renamed.txt") == 0);
+    assert(!db_vfs_snapshot_current(db));
+    assert(db_get_file_by_id(db, shared, &entry) == 0 && strcmp(entry.name, "renamed.txt") == 0);
+    wait_for_snapshot(db);
+    assert(db_get_file_by_id(db, shared, &entry) == 0 && strcmp(entry.name, "renamed.txt") == 0);
+    assert(db_get_file_path(db, shared, path, sizeof(path)) == 0 && strcmp(path, "/snap/renamed.txt") == 0);
+
+    // Readers keep going while renames replace the snapshot under them
+    SnapshotReader readers[2];
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) {
+        readers[i].db = db;
+        readers[i].dir_id = dir_id;
+        readers[i].file_id = shared;
+        readers[i].failures = 0;
+        assert(pthread_create(&threads[i], NULL, snapshot_reader, &readers[i]) == 0);
+    }
+    for (int i = 0; i < 20; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "renamed-%d.txt", i);
+        assert(db_rename_file(db, shared, name) == 0);
+        usleep(10000);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+        assert(readers[i].failures == 0);
+    }
+
+    db_close(db);
+    db_set_vfs_snapshot(0);
+
+    printf(" PASSED\n");
+}
+
 int main(void) {
     printf("========================================\n");
     printf("Running Phase 3 Database Tests\n");
@@ -208,6 +1298,25 @@ int main(void) {
     test_user_operations();
     test_activity_logging();
     test_file_operations();
+    test_blob_checksums();
+    test_blob_encoding();
+    test_user_quota();
+    test_list_subtree();
+    test_import_entries();
+    test_reader_pool();
+    test_statement_cache();
+    test_async_activity_log();
+    test_activity_partitions();
+    test_file_cache();
+    test_scan_directory();
+    test_file_paths();
+    test_search_index();
+    test_paging();
+    test_permission_filtering();
+    test_dir_totals();
+    test_subtree_operations();
+    test_group_commit();
+    test_vfs_snapshot();
 
     cleanup_test_db();
 
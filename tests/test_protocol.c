@@ -2,7 +2,13 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include "../src/common/protocol.h"
+#include "../src/common/crc32c.h"
+#include "../src/common/delta.h"
+#include "../src/common/tar.h"
+#include "../src/common/json_buf.h"
 
 void test_packet_create_and_free(void) {
     printf("Testing packet_create and packet_free...\n");
@@ -88,6 +94,232 @@ void test_buffer_too_small(void) {
     printf("PASSED\n");
 }
 
+void test_send_data_roundtrip(void) {
+    printf("Testing packet_send_data over socketpair...\n");
+
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    const char* data = "blob contents sent without a copy";
+    int result = packet_send_data(fds[0], CMD_SUCCESS, data, strlen(data));
+    assert(result == 0);
+
+    Packet received = {0};
+    result = packet_recv(fds[1], &received);
+    assert(result == 0);
+    assert(received.command == CMD_SUCCESS);
+    assert(received.data_length == strlen(data));
+    assert(memcmp(received.payload, data, strlen(data)) == 0);
+
+    free(received.payload);
+    close(fds[0]);
+    close(fds[1]);
+    printf("PASSED\n");
+}
+
+void test_crc32c(void) {
+    printf("Testing crc32c...\n");
+
+    // Standard check value for CRC-32C
+    assert(crc32c(0, "123456789", 9) == 0xE3069283);
+    assert(crc32c(0, "", 0) == 0);
+
+    // Incremental and one-shot results agree, at any alignment
+    uint8_t buf[4099];
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (uint8_t)(i * 31 + 7);
+    uint32_t whole = crc32c(0, buf + 3, sizeof(buf) - 3);
+    uint32_t split = crc32c(crc32c(0, buf + 3, 1000), buf + 1003, sizeof(buf) - 1003);
+    assert(whole == split);
+
+    // Chunked checksums cover the tail
+    uint32_t* crcs = NULL;
+    int count = 0;
+    assert(crc32c_chunks(buf, sizeof(buf), 1024, &crcs, &count) == 0);
+    assert(count == 5);
+    assert(crcs[4] == crc32c(0, buf + 4096, 3));
+    free(crcs);
+
+    printf("PASSED\n");
+}
+
+void test_delta_roundtrip(void) {
+    printf("Testing delta encode/apply...\n");
+
+    size_t old_size = 100000;
+    uint8_t* old_data = malloc(old_size);
+    for (size_t i = 0; i < old_size; i++) old_data[i] = (uint8_t)((i * 2654435761u) >> 13);
+
+    // New version: an insertion near the start, an edit in the middle
+    size_t new_size = old_size + 5;
+    uint8_t* new_data = malloc(new_size);
+    memcpy(new_data, old_data, 1000);
+    memcpy(new_data + 1000, "HELLO", 5);
+    memcpy(new_data + 1005, old_data + 1000, old_size - 1000);
+    new_data[60000] ^= 0xFF;
+
+    size_t block_size = delta_block_size(old_size);
+    DeltaSig* sigs = NULL;
+    int count = 0;
+    assert(delta_signatures(old_data, old_size, block_size, &sigs, &count) == 0);
+
+    // Signatures survive the wire format
+    uint8_t* wire = NULL;
+    size_t wire_len = 0;
+    assert(delta_sigs_encode(sigs, count, &wire, &wire_len) == 0);
+    DeltaSig* decoded = NULL;
+    int decoded_count = 0;
+    assert(delta_sigs_decode(wire, wire_len, &decoded, &decoded_count) == 0);
+    assert(decoded_count == count);
+    assert(memcmp(decoded, sigs, count * sizeof(DeltaSig)) == 0);
+
+    uint8_t* delta = NULL;
+    size_t delta_len = 0;
+    assert(delta_encode(new_data, new_size, block_size, decoded, decoded_count, old_size,
+                        &delta, &delta_len) == 0);
+    assert(delta_len < new_size / 4);  // Mostly copy instructions
+
+    uint8_t* rebuilt = malloc(new_size);
+    assert(delta_apply(old_data, old_size, block_size, delta, delta_len, rebuilt, new_size) == 0);
+    assert(memcmp(rebuilt, new_data, new_size) == 0);
+
+    // Truncated deltas are rejected
+    assert(delta_apply(old_data, old_size, block_size, delta, delta_len - 1, rebuilt, new_size) == -1);
+
+    free(old_data);
+    free(new_data);
+    free(sigs);
+    free(wire);
+    free(decoded);
+    free(delta);
+    free(rebuilt);
+    printf("PASSED\n");
+}
+
+// Collects what the tar reader reports
+typedef struct {
+    char paths[4][TAR_PATH_MAX];
+    char types[4];
+    uint64_t sizes[4];
+    int entries;
+    uint8_t data[2048];
+    size_t data_len;
+} TarCollect;
+
+static int collect_entry(void* ctx, const TarEntry* entry) {
+    TarCollect* c = ctx;
+    assert(c->entries < 4);
+    strcpy(c->paths[c->entries], entry->path);
+    c->types[c->entries] = entry->type;
+    c->sizes[c->entries] = entry->size;
+    c->entries++;
+    return 0;
+}
+
+static int collect_data(void* ctx, const uint8_t* data, size_t len) {
+    TarCollect* c = ctx;
+    assert(c->data_len + len <= sizeof(c->data));
+    memcpy(c->data + c->data_len, data, len);
+    c->data_len += len;
+    return 0;
+}
+
+void test_tar_roundtrip(void) {
+    printf("Testing tar write/read...\n");
+
+    char long_path[300];
+    memset(long_path, 'd', 150);
+    strcpy(long_path + 150, "/long-name.txt");
+
+    static uint8_t archive[16384];
+    size_t len = 0;
+    const char* body = "hello tar";
+    len += tar_header(archive + len, "docs", TAR_TYPE_DIR, 0, 0755, 1700000000);
+    len += tar_header(archive + len, "docs/a.txt", TAR_TYPE_FILE, strlen(body), 0644, 1700000000);
+    memcpy(archive + len, body, strlen(body));
+    len += strlen(body) + tar_padding(strlen(body));
+    len += tar_header(archive + len, long_path, TAR_TYPE_FILE, 0, 0644, 1700000000);
+    memset(archive + len, 0, 2 * TAR_BLOCK);
+    len += 2 * TAR_BLOCK;
+    assert(len % TAR_BLOCK == 0);
+
+    // Feed in awkward chunk sizes to exercise the streaming state machine
+    TarCollect c;
+    memset(&c, 0, sizeof(c));
+    TarReader reader;
+    tar_reader_init(&reader, collect_entry, collect_data, &c);
+    int rc = 0;
+    for (size_t off = 0; off < len && rc == 0; off += 7) {
+        rc = tar_reader_feed(&reader, archive + off, len - off < 7 ? len - off : 7);
+    }
+    assert(rc == 1);
+    assert(c.entries == 3);
+    assert(strcmp(c.paths[0], "docs") == 0 && c.types[0] == TAR_TYPE_DIR);
+    assert(strcmp(c.paths[1], "docs/a.txt") == 0 && c.sizes[1] == strlen(body));
+    assert(strcmp(c.paths[2], long_path) == 0 && c.sizes[2] == 0);
+    assert(c.data_len == strlen(body) && memcmp(c.data, body, c.data_len) == 0);
+
+    // pax headers supply long paths too
+    uint8_t pax[3 * TAR_BLOCK];
+    char record[64];
+    int record_len = snprintf(record, sizeof(record), "28 path=pax/a-long-name.txt\n");
+    assert(record_len == 28);
+    tar_header(pax, "PaxHeader", TAR_TYPE_PAX, (uint64_t)record_len, 0644, 0);
+    memcpy(pax + TAR_BLOCK, record, (size_t)record_len);
+    memset(pax + TAR_BLOCK + record_len, 0, tar_padding((uint64_t)record_len));
+    tar_header(pax + 2 * TAR_BLOCK, "pax/truncated", TAR_TYPE_DIR, 0, 0755, 0);
+    memset(&c, 0, sizeof(c));
+    tar_reader_init(&reader, collect_entry, collect_data, &c);
+    assert(tar_reader_feed(&reader, pax, sizeof(pax)) == 0);
+    assert(c.entries == 1 && strcmp(c.paths[0], "pax/a-long-name.txt") == 0);
+
+    // Corrupted headers fail their checksum
+    archive[0] ^= 1;
+    tar_reader_init(&reader, collect_entry, collect_data, &c);
+    assert(tar_reader_feed(&reader, archive, len) == -1);
+
+    assert(tar_path_safe("docs/a.txt"));
+    assert(!tar_path_safe("../etc/passwd"));
+    assert(!tar_path_safe("/etc/passwd"));
+    assert(!tar_path_safe("docs/../../x"));
+    assert(!tar_path_safe("docs//a"));
+
+    printf("PASSED\n");
+}
+
+void test_json_buf(void) {
+    printf("Testing JSON buffer...\n");
+
+    JsonBuf buf;
+    json_buf_init(&buf);
+    json_buf_append(&buf, "{\"name\":");
+    json_buf_string(&buf, "a\"b\\c\td\x01\xc3\xbc");
+    json_buf_append(&buf, ",\"n\":");
+    json_buf_number(&buf, 3000000000LL);
+    json_buf_append(&buf, ",\"d\":");
+    json_buf_bool(&buf, 1);
+    json_buf_append(&buf, ",\"x\":");
+    json_buf_string(&buf, NULL);
+    json_buf_append(&buf, "}");
+
+    assert(!buf.failed);
+    assert(strcmp(buf.data, "{\"name\":\"a\\\"b\\\\c\\td\\u0001\xc3\xbc\",\"n\":3000000000,\"d\":true,\"x\":null}") == 0);
+    assert(buf.len == strlen(buf.data));
+
+    // Grows past the initial allocation
+    for (int i = 0; i < 10000; i++) {
+        json_buf_string(&buf, "0123456789");
+    }
+    assert(!buf.failed && buf.len == strlen(buf.data));
+
+    // Reuse for the next message
+    json_buf_reset(&buf);
+    json_buf_append(&buf, "[]");
+    assert(buf.len == 2 && strcmp(buf.data, "[]") == 0);
+
+    json_buf_free(&buf);
+    printf("PASSED\n");
+}
+
 int main(void) {
     printf("=== Protocol Unit Tests ===\n\n");
 
@@ -96,6 +328,11 @@ int main(void) {
     test_invalid_magic();
     test_empty_payload();
     test_buffer_too_small();
+    test_send_data_roundtrip();
+    test_crc32c();
+    test_delta_roundtrip();
+    test_tar_roundtrip();
+    test_json_buf();
 
     printf("\n=== All tests passed! ===\n");
     return 0;